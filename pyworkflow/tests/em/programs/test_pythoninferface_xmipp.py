@@ -7,7 +7,9 @@ import os
 from os.path import join, exists
 import sys
 import unittest
-from tempfile import NamedTemporaryFile
+import threading
+import shutil
+from tempfile import NamedTemporaryFile, mkdtemp
 from time import time
 
 from xmipp import *
@@ -38,6 +40,26 @@ def binaryFileComparison(nameo, namet):
     return True
 
 
+def runInThreads(nThreads, func, items):
+    """ Call func(item) for all items from nThreads threads and return
+    the errors raised in them (an error in a thread does not fail the test
+    by itself). """
+    errors = []
+    def worker(chunk):
+        try:
+            for item in chunk:
+                func(item)
+        except Exception, e:
+            errors.append(e)
+    threads = [threading.Thread(target=worker, args=(items[i::nThreads],))
+               for i in range(nThreads)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    return errors
+
+
 class TestXmippPythonInterface(unittest.TestCase):
     testsPath = getXmippPath("resources", "test")
     # Temporary filenames used
@@ -400,6 +422,59 @@ class TestXmippPythonInterface(unittest.TestCase):
         #vol.write('/tmp/vol2.vol')
         proj.write('/tmp/kk.spi')
 
+    def test_Image_readWriteThreads(self):
+        """ Image.read and write release the GIL, images written and read
+        back from several threads must keep their data. """
+        from numpy import random, float32, array_equal
+        tmpDir = mkdtemp()
+        try:
+            n = 24
+            data = [random.rand(32, 40).astype(float32) for i in range(n)]
+            files = [join(tmpDir, "img%03d.%s" % (i, ["mrc", "spi", "stk"][i % 3]))
+                     for i in range(n)]
+
+            def write(i):
+                img = Image()
+                img.setData(data[i])
+                img.write(files[i])
+            self.assertEqual([], runInThreads(4, write, range(n)))
+
+            readData = [None] * n
+            def read(i):
+                img = Image()
+                img.read(files[i])
+                readData[i] = img.getData()
+            for nThreads in [1, 4]:
+                self.assertEqual([], runInThreads(nThreads, read, range(n)))
+                for i in range(n):
+                    self.assertTrue(array_equal(data[i], readData[i]),
+                                    "Wrong data in %s with %d threads" % (files[i], nThreads))
+        finally:
+            shutil.rmtree(tmpDir)
+
+    def test_FourierProjector_projectVolumeThreads(self):
+        """ Projections of a shared FourierProjector from several threads
+        must be the same as the sequential ones. """
+        from numpy import random, allclose
+        vol = Image()
+        vol.setData(random.rand(32, 32, 32))
+        projector = FourierProjector(vol, 2.0, 0.5, BSPLINE3)
+        angles = [(i * 37.0 % 360, i * 13.0 % 180, i * 71.0 % 360) for i in range(16)]
+
+        def project(i):
+            proj = Image()
+            projector.projectVolume(proj, angles[i][0], angles[i][1], angles[i][2])
+            return proj.getData()
+        expected = [project(i) for i in range(len(angles))]
+
+        projections = [None] * len(angles)
+        def store(i):
+            projections[i] = project(i)
+        self.assertEqual([], runInThreads(4, store, range(len(angles))))
+        for i in range(len(angles)):
+            self.assertTrue(allclose(expected[i], projections[i], rtol=0, atol=1e-12),
+                            "Projection %d differs with threads" % i)
+
     def test_Image_read(self):
         imgPath = testFile("tinyImage.spi")
         img = Image(imgPath)
@@ -0,0 +1,120 @@
+/***************************************************************************
+ *
+ * Authors:     Carlos Oscar S. Sorzano (coss@cnb.csic.es)
+ *
+ * Unidad de  Bioinformatica of Centro Nacional de Biotecnologia , CSIC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ *  All comments concerning this program package may be sent to the
+ *  e-mail address 'xmipp@cnb.csic.es'
+ ***************************************************************************/
+
+#include <data/xmipp_program.h>
+#include <reconstruction/reconstruct_fourier.h>
+
+class ProgBenchmarkFourierGridding: public XmippProgram
+{
+protected:
+    int size, Nsamples;
+    struct blobtype blob;
+
+    void defineParams()
+    {
+        addUsageLine("Time the gridding kernel of reconstruct_fourier in samples per second.");
+        addUsageLine("+The samples are placed along the rows of a central slice, as the coefficients of");
+        addUsageLine("+a projection, and added to a padded Fourier volume with FourierGriddingKernel.");
+        addUsageLine("+The insertion of the samples (addSample) and of their weights in the weight");
+        addUsageLine("+correction (addWeight) are timed separately.");
+        addKeywords("benchmark, reconstruction, Fourier");
+        addSeeAlsoLine("reconstruct_fourier");
+        addParamsLine(" [--size <n=256>]          : Size of the padded Fourier volume");
+        addParamsLine(" [--samples <N=1000000>]   : Number of samples");
+        addParamsLine(" [--blob <radius=1.9> <alpha=15>] : Blob parameters, as in reconstruct_fourier");
+        addExampleLine("Time the kernel in a 512^3 volume:", false);
+        addExampleLine("xmipp_benchmark_fourier_gridding --size 512");
+    }
+
+    void readParams()
+    {
+        size = getIntParam("--size");
+        Nsamples = getIntParam("--samples");
+        blob.radius = getDoubleParam("--blob", 0);
+        blob.alpha = getDoubleParam("--blob", 1);
+        blob.order = 0;
+    }
+
+    void show()
+    {
+        if (verbose == 0)
+            return;
+        std::cout << "Volume size:  " << size << std::endl
+        << "Samples:      " << Nsamples << std::endl
+        << "Blob radius:  " << blob.radius << std::endl
+        << "Blob alpha:   " << blob.alpha << std::endl;
+    }
+
+    void run()
+    {
+        show();
+
+        // Blob table sampled in squared distances as in ProgRecFourier
+        Matrix1D<double> blobTableSqrt(BLOB_TABLE_SIZE_SQRT);
+        double deltaSqrt = (blob.radius*blob.radius)/(BLOB_TABLE_SIZE_SQRT-1);
+        FOR_ALL_ELEMENTS_IN_MATRIX1D(blobTableSqrt)
+        VEC_ELEM(blobTableSqrt,i) = blob_val(sqrt(deltaSqrt*i), blob);
+
+        FourierGriddingKernel kernel;
+        kernel.initialize(blobTableSqrt, 1/deltaSqrt, blob.radius, size, size, size);
+        MultidimArray< std::complex<double> > V;
+        MultidimArray<double> W;
+        V.initZeros(size, size, size/2+1);
+        W.initZeros(V);
+
+        // Consecutive samples are neighbours in the rows of a tilted slice
+        std::vector<double> positions(3*Nsamples);
+        Matrix2D<double> A;
+        Euler_angles2matrix(30, 45, 60, A);
+        int half = size/2;
+        for (int n = 0; n < Nsamples; ++n)
+        {
+            double x = (n % size) - half, y = (n / size) % size - half;
+            for (int d = 0; d < 3; ++d)
+            {
+                double p = MAT_ELEM(A,d,0)*x+MAT_ELEM(A,d,1)*y;
+                positions[3*n+d] = (p < 0) ? p + size : p;
+            }
+        }
+
+        Timer timer;
+        size_t t0 = timer.now();
+        for (int n = 0; n < Nsamples; ++n)
+            kernel.addSample(V, W, positions[3*n], positions[3*n+1], positions[3*n+2], 1, 1, 1);
+        size_t t1 = timer.now();
+        for (int n = 0; n < Nsamples; ++n)
+            kernel.addWeight(W, &V, positions[3*n], positions[3*n+1], positions[3*n+2], 1);
+        size_t t2 = timer.now();
+        std::cout << "addSample: " << Nsamples/(1e3*XMIPP_MAX(t1-t0,1)) << " Msamples/s" << std::endl
+        << "addWeight: " << Nsamples/(1e3*XMIPP_MAX(t2-t1,1)) << " Msamples/s" << std::endl;
+    }
+};
+
+int main(int argc, char **argv)
+{
+    ProgBenchmarkFourierGridding program;
+    program.read(argc, argv);
+    return program.tryRun();
+}
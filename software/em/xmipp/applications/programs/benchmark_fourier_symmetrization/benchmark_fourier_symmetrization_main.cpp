@@ -0,0 +1,175 @@
+/***************************************************************************
+ *
+ * Authors:     Carlos Oscar S. Sorzano (coss@cnb.csic.es)
+ *
+ * Unidad de  Bioinformatica of Centro Nacional de Biotecnologia , CSIC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ *  All comments concerning this program package may be sent to the
+ *  e-mail address 'xmipp@cnb.csic.es'
+ ***************************************************************************/
+
+#include <data/xmipp_program.h>
+#include <data/projection.h>
+#include <reconstruction/reconstruct_fourier.h>
+
+class ProgBenchmarkFourierSymmetrization: public XmippProgram
+{
+protected:
+    int size, Nimages, Nthreads;
+    StringVector symmetries;
+    FileName fnRoot, fnStack, fnMd;
+
+    void defineParams()
+    {
+        addUsageLine("Time reconstruct_fourier with the symmetry applied to every image and to the accumulated volume.");
+        addUsageLine("+Projections of a random phantom in random directions are reconstructed with each");
+        addUsageLine("+symmetry twice: inserting every symmetric copy of the images, and inserting the");
+        addUsageLine("+images once and symmetrizing the accumulated volume (--symmetrize_volume). The");
+        addUsageLine("+time of each mode and the largest difference between both volumes, relative to");
+        addUsageLine("+their maximum, are shown.");
+        addKeywords("benchmark, reconstruction, symmetry");
+        addSeeAlsoLine("reconstruct_fourier");
+        addParamsLine(" [--size <n=64>]      : Size of the images");
+        addParamsLine(" [--images <N=100>]   : Number of images");
+        addParamsLine(" [--sym <...>]        : Symmetries, by default c4 d7 o i1");
+        addParamsLine(" [--thr <N=1>]        : Number of threads of the reconstruction");
+        addExampleLine("Time the icosahedral symmetry with 4 threads:", false);
+        addExampleLine("xmipp_benchmark_fourier_symmetrization --sym i1 --thr 4");
+    }
+
+    void readParams()
+    {
+        size = getIntParam("--size");
+        Nimages = getIntParam("--images");
+        Nthreads = getIntParam("--thr");
+        symmetries.clear();
+        if (checkParam("--sym"))
+            getListParam("--sym", symmetries);
+        else
+        {
+            symmetries.push_back("c4");
+            symmetries.push_back("d7");
+            symmetries.push_back("o");
+            symmetries.push_back("i1");
+        }
+    }
+
+    void show()
+    {
+        if (verbose == 0)
+            return;
+        std::cout << "Image size:  " << size << std::endl
+        << "Images:      " << Nimages << std::endl
+        << "Threads:     " << Nthreads << std::endl;
+    }
+
+    // Projections of a random phantom
+    void produceSideInfo()
+    {
+        fnRoot.initUniqueName("/tmp/benchmark_fourier_symmetrization_XXXXXX");
+        fnStack = fnRoot + ".stk";
+        fnMd = fnRoot + ".xmd";
+        MultidimArray<double> V;
+        V.initZeros(size, size, size);
+        V.setXmippOrigin();
+        double r2 = size*size/9.0;
+        FOR_ALL_ELEMENTS_IN_ARRAY3D(V)
+        if (k*k+i*i+j*j < r2)
+            A3D_ELEM(V,k,i,j) = rnd_unif(0, 1);
+        MetaData md;
+        Projection P;
+        for (int n = 0; n < Nimages; ++n)
+        {
+            double rot = rnd_unif(0, 360), tilt = rnd_unif(0, 180), psi = rnd_unif(0, 360);
+            projectVolume(V, P, size, size, rot, tilt, psi);
+            FileName fnImg;
+            fnImg.compose(n+1, fnStack);
+            P.write(fnImg, ALL_IMAGES, true, WRITE_REPLACE);
+            size_t id = md.addObject();
+            md.setValue(MDL_IMAGE, fnImg, id);
+            md.setValue(MDL_ANGLE_ROT, rot, id);
+            md.setValue(MDL_ANGLE_TILT, tilt, id);
+            md.setValue(MDL_ANGLE_PSI, psi, id);
+        }
+        md.write(fnMd);
+    }
+
+    // Reconstruct and return the time in seconds
+    double reconstruct(const String &symmetry, const FileName &fnVol, bool symmetrizeVolume)
+    {
+        String thr = integerToString(Nthreads);
+        std::vector<const char *> argv;
+        argv.push_back("xmipp_reconstruct_fourier");
+        argv.push_back("-i");
+        argv.push_back(fnMd.c_str());
+        argv.push_back("-o");
+        argv.push_back(fnVol.c_str());
+        argv.push_back("--sym");
+        argv.push_back(symmetry.c_str());
+        argv.push_back("--thr");
+        argv.push_back(thr.c_str());
+        argv.push_back("-v");
+        argv.push_back("0");
+        if (symmetrizeVolume)
+            argv.push_back("--symmetrize_volume");
+        ProgRecFourier prog;
+        prog.read((int)argv.size(), &argv[0]);
+        Timer timer;
+        size_t t0 = timer.now();
+        prog.run();
+        return (timer.now() - t0) / 1000.0;
+    }
+
+    void run()
+    {
+        show();
+        produceSideInfo();
+        FileName fnVol = fnRoot + ".vol", fnVolSym = fnRoot + "_sym.vol";
+        std::cout << formatString("%-8s %8s %14s %18s %8s %12s", "Symmetry", "Copies", "Per image (s)",
+                                  "Accumulated (s)", "Speedup", "Difference") << std::endl;
+        for (size_t s = 0; s < symmetries.size(); ++s)
+        {
+            SymList SL;
+            SL.readSymmetryFile(symmetries[s]);
+            double tImages = reconstruct(symmetries[s], fnVol, false);
+            double tVolume = reconstruct(symmetries[s], fnVolSym, true);
+
+            Image<double> Vrec, VrecSym;
+            Vrec.read(fnVol);
+            VrecSym.read(fnVolSym);
+            double maxV = Vrec().computeMax(), maxDiff = 0;
+            FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Vrec())
+            maxDiff = XMIPP_MAX(maxDiff, fabs(DIRECT_MULTIDIM_ELEM(Vrec(),n) - DIRECT_MULTIDIM_ELEM(VrecSym(),n)));
+            std::cout << formatString("%-8s %8d %14.2f %18.2f %8.2f %11.2f%%", symmetries[s].c_str(),
+                                      SL.symsNo()+1, tImages, tVolume, (tVolume > 0) ? tImages/tVolume : 0.0,
+                                      (maxV > 0) ? 100*maxDiff/maxV : 0.0) << std::endl;
+        }
+        fnVol.deleteFile();
+        fnVolSym.deleteFile();
+        fnStack.deleteFile();
+        fnMd.deleteFile();
+        fnRoot.deleteFile();
+    }
+};
+
+int main(int argc, char **argv)
+{
+    ProgBenchmarkFourierSymmetrization program;
+    program.read(argc, argv);
+    return program.tryRun();
+}
@@ -0,0 +1,136 @@
+/***************************************************************************
+ *
+ * Authors:     Carlos Oscar S. Sorzano (coss@cnb.csic.es)
+ *
+ * Unidad de  Bioinformatica of Centro Nacional de Biotecnologia , CSIC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ *  All comments concerning this program package may be sent to the
+ *  e-mail address 'xmipp@cnb.csic.es'
+ ***************************************************************************/
+
+#include <data/xmipp_program.h>
+#include <data/matrix2d.h>
+
+class ProgBenchmarkMatrix: public XmippProgram
+{
+protected:
+    int N0, NF, step, Nthreads, Neigs, NmaxDense;
+
+    void defineParams()
+    {
+        addUsageLine("Time the dense linear algebra of Matrix2D for square matrices of increasing size.");
+        addUsageLine("+For each size N, the blocked products A*B and A*B^t and the first eigenvectors");
+        addUsageLine("+of a symmetric matrix (firstEigs) are timed. The products are also given in GFLOPS.");
+        addUsageLine("+The interior and generalized eigensolvers (eigsBetween and generalizedEigs) compute");
+        addUsageLine("+a full decomposition in a single thread, so they are only timed up to --maxDense.");
+        addKeywords("benchmark, matrix, eigenvectors");
+        addParamsLine(" [--size <N0=1000> <NF=10000> <step=1000>] : Sizes from N0 to NF in steps");
+        addParamsLine(" [--thr <N=1>]          : Number of threads of the matrix operations");
+        addParamsLine(" [--eigs <M=10>]        : Number of eigenvectors");
+        addParamsLine(" [--maxDense <N=2000>]  : Largest size for eigsBetween and generalizedEigs");
+        addExampleLine("Time the sizes 1000, 2000, 3000 and 4000 with 8 threads:", false);
+        addExampleLine("xmipp_benchmark_matrix --size 1000 4000 1000 --thr 8");
+    }
+
+    void readParams()
+    {
+        N0 = getIntParam("--size", 0);
+        NF = getIntParam("--size", 1);
+        step = getIntParam("--size", 2);
+        Nthreads = getIntParam("--thr");
+        Neigs = getIntParam("--eigs");
+        NmaxDense = getIntParam("--maxDense");
+        if (N0 <= 0 || step <= 0 || NF < N0)
+            REPORT_ERROR(ERR_ARG_INCORRECT, "The sizes must be positive and N0<=NF");
+    }
+
+    void show()
+    {
+        if (verbose == 0)
+            return;
+        std::cout << "Sizes:         " << N0 << " to " << NF << " step " << step << std::endl
+        << "Threads:       " << Nthreads << std::endl
+        << "Eigenvectors:  " << Neigs << std::endl
+        << "Max. dense:    " << NmaxDense << std::endl;
+    }
+
+    // Seconds since t0
+    static double elapsed(Timer &timer, size_t t0)
+    {
+        return (timer.now() - t0) / 1000.0;
+    }
+
+    void run()
+    {
+        show();
+        setMatrix2DThreads(Nthreads);
+        Timer timer;
+        std::cout << formatString("%6s %10s %8s %10s %8s %10s %12s %15s",
+                                  "N", "A*B (s)", "GFLOPS", "A*Bt (s)", "GFLOPS", "firstEigs",
+                                  "eigsBetween", "generalizedEigs") << std::endl;
+        for (int N = N0; N <= NF; N += step)
+        {
+            Matrix2D<double> A, B, C, S, P;
+            Matrix1D<double> D;
+            A.initGaussian(N, N, 0, 1);
+            B.initGaussian(N, N, 0, 1);
+            double flops = 2.0 * N * N * (double)N;
+
+            size_t t0 = timer.now();
+            C = A * B;
+            double tAB = elapsed(timer, t0);
+
+            t0 = timer.now();
+            matrixOperation_ABt(A, B, C);
+            double tABt = elapsed(timer, t0);
+
+            // Symmetric positive definite matrix with a decaying spectrum
+            matrixOperation_AAt(A, S);
+            S /= N;
+            t0 = timer.now();
+            firstEigs(S, XMIPP_MIN(Neigs, N), D, P);
+            double tFirst = elapsed(timer, t0);
+
+            String between = "-", generalized = "-";
+            if (N <= NmaxDense)
+            {
+                t0 = timer.now();
+                eigsBetween(S, 0, XMIPP_MIN(Neigs, N) - 1, D, P);
+                between = formatString("%.2f", elapsed(timer, t0));
+
+                Matrix2D<double> I;
+                I.initIdentity(N);
+                S += I;
+                t0 = timer.now();
+                generalizedEigs(S, I, D, P);
+                generalized = formatString("%.2f", elapsed(timer, t0));
+            }
+            std::cout << formatString("%6d %10.2f %8.2f %10.2f %8.2f %10.2f %12s %15s",
+                                      N, tAB, (tAB > 0) ? flops / tAB * 1e-9 : 0.0,
+                                      tABt, (tABt > 0) ? flops / tABt * 1e-9 : 0.0, tFirst,
+                                      between.c_str(), generalized.c_str()) << std::endl;
+        }
+    }
+};
+
+int main(int argc, char **argv)
+{
+    ProgBenchmarkMatrix program;
+    program.read(argc, argv);
+    return program.tryRun();
+}
@@ -0,0 +1,156 @@
+/***************************************************************************
+ *
+ * Authors:     Carlos Oscar S. Sorzano (coss@cnb.csic.es)
+ *
+ * Unidad de  Bioinformatica of Centro Nacional de Biotecnologia , CSIC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ *  All comments concerning this program package may be sent to the
+ *  e-mail address 'xmipp@cnb.csic.es'
+ ***************************************************************************/
+
+#include <data/xmipp_program.h>
+#include <data/xmipp_simd.h>
+#include <data/filters.h>
+
+class ProgBenchmarkReductions: public XmippProgram
+{
+protected:
+    int size, repeat;
+
+    void defineParams()
+    {
+        addUsageLine("Time the statistics and correlations of MultidimArray with each instruction set.");
+        addUsageLine("+The reductions (sum, sum2, computeAvgStdev, computeStats, computeDoubleMinMax,");
+        addUsageLine("+dotProduct, fastCorrelation and correlationIndex) are run on a cubic volume in");
+        addUsageLine("+double and float precision. For each instruction set supported by the CPU, the");
+        addUsageLine("+time per call and the data throughput are shown. Each reduction is called at least");
+        addUsageLine("+--repeat times and for at least 0.2 seconds.");
+        addKeywords("benchmark, statistics, SIMD");
+        addParamsLine(" [--size <n=128>]   : Size of the volume");
+        addParamsLine(" [--repeat <r=20>]  : Minimum number of calls of each reduction");
+        addExampleLine("Time the reductions of a 256^3 volume:", false);
+        addExampleLine("xmipp_benchmark_reductions --size 256");
+    }
+
+    void readParams()
+    {
+        size = getIntParam("--size");
+        repeat = getIntParam("--repeat");
+    }
+
+    void show()
+    {
+        if (verbose == 0)
+            return;
+        std::cout << "Volume size:  " << size << std::endl
+        << "Repetitions:  " << repeat << std::endl
+        << "Best set:     " << simdInstructionSetName(getSimdInstructionSet()) << std::endl;
+    }
+
+    // Run the reduction r of A (and B) and return a value that depends on it
+    template <typename T>
+    double reduce(int r, const MultidimArray<T> &A, const MultidimArray<T> &B)
+    {
+        double avg, stddev;
+        T minval, maxval;
+        switch (r)
+        {
+        case 0:
+            return A.sum();
+        case 1:
+            return A.sum2();
+        case 2:
+            A.computeAvgStdev(avg, stddev);
+            return avg;
+        case 3:
+            A.computeStats(avg, stddev, minval, maxval);
+            return avg;
+        case 4:
+            A.computeDoubleMinMax(avg, stddev);
+            return avg;
+        case 5:
+            return A.dotProduct(B);
+        case 6:
+            return fastCorrelation(A, B);
+        default:
+            return correlationIndex(A, B);
+        }
+    }
+
+    // Time per call of the reductions of a volume in T precision
+    template <typename T>
+    void benchmark(const char *type)
+    {
+        MultidimArray<T> A(size, size, size), B(size, size, size);
+        A.initRandom(0, 1);
+        B.initRandom(0, 1);
+        A.setXmippOrigin();
+        B.setXmippOrigin();
+        double MB = MULTIDIM_SIZE(A) * sizeof(T) / (1024.0 * 1024.0);
+        const char *names[] = {"sum", "sum2", "computeAvgStdev", "computeStats",
+                               "computeDoubleMinMax", "dotProduct", "fastCorrelation", "correlationIndex"};
+        const int Nreductions = 8;
+        // Volumes read by each reduction
+        const int Nvolumes[] = {1, 1, 1, 1, 1, 2, 2, 2};
+
+        std::cout << std::endl << type << " " << size << "^3 (" << MB << " MB), ms per call and GB/s:" << std::endl;
+        SimdInstructionSet best = getSimdInstructionSet();
+        Timer timer;
+        double dummy = 0;
+        for (int set = SIMD_SCALAR; set <= SIMD_AVX512; ++set)
+        {
+            if (setSimdInstructionSet((SimdInstructionSet)set) != set)
+                continue;
+            std::cout << "  " << simdInstructionSetName((SimdInstructionSet)set) << std::endl;
+            for (int r = 0; r < Nreductions; ++r)
+            {
+                // The timer counts milliseconds, so that small volumes are
+                // reduced until a measurable time has passed
+                size_t t0 = timer.now(), elapsed = 0;
+                int Ncalls = 0;
+                do
+                {
+                    dummy += reduce(r, A, B);
+                    elapsed = timer.now() - t0;
+                }
+                while (++Ncalls < repeat || elapsed < 200);
+                double ms = (double)elapsed / Ncalls;
+                std::cout << formatString("    %-20s %9.3f ms %9.2f GB/s", names[r], ms,
+                                          Nvolumes[r] * MB / ms * 1000 / 1024) << std::endl;
+            }
+        }
+        setSimdInstructionSet(best);
+        // Keep the results alive
+        if (dummy == -1)
+            std::cout << dummy << std::endl;
+    }
+
+    void run()
+    {
+        show();
+        benchmark<double>("double");
+        benchmark<float>("float");
+    }
+};
+
+int main(int argc, char **argv)
+{
+    ProgBenchmarkReductions program;
+    program.read(argc, argv);
+    return program.tryRun();
+}
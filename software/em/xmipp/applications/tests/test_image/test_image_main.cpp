@@ -5,6 +5,8 @@
 #include <iostream>
 #include <gtest/gtest.h>
 #include <data/metadata.h>
+#include <data/xmipp_hdf5.h>
+#include <data/xmipp_threads.h>
 // MORE INFO HERE: http://code.google.com/p/googletest/wiki/AdvancedGuide
 // This test is named "Size", and belongs to the "MetadataTest"
 // test case.
@@ -420,6 +422,72 @@ TEST_F( ImageTest, checkImageFileSize)
     XMIPP_CATCH
 }
 
+// Images read concurrently from an HDF5 file
+struct HDF5ReadArgs
+{
+    FileName fn;
+    std::vector< MultidimArray<double> > refs;
+    std::vector<size_t> errors;
+};
+
+static void threadReadHDF5(ThreadArgument &thArg)
+{
+    HDF5ReadArgs *args = (HDF5ReadArgs *) thArg.workClass;
+    Image<double> I;
+    for (int round = 0; round < 20; ++round)
+        for (size_t n = 1; n <= args->refs.size(); ++n)
+        {
+            I.read(formatString("%lu@%s", n, args->fn.c_str()));
+            if (!(I() == args->refs[n - 1]))
+                args->errors[thArg.thread_id]++;
+        }
+}
+
+TEST_F( ImageTest, readHDF5Threads)
+{
+    XMIPP_TRY
+    FileName auxFn;
+    auxFn.initUniqueName("/tmp/temp_h5_XXXXXX");
+    HDF5ReadArgs args;
+    args.fn = auxFn + ".hdf";
+
+    // EMAN layout, one dataset per image
+    size_t nImages = 5, xdim = 24, ydim = 18;
+    hid_t file = H5Fcreate(args.fn.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    ASSERT_GE(file, 0);
+    H5Gclose(H5Gcreate2(file, "/MDF", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT));
+    H5Gclose(H5Gcreate2(file, "/MDF/images", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT));
+    hsize_t dims[2] = {ydim, xdim};
+    std::vector<float> buffer(xdim * ydim);
+    for (size_t img = 0; img < nImages; ++img)
+    {
+        MultidimArray<double> ref(ydim, xdim);
+        FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(ref)
+        buffer[n] = DIRECT_MULTIDIM_ELEM(ref, n) = (float) rnd_gaus(0, 1);
+        args.refs.push_back(ref);
+        String group = formatString("/MDF/images/%lu", img);
+        H5Gclose(H5Gcreate2(file, group.c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT));
+        hid_t space = H5Screate_simple(2, dims, NULL);
+        hid_t dataset = H5Dcreate2(file, (group + "/image").c_str(), H5T_NATIVE_FLOAT, space,
+                                   H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        H5Dwrite(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, &buffer[0]);
+        H5Dclose(dataset);
+        H5Sclose(space);
+    }
+    H5Fclose(file);
+
+    int nThreads = 4;
+    args.errors.resize(nThreads, 0);
+    ThreadManager thMgr(nThreads, &args);
+    thMgr.run(threadReadHDF5);
+    for (int t = 0; t < nThreads; ++t)
+        EXPECT_EQ((size_t)0, args.errors[t]) << "thread " << t;
+
+    args.fn.deleteFile();
+    auxFn.deleteFile();
+    XMIPP_CATCH
+}
+
 GTEST_API_ int main(int argc, char **argv)
 {
     testing::InitGoogleTest(&argc, argv);
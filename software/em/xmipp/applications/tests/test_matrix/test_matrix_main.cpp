@@ -1,4 +1,6 @@
 #include <data/matrix2d.h>
+#include <data/sparse_matrix2d.h>
+#include <data/xmipp_funcs.h>
 #include <iostream>
 #include <gtest/gtest.h>
 // MORE INFO HERE: http://code.google.com/p/googletest/wiki/AdvancedGuide
@@ -322,6 +324,263 @@ TEST_F( MatrixTest, matrixOperation_AtA)
     EXPECT_EQ(expectedB,B) << "matrixOperation_AtA failed";
 }
 
+// Reference product with the plain loops
+void naiveProduct(const Matrix2D<double> &A, const Matrix2D<double> &B, Matrix2D<double> &C)
+{
+    C.initZeros(MAT_YSIZE(A), MAT_XSIZE(B));
+    for (size_t i = 0; i < MAT_YSIZE(A); i++)
+        for (size_t j = 0; j < MAT_XSIZE(B); j++)
+            for (size_t k = 0; k < MAT_XSIZE(A); k++)
+                MAT_ELEM(C, i, j) += MAT_ELEM(A, i, k) * MAT_ELEM(B, k, j);
+}
+
+TEST_F( MatrixTest, blockedProducts)
+{
+    // Sizes that are not multiple of the blocks
+    Matrix2D<double> A, B, C, expected;
+    A.initRandom(70,290,-1,1);
+    B.initRandom(290,65,-1,1);
+    Matrix2D<double> At=A.transpose(), Bt=B.transpose();
+    naiveProduct(A,B,expected);
+    for (int nThreads=1; nThreads<=3; nThreads+=2)
+    {
+        setMatrix2DThreads(nThreads);
+        EXPECT_TRUE(expected.equal(A*B,1e-10)) << "operator* failed";
+        matrixOperation_AB(A,B,C);
+        EXPECT_TRUE(expected.equal(C,1e-10)) << "matrixOperation_AB failed";
+        matrixOperation_ABt(A,Bt,C);
+        EXPECT_TRUE(expected.equal(C,1e-10)) << "matrixOperation_ABt failed";
+        matrixOperation_AtB(At,B,C);
+        EXPECT_TRUE(expected.equal(C,1e-10)) << "matrixOperation_AtB failed";
+        matrixOperation_AtBt(At,Bt,C);
+        EXPECT_TRUE(expected.equal(C,1e-10)) << "matrixOperation_AtBt failed";
+
+        Matrix2D<double> expectedSym;
+        naiveProduct(At,A,expectedSym);
+        matrixOperation_AtA(A,C);
+        EXPECT_TRUE(expectedSym.equal(C,1e-10)) << "matrixOperation_AtA failed";
+        naiveProduct(A,At,expectedSym);
+        matrixOperation_AAt(A,C);
+        EXPECT_TRUE(expectedSym.equal(C,1e-10)) << "matrixOperation_AAt failed";
+    }
+    setMatrix2DThreads(1);
+}
+
+// Symmetric matrix with eigenvalues lambda and the eigenvectors given by the
+// columns of the Householder reflection I-2vv^t/(v^tv)
+void matrixWithEigs(const Matrix1D<double> &lambda, Matrix2D<double> &A, Matrix2D<double> &Q)
+{
+    size_t N=VEC_XSIZE(lambda);
+    Matrix1D<double> v(N);
+    FOR_ALL_ELEMENTS_IN_MATRIX1D(v)
+        VEC_ELEM(v,i)=sin(1.0+i);
+    double v2=v.sum2();
+    Q.initIdentity(N);
+    FOR_ALL_ELEMENTS_IN_MATRIX2D(Q)
+        MAT_ELEM(Q,i,j)-=2*VEC_ELEM(v,i)*VEC_ELEM(v,j)/v2;
+    Matrix2D<double> QD=Q;
+    FOR_ALL_ELEMENTS_IN_MATRIX2D(QD)
+        MAT_ELEM(QD,i,j)*=VEC_ELEM(lambda,j);
+    A=QD*Q;
+}
+
+TEST_F( MatrixTest, firstEigsLarge)
+{
+    const size_t N=640, M=4;
+    Matrix1D<double> lambda(N);
+    Matrix2D<double> A, Q, P;
+    Matrix1D<double> D;
+    for (int dominantNegative=0; dominantNegative<=1; dominantNegative++)
+    {
+        FOR_ALL_ELEMENTS_IN_MATRIX1D(lambda)
+            VEC_ELEM(lambda,i)=100./((1.+i)*(1.+i));
+        if (dominantNegative)
+            VEC_ELEM(lambda,N-1)=-500;
+        matrixWithEigs(lambda,A,Q);
+        firstEigs(A,M,D,P);
+        for (size_t l=0; l<M; l++)
+        {
+            EXPECT_NEAR(VEC_ELEM(lambda,l),VEC_ELEM(D,l),1e-8) << "firstEigs failed";
+            double dot=0;
+            for (size_t i=0; i<N; i++)
+                dot+=MAT_ELEM(P,i,l)*MAT_ELEM(Q,i,l);
+            EXPECT_NEAR(1,fabs(dot),1e-8) << "firstEigs failed";
+        }
+    }
+}
+
+TEST_F( MatrixTest, firstEigsThreads)
+{
+    // The subspace iteration gives the same eigenpairs with any number of
+    // threads and agrees with the dense decomposition
+    const size_t N=500, M=10;
+    Matrix1D<double> lambda(N), D, Dref, Dthr;
+    Matrix2D<double> A, Q, P, Pref, Pthr;
+    FOR_ALL_ELEMENTS_IN_MATRIX1D(lambda)
+        VEC_ELEM(lambda,i)=100./(1.+i);
+    matrixWithEigs(lambda,A,Q);
+    eigsBetween(A,N-M,N-1,Dref,Pref);
+    firstEigs(A,M,D,P);
+    setMatrix2DThreads(3);
+    firstEigs(A,M,Dthr,Pthr);
+    setMatrix2DThreads(1);
+    for (size_t l=0; l<M; l++)
+    {
+        EXPECT_NEAR(VEC_ELEM(lambda,l),VEC_ELEM(D,l),1e-8) << "firstEigs failed";
+        EXPECT_NEAR(VEC_ELEM(Dref,M-1-l),VEC_ELEM(D,l),1e-8) << "firstEigs differs from eigsBetween";
+        EXPECT_NEAR(VEC_ELEM(D,l),VEC_ELEM(Dthr,l),1e-10) << "firstEigs depends on the threads";
+        double dot=0;
+        for (size_t i=0; i<N; i++)
+            dot+=MAT_ELEM(P,i,l)*MAT_ELEM(Pthr,i,l);
+        EXPECT_NEAR(1,fabs(dot),1e-8) << "firstEigs depends on the threads";
+    }
+}
+
+// Random sparse matrix with some empty rows and repeated elements
+void randomSparse(int N, int perRow, SparseMatrix2D &S, std::vector<SparseElement> &elements)
+{
+    elements.clear();
+    unsigned int seed=1;
+    for (int i=0; i<N; i++)
+    {
+        if (i%7==3)
+            continue;
+        for (int n=0; n<perRow; n++)
+        {
+            SparseElement e;
+            e.i=i;
+            e.j=rand_r(&seed)%N;
+            e.value=(double)rand_r(&seed)/RAND_MAX-0.5;
+            elements.push_back(e);
+        }
+    }
+    S.fromElements(elements,N);
+}
+
+void denseFromElements(int N, const std::vector<SparseElement> &elements, Matrix2D<double> &dense)
+{
+    dense.initZeros(N,N);
+    for (size_t n=0; n<elements.size(); n++)
+        MAT_ELEM(dense,elements[n].i,elements[n].j)+=elements[n].value;
+}
+
+TEST_F( MatrixTest, sparseProducts)
+{
+    SparseMatrix2D S, S2, SS;
+    Matrix2D<double> dense, dense2, X, Y;
+    std::vector<SparseElement> elements, elements2;
+
+    // Large enough to be split among threads
+    const int N=20000;
+    randomSparse(N,10,S,elements);
+    Matrix1D<double> x(N), y, expectedy;
+    FOR_ALL_ELEMENTS_IN_MATRIX1D(x)
+        VEC_ELEM(x,i)=sin(0.1*i);
+    expectedy.initZeros(N);
+    X.initRandom(N,3,-1,1);
+    Matrix2D<double> expectedY;
+    expectedY.initZeros(N,3);
+    for (size_t n=0; n<elements.size(); n++)
+    {
+        const SparseElement &e=elements[n];
+        VEC_ELEM(expectedy,e.i)+=e.value*VEC_ELEM(x,e.j);
+        for (int l=0; l<3; l++)
+            MAT_ELEM(expectedY,e.i,l)+=e.value*MAT_ELEM(X,e.j,l);
+    }
+    for (int nThreads=1; nThreads<=3; nThreads+=2)
+    {
+        setMatrix2DThreads(nThreads);
+        randomSparse(N,10,S,elements);
+        y.initZeros(N);
+        S.multMv(MATRIX1D_ARRAY(x),MATRIX1D_ARRAY(y));
+        double maxDiff=0;
+        FOR_ALL_ELEMENTS_IN_MATRIX1D(y)
+            maxDiff=XMIPP_MAX(maxDiff,fabs(VEC_ELEM(y,i)-VEC_ELEM(expectedy,i)));
+        EXPECT_LT(maxDiff,1e-10) << "multMv failed";
+        S.multMM(X,Y);
+        EXPECT_TRUE(expectedY.equal(Y,1e-10)) << "multMM by dense matrix failed";
+    }
+    setMatrix2DThreads(1);
+
+    randomSparse(150,4,S,elements);
+    randomSparse(150,3,S2,elements2);
+    denseFromElements(150,elements,dense);
+    denseFromElements(150,elements2,dense2);
+    for (int i=0; i<150; i++)
+        for (int j=0; j<150; j++)
+            ASSERT_EQ(MAT_ELEM(dense,i,j),S.getElemIJ(i,j)) << "sparse element";
+    S.multMM(S2,SS);
+    Matrix2D<double> expected=dense*dense2;
+    for (int i=0; i<150; i++)
+        for (int j=0; j<150; j++)
+            EXPECT_NEAR(MAT_ELEM(expected,i,j),SS.getElemIJ(i,j),1e-12) << "multMM failed";
+
+    MultidimArray<double> d(150);
+    d.initRandom(0,1);
+    S.multMMDiagonal(d,SS);
+    for (int i=0; i<150; i++)
+        for (int j=0; j<150; j++)
+            EXPECT_NEAR(MAT_ELEM(dense,i,j)*DIRECT_A1D_ELEM(d,i),SS.getElemIJ(i,j),1e-12) << "multMMDiagonal failed";
+}
+
+TEST_F( MatrixTest, sparseEigs)
+{
+    // Symmetric, tridiagonal matrix
+    const int N=600;
+    const size_t M=4;
+    std::vector<SparseElement> elements;
+    for (int i=0; i<N; i++)
+    {
+        SparseElement e;
+        e.i=e.j=i;
+        e.value=1+i*0.1;
+        elements.push_back(e);
+        if (i+1<N)
+        {
+            e.j=i+1;
+            e.value=0.3;
+            elements.push_back(e);
+            e.i=i+1;
+            e.j=i;
+            elements.push_back(e);
+        }
+    }
+    SparseMatrix2D S(elements,N);
+    Matrix2D<double> dense(N,N);
+    for (size_t n=0; n<elements.size(); n++)
+        MAT_ELEM(dense,elements[n].i,elements[n].j)=elements[n].value;
+
+    Matrix1D<double> D, expectedD;
+    Matrix2D<double> P, expectedP;
+    for (int largest=0; largest<=1; largest++)
+    {
+        if (largest)
+        {
+            firstEigs(S,M,D,P);
+            eigsBetween(dense,N-M,N-1,expectedD,expectedP);
+            // eigsBetween sorts them in increasing order
+            expectedD.selfReverse();
+            Matrix2D<double> aux=expectedP;
+            for (int i=0; i<N; i++)
+                for (size_t l=0; l<M; l++)
+                    MAT_ELEM(expectedP,i,l)=MAT_ELEM(aux,i,M-1-l);
+        }
+        else
+        {
+            lastEigs(S,M,D,P);
+            eigsBetween(dense,0,M-1,expectedD,expectedP);
+        }
+        for (size_t l=0; l<M; l++)
+        {
+            EXPECT_NEAR(VEC_ELEM(expectedD,l),VEC_ELEM(D,l),1e-8) << "sparse eigenvalues failed";
+            double dot=0;
+            for (int i=0; i<N; i++)
+                dot+=MAT_ELEM(P,i,l)*MAT_ELEM(expectedP,i,l);
+            EXPECT_NEAR(1,fabs(dot),1e-6) << "sparse eigenvectors failed";
+        }
+    }
+}
+
 GTEST_API_ int main(int argc, char **argv)
 {
     testing::InitGoogleTest(&argc, argv);
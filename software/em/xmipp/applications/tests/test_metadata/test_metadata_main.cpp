@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <data/metadata_extension.h>
 #include <data/xmipp_image_convert.h>
+#include <data/xmipp_threads.h>
 #include <iostream>
 #include <gtest/gtest.h>
 #include <string.h>
@@ -287,6 +288,110 @@ TEST_F( MetadataTest, Copy)
     EXPECT_EQ(mDsource,auxMetadata);
 }
 
+TEST_F( MetadataTest, ReadRowWindow)
+{
+    FileName fn;
+    fn.initUniqueName("ReadRowWindow_XXXXXX");
+    FileName fnDB = fn + ".sqlite";
+    FileName fnSTAR = fn + ".xmd";
+
+    XMIPP_TRY
+
+    MetaData md;
+    size_t id;
+    for (int i = 0; i < 10; ++i)
+    {
+        id = md.addObject();
+        md.setValue(MDL_X, (double) i, id);
+        md.setValue(MDL_COMMENT, formatString("comment with spaces %d", i), id);
+        md.setValue(MDL_Y, (double) (2 * i), id);
+    }
+    md.write(fnDB);
+    md.write(fnSTAR);
+
+    MDLabelVector labels(1, MDL_Y);
+    MetaData mdWindow;
+    double x, y;
+
+    //Read a window of rows from sqlite
+    mdWindow.setRowOffset(3);
+    mdWindow.setMaxRows(4);
+    mdWindow.read(fnDB);
+    EXPECT_EQ((size_t)4, mdWindow.size());
+    EXPECT_EQ(md.size(), mdWindow.getParsedLines());
+    mdWindow.getValue(MDL_X, x, mdWindow.firstObject());
+    EXPECT_DOUBLE_EQ(3., x);
+
+    //Read a window of rows and only one column from STAR
+    mdWindow.read(fnSTAR, &labels);
+    EXPECT_EQ((size_t)4, mdWindow.size());
+    EXPECT_EQ(md.size(), mdWindow.getParsedLines());
+    EXPECT_FALSE(mdWindow.containsLabel(MDL_X));
+    EXPECT_FALSE(mdWindow.containsLabel(MDL_COMMENT));
+    double expectedY = 6;
+    FOR_ALL_OBJECTS_IN_METADATA(mdWindow)
+    {
+        mdWindow.getValue(MDL_Y, y, __iter.objId);
+        EXPECT_DOUBLE_EQ(expectedY, y);
+        expectedY += 2;
+    }
+
+    //Split among nodes reading only their part
+    int numImgTot;
+    MetaData mdPart, mdAll;
+    for (int rank = 0; rank < 3; ++rank)
+    {
+        mdPart.clear();
+        mpiSelectPart(fnSTAR, mdPart, rank, 3, numImgTot);
+        EXPECT_EQ((int)md.size(), numImgTot);
+        mdAll.unionAll(mdPart);
+    }
+    EXPECT_EQ(md, mdAll);
+
+    XMIPP_CATCH
+
+    unlink(fn.c_str());
+    unlink(fnDB.c_str());
+    unlink(fnSTAR.c_str());
+}
+
+TEST_F( MetadataTest, ColumnValues)
+{
+    XMIPP_TRY
+    std::vector<double> x;
+    mDsource.getColumnValues(MDL_X, x);
+    ASSERT_EQ(mDsource.size(), x.size());
+    EXPECT_DOUBLE_EQ(1., x[0]);
+    EXPECT_DOUBLE_EQ(3., x[1]);
+
+    //Set the values in an existing metadata
+    MetaData md(mDsource);
+    std::vector<int> ref(x.size());
+    for (size_t i = 0; i < ref.size(); ++i)
+        ref[i] = 10 * (i + 1);
+    md.setColumnValues(MDL_REF, ref);
+    std::vector<int> refOut;
+    md.getColumnValues(MDL_REF, refOut);
+    EXPECT_EQ(ref, refOut);
+
+    //Empty metadata, one object is added for each value
+    MetaData mdEmpty;
+    mdEmpty.setColumnValues(MDL_X, x);
+    EXPECT_EQ(x.size(), mdEmpty.size());
+    std::vector<double> xOut;
+    mdEmpty.getColumnValues(MDL_X, xOut);
+    EXPECT_EQ(x, xOut);
+
+    //Missing column gets default values
+    std::vector<double> z;
+    md.getColumnValues(MDL_Z, z);
+    EXPECT_EQ(md.size(), z.size());
+
+    //Wrong number of values
+    EXPECT_THROW(md.setColumnValues(MDL_REF, std::vector<int>(ref.size() + 1)), XmippError);
+    XMIPP_CATCH
+}
+
 TEST_F( MetadataTest, MDInfo)
 {
     //char sfnStar[64] = "";
@@ -1722,6 +1827,55 @@ TEST_F( MetadataTest, copyImages)
     XMIPP_CATCH
 }
 
+//Each thread fills its own metadata and reads a shared one
+struct ThreadMetadataArgs
+{
+    MetaData * shared;
+    std::vector<MetaData> * own;
+    std::vector<double> * sums;
+};
+
+void threadFillMetadata(ThreadArgument &thArg)
+{
+    ThreadMetadataArgs * args = (ThreadMetadataArgs*) thArg.workClass;
+    MetaData &md = (*args->own)[thArg.thread_id];
+    double x, sum = 0.;
+    for (int n = 0; n < 200; ++n)
+    {
+        size_t id = md.addObject();
+        md.setValue(MDL_X, (double)n, id);
+        md.setValue(MDL_Y, (double)thArg.thread_id, id);
+        FOR_ALL_OBJECTS_IN_METADATA(*(args->shared))
+        {
+            args->shared->getValue(MDL_X, x, __iter.objId);
+            sum += x;
+        }
+    }
+    (*args->sums)[thArg.thread_id] = sum;
+}
+
+TEST_F( MetadataTest, Threads)
+{
+    int nThreads = 4;
+    std::vector<MetaData> own(nThreads);
+    std::vector<double> sums(nThreads);
+    ThreadMetadataArgs args;
+    args.shared = &mDsource;
+    args.own = &own;
+    args.sums = &sums;
+    ThreadManager thMgr(nThreads, &args);
+    thMgr.run(threadFillMetadata);
+
+    MetaData mdAll;
+    for (int i = 0; i < nThreads; ++i)
+    {
+        EXPECT_EQ((size_t)200, own[i].size());
+        EXPECT_DOUBLE_EQ(200 * 4., sums[i]);
+        mdAll.unionAll(own[i]);
+    }
+    EXPECT_EQ((size_t)(200 * nThreads), mdAll.size());
+}
+
 GTEST_API_ int main(int argc, char **argv)
 {
     testing::InitGoogleTest(&argc, argv);
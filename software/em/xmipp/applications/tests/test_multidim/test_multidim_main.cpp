@@ -1,6 +1,8 @@
 #include <data/multidim_array.h>
 #include <data/matrix2d.h>
+#include <data/xmipp_threads.h>
 #include <iostream>
+#include <sstream>
 #include <gtest/gtest.h>
 // MORE INFO HERE: http://code.google.com/p/googletest/wiki/AdvancedGuide
 // Modify this test so it uses Fixures as test_image and test_metadata
@@ -41,6 +43,229 @@ TEST( MultidimTest, Copy)
     EXPECT_EQ(mdtarget,mdsource) << "MultidimArray: copy operator failed";
 }
 
+TEST( MultidimTest, Swap)
+{
+    MultidimArray<double> md1(3,4), md2(5), ref1, ref2;
+    md1.initRandom(0,1);
+    md2.initConstant(2.);
+    ref1 = md1;
+    ref2 = md2;
+    double *data1 = MULTIDIM_ARRAY(md1);
+    md1.swap(md2);
+    EXPECT_EQ(ref2, md1) << "MultidimArray: swap failed";
+    EXPECT_EQ(ref1, md2) << "MultidimArray: swap failed";
+    EXPECT_EQ(data1, MULTIDIM_ARRAY(md2)) << "MultidimArray: swap copied the data";
+    EXPECT_EQ((size_t)0, ((size_t)MULTIDIM_ARRAY(md2)) % XMIPP_MEMORY_ALIGNMENT) << "MultidimArray: data not aligned";
+
+#if __cplusplus >= 201103L
+    MultidimArray<double> md3(std::move(md2));
+    EXPECT_EQ(data1, MULTIDIM_ARRAY(md3)) << "MultidimArray: move copied the data";
+    EXPECT_TRUE(MULTIDIM_ARRAY(md2) == NULL) << "MultidimArray: moved array not empty";
+
+    // Assigning to an alias writes on the aliased memory
+    MultidimArray<double> alias, twice = ref1 * 2.;
+    alias.alias(md3);
+    alias = MultidimArray<double>(twice);
+    EXPECT_EQ(twice, md3) << "MultidimArray: move to alias failed";
+#endif
+}
+
+TEST( MultidimTest, ComplexAllocation)
+{
+    // As with new T[n], the complex numbers of fresh buffers are 0
+    MultidimArray< std::complex<double> > mc;
+    mc.resizeNoCopy(64,64);
+    FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(mc)
+    ASSERT_EQ(0., abs(DIRECT_MULTIDIM_ELEM(mc,n))) << "MultidimArray: complex data not initialized";
+    Matrix1D< std::complex<double> > vc(100);
+    FOR_ALL_ELEMENTS_IN_MATRIX1D(vc)
+    ASSERT_EQ(0., abs(VEC_ELEM(vc,i))) << "Matrix1D: complex data not initialized";
+}
+
+TEST( MultidimTest, MemoryPool)
+{
+    MultidimArray<double> kept(128,128);
+    double *keptData = MULTIDIM_ARRAY(kept);
+    EXPECT_FALSE(MemoryPool::isActive());
+    {
+        MemoryPool pool;
+        EXPECT_TRUE(MemoryPool::isActive());
+        // Buffer allocated without pool is reused
+        kept.clear();
+        MultidimArray<double> md(128,128);
+        EXPECT_EQ(keptData, MULTIDIM_ARRAY(md)) << "MemoryPool: buffer not reused";
+        for (int n = 0; n < 10; ++n)
+        {
+            MultidimArray<double> aux(128,128);
+            aux.initConstant(n);
+            EXPECT_EQ(0., aux.computeMin() - n);
+        }
+        // Smaller array of the same size class, initialized to zero
+        MultidimArray<double> aux(120,128);
+        EXPECT_EQ(0., aux.computeMax()) << "MemoryPool: buffer not initialized";
+        MemoryPoolStats stats = MemoryPool::getStats();
+        EXPECT_EQ((size_t)12, stats.requests);
+        EXPECT_EQ((size_t)11, stats.hits);
+        EXPECT_EQ((size_t)0, stats.pooledBytes);
+        EXPECT_EQ(128*128*sizeof(double), stats.peakPooledBytes);
+        EXPECT_EQ((size_t)0, ((size_t)MULTIDIM_ARRAY(aux)) % XMIPP_MEMORY_ALIGNMENT);
+    }
+    EXPECT_FALSE(MemoryPool::isActive());
+    EXPECT_EQ((size_t)0, MemoryPool::getStats().pooledBytes);
+    // A pool without limit, as programs do when XMIPP_MEMORY_POOL is not set
+    {
+        MemoryPool pool(0);
+        EXPECT_FALSE(MemoryPool::isActive());
+    }
+    EXPECT_FALSE(MemoryPool::isActive());
+}
+
+TEST( MultidimTest, Expression)
+{
+    MultidimArray<double> A(4,5), B(4,5), C(4,5), V, ref;
+    A.initRandom(0,1);
+    B.initRandom(1,2);
+    C.initRandom(0,1);
+
+    V = lazy(A) * 3. + B - C;
+    ref = A * 3. + B - C;
+    EXPECT_EQ(ref, V) << "MultidimArray: expression failed";
+
+    V = 2. - (lazy(A) + B) / C * (-lazy(C));
+    ref = 2. - (A + B) / C * (-C);
+    EXPECT_EQ(ref, V) << "MultidimArray: expression failed";
+
+    // The result can be one of the operands
+    ref = A * 0.5 + C;
+    A = lazy(A) * 0.5 + C;
+    EXPECT_EQ(ref, A) << "MultidimArray: expression on an operand failed";
+    ref = A + B * 2.;
+    A += lazy(B) * 2;
+    EXPECT_EQ(ref, A) << "MultidimArray: operator+= failed";
+
+    MultidimArray<double> W = lazy(B) * B;
+    ref = B * B;
+    EXPECT_EQ(ref, W) << "MultidimArray: constructor from expression failed";
+
+    MultidimArray<double> D(5,4);
+    EXPECT_THROW(V = lazy(A) + D, XmippError);
+}
+
+// V = A * c + B - C gives the same result with the array operators and with
+// an expression, and the expression does not allocate any temporary array
+TEST( MultidimTest, ExpressionTemporaries)
+{
+    MultidimArray<double> A(32,32,32), B(32,32,32), C(32,32,32);
+    MultidimArray<double> V(32,32,32), ref(32,32,32);
+    A.initRandom(0,1);
+    B.initRandom(0,1);
+    C.initRandom(0,1);
+    MemoryPool pool;
+
+    ref = A * 2. + B - C;
+    size_t requestsOperators = MemoryPool::getStats().requests;
+    V = lazy(A) * 2. + B - C;
+    size_t requestsExpression = MemoryPool::getStats().requests - requestsOperators;
+
+    EXPECT_EQ(ref, V);
+    EXPECT_EQ((size_t)3, requestsOperators);
+    EXPECT_EQ((size_t)0, requestsExpression);
+}
+
+// The reductions of all the instruction sets agree with a direct computation
+template<typename T>
+void checkReductions(size_t size)
+{
+    MultidimArray<T> A(size), B(size);
+    A.initRandom(-1,3);
+    B.initRandom(0,1);
+    long double sum = 0, sum2 = 0, dot = 0;
+    T minval = A(0), maxval = A(0);
+    FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(A)
+    {
+        long double a = DIRECT_MULTIDIM_ELEM(A,n);
+        sum += a;
+        sum2 += a * a;
+        dot += a * DIRECT_MULTIDIM_ELEM(B,n);
+        minval = XMIPP_MIN(minval, DIRECT_MULTIDIM_ELEM(A,n));
+        maxval = XMIPP_MAX(maxval, DIRECT_MULTIDIM_ELEM(A,n));
+    }
+    for (int set = SIMD_SCALAR; set <= SIMD_AVX512; ++set)
+    {
+        if (setSimdInstructionSet((SimdInstructionSet)set) != set)
+            continue;
+        const char *name = simdInstructionSetName((SimdInstructionSet)set);
+        double tol = 1e-12 * size;
+        EXPECT_NEAR((double)sum, A.sum(), tol) << name;
+        EXPECT_NEAR((double)sum2, A.sum2(), tol) << name;
+        EXPECT_NEAR((double)dot, A.dotProduct(B), tol) << name;
+        double avg, stddev;
+        T Tmin, Tmax;
+        A.computeStats(avg, stddev, Tmin, Tmax);
+        EXPECT_NEAR((double)(sum / size), avg, tol) << name;
+        EXPECT_EQ(minval, Tmin) << name;
+        EXPECT_EQ(maxval, Tmax) << name;
+        double dmin, dmax;
+        A.computeDoubleMinMax(dmin, dmax);
+        EXPECT_EQ((double)minval, dmin) << name;
+        EXPECT_EQ((double)maxval, dmax) << name;
+        if (size > 1)
+        {
+            MultidimArray<T> C = A;
+            C.statisticsAdjust(0, 1);
+            C.computeAvgStdev(avg, stddev);
+            EXPECT_NEAR(0., avg, 1e-6) << name;
+            EXPECT_NEAR(1., stddev, 1e-6) << name;
+        }
+    }
+    setSimdInstructionSet(SIMD_AVX512);
+}
+
+TEST( MultidimTest, Reductions)
+{
+    size_t sizes[] = {1, 3, 17, 100, 1003};
+    for (int i = 0; i < 5; ++i)
+    {
+        checkReductions<double>(sizes[i]);
+        checkReductions<float>(sizes[i]);
+    }
+}
+
+// All the instruction sets give the same statistics of a volume, whose
+// size is not a multiple of any vector width
+template<typename T>
+void compareReductionsInstructionSets()
+{
+    MultidimArray<T> A(33,32,31), B(33,32,31);
+    A.initRandom(0,1);
+    B.initRandom(0,1);
+    setSimdInstructionSet(SIMD_SCALAR);
+    double avgRef, stddevRef, dotRef = A.dotProduct(B);
+    T minRef, maxRef;
+    A.computeStats(avgRef, stddevRef, minRef, maxRef);
+    for (int set = SIMD_SCALAR + 1; set <= SIMD_AVX512; ++set)
+    {
+        if (setSimdInstructionSet((SimdInstructionSet)set) != set)
+            continue;
+        const char *name = simdInstructionSetName((SimdInstructionSet)set);
+        double avg, stddev;
+        T minval, maxval;
+        A.computeStats(avg, stddev, minval, maxval);
+        EXPECT_NEAR(avgRef, avg, 1e-12) << name;
+        EXPECT_NEAR(stddevRef, stddev, 1e-9) << name;
+        EXPECT_EQ(minRef, minval) << name;
+        EXPECT_EQ(maxRef, maxval) << name;
+        EXPECT_NEAR(dotRef, A.dotProduct(B), 1e-12 * MULTIDIM_SIZE(A)) << name;
+    }
+    setSimdInstructionSet(SIMD_AVX512);
+}
+
+TEST( MultidimTest, ReductionsInstructionSets)
+{
+    compareReductionsInstructionSets<double>();
+    compareReductionsInstructionSets<float>();
+}
+
 TEST( MultidimTest, CopyFromMatrix2D)
 {
     MultidimArray<double> mdTarget;
@@ -331,6 +556,49 @@ TEST( MultidimTest, mapFile)
     XMIPP_CATCH
 }
 
+TEST( MultidimTest, initZerosFirstTouch)
+{
+    XMIPP_TRY
+    MultidimArray<double> mda, ref;
+    mda.initZeros(8,8,8);
+    mda.initConstant(5);
+    mda.initZerosFirstTouch(37,33,65,4);
+    ref.initZeros(37,33,65);
+    ASSERT_EQ(ref, mda);
+
+    MultidimArray<std::complex<double> > pattern(20,21,11);
+    pattern.setXmippOrigin();
+    MultidimArray<double> weights;
+    weights.initZerosFirstTouch(pattern,3);
+    EXPECT_TRUE(weights.sameShape(pattern));
+    EXPECT_EQ(STARTINGZ(pattern), STARTINGZ(weights));
+    EXPECT_EQ(STARTINGX(pattern), STARTINGX(weights));
+    EXPECT_EQ(0., weights.sum());
+
+    // The same placement must be obtained with a thread affinity policy
+    ThreadAffinityPolicy policy = getThreadAffinityPolicy();
+    setThreadAffinityPolicy(AFFINITY_SOCKETS);
+    clearThreadPlacement();
+    mda.initConstant(1);
+    mda.initZerosFirstTouch(37,33,65,4);
+    setThreadAffinityPolicy(policy);
+    ASSERT_EQ(ref, mda);
+
+    std::ostringstream report;
+    threadPlacementReport(report);
+    EXPECT_NE(std::string::npos, report.str().find("worker 3:"));
+
+    // Without a policy nothing is recorded
+    setThreadAffinityPolicy(AFFINITY_NONE);
+    clearThreadPlacement();
+    mda.initZerosFirstTouch(37,33,65,4);
+    setThreadAffinityPolicy(policy);
+    std::ostringstream emptyReport;
+    threadPlacementReport(emptyReport);
+    EXPECT_EQ(std::string::npos, emptyReport.str().find("worker"));
+    XMIPP_CATCH
+}
+
 GTEST_API_ int main(int argc, char **argv)
 {
 
@@ -0,0 +1,92 @@
+#include <data/projection.h>
+#include <data/xmipp_funcs.h>
+#include <iostream>
+#include <gtest/gtest.h>
+
+class ProjectionTest : public ::testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        // Random sphere, not centered in the projection directions
+        int size = 32;
+        V.initZeros(size, size, size);
+        V.setXmippOrigin();
+        init_random_generator(1);
+        FOR_ALL_ELEMENTS_IN_ARRAY3D(V)
+        if ((k-2)*(k-2)+i*i+(j+1)*(j+1) < 100)
+            A3D_ELEM(V,k,i,j) = 1+rnd_unif(0, 1);
+
+        // Axis aligned directions and general ones
+        double directions[6][3] = { {0, 0, 0}, {0, 90, 0}, {90, 90, 0},
+                                    {10, 20, 30}, {-45, 120, 200}, {33, 77, -12} };
+        angles.initZeros(6, 3);
+        offsets.initZeros(6, 3);
+        for (int n = 0; n < 6; ++n)
+            for (int c = 0; c < 3; ++c)
+            {
+                MAT_ELEM(angles,n,c) = directions[n][c];
+                MAT_ELEM(offsets,n,c) = 0.5*(c+1)-n;
+            }
+    }
+
+    MultidimArray<double> V;
+    Matrix2D<double> angles, offsets;
+};
+
+// The batch of projections is the same as projecting one by one, with and
+// without offsets and for any number of threads
+TEST_F(ProjectionTest, projectVolumeBatch)
+{
+    int Ydim = 29, Xdim = 33;
+    Projection P;
+    MultidimArray<double> stack, projection;
+    Matrix1D<double> roffset(3);
+    for (int nThreads = 1; nThreads <= 3; nThreads += 2)
+        for (int withOffsets = 0; withOffsets < 2; ++withOffsets)
+        {
+            projectVolumeBatch(V, angles, stack, Ydim, Xdim, nThreads, withOffsets ? &offsets : NULL);
+            ASSERT_EQ(NSIZE(stack), MAT_YSIZE(angles));
+            for (size_t n = 0; n < MAT_YSIZE(angles); ++n)
+            {
+                offsets.getRow(n, roffset);
+                roffset.selfTranspose();
+                projectVolume(V, P, Ydim, Xdim, MAT_ELEM(angles,n,0), MAT_ELEM(angles,n,1),
+                              MAT_ELEM(angles,n,2), withOffsets ? &roffset : NULL);
+                ASSERT_GT(P().computeMax(), 0);
+                projection.aliasImageInStack(stack, n);
+                FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(projection)
+                ASSERT_EQ(DIRECT_MULTIDIM_ELEM(projection,n), DIRECT_MULTIDIM_ELEM(P(),n));
+            }
+        }
+}
+
+// The rows of a projection shared by threads, new or reused, give the same
+// projection as a single thread
+TEST_F(ProjectionTest, projectVolumeThreads)
+{
+    int size = XSIZE(V);
+    Projection P1, P3, Pmgr;
+    Matrix1D<double> roffset(3);
+    ThreadManager thMgr(3);
+    for (size_t n = 0; n < MAT_YSIZE(angles); ++n)
+    {
+        offsets.getRow(n, roffset);
+        roffset.selfTranspose();
+        double rot = MAT_ELEM(angles,n,0), tilt = MAT_ELEM(angles,n,1), psi = MAT_ELEM(angles,n,2);
+        projectVolume(V, P1, size, size, rot, tilt, psi, &roffset);
+        projectVolume(V, P3, size, size, rot, tilt, psi, &roffset, 3);
+        projectVolume(V, Pmgr, size, size, rot, tilt, psi, &roffset, 1, &thMgr);
+        FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(P1())
+        {
+            ASSERT_EQ(DIRECT_MULTIDIM_ELEM(P1(),n), DIRECT_MULTIDIM_ELEM(P3(),n));
+            ASSERT_EQ(DIRECT_MULTIDIM_ELEM(P1(),n), DIRECT_MULTIDIM_ELEM(Pmgr(),n));
+        }
+    }
+}
+
+GTEST_API_ int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
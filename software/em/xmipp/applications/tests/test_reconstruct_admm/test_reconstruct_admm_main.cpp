@@ -0,0 +1,164 @@
+#include <reconstruction/reconstruct_ADMM.h>
+#include <data/xmipp_funcs.h>
+#include <iostream>
+#include <gtest/gtest.h>
+
+class ReconstructAdmmTest : public ::testing::Test
+{
+protected:
+    // Random H^tb and a Gaussian H^tKH, so that the test does not need the
+    // autocorrelation of the Kaiser-Bessel kernel
+    virtual void SetUp()
+    {
+        int size = 12;
+        init_random_generator(11);
+        Htb.initZeros(size, size, size);
+        Htb.setXmippOrigin();
+        Htb.initRandom(0, 1);
+
+        HtKH.initZeros(2*size-1, 2*size-1, 2*size-1);
+        HtKH.setXmippOrigin();
+        FOR_ALL_ELEMENTS_IN_ARRAY3D(HtKH)
+        A3D_ELEM(HtKH,k,i,j) = exp(-(k*k+i*i+j*j)/4.5);
+    }
+
+    // Read the parameters and prepare the conjugate gradient from Htb and HtKH
+    void prepare(ProgReconsADMM &prog, int threads, bool useFloat)
+    {
+        String thr = integerToString(threads);
+        std::vector<const char *> argv;
+        argv.push_back("xmipp_reconstruct_admm");
+        argv.push_back("-i");
+        argv.push_back("images.xmd");
+        argv.push_back("--cgiter");
+        argv.push_back("5");
+        argv.push_back("--thr");
+        argv.push_back(thr.c_str());
+        if (useFloat)
+            argv.push_back("--float");
+        prog.read((int)argv.size(), &argv[0]);
+        prog.kernel.initializeKernel(prog.alpha, prog.a, 0.0001);
+        prog.CHtb() = Htb;
+        prog.Ck().initZeros(Htb);
+        prog.Ck().setXmippOrigin();
+        MultidimArray<double> kernelV = HtKH;
+        prog.prepareConjugateGradient(kernelV);
+    }
+
+    // A^tA x as computed before the conjugate gradient was threaded:
+    // zero padding, product with the kernel in Fourier space, CenterFFT
+    // and cropping of the central region
+    void referenceKernel3D(ProgReconsADMM &prog, const MultidimArray<double> &x, MultidimArray<double> &AtAx)
+    {
+        MultidimArray<double> paddedx;
+        paddedx.initZeros(2*ZSIZE(x)-1,2*YSIZE(x)-1,2*XSIZE(x)-1);
+        paddedx.setXmippOrigin();
+        FOR_ALL_ELEMENTS_IN_ARRAY3D(x)
+        A3D_ELEM(paddedx,k,i,j) = A3D_ELEM(x,k,i,j);
+
+        FourierTransformer transformer;
+        transformer.setReal(paddedx);
+        transformer.FourierTransform();
+        double K = MULTIDIM_SIZE(paddedx);
+        FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(transformer.fFourier)
+        DIRECT_MULTIDIM_ELEM(transformer.fFourier,n) *= DIRECT_MULTIDIM_ELEM(prog.fourierKernelV,n)*K;
+        transformer.inverseFourierTransform();
+        CenterFFT(paddedx,false);
+
+        AtAx.resize(x);
+        FOR_ALL_ELEMENTS_IN_ARRAY3D(x)
+        A3D_ELEM(AtAx,k,i,j) = A3D_ELEM(paddedx,k,i,j);
+    }
+
+    // Conjugate gradient in double precision and in a single thread
+    void referenceConjugateGradient(ProgReconsADMM &prog)
+    {
+        MultidimArray<double> &mCk = prog.Ck();
+        MultidimArray<double> AtAVk;
+        referenceKernel3D(prog, mCk, AtAVk);
+
+        MultidimArray<double> r;
+        prog.applyLtFilter(prog.fourierLx, prog.ux, prog.dx);
+        r = prog.ud;
+        prog.applyLtFilter(prog.fourierLy, prog.uy, prog.dy);
+        r += prog.ud;
+        prog.applyLtFilter(prog.fourierLz, prog.uz, prog.dz);
+        r += prog.ud;
+        r *= prog.mu;
+        r += prog.CHtb();
+        r -= AtAVk;
+        double d = r.sum2();
+
+        MultidimArray<double> p = r, AtAp;
+        for (int iter = 0; iter < prog.Ncgiter; ++iter)
+        {
+            referenceKernel3D(prog, p, AtAp);
+            double alpha = d/p.dotProduct(AtAp);
+            FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(r)
+            {
+                DIRECT_MULTIDIM_ELEM(r,n) -= alpha*DIRECT_MULTIDIM_ELEM(AtAp,n);
+                DIRECT_MULTIDIM_ELEM(mCk,n) += alpha*DIRECT_MULTIDIM_ELEM(p,n);
+            }
+            double newd = r.sum2();
+            double beta = newd/d;
+            d = newd;
+            FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(p)
+            DIRECT_MULTIDIM_ELEM(p,n) = DIRECT_MULTIDIM_ELEM(r,n)+beta*DIRECT_MULTIDIM_ELEM(p,n);
+        }
+    }
+
+    // Two ADMM iterations, so that the second one starts from non-zero u and d
+    void iterate(ProgReconsADMM &prog, bool reference)
+    {
+        for (int iter = 0; iter < 2; ++iter)
+        {
+            if (reference)
+                referenceConjugateGradient(prog);
+            else
+                prog.applyConjugateGradient();
+            prog.updateUD();
+        }
+    }
+
+    MultidimArray<double> Htb, HtKH;
+};
+
+// The threaded conjugate gradient gives the same estimate as the previous
+// double precision code with 1 and N threads, and a close one in single precision
+TEST_F(ReconstructAdmmTest, conjugateGradient)
+{
+    ProgReconsADMM reference;
+    prepare(reference, 1, false);
+    iterate(reference, true);
+    const MultidimArray<double> &Cref = reference.Ck();
+    double maxC = Cref.computeMax();
+    ASSERT_GT(maxC, 0);
+
+    int threads[] = {1, 3};
+    for (int t = 0; t < 2; ++t)
+    {
+        ProgReconsADMM progDouble, progFloat;
+        prepare(progDouble, threads[t], false);
+        iterate(progDouble, false);
+        prepare(progFloat, threads[t], true);
+        iterate(progFloat, false);
+
+        const MultidimArray<double> &Cdouble = progDouble.Ck();
+        const MultidimArray<double> &Cfloat = progFloat.Ck();
+        ASSERT_TRUE(Cref.sameShape(Cdouble));
+        ASSERT_TRUE(Cref.sameShape(Cfloat));
+        FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Cref)
+        {
+            ASSERT_NEAR(DIRECT_MULTIDIM_ELEM(Cref,n), DIRECT_MULTIDIM_ELEM(Cdouble,n), 1e-10*maxC)
+            << threads[t] << " threads, double";
+            ASSERT_NEAR(DIRECT_MULTIDIM_ELEM(Cref,n), DIRECT_MULTIDIM_ELEM(Cfloat,n), 1e-5*maxC)
+            << threads[t] << " threads, float";
+        }
+    }
+}
+
+GTEST_API_ int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,170 @@
+#include <reconstruction/reconstruct_art.h>
+#include <data/projection.h>
+#include <data/xmipp_funcs.h>
+#include <iostream>
+#include <fstream>
+#include <gtest/gtest.h>
+
+class ReconstructArtTest : public ::testing::Test
+{
+protected:
+    // Projections of a small phantom in directions spread over the sphere
+    virtual void SetUp()
+    {
+        int size = 24;
+        fnRoot.initUniqueName("/tmp/temp_art_XXXXXX");
+        fnStack = fnRoot + ".stk";
+        fnMd = fnRoot + ".xmd";
+
+        init_random_generator(7);
+        MultidimArray<double> V;
+        V.initZeros(size, size, size);
+        V.setXmippOrigin();
+        FOR_ALL_ELEMENTS_IN_ARRAY3D(V)
+        if (k*k+i*i+j*j < 36)
+            A3D_ELEM(V,k,i,j) = 1;
+        else if ((k-3)*(k-3)+(i+4)*(i+4)+(j-2)*(j-2) < 16)
+            A3D_ELEM(V,k,i,j) = 0.5;
+        MetaData md;
+        Projection P;
+        for (int n = 0; n < 30; ++n)
+        {
+            double rot = rnd_unif(0, 360), tilt = RAD2DEG(acos(rnd_unif(-1, 1))), psi = rnd_unif(0, 360);
+            projectVolume(V, P, size, size, rot, tilt, psi);
+            FileName fnImg;
+            fnImg.compose(n+1, fnStack);
+            P.write(fnImg, ALL_IMAGES, true, WRITE_REPLACE);
+            size_t id = md.addObject();
+            md.setValue(MDL_IMAGE, fnImg, id);
+            md.setValue(MDL_ANGLE_ROT, rot, id);
+            md.setValue(MDL_ANGLE_TILT, tilt, id);
+            md.setValue(MDL_ANGLE_PSI, psi, id);
+        }
+        md.write(fnMd);
+    }
+
+    virtual void TearDown()
+    {
+        for (size_t n = 0; n < outputs.size(); ++n)
+        {
+            outputs[n].deleteFile();
+            outputs[n].withoutExtension().addExtension("hist").deleteFile();
+        }
+        fnStack.deleteFile();
+        fnMd.deleteFile();
+        fnRoot.deleteFile();
+    }
+
+    // Reconstruct the projections with the given extra arguments
+    void reconstruct(const FileName &fnVol, const std::vector<String> &extra, Image<double> &Vrec)
+    {
+        std::vector<const char *> argv;
+        argv.push_back("xmipp_reconstruct_art");
+        argv.push_back("-i");
+        argv.push_back(fnMd.c_str());
+        argv.push_back("-o");
+        argv.push_back(fnVol.c_str());
+        argv.push_back("-v");
+        argv.push_back("0");
+        for (size_t n = 0; n < extra.size(); ++n)
+            argv.push_back(extra[n].c_str());
+        outputs.push_back(fnVol);
+        ProgReconsART prog;
+        prog.read((int)argv.size(), &argv[0]);
+        prog.run();
+        Vrec.read(fnVol);
+    }
+
+    // Global mean squared error of each iteration and iteration at which
+    // the convergence stop was reported (-1 if none) from the history file
+    void readHistory(const FileName &fnVol, std::vector<double> &errors, int &stopIteration)
+    {
+        std::ifstream fh(fnVol.withoutExtension().addExtension("hist").c_str());
+        String line;
+        String errorTag = "Global mean squared error:";
+        String stopTag = "stopping at iteration";
+        stopIteration = -1;
+        while (getline(fh, line))
+        {
+            size_t pos = line.find(errorTag);
+            if (pos != String::npos && line.find("POCS") == String::npos)
+                errors.push_back(textToFloat(line.substr(pos + errorTag.size())));
+            pos = line.find(stopTag);
+            if (pos != String::npos)
+                stopIteration = textToInteger(line.substr(pos + stopTag.size()));
+        }
+    }
+
+    FileName fnRoot, fnStack, fnMd;
+    std::vector<FileName> outputs;
+};
+
+// Blocks of one projection apply each correction before the next
+// projection, which is ART
+TEST_F(ReconstructArtTest, ossirtBlock1IsArt)
+{
+    Image<double> Vart, Vossirt;
+    std::vector<String> args;
+    args.push_back("-n");
+    args.push_back("2");
+    args.push_back("-l");
+    args.push_back("0.1");
+    reconstruct(fnRoot + "_art.vol", args, Vart);
+    args.push_back("--parallel_mode");
+    args.push_back("OSSIRT");
+    args.push_back("--block_size");
+    args.push_back("1");
+    reconstruct(fnRoot + "_ossirt.vol", args, Vossirt);
+
+    ASSERT_TRUE(Vart().sameShape(Vossirt()));
+    double maxV = Vart().computeMax();
+    ASSERT_GT(maxV, 0);
+    FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Vart())
+    ASSERT_NEAR(DIRECT_MULTIDIM_ELEM(Vart(),n), DIRECT_MULTIDIM_ELEM(Vossirt(),n), 1e-12*maxV);
+}
+
+// With blocks of several projections the residual decreases at each
+// iteration until its relative decrease goes below --stop_tol
+TEST_F(ReconstructArtTest, ossirtConvergence)
+{
+    double tolerance = 0.05;
+    int iterations = 40;
+    Image<double> Vrec;
+    std::vector<String> args;
+    args.push_back("-n");
+    args.push_back(integerToString(iterations));
+    args.push_back("-l");
+    args.push_back("0.2");
+    args.push_back("--parallel_mode");
+    args.push_back("OSSIRT");
+    args.push_back("--block_size");
+    args.push_back("10");
+    args.push_back("--thr");
+    args.push_back("2");
+    args.push_back("--stop_tol");
+    args.push_back("0.05");
+    FileName fnVol = fnRoot + "_ossirt.vol";
+    reconstruct(fnVol, args, Vrec);
+
+    std::vector<double> errors;
+    int stopIteration;
+    readHistory(fnVol, errors, stopIteration);
+    ASSERT_GE(errors.size(), (size_t)3);
+    ASSERT_EQ(stopIteration + 1, (int)errors.size());
+    ASSERT_LT((int)errors.size(), iterations);
+    for (size_t it = 1; it < errors.size(); ++it)
+    {
+        ASSERT_LT(errors[it], errors[it-1]) << "iteration " << it;
+        double decrease = (errors[it-1] - errors[it]) / errors[it-1];
+        if (it + 1 < errors.size())
+            EXPECT_GE(decrease, tolerance) << "iteration " << it;
+        else
+            EXPECT_LT(decrease, tolerance) << "iteration " << it;
+    }
+}
+
+GTEST_API_ int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
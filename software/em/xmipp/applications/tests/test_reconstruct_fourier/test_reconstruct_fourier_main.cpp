@@ -0,0 +1,366 @@
+#include <reconstruction/reconstruct_fourier.h>
+#include <reconstruction/fourier_projection.h>
+#include <data/xmipp_funcs.h>
+#include <iostream>
+#include <gtest/gtest.h>
+
+class ReconstructFourierTest : public ::testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        // Blob table sampled in squared distances as in ProgRecFourier
+        blob.radius = 1.9;
+        blob.order = 0;
+        blob.alpha = 15;
+        blobTableSqrt.resize(BLOB_TABLE_SIZE_SQRT);
+        double deltaSqrt = (blob.radius*blob.radius)/(BLOB_TABLE_SIZE_SQRT-1);
+        FOR_ALL_ELEMENTS_IN_MATRIX1D(blobTableSqrt)
+        VEC_ELEM(blobTableSqrt,i) = blob_val(sqrt(deltaSqrt*i), blob);
+        iDeltaSqrt = 1/deltaSqrt;
+    }
+
+    // Straightforward gridding of a sample with the exact blob
+    void addSampleReference(MultidimArray< std::complex<double> > &V, MultidimArray<double> &W,
+                            double px, double py, double pz, double re, double im, double weight)
+    {
+        int zsize = ZSIZE(V), ysize = YSIZE(V), xsize = 2*(XSIZE(V)-1);
+        for (int intz = CEIL(pz-blob.radius); intz <= FLOOR(pz+blob.radius); ++intz)
+            for (int inty = CEIL(py-blob.radius); inty <= FLOOR(py+blob.radius); ++inty)
+                for (int intx = CEIL(px-blob.radius); intx <= FLOOR(px+blob.radius); ++intx)
+                {
+                    double d2 = (intx-px)*(intx-px)+(inty-py)*(inty-py)+(intz-pz)*(intz-pz);
+                    if (d2 > blob.radius*blob.radius)
+                        continue;
+                    double b = blob_val(sqrt(d2), blob);
+                    int ix = intWRAP(intx, 0, xsize-1), iy = intWRAP(inty, 0, ysize-1), iz = intWRAP(intz, 0, zsize-1);
+                    double sign = 1;
+                    if (ix >= (int)XSIZE(V))
+                    {
+                        ix = intWRAP(-ix, 0, xsize-1);
+                        iy = intWRAP(-iy, 0, ysize-1);
+                        iz = intWRAP(-iz, 0, zsize-1);
+                        sign = -1;
+                    }
+                    DIRECT_A3D_ELEM(V,iz,iy,ix) += std::complex<double>(b*re, sign*b*im);
+                    DIRECT_A3D_ELEM(W,iz,iy,ix) += b*weight;
+                }
+    }
+
+    // Random positions within the sphere of radius size/2 of the volume
+    void randomSamples(int N, int size, std::vector<double> &positions)
+    {
+        positions.resize(3*N);
+        for (int n = 0; n < N; ++n)
+        {
+            double x, y, z;
+            do
+            {
+                x = rnd_unif(-0.5, 0.5);
+                y = rnd_unif(-0.5, 0.5);
+                z = rnd_unif(-0.5, 0.5);
+            }
+            while (x*x+y*y+z*z > 0.25);
+            positions[3*n] = (x < 0) ? size*(x+1) : size*x;
+            positions[3*n+1] = (y < 0) ? size*(y+1) : size*y;
+            positions[3*n+2] = (z < 0) ? size*(z+1) : size*z;
+        }
+    }
+
+    struct blobtype blob;
+    Matrix1D<double> blobTableSqrt;
+    double iDeltaSqrt;
+};
+
+TEST_F(ReconstructFourierTest, griddingKernel)
+{
+    int size = 32;
+    FourierGriddingKernel kernel;
+    kernel.initialize(blobTableSqrt, iDeltaSqrt, blob.radius, size, size, size);
+    MultidimArray< std::complex<double> > V, Vref;
+    MultidimArray<double> W, Wref, Wv;
+    V.initZeros(size, size, size/2+1);
+    Vref.initZeros(V);
+    W.initZeros(V);
+    Wref.initZeros(V);
+    Wv.initZeros(V);
+
+    init_random_generator(1);
+    std::vector<double> positions;
+    randomSamples(500, size, positions);
+    for (size_t n = 0; n < positions.size(); n += 3)
+    {
+        double re = rnd_unif(-1, 1), im = rnd_unif(-1, 1), weight = rnd_unif(0.5, 1);
+        kernel.addSample(V, W, positions[n], positions[n+1], positions[n+2], re, im, weight);
+        addSampleReference(Vref, Wref, positions[n], positions[n+1], positions[n+2], re, im, weight);
+        kernel.addWeight(Wv, NULL, positions[n], positions[n+1], positions[n+2], weight);
+    }
+    // The table is sampled in squared distances
+    double maxW = Wref.computeMax();
+    FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(W)
+    {
+        ASSERT_NEAR(DIRECT_MULTIDIM_ELEM(W,n), DIRECT_MULTIDIM_ELEM(Wref,n), 1e-3*maxW);
+        ASSERT_NEAR(DIRECT_MULTIDIM_ELEM(Wv,n), DIRECT_MULTIDIM_ELEM(W,n), 1e-12*maxW);
+        ASSERT_NEAR(abs(DIRECT_MULTIDIM_ELEM(V,n)-DIRECT_MULTIDIM_ELEM(Vref,n)), 0, 1e-3*maxW);
+    }
+
+    // Weights multiplied by the real part of a volume
+    MultidimArray<double> Wr;
+    Wr.initZeros(W);
+    Wv.initZeros();
+    FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(V)
+    DIRECT_MULTIDIM_ELEM(V,n) = std::complex<double>(n%7, 1);
+    for (size_t n = 0; n < positions.size(); n += 3)
+    {
+        kernel.addWeight(Wv, NULL, positions[n], positions[n+1], positions[n+2], 1);
+        kernel.addWeight(Wr, &V, positions[n], positions[n+1], positions[n+2], 1);
+    }
+    FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Wr)
+    ASSERT_NEAR(DIRECT_MULTIDIM_ELEM(Wr,n), (n%7)*DIRECT_MULTIDIM_ELEM(Wv,n), 1e-12*maxW);
+}
+
+// Gridding slab by slab gives the same volume as gridding the whole volume,
+// also for the samples whose Hermitian pairs are in other slabs
+TEST_F(ReconstructFourierTest, griddingKernelSlabs)
+{
+    int size = 32;
+    FourierGriddingKernel kernel;
+    kernel.initialize(blobTableSqrt, iDeltaSqrt, blob.radius, size, size, size);
+    MultidimArray< std::complex<double> > V, Vslab;
+    MultidimArray<double> W, Wslab, Wv, Wvslab;
+    V.initZeros(size, size, size/2+1);
+    Vslab.initZeros(V);
+    W.initZeros(V);
+    Wslab.initZeros(V);
+    Wv.initZeros(V);
+    Wvslab.initZeros(V);
+
+    init_random_generator(2);
+    std::vector<double> positions;
+    randomSamples(500, size, positions);
+    for (size_t n = 0; n < positions.size(); n += 3)
+        kernel.addSample(V, W, positions[n], positions[n+1], positions[n+2], n%5, n%3, 1);
+    for (size_t n = 0; n < positions.size(); n += 3)
+        kernel.addWeight(Wv, &V, positions[n], positions[n+1], positions[n+2], 1);
+    int slabSize = 7;
+    for (int z0 = 0; z0 < size; z0 += slabSize)
+    {
+        kernel.setSlab(z0, XMIPP_MIN(z0+slabSize, size)-1);
+        for (size_t n = 0; n < positions.size(); n += 3)
+        {
+            kernel.addSample(Vslab, Wslab, positions[n], positions[n+1], positions[n+2], n%5, n%3, 1);
+            kernel.addWeight(Wvslab, &V, positions[n], positions[n+1], positions[n+2], 1);
+        }
+    }
+    FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(W)
+    {
+        ASSERT_EQ(DIRECT_MULTIDIM_ELEM(W,n), DIRECT_MULTIDIM_ELEM(Wslab,n));
+        ASSERT_EQ(DIRECT_MULTIDIM_ELEM(V,n), DIRECT_MULTIDIM_ELEM(Vslab,n));
+        ASSERT_EQ(DIRECT_MULTIDIM_ELEM(Wv,n), DIRECT_MULTIDIM_ELEM(Wvslab,n));
+    }
+}
+
+// The batch of projections is the same as projecting angle by angle,
+// with and without CTF and for any number of threads
+TEST_F(ReconstructFourierTest, projectBatch)
+{
+    int size = 32;
+    MultidimArray<double> V;
+    V.initZeros(size, size, size);
+    V.setXmippOrigin();
+    init_random_generator(3);
+    V.initRandom(0, 1);
+    FourierProjector projector(V, 2, 0.5, BSPLINE3);
+
+    int Nangles = 7;
+    Matrix2D<double> angles(Nangles, 3);
+    for (int n = 0; n < Nangles; ++n)
+    {
+        MAT_ELEM(angles,n,0) = 37*n;
+        MAT_ELEM(angles,n,1) = 23*n;
+        MAT_ELEM(angles,n,2) = 11*n;
+    }
+    MultidimArray<double> ctf;
+    ctf.resizeNoCopy(projector.projectionFourier);
+    FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(ctf)
+    DIRECT_MULTIDIM_ELEM(ctf,n) = 1-(n%5)*0.1;
+    std::vector< MultidimArray<double> > ctfs(1, ctf);
+
+    Projection P;
+    MultidimArray<double> stack, projection;
+    for (int thr = 1; thr <= 3; thr += 2)
+        for (int withCtf = 0; withCtf < 2; ++withCtf)
+        {
+            projector.projectBatch(angles, stack, thr, withCtf ? &ctfs : NULL);
+            ASSERT_EQ(NSIZE(stack), (size_t)Nangles);
+            for (int n = 0; n < Nangles; ++n)
+            {
+                projectVolume(projector, P, size, size, MAT_ELEM(angles,n,0), MAT_ELEM(angles,n,1),
+                              MAT_ELEM(angles,n,2), withCtf ? &ctf : NULL);
+                projection.aliasImageInStack(stack, n);
+                FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(projection)
+                ASSERT_NEAR(DIRECT_MULTIDIM_ELEM(projection,n), DIRECT_MULTIDIM_ELEM(P(),n), 1e-12);
+            }
+        }
+}
+
+// The fast slice modes interpolate the centered Fourier transform of the
+// padded volume: NEAREST takes the closest voxel and LINEAR is the
+// trilinear interpolation of interpolatedElement3D. The volume is kept in
+// single precision, hence the tolerance relative to its largest coefficient.
+TEST_F(ReconstructFourierTest, projectSliceModes)
+{
+    int size = 24;
+    double padding = 2, maxFreq = 0.4;
+    MultidimArray<double> V;
+    V.initZeros(size, size, size);
+    V.setXmippOrigin();
+    init_random_generator(5);
+    V.initRandom(0, 1);
+
+    // Transform of the padded volume, as prepared by FourierProjector
+    int paddedDim = (int)(padding*size);
+    MultidimArray<double> Vpadded;
+    V.window(Vpadded, FIRST_XMIPP_INDEX(paddedDim), FIRST_XMIPP_INDEX(paddedDim), FIRST_XMIPP_INDEX(paddedDim),
+             LAST_XMIPP_INDEX(paddedDim), LAST_XMIPP_INDEX(paddedDim), LAST_XMIPP_INDEX(paddedDim));
+    FourierTransformer transformer;
+    MultidimArray< std::complex<double> > Vfourier;
+    transformer.completeFourierTransform(Vpadded, Vfourier);
+    ShiftFFT(Vfourier, FIRST_XMIPP_INDEX(paddedDim), FIRST_XMIPP_INDEX(paddedDim), FIRST_XMIPP_INDEX(paddedDim));
+    CenterFFT(Vfourier, true);
+    double K = (double)paddedDim*paddedDim*paddedDim/((double)size*size);
+    double maxAbs = 0;
+    FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Vfourier)
+    {
+        DIRECT_MULTIDIM_ELEM(Vfourier,n) *= K;
+        maxAbs = XMIPP_MAX(maxAbs, abs(DIRECT_MULTIDIM_ELEM(Vfourier,n)));
+    }
+    MultidimArray<double> Vre, Vim;
+    Complex2RealImag(Vfourier, Vre, Vim);
+    Vre.setXmippOrigin();
+    Vim.setXmippOrigin();
+    double tolerance = 1e-5*maxAbs;
+
+    for (int degree = NEAREST; degree <= LINEAR; ++degree)
+    {
+        MultidimArray<double> Vaux = V;
+        FourierProjector projector(Vaux, padding, maxFreq, degree);
+        ASSERT_EQ(2*MULTIDIM_SIZE(Vre), MULTIDIM_SIZE(projector.VfourierFloat));
+        Matrix2D<double> E;
+        MultidimArray< std::complex<double> > projFourier;
+        projFourier.resizeNoCopy(projector.projectionFourier);
+        for (int n = 0; n < 5; ++n)
+        {
+            projector.projectFourier(37*n+3, 23*n+5, 11*n+7, E, projFourier);
+            double E00 = MAT_ELEM(E,0,0)*paddedDim, E01 = MAT_ELEM(E,0,1)*paddedDim, E02 = MAT_ELEM(E,0,2)*paddedDim;
+            double E10 = MAT_ELEM(E,1,0)*paddedDim, E11 = MAT_ELEM(E,1,1)*paddedDim, E12 = MAT_ELEM(E,1,2)*paddedDim;
+            for (size_t s = 0; s < projector.sliceSamples.size(); ++s)
+            {
+                const FourierProjector::SliceSample &sample = projector.sliceSamples[s];
+                double x = E00*sample.freqx+E10*sample.freqy;
+                double y = E01*sample.freqx+E11*sample.freqy;
+                double z = E02*sample.freqx+E12*sample.freqy;
+                double c = 0, d = 0;
+                if (degree == NEAREST)
+                {
+                    int k = (int)round(z), i = (int)round(y), j = (int)round(x);
+                    if (!Vre.outside(k, i, j))
+                    {
+                        c = A3D_ELEM(Vre,k,i,j);
+                        d = A3D_ELEM(Vim,k,i,j);
+                    }
+                }
+                else
+                {
+                    c = Vre.interpolatedElement3D(x, y, z);
+                    d = Vim.interpolatedElement3D(x, y, z);
+                }
+                std::complex<double> expected = std::complex<double>(c, d)*std::complex<double>(sample.a, sample.b);
+                const std::complex<double> &value = DIRECT_MULTIDIM_ELEM(projFourier,sample.n);
+                ASSERT_NEAR(real(expected), real(value), tolerance) << "degree " << degree << " sample " << s;
+                ASSERT_NEAR(imag(expected), imag(value), tolerance) << "degree " << degree << " sample " << s;
+            }
+        }
+    }
+}
+
+// Applying the symmetry to the accumulated volume gives the same
+// reconstruction as inserting every symmetric copy of the projections, for
+// cyclic, dihedral, octahedral and icosahedral groups. It is exact up to the
+// blob sampling when the symmetry maps the Fourier grid onto itself
+TEST_F(ReconstructFourierTest, symmetrizeVolume)
+{
+    int size = 32;
+    FileName fnRoot;
+    fnRoot.initUniqueName("/tmp/temp_recfourier_XXXXXX");
+    FileName fnStack = fnRoot + ".stk", fnMd = fnRoot + ".xmd";
+    FileName fnVol = fnRoot + ".vol", fnVolSym = fnRoot + "_sym.vol";
+
+    init_random_generator(4);
+    MultidimArray<double> V;
+    V.initZeros(size, size, size);
+    V.setXmippOrigin();
+    FOR_ALL_ELEMENTS_IN_ARRAY3D(V)
+    if (k*k+i*i+j*j < 100)
+        A3D_ELEM(V,k,i,j) = rnd_unif(0, 1);
+    MetaData md;
+    Projection P;
+    for (int n = 0; n < 20; ++n)
+    {
+        double rot = rnd_unif(0, 360), tilt = rnd_unif(0, 180), psi = rnd_unif(0, 360);
+        projectVolume(V, P, size, size, rot, tilt, psi);
+        FileName fnImg;
+        fnImg.compose(n+1, fnStack);
+        P.write(fnImg, ALL_IMAGES, true, WRITE_REPLACE);
+        size_t id = md.addObject();
+        md.setValue(MDL_IMAGE, fnImg, id);
+        md.setValue(MDL_ANGLE_ROT, rot, id);
+        md.setValue(MDL_ANGLE_TILT, tilt, id);
+        md.setValue(MDL_ANGLE_PSI, psi, id);
+    }
+    md.write(fnMd);
+
+    // The rotations of c4, d4 and o map the Fourier grid onto itself. Those of
+    // d3 and i1 do not, and the accumulated data are interpolated trilinearly
+    // (about 5% of the maximum for this phantom, whose spectrum is white)
+    const char *symmetries[] = { "c4", "d4", "o", "d3", "i1" };
+    double tolerances[] = { 1e-2, 1e-2, 1e-2, 1e-1, 1e-1 };
+    for (int s = 0; s < 5; ++s)
+    {
+        for (int symmetrize = 0; symmetrize < 2; ++symmetrize)
+        {
+            const char *argv[] = { "xmipp_reconstruct_fourier", "-i", fnMd.c_str(), "-o",
+                                   symmetrize ? fnVolSym.c_str() : fnVol.c_str(), "--sym", symmetries[s],
+                                   "--thr", "2", "-v", "0", "--symmetrize_volume" };
+            ProgRecFourier prog;
+            prog.read(symmetrize ? 12 : 11, argv);
+            prog.run();
+        }
+
+        Image<double> Vrec, VrecSym;
+        Vrec.read(fnVol);
+        VrecSym.read(fnVolSym);
+        ASSERT_TRUE(Vrec().sameShape(VrecSym()));
+        // Even if the grid is preserved, the blob is evaluated at the rotated
+        // samples and its table is sampled, so both volumes only agree up to
+        // a fraction of their maximum (the volume without symmetry differs by
+        // more than 40%)
+        double maxV = Vrec().computeMax();
+        ASSERT_GT(maxV, 0);
+        FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Vrec())
+        ASSERT_NEAR(DIRECT_MULTIDIM_ELEM(Vrec(),n), DIRECT_MULTIDIM_ELEM(VrecSym(),n), tolerances[s]*maxV)
+        << "Symmetry " << symmetries[s];
+    }
+
+    fnStack.deleteFile();
+    fnMd.deleteFile();
+    fnVol.deleteFile();
+    fnVolSym.deleteFile();
+    fnRoot.deleteFile();
+}
+
+GTEST_API_ int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
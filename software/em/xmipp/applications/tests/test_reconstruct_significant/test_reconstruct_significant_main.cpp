@@ -0,0 +1,171 @@
+#include <reconstruction/reconstruct_significant.h>
+#include <data/projection.h>
+#include <data/xmipp_funcs.h>
+#include <iostream>
+#include <set>
+#include <gtest/gtest.h>
+
+class ReconstructSignificantTest : public ::testing::Test
+{
+protected:
+    // Gallery of projections of a small phantom in a grid of directions and
+    // noisy, rotated and shifted projections in random directions as input
+    virtual void SetUp()
+    {
+        int size = 32;
+        fnRoot.initUniqueName("/tmp/temp_significant_XXXXXX");
+        fnDir = fnRoot + "_dir";
+        fnDir.makePath();
+        fnGallery = fnRoot + "_gallery.doc";
+        fnGalleryStack = fnGallery.replaceExtension("stk");
+        fnStack = fnRoot + "_images.stk";
+        fnMd = fnRoot + "_images.xmd";
+
+        init_random_generator(5);
+        MultidimArray<double> V;
+        V.initZeros(size, size, size);
+        V.setXmippOrigin();
+        FOR_ALL_ELEMENTS_IN_ARRAY3D(V)
+        if ((k*k)/64.0+(i*i)/25.0+(j*j)/9.0 < 1)
+            A3D_ELEM(V,k,i,j) = 1;
+        else if ((k-5)*(k-5)+(i+4)*(i+4)+(j-3)*(j-3) < 9)
+            A3D_ELEM(V,k,i,j) = 2;
+
+        MetaData md;
+        Projection P;
+        size_t nGallery = 0;
+        for (double tilt = 0; tilt <= 90; tilt += 30)
+            for (double rot = 0; rot < 360; rot += (tilt == 0) ? 360 : 30)
+            {
+                projectVolume(V, P, size, size, rot, tilt, 0);
+                FileName fnImg;
+                fnImg.compose(++nGallery, fnGalleryStack);
+                P.write(fnImg, ALL_IMAGES, true, WRITE_REPLACE);
+                size_t id = md.addObject();
+                md.setValue(MDL_IMAGE, fnImg, id);
+                md.setValue(MDL_ANGLE_ROT, rot, id);
+                md.setValue(MDL_ANGLE_TILT, tilt, id);
+            }
+        md.write(fnGallery);
+
+        md.clear();
+        for (int n = 0; n < 8; ++n)
+        {
+            double rot = rnd_unif(0, 360), tilt = rnd_unif(0, 90), psi = rnd_unif(0, 360);
+            Matrix1D<double> offset = vectorR3(rnd_unif(-2, 2), rnd_unif(-2, 2), 0.0);
+            projectVolume(V, P, size, size, rot, tilt, psi, &offset);
+            P().addNoise(0, 0.5, "gaussian");
+            FileName fnImg;
+            fnImg.compose(n+1, fnStack);
+            P.write(fnImg, ALL_IMAGES, true, WRITE_REPLACE);
+            md.setValue(MDL_IMAGE, fnImg, md.addObject());
+        }
+        md.write(fnMd);
+    }
+
+    virtual void TearDown()
+    {
+        fnGallery.deleteFile();
+        fnGalleryStack.deleteFile();
+        fnStack.deleteFile();
+        fnMd.deleteFile();
+        String cmd = (String)"rm -rf " + fnDir;
+        if (system(cmd.c_str()) != 0)
+            std::cerr << "Cannot remove " << fnDir << std::endl;
+        fnRoot.deleteFile();
+    }
+
+    // Align the input images to the gallery as in the first iteration
+    void align(ProgReconstructSignificant &prog, int threads, bool coarseSearch)
+    {
+        String thr = integerToString(threads);
+        std::vector<const char *> argv;
+        argv.push_back("xmipp_reconstruct_significant");
+        argv.push_back("-i");
+        argv.push_back(fnMd.c_str());
+        argv.push_back("--initgallery");
+        argv.push_back(fnGallery.c_str());
+        argv.push_back("--odir");
+        argv.push_back(fnDir.c_str());
+        argv.push_back("--alpha0");
+        argv.push_back("0.1");
+        argv.push_back("--dontReconstruct");
+        argv.push_back("--thr");
+        argv.push_back(thr.c_str());
+        if (coarseSearch)
+            argv.push_back("--coarseSearch");
+        prog.read((int)argv.size(), &argv[0]);
+        prog.verbose = 0;
+        prog.produceSideinfo();
+        prog.iter = 1;
+        prog.generateProjections();
+        prog.cc.initZeros(prog.mdIn.size(), prog.mdGallery.size(), prog.mdGallery[0].size());
+        prog.weight = prog.cc;
+        prog.currentAlpha = prog.alpha0;
+        prog.alignImagesToGallery();
+    }
+
+    // Image index and gallery direction of the significant assignments
+    void significantSet(ProgReconstructSignificant &prog, std::set< std::pair<size_t,int> > &significant)
+    {
+        MetaData &md = prog.mdReconstructionPartial[0];
+        size_t nImg;
+        int nDir;
+        FOR_ALL_OBJECTS_IN_METADATA(md)
+        {
+            md.getValue(MDL_IMAGE_IDX, nImg, __iter.objId);
+            md.getValue(MDL_REF, nDir, __iter.objId);
+            significant.insert(std::make_pair(nImg, nDir));
+        }
+    }
+
+    FileName fnRoot, fnDir, fnGallery, fnGalleryStack, fnStack, fnMd;
+};
+
+// The output metadatas do not depend on the number of threads
+TEST_F(ReconstructSignificantTest, alignThreads)
+{
+    ProgReconstructSignificant prog1;
+    align(prog1, 1, false);
+    ASSERT_GT(prog1.mdReconstructionPartial[0].size(), prog1.mdIn.size());
+    ASSERT_GT(prog1.mdReconstructionProjectionMatching[0].size(), (size_t)0);
+
+    ProgReconstructSignificant prog3;
+    align(prog3, 3, false);
+    EXPECT_TRUE(prog1.mdReconstructionPartial[0] == prog3.mdReconstructionPartial[0]);
+    EXPECT_TRUE(prog1.mdReconstructionProjectionMatching[0] == prog3.mdReconstructionProjectionMatching[0]);
+    ASSERT_TRUE(prog1.cc.sameShape(prog3.cc));
+    FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(prog1.cc)
+    {
+        ASSERT_EQ(DIRECT_MULTIDIM_ELEM(prog1.cc,n), DIRECT_MULTIDIM_ELEM(prog3.cc,n));
+        ASSERT_EQ(DIRECT_MULTIDIM_ELEM(prog1.weight,n), DIRECT_MULTIDIM_ELEM(prog3.weight,n));
+    }
+}
+
+// The coarse search only skips directions that would not be significant
+TEST_F(ReconstructSignificantTest, coarseSearch)
+{
+    ProgReconstructSignificant progFull, progCoarse;
+    align(progFull, 1, false);
+    align(progCoarse, 2, true);
+
+    std::set< std::pair<size_t,int> > significantFull, significantCoarse;
+    significantSet(progFull, significantFull);
+    significantSet(progCoarse, significantCoarse);
+    ASSERT_FALSE(significantFull.empty());
+    EXPECT_TRUE(significantFull == significantCoarse);
+
+    // The correlations of the skipped directions are those of the coarse search
+    size_t skipped = 0;
+    FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(progFull.cc)
+    if (DIRECT_MULTIDIM_ELEM(progFull.cc,n) != DIRECT_MULTIDIM_ELEM(progCoarse.cc,n))
+        ++skipped;
+    EXPECT_GT(skipped, (size_t)0);
+    EXPECT_TRUE(progFull.mdReconstructionProjectionMatching[0] == progCoarse.mdReconstructionProjectionMatching[0]);
+}
+
+GTEST_API_ int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,168 @@
+#include <reconstruction/reconstruct_wbp.h>
+#include <data/xmipp_funcs.h>
+#include <iostream>
+#include <gtest/gtest.h>
+
+class ReconstructWbpTest : public ::testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        init_random_generator(1);
+    }
+
+    // Random projection directions with random counts
+    void randomMatrices(ProgRecWbp &prog, int N)
+    {
+        prog.no_mats = N;
+        prog.mat_g = (WBPInfo*) malloc(N * sizeof(WBPInfo));
+        prog.mat_f = (WBPInfo*) malloc(N * sizeof(WBPInfo));
+        for (int k = 0; k < N; k++)
+        {
+            double rot = rnd_unif(0, 360), tilt = rnd_unif(0, 180);
+            Matrix1D<double> v;
+            Euler_direction(rot, tilt, 0, v);
+            prog.mat_g[k].x = XX(v);
+            prog.mat_g[k].y = YY(v);
+            prog.mat_g[k].z = ZZ(v);
+            prog.mat_g[k].count = rnd_unif(1, 5);
+        }
+    }
+
+    // Filter of a projection computed pixel by pixel in a single thread
+    void referenceFilter(const ProgRecWbp &prog, const Projection &proj, const Tabsinc &TSINC,
+                         MultidimArray<double> &divisor, int &count_thr)
+    {
+        Matrix2D<double> A;
+        Euler_angles2matrix(-proj.rot(), proj.tilt(), -proj.psi(), A);
+        divisor.resizeNoCopy(proj());
+        count_thr = 0;
+        double K = ((double) prog.diameter) / prog.dim;
+        FOR_ALL_ELEMENTS_IN_ARRAY2D(divisor)
+        {
+            double y = K * i, x = K * j, weight = 0;
+            for (int k = 0; k < prog.no_mats; k++)
+            {
+                double fx = MAT_ELEM(A,0,0) * prog.mat_g[k].x + MAT_ELEM(A,1,0) * prog.mat_g[k].y +
+                            MAT_ELEM(A,2,0) * prog.mat_g[k].z;
+                double fy = MAT_ELEM(A,0,1) * prog.mat_g[k].x + MAT_ELEM(A,1,1) * prog.mat_g[k].y +
+                            MAT_ELEM(A,2,1) * prog.mat_g[k].z;
+                double argum = x * fx + y * fy, daux;
+                TSINCVALUE(TSINC, argum, daux);
+                weight += prog.mat_g[k].count * daux;
+            }
+            if (fabs(weight) < prog.threshold)
+            {
+                count_thr++;
+                A2D_ELEM(divisor, i, j) = SGN(weight) * (prog.threshold * prog.diameter);
+            }
+            else
+                A2D_ELEM(divisor, i, j) = weight * prog.diameter;
+        }
+    }
+};
+
+// The threaded filter, which mirrors the rows, is the same as the filter
+// computed pixel by pixel, for odd and even image sizes
+TEST_F(ReconstructWbpTest, filterThreads)
+{
+    for (int size = 31; size <= 32; size++)
+    {
+        ProgRecWbp prog;
+        prog.dim = size;
+        prog.diameter = size;
+        prog.threshold = 0.5;
+        prog.filterCacheSize = 1;
+        randomMatrices(prog, 40);
+        prog.Nthreads = 3;
+        prog.thMgr = new ThreadManager(prog.Nthreads, &prog);
+        Tabsinc TSINC(0.0001, size);
+
+        Projection proj;
+        proj().initZeros(size, size);
+        proj().setXmippOrigin();
+        proj().initRandom(0, 1);
+        proj.setEulerAngles(30, 60, 10);
+        prog.filterOneImage(proj, TSINC);
+        ASSERT_EQ(prog.filterCache.size(), (size_t)1);
+        const WBPFilter &filter = prog.filterCache.begin()->second;
+
+        MultidimArray<double> divisor;
+        int count_thr;
+        referenceFilter(prog, proj, TSINC, divisor, count_thr);
+        ASSERT_TRUE(divisor.sameShape(filter.divisor));
+        FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(divisor)
+        ASSERT_EQ(DIRECT_MULTIDIM_ELEM(divisor,n), DIRECT_MULTIDIM_ELEM(filter.divisor,n));
+        ASSERT_EQ(count_thr, filter.count_thr);
+        ASSERT_GT(count_thr, 0);
+        free(prog.mat_g);
+        free(prog.mat_f);
+    }
+}
+
+// Backprojecting the images in batches gives the same volume as
+// backprojecting them one by one
+TEST_F(ReconstructWbpTest, batch)
+{
+    int size = 32;
+    FileName fnRoot;
+    fnRoot.initUniqueName("/tmp/temp_wbp_XXXXXX");
+    FileName fnStack = fnRoot + ".stk", fnMd = fnRoot + ".xmd";
+    FileName fnVol1 = fnRoot + "_1.vol", fnVolBatch = fnRoot + "_batch.vol";
+
+    MultidimArray<double> V;
+    V.initZeros(size, size, size);
+    V.setXmippOrigin();
+    FOR_ALL_ELEMENTS_IN_ARRAY3D(V)
+    if (k*k+i*i+j*j < 100)
+        A3D_ELEM(V,k,i,j) = rnd_unif(0, 1);
+    MetaData md;
+    Projection P;
+    for (int n = 0; n < 24; ++n)
+    {
+        // Some directions are repeated to use the cached filters
+        double rot = (n%9)*40, tilt = (n%9)*20+5, psi = (n%9)*30;
+        projectVolume(V, P, size, size, rot, tilt, psi);
+        FileName fnImg;
+        fnImg.compose(n+1, fnStack);
+        P.write(fnImg, ALL_IMAGES, true, WRITE_REPLACE);
+        size_t id = md.addObject();
+        md.setValue(MDL_IMAGE, fnImg, id);
+        md.setValue(MDL_ANGLE_ROT, rot, id);
+        md.setValue(MDL_ANGLE_TILT, tilt, id);
+        md.setValue(MDL_ANGLE_PSI, psi, id);
+    }
+    md.write(fnMd);
+
+    const char *argv1[] = { "xmipp_reconstruct_wbp", "-i", fnMd.c_str(), "-o", fnVol1.c_str(),
+                            "--sym", "c2", "-v", "0", "--batch", "1" };
+    ProgRecWbp prog1;
+    prog1.read(11, argv1);
+    prog1.run();
+    const char *argvBatch[] = { "xmipp_reconstruct_wbp", "-i", fnMd.c_str(), "-o", fnVolBatch.c_str(),
+                                "--sym", "c2", "-v", "0", "--batch", "7", "--thr", "3" };
+    ProgRecWbp progBatch;
+    progBatch.read(13, argvBatch);
+    progBatch.run();
+
+    Image<double> V1, Vbatch;
+    V1.read(fnVol1);
+    Vbatch.read(fnVolBatch);
+    ASSERT_TRUE(V1().sameShape(Vbatch()));
+    double maxV = V1().computeMax();
+    FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(V1())
+    ASSERT_NEAR(DIRECT_MULTIDIM_ELEM(V1(),n), DIRECT_MULTIDIM_ELEM(Vbatch(),n), 1e-12*maxV);
+    ASSERT_EQ(prog1.count_thr, progBatch.count_thr);
+
+    fnStack.deleteFile();
+    fnMd.deleteFile();
+    fnVol1.deleteFile();
+    fnVolBatch.deleteFile();
+    fnRoot.deleteFile();
+}
+
+GTEST_API_ int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -250,6 +250,190 @@ TEST_F(TransformationTest, str2TransformationMatrix)
 
 }
 
+TEST_F(TransformationTest, applyGeometryThreads)
+{
+    // The threads split the output rows, the result must not change
+    MultidimArray<double> V, out1, outN;
+    V.initZeros(64,64,64);
+    V.initRandom(0,1);
+    V.setXmippOrigin();
+    Matrix2D<double> A;
+    Euler_angles2matrix(30,45,60,A,true);
+    MAT_ELEM(A,0,3)=2.5;
+    MAT_ELEM(A,2,3)=-1.3;
+    for (int degree=NEAREST; degree<=BSPLINE3; degree+=2)
+    {
+        out1.clear();
+        outN.clear();
+        applyGeometry(degree, out1, V, A, IS_NOT_INV, DONT_WRAP, 0., 1);
+        applyGeometry(degree, outN, V, A, IS_NOT_INV, DONT_WRAP, 0., 4);
+        EXPECT_TRUE(out1.equal(outN, 0.));
+        applyGeometry(degree, out1, V, A, IS_NOT_INV, WRAP, 0., 1);
+        applyGeometry(degree, outN, V, A, IS_NOT_INV, WRAP, 0., 3);
+        EXPECT_TRUE(out1.equal(outN, 0.));
+    }
+
+    MultidimArray<double> I;
+    I.initZeros(512,512);
+    I.initRandom(0,1);
+    I.setXmippOrigin();
+    rotation2DMatrix(23, A);
+    for (int degree=LINEAR; degree<=BSPLINE3; degree+=2)
+    {
+        out1.clear();
+        outN.clear();
+        applyGeometry(degree, out1, I, A, IS_NOT_INV, DONT_WRAP, 0., 1);
+        applyGeometry(degree, outN, I, A, IS_NOT_INV, DONT_WRAP, 0., 4);
+        EXPECT_TRUE(out1.equal(outN, 0.));
+    }
+}
+
+TEST_F(TransformationTest, applyGeometryBatch)
+{
+    const size_t Ndim=7;
+    MultidimArray<double> stack, out, I(32,32), outn(32,32), Iout;
+    stack.initZeros(Ndim,1,32,32);
+    stack.initRandom(0,1);
+    std::vector< Matrix2D<double> > A(Ndim);
+    for (size_t n=0; n<Ndim; n++)
+    {
+        rotation2DMatrix(15.0*n, A[n]);
+        MAT_ELEM(A[n],0,2)=0.5*n;
+    }
+
+    for (int nThreads=1; nThreads<=3; nThreads+=2)
+    {
+        setApplyGeometryThreads(nThreads);
+        out.clear();
+        applyGeometryBatch(BSPLINE3, out, stack, A, IS_NOT_INV, DONT_WRAP);
+        ASSERT_EQ(NSIZE(out), Ndim);
+        for (size_t n=0; n<Ndim; n++)
+        {
+            stack.getImage(n, I);
+            Iout.clear();
+            applyGeometry(BSPLINE3, Iout, I, A[n], IS_NOT_INV, DONT_WRAP);
+            out.getImage(n, outn);
+            EXPECT_TRUE(Iout.equal(outn, 0.));
+        }
+    }
+    setApplyGeometryThreads(1);
+
+    A.pop_back();
+    EXPECT_THROW(applyGeometryBatch(BSPLINE3, out, stack, A, IS_NOT_INV, DONT_WRAP), XmippError);
+}
+
+TEST_F(TransformationTest, produceSplineCoefficientsThreads)
+{
+    MultidimArray<double> V, coeffs, expected;
+    V.initZeros(40,50,70);
+    V.initRandom(0,1);
+    V.setXmippOrigin();
+    for (int degree=2; degree<=3; degree++)
+    {
+        // Reference: the sequential bilib change of basis
+        expected.initZeros(V);
+        int Status;
+        ChangeBasisVolume(MULTIDIM_ARRAY(V), MULTIDIM_ARRAY(expected),
+                          XSIZE(V), YSIZE(V), ZSIZE(V),
+                          CardinalSpline, BasicSpline, degree,
+                          MirrorOffBounds, DBL_EPSILON, &Status);
+        for (int nThreads=1; nThreads<=3; nThreads+=2)
+        {
+            produceSplineCoefficients(degree, coeffs, V, nThreads);
+            EXPECT_TRUE(coeffs.equal(expected,0.)) << "B-spline coefficients of degree " << degree
+            << " with " << nThreads << " threads";
+        }
+    }
+
+    // Single images
+    MultidimArray<double> I;
+    I.initZeros(33,47);
+    I.initRandom(0,1);
+    I.setXmippOrigin();
+    expected.initZeros(I);
+    int Status;
+    ChangeBasisVolume(MULTIDIM_ARRAY(I), MULTIDIM_ARRAY(expected),
+                      XSIZE(I), YSIZE(I), 1, CardinalSpline, BasicSpline, 3,
+                      MirrorOffBounds, DBL_EPSILON, &Status);
+    produceSplineCoefficients(BSPLINE3, coeffs, I);
+    EXPECT_TRUE(coeffs.equal(expected,0.)) << "B-spline coefficients of an image";
+}
+
+TEST_F(TransformationTest, TransformationBuilder)
+{
+    MultidimArray<double> I, out1, out2;
+    I.initZeros(64,64);
+    I.initRandom(0,1);
+    I.setXmippOrigin();
+
+    // Rotation followed by a shift, interpolated once
+    TransformationBuilder T;
+    T.rotate(30).shift(2,-1);
+    Matrix2D<double> R, S;
+    rotation2DMatrix(30, R);
+    translation2DMatrix(vectorR2(2,-1), S);
+    Matrix2D<double> M=S*R;
+    EXPECT_TRUE(T.A.equal(M));
+    T.apply(BSPLINE3, out1, I, DONT_WRAP);
+    applyGeometry(BSPLINE3, out2, I, M, IS_NOT_INV, DONT_WRAP);
+    EXPECT_TRUE(out1.equal(out2, 0.));
+
+    // The inverse of the composition brings back the identity
+    T.matrix(M, IS_INV);
+    Matrix2D<double> Id;
+    Id.initIdentity(3);
+    EXPECT_TRUE(T.isTranslation());
+    EXPECT_TRUE(T.A.equal(Id));
+
+    // Integer shifts in Fourier space are exact
+    T.clear();
+    T.shift(3,-2);
+    T.apply(BSPLINE3, out1, I, WRAP);
+    FOR_ALL_ELEMENTS_IN_ARRAY2D(I)
+    EXPECT_NEAR(A2D_ELEM(out1,i,j),
+                A2D_ELEM(I,intWRAP(i+2,STARTINGY(I),FINISHINGY(I)),intWRAP(j-3,STARTINGX(I),FINISHINGX(I))),
+                1e-9);
+
+    // Subpixel shift of a smooth image in Fourier space
+    const double sigma=4, shiftX=1.5, shiftY=-0.7;
+    FOR_ALL_ELEMENTS_IN_ARRAY2D(I)
+    A2D_ELEM(I,i,j)=exp(-(i*i+j*j)/(2*sigma*sigma));
+    T.clear();
+    T.shift(shiftX,shiftY);
+    T.apply(BSPLINE3, out1, I, WRAP);
+    FOR_ALL_ELEMENTS_IN_ARRAY2D(I)
+    {
+        double x=j-shiftX, y=i-shiftY;
+        EXPECT_NEAR(A2D_ELEM(out1,i,j),exp(-(x*x+y*y)/(2*sigma*sigma)),1e-6);
+    }
+}
+
+// The shortcuts of TransformationBuilder agree with the interpolations
+// they replace on a smooth image
+TEST_F(TransformationTest, TransformationBuilderEquivalence)
+{
+    MultidimArray<double> I, out1, out2;
+    I.initZeros(128,128);
+    I.setXmippOrigin();
+    const double sigma=8;
+    FOR_ALL_ELEMENTS_IN_ARRAY2D(I)
+    A2D_ELEM(I,i,j)=exp(-(i*i+j*j)/(2*sigma*sigma));
+
+    // Subpixel shift in Fourier space and with B-splines
+    TransformationBuilder T;
+    T.shift(1.3,-2.4);
+    applyGeometry(BSPLINE3, out1, I, T.A, IS_NOT_INV, WRAP);
+    T.apply(BSPLINE3, out2, I, WRAP);
+    EXPECT_TRUE(out1.equal(out2, 1e-3));
+
+    // Shift and rotation in one or in two interpolations
+    T.rotate(23);
+    translate(BSPLINE3, out1, I, vectorR2(1.3,-2.4), WRAP);
+    selfRotate(BSPLINE3, out1, 23., 'Z', WRAP);
+    T.apply(BSPLINE3, out2, I, WRAP);
+    EXPECT_TRUE(out1.equal(out2, 1e-3));
+}
+
 /*
 
 
@@ -440,8 +440,21 @@ public class MetaData {
 
 	public native double[] getStatistics(boolean applyGeo, int label);
 
+	/** All values of a column, read with a single query */
 	public native double[] getColumnValues(int label);
 
+	public native int[] getColumnValuesInt(int label);
+
+	public native long[] getColumnValuesLong(int label);
+
+	/** Set all values of a column, the array should have one value per object
+	 * or the metadata should be empty */
+	public native void setColumnValuesDouble(int label, double[] values);
+
+	public native void setColumnValuesInt(int label, int[] values);
+
+	public native void setColumnValuesLong(int label, long[] values);
+
 	// set functions connection with MetaData class in C++
 	public boolean setEnabled(boolean value, long objId) {
 		
@@ -639,14 +639,57 @@ JNIEXPORT jdoubleArray JNICALL Java_xmipp_jni_MetaData_getColumnValues(JNIEnv *e
 
         // Copies vector into array.
         size_t size = values.size();
-        jdouble *body = new jdouble[size];
-        for (size_t i = 0; i < size; i++)
+        jdoubleArray array = env->NewDoubleArray(size);
+        if (size > 0)
+            env->SetDoubleArrayRegion(array, 0, size, &values[0]);
+
+        return array;
+    }
+    XMIPP_JAVA_CATCH;
+
+    return NULL;
+}
+
+JNIEXPORT jintArray JNICALL Java_xmipp_jni_MetaData_getColumnValuesInt(JNIEnv *env,
+        jobject jobj, jint label)
+{
+    MetaData *md = GET_INTERNAL_METADATA(jobj);
+
+    XMIPP_JAVA_TRY
     {
-        body[i] = values[i];
-        }
+        std::vector<int> values;
+        md->getColumnValues((MDLabel) label, values);
 
-        jdoubleArray array = env->NewDoubleArray(size);
-        env->SetDoubleArrayRegion(array, 0, size, body);
+        // Copies vector into array.
+        size_t size = values.size();
+        std::vector<jint> body(values.begin(), values.end());
+        jintArray array = env->NewIntArray(size);
+        if (size > 0)
+            env->SetIntArrayRegion(array, 0, size, &body[0]);
+
+        return array;
+    }
+    XMIPP_JAVA_CATCH;
+
+    return NULL;
+}
+
+JNIEXPORT jlongArray JNICALL Java_xmipp_jni_MetaData_getColumnValuesLong(JNIEnv *env,
+        jobject jobj, jint label)
+{
+    MetaData *md = GET_INTERNAL_METADATA(jobj);
+
+    XMIPP_JAVA_TRY
+    {
+        std::vector<size_t> values;
+        md->getColumnValues((MDLabel) label, values);
+
+        // Copies vector into array.
+        size_t size = values.size();
+        std::vector<jlong> body(values.begin(), values.end());
+        jlongArray array = env->NewLongArray(size);
+        if (size > 0)
+            env->SetLongArrayRegion(array, 0, size, &body[0]);
 
         return array;
     }
@@ -655,6 +698,56 @@ JNIEXPORT jdoubleArray JNICALL Java_xmipp_jni_MetaData_getColumnValues(JNIEnv *e
     return NULL;
 }
 
+JNIEXPORT void JNICALL Java_xmipp_jni_MetaData_setColumnValuesDouble(JNIEnv *env,
+        jobject jobj, jint label, jdoubleArray values)
+{
+    MetaData *md = GET_INTERNAL_METADATA(jobj);
+
+    XMIPP_JAVA_TRY
+    {
+        size_t size = env->GetArrayLength(values);
+        std::vector<double> vValues(size);
+        if (size > 0)
+            env->GetDoubleArrayRegion(values, 0, size, &vValues[0]);
+        md->setColumnValues((MDLabel) label, vValues);
+    }
+    XMIPP_JAVA_CATCH;
+}
+
+JNIEXPORT void JNICALL Java_xmipp_jni_MetaData_setColumnValuesInt(JNIEnv *env,
+        jobject jobj, jint label, jintArray values)
+{
+    MetaData *md = GET_INTERNAL_METADATA(jobj);
+
+    XMIPP_JAVA_TRY
+    {
+        size_t size = env->GetArrayLength(values);
+        std::vector<jint> body(size);
+        if (size > 0)
+            env->GetIntArrayRegion(values, 0, size, &body[0]);
+        std::vector<int> vValues(body.begin(), body.end());
+        md->setColumnValues((MDLabel) label, vValues);
+    }
+    XMIPP_JAVA_CATCH;
+}
+
+JNIEXPORT void JNICALL Java_xmipp_jni_MetaData_setColumnValuesLong(JNIEnv *env,
+        jobject jobj, jint label, jlongArray values)
+{
+    MetaData *md = GET_INTERNAL_METADATA(jobj);
+
+    XMIPP_JAVA_TRY
+    {
+        size_t size = env->GetArrayLength(values);
+        std::vector<jlong> body(size);
+        if (size > 0)
+            env->GetLongArrayRegion(values, 0, size, &body[0]);
+        std::vector<size_t> vValues(body.begin(), body.end());
+        md->setColumnValues((MDLabel) label, vValues);
+    }
+    XMIPP_JAVA_CATCH;
+}
+
 //Utility function to create jlongArray from std::vector<size_t>
 jlongArray createLongArray(JNIEnv *env, const std::vector<size_t> & ids)
 {
@@ -286,6 +286,46 @@ extern "C"
     JNIEXPORT jdoubleArray JNICALL Java_xmipp_jni_MetaData_getColumnValues
     (JNIEnv *, jobject, jint);
 
+    /*
+     * Class:     xmipp_MetaData
+     * Method:    getColumnValuesInt
+     * Signature: (I)[I
+     */
+    JNIEXPORT jintArray JNICALL Java_xmipp_jni_MetaData_getColumnValuesInt
+    (JNIEnv *, jobject, jint);
+
+    /*
+     * Class:     xmipp_MetaData
+     * Method:    getColumnValuesLong
+     * Signature: (I)[J
+     */
+    JNIEXPORT jlongArray JNICALL Java_xmipp_jni_MetaData_getColumnValuesLong
+    (JNIEnv *, jobject, jint);
+
+    /*
+     * Class:     xmipp_MetaData
+     * Method:    setColumnValuesDouble
+     * Signature: (I[D)V
+     */
+    JNIEXPORT void JNICALL Java_xmipp_jni_MetaData_setColumnValuesDouble
+    (JNIEnv *, jobject, jint, jdoubleArray);
+
+    /*
+     * Class:     xmipp_MetaData
+     * Method:    setColumnValuesInt
+     * Signature: (I[I)V
+     */
+    JNIEXPORT void JNICALL Java_xmipp_jni_MetaData_setColumnValuesInt
+    (JNIEnv *, jobject, jint, jintArray);
+
+    /*
+     * Class:     xmipp_MetaData
+     * Method:    setColumnValuesLong
+     * Signature: (I[J)V
+     */
+    JNIEXPORT void JNICALL Java_xmipp_jni_MetaData_setColumnValuesLong
+    (JNIEnv *, jobject, jint, jlongArray);
+
     /*
      * Class:     xmipp_MetaData
      * Method:    setValueInt
@@ -37,6 +37,8 @@
  {
     { "projectVolume", (PyCFunction) FourierProjector_projectVolume,
       METH_VARARGS, "projects Volume" },
+    { "projectBatch", (PyCFunction) FourierProjector_projectBatch,
+      METH_VARARGS, "projects Volume in a list of (rot, tilt, psi) directions into a stack, optionally with several threads" },
     { NULL } /* Sentinel */
  };//FourierProjector_methods
 
@@ -131,16 +133,66 @@ PyObject * FourierProjector_projectVolume(PyObject * obj, PyObject *args, PyObje
       {
           try
           {
-        	  Projection P;
-              projectVolume(FourierProjector_Value(self), P, self->dims.xdim, self->dims.ydim, rot, tilt, psi);
+              Projection P;
+              {
+                  // Threads sharing the projector get private buffers
+                  ReleaseGIL nogil;
+                  projectVolume(FourierProjector_Value(self), P, self->dims.xdim, self->dims.ydim, rot, tilt, psi);
+              }
+              Image_releaseData(projection_image);
               Image_Value(projection_image).data->setImage(MULTIDIM_ARRAY(P));
+              Py_RETURN_NONE;
           }
           catch (XmippError &xe)
           {
               PyErr_SetString(PyXmippError, xe.msg.c_str());
           }
-          Py_RETURN_NONE;
       }
+      return NULL;
+}
+
+/* projectBatch */
+PyObject * FourierProjector_projectBatch(PyObject * obj, PyObject *args, PyObject *kwargs)
+{
+      FourierProjectorObject *self = (FourierProjectorObject*) obj;
+      PyObject *projection_image = NULL;
+      PyObject *angles_list = NULL;
+      int threads = 1;
+      if (self != NULL && PyArg_ParseTuple(args, "OO|i", &projection_image, &angles_list, &threads))
+      {
+          try
+          {
+              PyObject *angles_seq = PySequence_Fast(angles_list, "angles must be a sequence of (rot, tilt, psi)");
+              if (angles_seq == NULL)
+                  return NULL;
+              Py_ssize_t N = PySequence_Fast_GET_SIZE(angles_seq);
+              Matrix2D<double> angles(N, 3);
+              for (Py_ssize_t n = 0; n < N; ++n)
+              {
+                  PyObject *item = PySequence_Fast_GET_ITEM(angles_seq, n);
+                  if (!PyArg_ParseTuple(item, "ddd", &MAT_ELEM(angles, n, 0), &MAT_ELEM(angles, n, 1), &MAT_ELEM(angles, n, 2)))
+                  {
+                      Py_DECREF(angles_seq);
+                      return NULL;
+                  }
+              }
+              Py_DECREF(angles_seq);
+
+              MultidimArray<double> projections;
+              {
+                  ReleaseGIL nogil;
+                  FourierProjector_Value(self).projectBatch(angles, projections, threads);
+              }
+              Image_releaseData(projection_image);
+              Image_Value(projection_image).data->setImage(projections);
+              Py_RETURN_NONE;
+          }
+          catch (XmippError &xe)
+          {
+              PyErr_SetString(PyXmippError, xe.msg.c_str());
+          }
+      }
+      return NULL;
 }
 
 
@@ -57,6 +57,11 @@ void FourierProjector_dealloc(FourierProjectorObject* self);
 
 PyObject * FourierProjector_projectVolume(PyObject * obj, PyObject *args, PyObject *kwargs);
 
+/* Project a volume in a list of directions (rot, tilt, psi) with several threads.
+ * The projections are stored as a stack in the given image.
+ */
+PyObject * FourierProjector_projectBatch(PyObject * obj, PyObject *args, PyObject *kwargs);
+
 /* FourierProjector methods */
 extern PyMethodDef FourierProjector_methods[];
 /*FourierProjectorType Type */
@@ -30,14 +30,64 @@
 /*                            Image                         */
 /**************************************************************/
 
+/* Image data shared with the NumPy arrays returned by getData */
+typedef struct
+{
+    ImageGeneric * image;
+    bool owned; //true when the Image object does not use this data anymore
+}
+ImageDataView;
+
+void ImageDataView_destroy(PyObject *capsule)
+{
+    ImageDataView * view = (ImageDataView*) PyCapsule_GetPointer(capsule, NULL);
+    if (view->owned)
+        delete view->image;
+    delete view;
+}
+
 /* Destructor */
 void Image_dealloc(ImageObject* self)
 {
-
-    delete self->image;
+    if (self->views != NULL)
+    {
+        //The arrays still alive will free the image
+        ((ImageDataView*) PyCapsule_GetPointer(self->views, NULL))->owned = true;
+        Py_DECREF(self->views);
+    }
+    else
+        delete self->image;
     self->ob_type->tp_free((PyObject*) self);
 }//function Image_dealloc
 
+ImageObject * Image_alloc()
+{
+    ImageObject * self = PyObject_New(ImageObject, &ImageType);
+    if (self != NULL)
+    {
+        self->image = NULL;
+        self->views = NULL;
+    }
+    return self;
+}//function Image_alloc
+
+void Image_releaseData(PyObject *obj, bool keepData)
+{
+    ImageObject *self = (ImageObject*) obj;
+    if (self->views == NULL)
+        return;
+    if (self->views->ob_refcnt > 1)
+    {
+        ImageDataView * view = (ImageDataView*) PyCapsule_GetPointer(self->views, NULL);
+        view->owned = true;
+        if (keepData)
+            self->image = new ImageGeneric(*view->image);
+        else
+            self->image = new ImageGeneric(view->image->getDatatype());
+    }
+    Py_CLEAR(self->views);
+}//function Image_releaseData
+
 
 /* Image methods that behave like numbers */
 PyNumberMethods Image_NumberMethods =
@@ -111,7 +161,7 @@ PyMethodDef Image_methods[] =
         { "write", (PyCFunction) Image_write, METH_VARARGS,
           "Write image to disk" },
         { "getData", (PyCFunction) Image_getData, METH_VARARGS,
-          "Return NumPy array from image data" },
+          "Return NumPy array viewing the image data (no copy)" },
         { "projectVolumeDouble", (PyCFunction) Image_projectVolumeDouble, METH_VARARGS,
           "project a volume using Euler angles" },
 
@@ -222,6 +272,7 @@ Image_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
     ImageObject *self = (ImageObject*) type->tp_alloc(type, 0);
     if (self != NULL)
     {
+        self->views = NULL;
         PyObject *input = NULL;
 
         if (PyArg_ParseTuple(args, "|O", &input))
@@ -351,13 +402,22 @@ Image_write(PyObject *obj, PyObject *args, PyObject *kwargs)
                 // Now read using both of index and filename
                 bool isStack = (index > 0);
                 WriteMode writeMode = isStack ? WRITE_REPLACE : WRITE_OVERWRITE;
-                self->image->write(filename, index, isStack, writeMode);
+                FileName fn(filename);
+                {
+                    ReleaseGIL nogil;
+                    self->image->write(fn, index, isStack, writeMode);
+                }
 
                 Py_RETURN_NONE;
               }
               if ((pyStr = PyObject_Str(input)) != NULL)
               {
-                  self->image->write(PyString_AsString(input));
+                  FileName fn(PyString_AsString(pyStr));
+                  Py_DECREF(pyStr);
+                  {
+                      ReleaseGIL nogil;
+                      self->image->write(fn);
+                  }
                   Py_RETURN_NONE;
               }
               else
@@ -398,12 +458,23 @@ Image_read(PyObject *obj, PyObject *args, PyObject *kwargs)
                 size_t index = PyInt_AsSsize_t(PyTuple_GetItem(input, 0));
                 const char * filename = PyString_AsString(PyTuple_GetItem(input, 1));
                 // Now read using both of index and filename
-                self->image->read(filename,(DataMode)datamode, index);
+                Image_releaseData(obj);
+                FileName fn(filename);
+                {
+                    ReleaseGIL nogil;
+                    self->image->read(fn,(DataMode)datamode, index);
+                }
                 Py_RETURN_NONE;
               }
               else if ((pyStr = PyObject_Str(input)) != NULL)
               {
-                  self->image->read(PyString_AsString(pyStr),(DataMode)datamode);
+                  Image_releaseData(obj);
+                  FileName fn(PyString_AsString(pyStr));
+                  Py_DECREF(pyStr);
+                  {
+                      ReleaseGIL nogil;
+                      self->image->read(fn,(DataMode)datamode);
+                  }
                   Py_RETURN_NONE;
               }
               else
@@ -451,7 +522,13 @@ Image_readPreview(PyObject *obj, PyObject *args, PyObject *kwargs)
               PyObject *pyStr;
               if ((pyStr = PyObject_Str(input)) != NULL)
               {
-                  readImagePreview(self->image, PyString_AsString(pyStr), x, slice);
+                  Image_releaseData(obj);
+                  FileName fn(PyString_AsString(pyStr));
+                  Py_DECREF(pyStr);
+                  {
+                      ReleaseGIL nogil;
+                      readImagePreview(self->image, fn, x, slice);
+                  }
                   Py_RETURN_NONE;
               }
               else
@@ -489,8 +566,14 @@ Image_readPreviewSmooth(PyObject *obj, PyObject *args, PyObject *kwargs)
               PyObject *pyStr;
               if ((pyStr = PyObject_Str(input)) != NULL)
               {
-                self->image->readPreviewSmooth(PyString_AsString(pyStr), x);
-                  Py_RETURN_NONE;
+                Image_releaseData(obj);
+                FileName fn(PyString_AsString(pyStr));
+                Py_DECREF(pyStr);
+                {
+                    ReleaseGIL nogil;
+                    self->image->readPreviewSmooth(fn, x);
+                }
+                Py_RETURN_NONE;
               }
               else
               {
@@ -517,6 +600,7 @@ Image_convertPSD(PyObject *obj, PyObject *args, PyObject *kwargs)
     {
         try
         {
+            Image_releaseData(obj, true);
             ImageGeneric *image = self->image;
             image->convert2Datatype(DT_Double);
             MultidimArray<double> *in;
@@ -595,22 +679,6 @@ DataType npyType2Datatype(int npy)
     }
 }
 
-/** Just to statically call the function import_array
- * required to work with NumPy arrays
- */
-class NumpyStaticImport
-{
-public:
-    NumpyStaticImport()
-    {
-        import_array();
-    }
-}
-;//class NumpyStaticImport
-
-//Declare a variable to call the constructor
-static NumpyStaticImport _npyImport;
-
 /* getData */
 PyObject *
 Image_getData(PyObject *obj, PyObject *args, PyObject *kwargs)
@@ -634,10 +702,25 @@ Image_getData(PyObject *obj, PyObject *args, PyObject *kwargs)
             //Get the pointer to data
             void *mymem = image().getArrayPointer();
             NPY_TYPES type = datatype2NpyType(dt);
+            //The array is a view of the image data, the capsule
+            //keeps the data alive while the array is used
+            if (self->views == NULL)
+            {
+                ImageDataView * view = new ImageDataView;
+                view->image = self->image;
+                view->owned = false;
+                self->views = PyCapsule_New(view, NULL, ImageDataView_destroy);
+            }
             //dims pointer is shifted if ndim or zdim are 1
-            PyArrayObject * arr = (PyArrayObject*) PyArray_SimpleNew(nd, dims+4-nd, type);
-            void * data = PyArray_DATA(arr);
-            memcpy(data, mymem, adim.nzyxdim * gettypesize(dt));
+            PyArrayObject * arr = (PyArrayObject*) PyArray_SimpleNewFromData(nd, dims+4-nd, type, mymem);
+            if (arr == NULL)
+                return NULL;
+            Py_INCREF(self->views);
+#if NPY_API_VERSION >= 0x00000007
+            PyArray_SetBaseObject(arr, self->views);
+#else
+            arr->base = self->views;
+#endif
 
             return (PyObject*)arr;
         }
@@ -666,8 +749,11 @@ Image_projectVolumeDouble(PyObject *obj, PyObject *args, PyObject *kwargs)
             ArrayDim aDim;
             pVolume->getDimensions(aDim);
             pVolume->setXmippOrigin();
-            projectVolume(*pVolume, P, aDim.xdim, aDim.ydim,rot, tilt, psi);
-            ImageObject * result = PyObject_New(ImageObject, &ImageType);
+            {
+                ReleaseGIL nogil;
+                projectVolume(*pVolume, P, aDim.xdim, aDim.ydim,rot, tilt, psi);
+            }
+            ImageObject * result = Image_alloc();
             Image <double> I;
 
             result->image = new ImageGeneric();
@@ -691,33 +777,52 @@ PyObject *
 Image_setData(PyObject *obj, PyObject *args, PyObject *kwargs)
 {
     ImageObject *self = (ImageObject*) obj;
-    PyArrayObject * arr = NULL;
+    PyObject * input = NULL;
 
-    if (self != NULL && PyArg_ParseTuple(args, "O", &arr))
+    if (self != NULL && PyArg_ParseTuple(args, "O", &input))
     {
+        if (!PyArray_Check(input))
+        {
+            PyErr_SetString(PyExc_TypeError, "Image_setData: Expected a NumPy array");
+            return NULL;
+        }
+        //New reference, only a copy if the array is not contiguous
+        PyArrayObject * arr = PyArray_GETCONTIGUOUS((PyArrayObject*) input);
         try
         {
-            ImageGeneric & image = Image_Value(self);
             DataType dt = npyType2Datatype(PyArray_TYPE(arr));
             int nd = PyArray_NDIM(arr);
-            //Setup of image
-            image.setDatatype(dt);
-            ArrayDim adim;
+            ArrayDim adim, currentDim;
             adim.ndim = (nd == 4 ) ? PyArray_DIM(arr, 0) : 1;
             adim.zdim = (nd > 2 ) ? PyArray_DIM(arr, nd - 3) : 1;
             adim.ydim = PyArray_DIM(arr, nd - 2);
             adim.xdim = PyArray_DIM(arr, nd - 1);
 
-            MULTIDIM_ARRAY_GENERIC(image).resize(adim, false);
-            void *mymem = image().getArrayPointer();
+            //The data is written directly in the current image if it has the
+            //same type and size, otherwise a new image is setup
+            ImageGeneric & current = Image_Value(self);
+            MULTIDIM_ARRAY_GENERIC(current).getDimensions(currentDim);
+            if (dt != current.getDatatype() || currentDim.ndim != adim.ndim || currentDim.zdim != adim.zdim ||
+                currentDim.ydim != adim.ydim || currentDim.xdim != adim.xdim)
+            {
+                Image_releaseData(obj);
+                ImageGeneric & image = Image_Value(self);
+                image.setDatatype(dt);
+                MULTIDIM_ARRAY_GENERIC(image).resize(adim, false);
+            }
+            adim.nzyxdim = adim.ndim * adim.zdim * adim.ydim * adim.xdim;
+            void *mymem = Image_Value(self)().getArrayPointer();
             void * data = PyArray_DATA(arr);
-            memcpy(mymem, data, adim.nzyxdim * gettypesize(dt));
+            if (mymem != data) //nothing to do if the array is a view of this image
+                memcpy(mymem, data, adim.nzyxdim * gettypesize(dt));
+            Py_DECREF(arr);
             Py_RETURN_NONE;
         }
         catch (XmippError &xe)
         {
             PyErr_SetString(PyXmippError, xe.msg.c_str());
         }
+        Py_DECREF(arr);
     }
     return NULL;
 }//function Image_setData
@@ -847,6 +952,7 @@ Image_resize(PyObject *obj, PyObject *args, PyObject *kwargs)
     {
         try
         {
+            Image_releaseData(obj);
             self->image->resize(xDim, yDim, zDim, nDim, false); // TODO: Take care of copy mode if needed
             Py_RETURN_NONE;
         }
@@ -869,6 +975,7 @@ Image_scale(PyObject *obj, PyObject *args, PyObject *kwargs)
     {
         try
         {
+            Image_releaseData(obj, true);
             MULTIDIM_ARRAY_GENERIC(Image_Value(self)).setXmippOrigin();
             selfScaleToSize(BSPLINE2, MULTIDIM_ARRAY_GENERIC(Image_Value(self)), xDim, yDim, zDim);
             Py_RETURN_NONE;
@@ -892,6 +999,7 @@ Image_reslice(PyObject *obj, PyObject *args, PyObject *kwargs)
     {
         try
         {
+            Image_releaseData(obj, true);
             self->image->reslice((AxisView) axis);
             Py_RETURN_NONE;
         }
@@ -938,6 +1046,7 @@ Image_setDataType(PyObject *obj, PyObject *args, PyObject *kwargs)
     {
         try
         {
+            Image_releaseData(obj);
             self->image->setDatatype((DataType)datatype);
             Py_RETURN_NONE;
         }
@@ -961,6 +1070,7 @@ Image_convert2DataType(PyObject *obj, PyObject *args, PyObject *kwargs)
     {
         try
         {
+            Image_releaseData(obj, true);
             self->image->convert2Datatype((DataType)datatype, (CastWriteMode)castMode);
             Py_RETURN_NONE;
         }
@@ -1165,7 +1275,7 @@ Image_adjustAndSubtract(PyObject *obj, PyObject *args, PyObject *kwargs)
 {
     ImageObject *self = (ImageObject*) obj;
     PyObject *pimg2 = NULL;
-    ImageObject * result = PyObject_New(ImageObject, &ImageType);
+    ImageObject * result = Image_alloc();
     if (self != NULL)
     {
         try
@@ -1191,7 +1301,7 @@ Image_adjustAndSubtract(PyObject *obj, PyObject *args, PyObject *kwargs)
 PyObject *
 Image_add(PyObject *obj1, PyObject *obj2)
 {
-    ImageObject * result = PyObject_New(ImageObject, &ImageType);
+    ImageObject * result = Image_alloc();
     if (result != NULL)
     {
         try
@@ -1216,7 +1326,7 @@ Image_iadd(PyObject *obj1, PyObject *obj2)
     try
     {
         Image_Value(obj1).add(Image_Value(obj2));
-        if ((result = PyObject_New(ImageObject, &ImageType)))
+        if ((result = Image_alloc()))
             result->image = new ImageGeneric(Image_Value(obj1));
         //return obj1;
     }
@@ -1259,7 +1369,7 @@ Image_inplaceAdd(PyObject *self, PyObject *args, PyObject *kwargs)
 PyObject *
 Image_subtract(PyObject *obj1, PyObject *obj2)
 {
-    ImageObject * result = PyObject_New(ImageObject, &ImageType);
+    ImageObject * result = Image_alloc();
     if (result != NULL)
     {
         try
@@ -1284,7 +1394,7 @@ Image_isubtract(PyObject *obj1, PyObject *obj2)
     try
     {
         Image_Value(obj1).subtract(Image_Value(obj2));
-        if ((result = PyObject_New(ImageObject, &ImageType)))
+        if ((result = Image_alloc()))
             result->image = new ImageGeneric(Image_Value(obj1));
     }
     catch (XmippError &xe)
@@ -1325,7 +1435,7 @@ Image_inplaceSubtract(PyObject *self, PyObject *args, PyObject *kwargs)
 PyObject *
 Image_multiply(PyObject *obj1, PyObject *obj2)
 {
-    ImageObject * result = PyObject_New(ImageObject, &ImageType);
+    ImageObject * result = Image_alloc();
     if (result != NULL)
     {
         try
@@ -1350,7 +1460,7 @@ Image_imultiply(PyObject *obj1, PyObject *obj2)
     try
     {
         ImageObject * result = NULL;
-        if ((result = PyObject_New(ImageObject, &ImageType)))
+        if ((result = Image_alloc()))
             result->image = new ImageGeneric(Image_Value(obj1));
         double value = PyFloat_AsDouble(obj2);
         Image_Value(result).multiply(value);
@@ -1393,7 +1503,7 @@ Image_inplaceMultiply(PyObject *self, PyObject *args, PyObject *kwargs)
 PyObject *
 Image_divide(PyObject *obj1, PyObject *obj2)
 {
-    ImageObject * result = PyObject_New(ImageObject, &ImageType);
+    ImageObject * result = Image_alloc();
     if (result != NULL)
     {
         try
@@ -1422,7 +1532,7 @@ Image_idivide(PyObject *obj1, PyObject *obj2)
     try
     {
       ImageObject * result = NULL;
-      if ((result = PyObject_New(ImageObject, &ImageType)))
+      if ((result = Image_alloc()))
           result->image = new ImageGeneric(Image_Value(obj1));
       double value = PyFloat_AsDouble(obj2);
       Image_Value(result).divide(value);
@@ -1472,6 +1582,7 @@ Image_applyTransforMatScipion(PyObject *obj, PyObject *args, PyObject *kwargs)
     ImageBase * img;
     PyObject *only_apply_shifts = Py_False;
     PyObject *wrap = (WRAP ? Py_True : Py_False);
+    Image_releaseData(obj, true);
     img = self->image->image;
     bool boolOnly_apply_shifts = false;
     bool boolWrap = WRAP;
@@ -1542,6 +1653,7 @@ Image_applyCTF(PyObject *obj, PyObject *args, PyObject *kwargs)
 			{
 				FileName fnCTF=PyString_AsString(pyStr);
 			    ImageObject *self = (ImageObject*) obj;
+			    Image_releaseData(obj, true);
 	            ImageGeneric *image = self->image;
 	            image->convert2Datatype(DT_Double);
 	            MultidimArray<double> * pImage=NULL;
@@ -1599,7 +1711,11 @@ Image_readApplyGeo(PyObject *obj, PyObject *args, PyObject *kwargs)
                 params.datamode = (DataMode)datamode;
                 params.select_img = select_img;
                 params.wrap = boolWrap;
-                self->image->readApplyGeo(MetaData_Value(md), objectId, params);
+                Image_releaseData(obj);
+                {
+                    ReleaseGIL nogil;
+                    self->image->readApplyGeo(MetaData_Value(md), objectId, params);
+                }
                 Py_RETURN_NONE;
             }
             catch (XmippError &xe)
@@ -1640,6 +1756,7 @@ Image_applyGeo(PyObject *obj, PyObject *args, PyObject *kwargs)
                 ApplyGeoParams params;
                 params.only_apply_shifts = boolOnly_apply_shifts;
                 params.wrap = boolWrap;
+                Image_releaseData(obj, true);
                 self->image->applyGeo(MetaData_Value(md), objectId, params);
                 Py_RETURN_NONE;
             }
@@ -42,11 +42,22 @@ typedef struct
 {
     PyObject_HEAD
     ImageGeneric * image;
+    PyObject * views; //Capsule shared with the NumPy arrays viewing the image data
 }
 ImageObject;
 
 #define ImageObject_New() (ImageObject*)malloc(sizeof(ImageObject))
 
+/* Create an Image object, the image should be set by the caller */
+ImageObject * Image_alloc();
+
+/* Stop sharing the image data with the NumPy arrays returned by getData.
+ * It should be called before any operation that may reallocate the image data.
+ * If there are arrays still alive, they keep the current data and the Image
+ * gets a new one, which is a copy of the current data if keepData is true.
+ */
+void Image_releaseData(PyObject *obj, bool keepData=false);
+
 /* Destructor */
 void Image_dealloc(ImageObject* self);
 
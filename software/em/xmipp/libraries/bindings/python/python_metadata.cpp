@@ -274,6 +274,10 @@ PyMethodDef MetaData_methods[] =
           METH_VARARGS, "Get all values value from column(label)" },
         { "setColumnValues", (PyCFunction) MetaData_setColumnValues,
           METH_VARARGS, "Set all values value from column(label)" },
+        { "getColumnArray", (PyCFunction) MetaData_getColumnArray,
+          METH_VARARGS, "Get all values from a numeric column(label) as a NumPy array" },
+        { "setColumnArray", (PyCFunction) MetaData_setColumnArray,
+          METH_VARARGS, "Set all values of a numeric column(label) from a NumPy array" },
         { "getActiveLabels",
           (PyCFunction) MetaData_getActiveLabels,
           METH_VARARGS,
@@ -529,16 +533,21 @@ MetaData_read(PyObject *obj, PyObject *args, PyObject *kwargs)
                                 iValue = PyInt_AsLong(item);
                                 vValue[i] = (MDLabel)iValue;
                             }
+                            ReleaseGIL nogil;
                             self->metadata->read(str,&vValue);
                         }
                         else if (PyInt_Check(list)){
                           size_t maxRows = (size_t) PyInt_AsLong(list);
                           self->metadata->setMaxRows(maxRows);
+                          ReleaseGIL nogil;
                           self->metadata->read(str);
                         }
                     }
                     else
+                    {
+                        ReleaseGIL nogil;
                         self->metadata->read(str);
+                    }
                     Py_RETURN_NONE;
                 }
                 else
@@ -999,36 +1008,155 @@ MetaData_setColumnValues(PyObject *obj, PyObject *args, PyObject *kwargs)
         {
             MetaDataObject *self = (MetaDataObject*) obj;
             size_t size=PyList_Size(list);
-            bool addObjects=(self->metadata->size()==0);
-            MDObject object((MDLabel) label);
-            if (addObjects)
+            if (self->metadata->size()!=size && self->metadata->size()!=0)
             {
-                for (size_t i=0; i<size; ++i)
+                PyErr_SetString(PyXmippError, "Metadata size different from list size");
+                return NULL;
+            }
+            std::vector<MDObject> values(size, MDObject((MDLabel) label));
+            for (size_t i=0; i<size; ++i)
+                setMDObjectValue(&(values[i]),PyList_GetItem(list,i));
+            self->metadata->setColumnValues(values);
+        }
+        catch (XmippError &xe)
+        {
+            PyErr_SetString(PyXmippError, xe.msg.c_str());
+            return NULL;
+        }
+    }
+    Py_RETURN_NONE;
+}
+
+/* Type of the NumPy array used for a numeric label, NPY_NOTYPE if not numeric */
+int label2NpyType(MDLabel label)
+{
+    switch (MDL::labelType(label))
+    {
+    case LABEL_INT:
+        return NPY_INT;
+    case LABEL_BOOL:
+        return NPY_BOOL;
+    case LABEL_DOUBLE:
+        return NPY_DOUBLE;
+    case LABEL_SIZET:
+        return NPY_UINTP;
+    default:
+        return NPY_NOTYPE;
+    }
+}
+
+/* getColumnArray */
+PyObject *
+MetaData_getColumnArray(PyObject *obj, PyObject *args, PyObject *kwargs)
+{
+    int label;
+    if (PyArg_ParseTuple(args, "i", &label))
+    {
+        int type = label2NpyType((MDLabel) label);
+        if (type == NPY_NOTYPE)
+        {
+            PyErr_SetString(PyExc_TypeError, "getColumnArray: only numeric labels, use getColumnValues");
+            return NULL;
+        }
+        try
+        {
+            MetaDataObject *self = (MetaDataObject*) obj;
+            std::vector<MDObject> values;
+            self->metadata->getColumnValues((MDLabel) label, values);
+
+            npy_intp size = values.size();
+            PyArrayObject * arr = (PyArrayObject*) PyArray_SimpleNew(1, &size, type);
+            if (arr == NULL)
+                return NULL;
+            void * data = PyArray_DATA(arr);
+            int iValue;
+            bool bValue;
+            for (npy_intp i = 0; i < size; ++i)
+            {
+                const MDObject &value = values[i];
+                switch (type)
                 {
-                    size_t id=self->metadata->addObject();
-                    setMDObjectValue(&object,PyList_GetItem(list,i));
-                    self->metadata->setValue(object,id);
+                case NPY_INT:
+                    value.getValue(iValue);
+                    ((int*) data)[i] = iValue;
+                    break;
+                case NPY_BOOL:
+                    value.getValue(bValue);
+                    ((npy_bool*) data)[i] = bValue;
+                    break;
+                case NPY_DOUBLE:
+                    value.getValue(((double*) data)[i]);
+                    break;
+                default:
+                    value.getValue(((size_t*) data)[i]);
                 }
             }
-            else
+            return (PyObject*) arr;
+        }
+        catch (XmippError &xe)
+        {
+            PyErr_SetString(PyXmippError, xe.msg.c_str());
+        }
+    }
+    return NULL;
+}
+
+/* setColumnArray */
+PyObject *
+MetaData_setColumnArray(PyObject *obj, PyObject *args, PyObject *kwargs)
+{
+    int label;
+    PyObject *input = NULL;
+    if (PyArg_ParseTuple(args, "iO", &label, &input))
+    {
+        int type = label2NpyType((MDLabel) label);
+        if (type == NPY_NOTYPE)
+        {
+            PyErr_SetString(PyExc_TypeError, "setColumnArray: only numeric labels, use setColumnValues");
+            return NULL;
+        }
+        //New reference, converted to the type of the label if needed
+        PyArrayObject * arr = (PyArrayObject*) PyArray_ContiguousFromAny(input, type, 1, 1);
+        if (arr == NULL)
+            return NULL;
+        try
+        {
+            MetaDataObject *self = (MetaDataObject*) obj;
+            size_t size = PyArray_DIM(arr, 0);
+            if (self->metadata->size()!=size && self->metadata->size()!=0)
+                REPORT_ERROR(ERR_MD_OBJECTNUMBER, "Metadata size different from array size");
+
+            void * data = PyArray_DATA(arr);
+            std::vector<MDObject> values(size, MDObject((MDLabel) label));
+            for (size_t i = 0; i < size; ++i)
             {
-                if (self->metadata->size()!=size)
-                    PyErr_SetString(PyXmippError, "Metadata size different from list size");
-                size_t i=0;
-                FOR_ALL_OBJECTS_IN_METADATA(*(self->metadata))
+                MDObject &value = values[i];
+                switch (type)
                 {
-                    setMDObjectValue(&object,PyList_GetItem(list,i++));
-                    self->metadata->setValue(object,__iter.objId);
+                case NPY_INT:
+                    value.setValue(((int*) data)[i]);
+                    break;
+                case NPY_BOOL:
+                    value.setValue((bool) ((npy_bool*) data)[i]);
+                    break;
+                case NPY_DOUBLE:
+                    value.setValue(((double*) data)[i]);
+                    break;
+                default:
+                    value.setValue(((size_t*) data)[i]);
                 }
             }
+            self->metadata->setColumnValues(values);
+            Py_DECREF(arr);
+            Py_RETURN_NONE;
         }
         catch (XmippError &xe)
         {
             PyErr_SetString(PyXmippError, xe.msg.c_str());
-            return NULL;
         }
+        Py_DECREF(arr);
     }
-    Py_RETURN_NONE;
+    return NULL;
 }
 
 /* containsLabel */
@@ -23,6 +23,8 @@
  *  e-mail address 'xmipp@cnb.csic.es'
  ***************************************************************************/
 
+//The NumPy API table is imported in initxmipp
+#define XMIPP_IMPORT_ARRAY
 #include "xmippmodule.h"
 #include "data/ctf.h"
 
@@ -355,7 +357,11 @@ xmipp_ImgCompare(PyObject *obj, PyObject *args, PyObject *kwargs)
             PyObject * pyStr2 = PyObject_Str(filename2);
             char * str1 = PyString_AsString(pyStr1);
             char * str2 = PyString_AsString(pyStr2);
-            bool result = compareImage(str1, str2);
+            bool result;
+            {
+                ReleaseGIL nogil;
+                result = compareImage(str1, str2);
+            }
             Py_DECREF(pyStr1);
             Py_DECREF(pyStr2);
             if (result)
@@ -384,7 +390,11 @@ xmipp_compareTwoFiles(PyObject *obj, PyObject *args, PyObject *kwargs)
             PyObject * pyStr2 = PyObject_Str(filename2);
             char * str1 = PyString_AsString(pyStr1);
             char * str2 = PyString_AsString(pyStr2);
-            bool result = compareTwoFiles(str1, str2, offset);
+            bool result;
+            {
+                ReleaseGIL nogil;
+                result = compareTwoFiles(str1, str2, offset);
+            }
             Py_DECREF(pyStr1);
             Py_DECREF(pyStr2);
             if (result)
@@ -487,7 +497,11 @@ xmipp_compareTwoImageTolerance(PyObject *obj, PyObject *args, PyObject *kwargs)
             else
               fn2 = PyString_AsString(PyObject_Str(input2));
 
-            bool result = compareTwoImageTolerance(fn1, fn2, tolerance, index1, index2);
+            bool result;
+            {
+                ReleaseGIL nogil;
+                result = compareTwoImageTolerance(fn1, fn2, tolerance, index1, index2);
+            }
 
             if (result)
                 Py_RETURN_TRUE;
@@ -666,8 +680,12 @@ xmipp_fastEstimateEnhancedPSD(PyObject *obj, PyObject *args, PyObject *kwargs)
             if (validateInputImageString(pyImage, pyStrFn, fn))
             {
                 MultidimArray<double> data;
-                fastEstimateEnhancedPSD(fn, downsampling, data, Nthreads);
-                selfScaleToSize(LINEAR, data, dim, dim);
+                {
+                    ReleaseGIL nogil;
+                    fastEstimateEnhancedPSD(fn, downsampling, data, Nthreads);
+                    selfScaleToSize(LINEAR, data, dim, dim);
+                }
+                Image_releaseData(pyImage);
                 Image_Value(pyImage).setDatatype(DT_Double);
                 Image_Value(pyImage).data->setImage(data);
                 Py_RETURN_NONE;
@@ -680,14 +698,17 @@ xmipp_fastEstimateEnhancedPSD(PyObject *obj, PyObject *args, PyObject *kwargs)
     }
     return NULL;
 }
-/** Some helper macros repeated in filter functions*/
+/** Some helper macros repeated in filter functions.
+ * The GIL is released from the image reading to the final scaling */
 #define FILTER_TRY()\
 try {\
 if (validateInputImageString(pyImage, pyStrFn, fn)) {\
 Image<double> img;\
-img.read(fn);\
 MultidimArray<double> &data = MULTIDIM_ARRAY(img);\
 ArrayDim idim;\
+{\
+ReleaseGIL nogil;\
+img.read(fn);\
 data.getDimensions(idim);
 
 #define FILTER_CATCH()\
@@ -696,6 +717,8 @@ if (x > y) h = y * (dim/x);\
 else if (y > x)\
   w = x * (dim/y);\
 selfScaleToSize(LINEAR, data, w, h);\
+}\
+Image_releaseData(pyImage);\
 Image_Value(pyImage).setDatatype(DT_Double);\
 data.resetOrigin();\
 MULTIDIM_ARRAY_GENERIC(Image_Value(pyImage)).setImage(data);\
@@ -1105,6 +1128,8 @@ PyMODINIT_FUNC initxmipp(void)
     module = Py_InitModule3("xmipp", xmipp_methods,
                             "Xmipp module as a Python extension.");
     import_array();
+    // Several methods release the GIL, make sure it exists
+    PyEval_InitThreads();
 
     //Check types and add to module
     INIT_TYPE(FileName);
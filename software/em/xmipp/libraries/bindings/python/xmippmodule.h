@@ -28,6 +28,12 @@
 #define _XMIPPMODULE_H
 
 #include "Python.h"
+//The NumPy API table is shared by all the files of the module,
+//it is imported by initxmipp in xmippmodule.cpp
+#define PY_ARRAY_UNIQUE_SYMBOL XMIPP_ARRAY_API
+#ifndef XMIPP_IMPORT_ARRAY
+#define NO_IMPORT_ARRAY
+#endif
 #include "numpy/ndarraytypes.h"
 #include "numpy/ndarrayobject.h"
 
@@ -50,6 +56,33 @@
 
 extern PyObject * PyXmippError;
 
+/** Release the GIL while this object is in scope.
+ * Declare it around long C++ calls (image I/O, projections, programs...)
+ * so other Python threads can run meanwhile. Nothing in that scope may
+ * touch a Python object. The destructor takes the GIL back, also when an
+ * XmippError leaves the scope, so the error can be set in the usual
+ * catch block. The C++ code in the scope must be safe for concurrent
+ * callers; the image readers serialize the formats whose library is not
+ * (HDF5, see HDF5Lock).
+ */
+class ReleaseGIL
+{
+public:
+    ReleaseGIL()
+    {
+        state = PyEval_SaveThread();
+    }
+    ~ReleaseGIL()
+    {
+        PyEval_RestoreThread(state);
+    }
+private:
+    PyThreadState *state;
+    // Not copyable
+    ReleaseGIL(const ReleaseGIL &);
+    ReleaseGIL & operator=(const ReleaseGIL &);
+};
+
 #define SymList_Check(v) (((v)->ob_type == &SymListType))
 #define SymList_Value(v)  ((*((SymListObject*)(v))->symlist))
 
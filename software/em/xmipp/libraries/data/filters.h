@@ -289,22 +289,8 @@ template <typename T>
 double fastCorrelation(const MultidimArray< T >& x,
                        const MultidimArray< T >& y)
 {
-    double retval = 0; // returned value
-    size_t nmax=4*(MULTIDIM_SIZE(x)/4);
-    // loop unrolling
-    for (size_t n=0; n<nmax; n+=4)
-    {
-        size_t n_1=n+1;
-        size_t n_2=n+2;
-        size_t n_3=n+3;
-        retval += DIRECT_MULTIDIM_ELEM(x, n)   * DIRECT_MULTIDIM_ELEM(y, n)+
-                  DIRECT_MULTIDIM_ELEM(x, n_1) * DIRECT_MULTIDIM_ELEM(y, n_1)+
-                  DIRECT_MULTIDIM_ELEM(x, n_2) * DIRECT_MULTIDIM_ELEM(y, n_2)+
-                  DIRECT_MULTIDIM_ELEM(x, n_3) * DIRECT_MULTIDIM_ELEM(y, n_3);
-    }
-    for (size_t n=nmax; n<MULTIDIM_SIZE(x); ++n)
-        retval += DIRECT_MULTIDIM_ELEM(x, n)   * DIRECT_MULTIDIM_ELEM(y, n);
-    return retval / MULTIDIM_SIZE(x);
+    return simdDot(MULTIDIM_ARRAY(x), MULTIDIM_ARRAY(y), MULTIDIM_SIZE(x)) /
+           MULTIDIM_SIZE(x);
 }
 
 /** correlationIndex nD
@@ -362,8 +348,7 @@ double correlationIndex(const MultidimArray< T >& x,
     {
         if (mask==NULL && x.sameShape(y))
         {
-            FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(x)
-                retval += DIRECT_MULTIDIM_ELEM(x, n)*DIRECT_MULTIDIM_ELEM(y, n);
+            retval = simdDot(MULTIDIM_ARRAY(x), MULTIDIM_ARRAY(y), MULTIDIM_SIZE(x));
             N=MULTIDIM_SIZE(x);
             retval-=N*mean_x*mean_y;
         }
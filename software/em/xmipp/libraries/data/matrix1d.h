@@ -28,7 +28,9 @@
 
 #include <stdlib.h>
 #include <cmath>
+#include <algorithm>
 #include "xmipp_funcs.h"
+#include "xmipp_memory.h"
 #include "numerical_recipes.h"
 
 extern int bestPrecision(float F, int _width);
@@ -330,6 +332,21 @@ public:
         row = v.row;
     }
 
+#if __cplusplus >= 201103L
+    /** Move constructor
+     *
+     * The data of v is taken without copying it and v is left empty.
+     */
+    Matrix1D(Matrix1D<T>&& v)
+    {
+        coreInit();
+        if (v.destroyData)
+            swap(v);
+        else
+            *this = v;
+    }
+#endif
+
     /** Destructor.
      */
     ~Matrix1D()
@@ -359,6 +376,40 @@ public:
         return *this;
     }
 
+#if __cplusplus >= 201103L
+    /** Move assignment.
+     *
+     * The data of op1 is taken without copying it and op1 is left empty.
+     * The values are copied if any of the vectors does not own its data.
+     */
+    Matrix1D<T>& operator=(Matrix1D<T>&& op1)
+    {
+        if (&op1 != this)
+        {
+            if (op1.destroyData && (destroyData || vdata == NULL))
+            {
+                clear();
+                swap(op1);
+            }
+            else
+                *this = op1;
+        }
+        return *this;
+    }
+#endif
+
+    /** Swap two vectors.
+     *
+     * Size, orientation and data are exchanged without copying any element.
+     */
+    void swap(Matrix1D<T>& v)
+    {
+        std::swap(vdata, v.vdata);
+        std::swap(destroyData, v.destroyData);
+        std::swap(vdim, v.vdim);
+        std::swap(row, v.row);
+    }
+
     /** Equals.
      */
     bool operator==(const Matrix1D<T>& op1) const
@@ -415,7 +466,7 @@ public:
         }
 
         vdim = _vdim;
-        vdata = new T[vdim];
+        vdata = askAlignedMemory<T>(vdim);
         memset(vdata, 0, vdim * sizeof(T));
         if (vdata == NULL
            )
@@ -428,7 +479,7 @@ public:
     inline void coreDeallocate()
     {
         if (vdata != NULL && destroyData)
-            delete[] vdata;
+            freeAlignedMemory(vdata);
         vdata = NULL;
     }
     //@}
@@ -460,7 +511,7 @@ public:
         T * new_vdata;
         try
         {
-            new_vdata = new T[(size_t) Xdim]; //TODO: Kino: Valgrind points here there is something wrong, but I could'nt resolve
+            new_vdata = askAlignedMemory<T>(Xdim);
             memset(new_vdata, 0, Xdim * sizeof(T));
         }
         catch (std::bad_alloc &)
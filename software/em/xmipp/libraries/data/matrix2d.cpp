@@ -29,6 +29,8 @@
 #include <alglib/src/linalg.h>
 
 #include "matrix2d.h"
+#include "xmipp_simd.h"
+#include "xmipp_threads.h"
 
 /* Cholesky decomposition -------------------------------------------------- */
 void cholesky(const Matrix2D<double> &M, Matrix2D<double> &L)
@@ -395,6 +397,321 @@ void schur(const Matrix2D<double> &M, Matrix2D<double> &O, Matrix2D<double> &T)
 	}
 }
 
+/* Blocked matrix products ------------------------------------------------- */
+static int matrix2DThreads = 1;
+
+void setMatrix2DThreads(int nThreads)
+{
+    matrix2DThreads = XMIPP_MAX(nThreads, 1);
+}
+
+int getMatrix2DThreads()
+{
+    return matrix2DThreads;
+}
+
+// Products with less multiply-adds than this are computed with the plain loops
+#define MATRIX2D_BLOCKED_MIN_OPS 110592
+// Minimum number of multiply-adds given to each thread
+#define MATRIX2D_MIN_OPS_PER_THREAD 4194304
+// Blocks of the product: GEMM_KB rows of B (columns of A) by GEMM_NB columns
+// of B fit in the L2 cache, and 4 rows of C are updated at the same time
+#define GEMM_KB 128
+#define GEMM_NB 256
+
+// C(MxN)=A(MxK)*B(KxN), all of them row-major
+struct GemmArgs
+{
+    const double *A;
+    const double *B;
+    double *C;
+    size_t M, N, K;
+    bool splitColumns;
+};
+
+// Product of the rows i0..iF-1 and the columns j0..jF-1 of C
+static void gemmBlock(const GemmArgs &g, size_t i0, size_t iF, size_t j0, size_t jF)
+{
+    const size_t N = g.N, K = g.K;
+    for (size_t i = i0; i < iF; ++i)
+        memset(g.C + i * N + j0, 0, (jF - j0) * sizeof(double));
+    for (size_t kk = 0; kk < K; kk += GEMM_KB)
+    {
+        size_t kF = std::min(kk + GEMM_KB, K);
+        for (size_t jj = j0; jj < jF; jj += GEMM_NB)
+        {
+            size_t nj = std::min(jj + GEMM_NB, jF) - jj;
+            size_t i = i0;
+            for (; i + 4 <= iF; i += 4)
+            {
+                double *c0 = g.C + i * N + jj;
+                double *c1 = c0 + N;
+                double *c2 = c1 + N;
+                double *c3 = c2 + N;
+                const double *a0 = g.A + i * K;
+                const double *a1 = a0 + K;
+                const double *a2 = a1 + K;
+                const double *a3 = a2 + K;
+                for (size_t k = kk; k < kF; ++k)
+                {
+                    double a0k = a0[k], a1k = a1[k], a2k = a2[k], a3k = a3[k];
+                    const double *b = g.B + k * N + jj;
+                    for (size_t j = 0; j < nj; ++j)
+                    {
+                        double bj = b[j];
+                        c0[j] += a0k * bj;
+                        c1[j] += a1k * bj;
+                        c2[j] += a2k * bj;
+                        c3[j] += a3k * bj;
+                    }
+                }
+            }
+            for (; i < iF; ++i)
+            {
+                double *c0 = g.C + i * N + jj;
+                const double *a0 = g.A + i * K;
+                for (size_t k = kk; k < kF; ++k)
+                {
+                    double a0k = a0[k];
+                    const double *b = g.B + k * N + jj;
+                    for (size_t j = 0; j < nj; ++j)
+                        c0[j] += a0k * b[j];
+                }
+            }
+        }
+    }
+}
+
+// Each thread computes a band of rows of C (aligned to 4 rows), or a band of
+// columns when C has too few rows
+static void gemmThread(ThreadArgument &thArg)
+{
+    const GemmArgs &g = *((GemmArgs *) thArg.data);
+    size_t id = thArg.thread_id, nThreads = thArg.threads;
+    if (g.splitColumns)
+    {
+        size_t nBlocks = (g.N + 7) / 8;
+        size_t j0 = std::min(8 * ((nBlocks * id) / nThreads), g.N);
+        size_t jF = std::min(8 * ((nBlocks * (id + 1)) / nThreads), g.N);
+        gemmBlock(g, 0, g.M, j0, jF);
+    }
+    else
+    {
+        size_t nBlocks = (g.M + 3) / 4;
+        size_t i0 = std::min(4 * ((nBlocks * id) / nThreads), g.M);
+        size_t iF = std::min(4 * ((nBlocks * (id + 1)) / nThreads), g.M);
+        gemmBlock(g, i0, iF, 0, g.N);
+    }
+}
+
+static inline bool useBlockedProduct(size_t M, size_t N, size_t K)
+{
+    return (double)M * N * K >= MATRIX2D_BLOCKED_MIN_OPS;
+}
+
+static void gemm(const double *A, const double *B, double *C, size_t M, size_t N, size_t K)
+{
+    GemmArgs args;
+    args.A = A;
+    args.B = B;
+    args.C = C;
+    args.M = M;
+    args.N = N;
+    args.K = K;
+    double ops = (double)M * N * K;
+    int nThreads = std::min(matrix2DThreads, (int)std::max(1., ops / MATRIX2D_MIN_OPS_PER_THREAD));
+    args.splitColumns = M < 16 * (size_t)nThreads;
+    nThreads = std::min(nThreads, (int)(args.splitColumns ? (N + 7) / 8 : (M + 3) / 4));
+    if (nThreads > 1)
+    {
+        ThreadManager thMgr(nThreads);
+        thMgr.run(gemmThread, &args);
+    }
+    else
+        gemmBlock(args, 0, M, 0, N);
+}
+
+// At=A^t, by tiles so that neither of them is read with a large stride
+static void transposeBlocked(const Matrix2D<double> &A, Matrix2D<double> &At)
+{
+    const size_t Ydim = MAT_YSIZE(A), Xdim = MAT_XSIZE(A);
+    At.resizeNoCopy(Xdim, Ydim);
+    for (size_t ii = 0; ii < Ydim; ii += 32)
+        for (size_t jj = 0; jj < Xdim; jj += 32)
+        {
+            size_t iF = std::min(ii + 32, Ydim), jF = std::min(jj + 32, Xdim);
+            for (size_t i = ii; i < iF; ++i)
+                for (size_t j = jj; j < jF; ++j)
+                    MAT_ELEM(At, j, i) = MAT_ELEM(A, i, j);
+        }
+}
+
+void matrixProduct(const Matrix2D<double> &A, const Matrix2D<double> &B, Matrix2D<double> &C)
+{
+    if (useBlockedProduct(MAT_YSIZE(A), MAT_XSIZE(B), MAT_XSIZE(A)))
+    {
+        C.resizeNoCopy(MAT_YSIZE(A), MAT_XSIZE(B));
+        gemm(MATRIX2D_ARRAY(A), MATRIX2D_ARRAY(B), MATRIX2D_ARRAY(C),
+             MAT_YSIZE(A), MAT_XSIZE(B), MAT_XSIZE(A));
+        return;
+    }
+    C.initZeros(MAT_YSIZE(A), MAT_XSIZE(B));
+    for (size_t i = 0; i < MAT_YSIZE(A); i++)
+        for (size_t j = 0; j < MAT_XSIZE(B); j++)
+            for (size_t k = 0; k < MAT_XSIZE(A); k++)
+                MAT_ELEM(C, i, j) += MAT_ELEM(A, i, k) * MAT_ELEM(B, k, j);
+}
+
+/* Subspace iteration ------------------------------------------------------ */
+// Orthogonalize the row i of Q with respect to the previous rows (twice, for
+// stability) and normalize it. It fails if the row is linearly dependent
+static bool orthonormalizeRow(Matrix2D<double> &Q, size_t i)
+{
+    const size_t N = MAT_XSIZE(Q);
+    double *qi = &MAT_ELEM(Q, i, 0);
+    double norm0 = sqrt(simdDot(qi, qi, N));
+    for (int pass = 0; pass < 2; ++pass)
+        for (size_t j = 0; j < i; ++j)
+        {
+            const double *qj = &MAT_ELEM(Q, j, 0);
+            double r = simdDot(qi, qj, N);
+            for (size_t k = 0; k < N; ++k)
+                qi[k] -= r * qj[k];
+        }
+    double norm = sqrt(simdDot(qi, qi, N));
+    if (norm == 0 || norm <= 1e-10 * norm0)
+        return false;
+    double inorm = 1. / norm;
+    for (size_t k = 0; k < N; ++k)
+        qi[k] *= inorm;
+    return true;
+}
+
+// Orthonormalize the rows of Q. Dependent rows are replaced by random ones
+static void orthonormalizeRows(Matrix2D<double> &Q, unsigned int &seed)
+{
+    for (size_t i = 0; i < MAT_YSIZE(Q); ++i)
+        while (!orthonormalizeRow(Q, i))
+            for (size_t k = 0; k < MAT_XSIZE(Q); ++k)
+                MAT_ELEM(Q, i, k) = (double)rand_r(&seed) / RAND_MAX - 0.5;
+}
+
+// The subspace iteration is only tried for a few eigenvectors of a large matrix
+static inline size_t firstEigsSubspaceSize(size_t N, size_t M)
+{
+    return std::min(N, M + std::max(M / 2, (size_t)10));
+}
+
+static inline bool useFirstEigsSubspace(size_t N, size_t M)
+{
+    return N >= 512 && 8 * firstEigsSubspaceSize(N, M) <= N;
+}
+
+/* Block subspace iteration with Rayleigh-Ritz for the M largest eigenvalues
+   of the symmetric matrix A. The vectors of the subspace are the rows of Qt,
+   so that A*Q is computed as the blocked product Qt*A. The subspace has a few
+   more vectors than M to speed up the convergence.
+
+   The iteration converges to the eigenvalues of largest magnitude, which are
+   the largest ones unless there are large negative eigenvalues. In that case,
+   or when the convergence is predicted to be slower than the dense
+   decomposition, it returns false. */
+static bool firstEigsSubspace(const Matrix2D<double> &A, size_t M, Matrix1D<double> &D, Matrix2D<double> &P, bool Pneeded)
+{
+    const size_t N = MAT_YSIZE(A);
+    const size_t b = firstEigsSubspaceSize(N, M);
+    const double tol = 1e-9;
+    // An iteration costs about 2*b*N^2 flops, and the dense decomposition
+    // a few N^3 with a much worse use of the caches
+    const int maxIter = (int)std::max((size_t)30, N / b);
+
+    unsigned int seed = 12345;
+    Matrix2D<double> Qt(b, N), Zt, H, Vt, Qaux;
+    FOR_ALL_ELEMENTS_IN_MATRIX2D(Qt)
+        MAT_ELEM(Qt, i, j) = (double)rand_r(&seed) / RAND_MAX - 0.5;
+    orthonormalizeRows(Qt, seed);
+
+    std::vector<double> theta(b);
+    double previousResidual = -1;
+    for (int iter = 0; iter < maxIter; ++iter)
+    {
+        // Rayleigh-Ritz: H=Q^t*A*Q
+        matrixOperation_AB(Qt, A, Zt);
+        matrixOperation_ABt(Qt, Zt, H);
+        alglib::real_2d_array h, z;
+        h.setlength(b, b);
+        for (size_t i = 0; i < b; ++i)
+            for (size_t j = 0; j < b; ++j)
+                h(i, j) = 0.5 * (MAT_ELEM(H, i, j) + MAT_ELEM(H, j, i));
+        alglib::real_1d_array d;
+        if (!alglib::smatrixevd(h, b, 1, true, d, z))
+            return false;
+
+        // Ritz vectors sorted by decreasing Ritz value
+        Vt.resizeNoCopy(b, b);
+        for (size_t l = 0; l < b; ++l)
+        {
+            theta[l] = d(b - 1 - l);
+            for (size_t m = 0; m < b; ++m)
+                MAT_ELEM(Vt, l, m) = z(m, b - 1 - l);
+        }
+        matrixOperation_AB(Vt, Qt, Qaux);
+        Qt = Qaux;
+        matrixOperation_AB(Vt, Zt, Qaux);
+        Zt = Qaux;
+
+        // Residuals of the wanted pairs: ||A*q-theta*q||
+        double residual = 0;
+        for (size_t l = 0; l < M; ++l)
+        {
+            const double *q = &MAT_ELEM(Qt, l, 0);
+            const double *zl = &MAT_ELEM(Zt, l, 0);
+            double r2 = 0;
+            for (size_t k = 0; k < N; ++k)
+            {
+                double diff = zl[k] - theta[l] * q[k];
+                r2 += diff * diff;
+            }
+            residual = std::max(residual, sqrt(r2));
+        }
+        double scale = std::max(fabs(theta[0]), fabs(theta[b - 1]));
+        if (residual <= tol * scale || scale == 0)
+        {
+            // A negative eigenvalue of larger magnitude than the wanted ones
+            // would have taken their place in the subspace
+            if (-theta[b - 1] >= theta[M - 1])
+                return false;
+            D.resizeNoCopy(M);
+            for (size_t l = 0; l < M; ++l)
+                VEC_ELEM(D, l) = theta[l];
+            if (Pneeded)
+            {
+                P.resizeNoCopy(N, M);
+                for (size_t i = 0; i < N; ++i)
+                    for (size_t l = 0; l < M; ++l)
+                        MAT_ELEM(P, i, l) = MAT_ELEM(Qt, l, i);
+            }
+            return true;
+        }
+
+        // The residual decreases by the ratio between the largest unwanted
+        // and the smallest wanted eigenvalue. Give up early if the remaining
+        // iterations would exceed the budget
+        if (iter >= 4 && previousResidual > 0)
+        {
+            double rate = residual / previousResidual;
+            if (rate >= 1 || iter + log(tol * scale / residual) / log(rate) > maxIter)
+                return false;
+        }
+        previousResidual = residual;
+
+        // Next subspace
+        Qt = Zt;
+        orthonormalizeRows(Qt, seed);
+    }
+    return false;
+}
+
 void generalizedEigs(const Matrix2D<double> &A, const Matrix2D<double> &B, Matrix1D<double> &D, Matrix2D<double> &P)
 {
 	int N=(int)MAT_YSIZE(A);
@@ -415,6 +732,8 @@ void generalizedEigs(const Matrix2D<double> &A, const Matrix2D<double> &B, Matri
 void firstEigs(const Matrix2D<double> &A, size_t M, Matrix1D<double> &D, Matrix2D<double> &P, bool Pneeded)
 {
 	int N=(int)MAT_YSIZE(A);
+	if (useFirstEigsSubspace(N,M) && firstEigsSubspace(A, M, D, P, Pneeded))
+		return;
 	alglib::real_2d_array a, z;
 	a.setcontent(N,N,MATRIX2D_ARRAY(A));
 	alglib::real_1d_array d;
@@ -526,6 +845,13 @@ void connectedComponentsOfUndirectedGraph(const Matrix2D<double> &G, Matrix1D<in
 
 void matrixOperation_AB(const Matrix2D <double> &A, const Matrix2D<double> &B, Matrix2D<double> &C)
 {
+	if (useBlockedProduct(MAT_YSIZE(A), MAT_XSIZE(B), MAT_XSIZE(A)))
+	{
+		C.resizeNoCopy(MAT_YSIZE(A), MAT_XSIZE(B));
+		gemm(MATRIX2D_ARRAY(A), MATRIX2D_ARRAY(B), MATRIX2D_ARRAY(C),
+		     MAT_YSIZE(A), MAT_XSIZE(B), MAT_XSIZE(A));
+		return;
+	}
 	C.initZeros(MAT_YSIZE(A), MAT_XSIZE(B));
 	for (size_t i = 0; i < MAT_YSIZE(A); ++i)
 		for (size_t j = 0; j < MAT_XSIZE(B); ++j)
@@ -551,6 +877,15 @@ void matrixOperation_Ax(const Matrix2D <double> &A, const Matrix1D<double> &x, M
 
 void matrixOperation_AtA(const Matrix2D <double> &A, Matrix2D<double> &B)
 {
+    if (useBlockedProduct(MAT_XSIZE(A), MAT_XSIZE(A), MAT_YSIZE(A)))
+    {
+        Matrix2D<double> At;
+        transposeBlocked(A, At);
+        B.resizeNoCopy(MAT_XSIZE(A), MAT_XSIZE(A));
+        gemm(MATRIX2D_ARRAY(At), MATRIX2D_ARRAY(A), MATRIX2D_ARRAY(B),
+             MAT_XSIZE(A), MAT_XSIZE(A), MAT_YSIZE(A));
+        return;
+    }
     B.resizeNoCopy(MAT_XSIZE(A), MAT_XSIZE(A));
     for (size_t i = 0; i < MAT_XSIZE(A); ++i)
         for (size_t j = i; j < MAT_XSIZE(A); ++j)
@@ -564,6 +899,15 @@ void matrixOperation_AtA(const Matrix2D <double> &A, Matrix2D<double> &B)
 
 void matrixOperation_AAt(const Matrix2D <double> &A, Matrix2D<double> &C)
 {
+	if (useBlockedProduct(MAT_YSIZE(A), MAT_YSIZE(A), MAT_XSIZE(A)))
+	{
+		Matrix2D<double> At;
+		transposeBlocked(A, At);
+		C.resizeNoCopy(MAT_YSIZE(A), MAT_YSIZE(A));
+		gemm(MATRIX2D_ARRAY(A), MATRIX2D_ARRAY(At), MATRIX2D_ARRAY(C),
+		     MAT_YSIZE(A), MAT_YSIZE(A), MAT_XSIZE(A));
+		return;
+	}
 	C.initZeros(MAT_YSIZE(A), MAT_YSIZE(A));
 	for (size_t i = 0; i < MAT_YSIZE(A); ++i)
 		for (size_t j = i; j < MAT_YSIZE(A); ++j)
@@ -577,6 +921,15 @@ void matrixOperation_AAt(const Matrix2D <double> &A, Matrix2D<double> &C)
 
 void matrixOperation_ABt(const Matrix2D <double> &A, const Matrix2D <double> &B, Matrix2D<double> &C)
 {
+	if (useBlockedProduct(MAT_YSIZE(A), MAT_YSIZE(B), MAT_XSIZE(A)))
+	{
+		Matrix2D<double> Bt;
+		transposeBlocked(B, Bt);
+		C.resizeNoCopy(MAT_YSIZE(A), MAT_YSIZE(B));
+		gemm(MATRIX2D_ARRAY(A), MATRIX2D_ARRAY(Bt), MATRIX2D_ARRAY(C),
+		     MAT_YSIZE(A), MAT_YSIZE(B), MAT_XSIZE(A));
+		return;
+	}
 	C.initZeros(MAT_YSIZE(A), MAT_YSIZE(B));
 	for (size_t i = 0; i < MAT_YSIZE(A); ++i)
 		for (size_t j = 0; j < MAT_YSIZE(B); ++j)
@@ -590,6 +943,15 @@ void matrixOperation_ABt(const Matrix2D <double> &A, const Matrix2D <double> &B,
 
 void matrixOperation_AtB(const Matrix2D <double> &A, const Matrix2D<double> &B, Matrix2D<double> &C)
 {
+    if (useBlockedProduct(MAT_XSIZE(A), MAT_XSIZE(B), MAT_YSIZE(A)))
+    {
+        Matrix2D<double> At;
+        transposeBlocked(A, At);
+        C.resizeNoCopy(MAT_XSIZE(A), MAT_XSIZE(B));
+        gemm(MATRIX2D_ARRAY(At), MATRIX2D_ARRAY(B), MATRIX2D_ARRAY(C),
+             MAT_XSIZE(A), MAT_XSIZE(B), MAT_YSIZE(A));
+        return;
+    }
     C.resizeNoCopy(MAT_XSIZE(A), MAT_XSIZE(B));
     for (size_t i = 0; i < MAT_XSIZE(A); ++i)
         for (size_t j = 0; j < MAT_XSIZE(B); ++j)
@@ -615,6 +977,16 @@ void matrixOperation_Atx(const Matrix2D <double> &A, const Matrix1D<double> &x,
 
 void matrixOperation_AtBt(const Matrix2D <double> &A, const Matrix2D<double> &B, Matrix2D<double> &C)
 {
+	if (useBlockedProduct(MAT_XSIZE(A), MAT_YSIZE(B), MAT_YSIZE(A)))
+	{
+		Matrix2D<double> At, Bt;
+		transposeBlocked(A, At);
+		transposeBlocked(B, Bt);
+		C.resizeNoCopy(MAT_XSIZE(A), MAT_YSIZE(B));
+		gemm(MATRIX2D_ARRAY(At), MATRIX2D_ARRAY(Bt), MATRIX2D_ARRAY(C),
+		     MAT_XSIZE(A), MAT_YSIZE(B), MAT_YSIZE(A));
+		return;
+	}
 	C.initZeros(MAT_XSIZE(A), MAT_YSIZE(B));
 	for (size_t i = 0; i < MAT_XSIZE(A); ++i)
 		for (size_t j = 0; j < MAT_YSIZE(B); ++j)
@@ -629,6 +1001,14 @@ void matrixOperation_AtBt(const Matrix2D <double> &A, const Matrix2D<double> &B,
 void matrixOperation_XtAX_symmetric(const Matrix2D<double> &X, const Matrix2D<double> &A, Matrix2D<double> &B)
 {
 	Matrix2D<double> AX=A*X;
+    if (useBlockedProduct(MAT_XSIZE(X), MAT_XSIZE(X), MAT_YSIZE(X)))
+    {
+        matrixOperation_AtB(X, AX, B);
+        for (size_t i = 0; i < MAT_XSIZE(X); ++i)
+            for (size_t j = i + 1; j < MAT_XSIZE(X); ++j)
+                MAT_ELEM(B, j, i) = MAT_ELEM(B, i, j);
+        return;
+    }
     B.resizeNoCopy(MAT_XSIZE(X), MAT_XSIZE(X));
     for (size_t i = 0; i < MAT_XSIZE(X); ++i)
         for (size_t j = i; j < MAT_XSIZE(X); ++j)
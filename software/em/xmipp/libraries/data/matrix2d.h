@@ -29,9 +29,11 @@
 #include <fstream>
 #include <errno.h>
 #include <fcntl.h>
+#include <algorithm>
 #include <bilib/headers/linearalgebra.h>
 
 #include "xmipp_macros.h"
+#include "xmipp_memory.h"
 #include "xmipp_filename.h"
 #include "xmipp_error.h"
 #include "matrix1d.h"
@@ -63,6 +65,10 @@ void svbksb(Matrix2D< double >& u,
             Matrix1D< double >& b,
             Matrix1D< double >& x);
 
+template<typename T>
+void matrixProduct(const Matrix2D<T> &A, const Matrix2D<T> &B, Matrix2D<T> &C);
+
+void matrixProduct(const Matrix2D<double> &A, const Matrix2D<double> &B, Matrix2D<double> &C);
 
 /** Cholesky decomposition.
  * Given M, this function decomposes M as M=L*L^t where L is a lower triangular matrix.
@@ -446,6 +452,21 @@ public:
         *this = v;
     }
 
+#if __cplusplus >= 201103L
+    /** Move constructor
+     *
+     * The data of v is taken without copying it and v is left empty.
+     */
+    Matrix2D(Matrix2D<T>&& v)
+    {
+        coreInit();
+        if (v.destroyData && !v.mappedData)
+            swap(v);
+        else
+            *this = v;
+    }
+#endif
+
     /** Destructor.
      */
     ~Matrix2D()
@@ -475,6 +496,47 @@ public:
 
         return *this;
     }
+
+#if __cplusplus >= 201103L
+    /** Move assignment.
+     *
+     * The data of op1 is taken without copying it and op1 is left empty.
+     * The values are copied if any of the matrices does not own its data
+     * or is mapped to a file.
+     */
+    Matrix2D<T>& operator=(Matrix2D<T>&& op1)
+    {
+        if (&op1 != this)
+        {
+            if (op1.destroyData && !op1.mappedData &&
+                ((destroyData && !mappedData) || mdata == NULL))
+            {
+                clear();
+                swap(op1);
+            }
+            else
+                *this = op1;
+        }
+        return *this;
+    }
+#endif
+
+    /** Swap two matrices.
+     *
+     * Size and data (also the file mapping) are exchanged without copying
+     * any element.
+     */
+    void swap(Matrix2D<T>& v)
+    {
+        std::swap(mdata, v.mdata);
+        std::swap(destroyData, v.destroyData);
+        std::swap(mappedData, v.mappedData);
+        std::swap(fdMap, v.fdMap);
+        std::swap(mdataOriginal, v.mdataOriginal);
+        std::swap(mdimx, v.mdimx);
+        std::swap(mdimy, v.mdimy);
+        std::swap(mdim, v.mdim);
+    }
     //@}
 
     /// @name Core memory operations for Matrix2D
@@ -540,7 +602,7 @@ public:
         mdimx=_mdimx;
         mdimy=_mdimy;
         mdim=_mdimx*_mdimy;
-        mdata = new T [mdim];
+        mdata = askAlignedMemory<T>(mdim);
         mdataOriginal = NULL;
         mappedData=false;
         fdMap=-1;
@@ -554,7 +616,7 @@ public:
     void coreDeallocate()
     {
         if (mdata != NULL && destroyData)
-            delete[] mdata;
+            freeAlignedMemory(mdata);
         if (mappedData)
         {
 #ifdef XMIPP_MMAP
@@ -592,7 +654,7 @@ public:
 
         try
         {
-            new_mdata = new T [YXdim];
+            new_mdata = askAlignedMemory<T>(YXdim);
         }
         catch (std::bad_alloc &)
         {
@@ -964,11 +1026,7 @@ public:
         if (mdimx != op1.mdimy)
             REPORT_ERROR(ERR_MATRIX_SIZE, "Not compatible sizes in matrix multiplication");
 
-        result.initZeros(mdimy, op1.mdimx);
-        for (size_t i = 0; i < mdimy; i++)
-            for (size_t j = 0; j < op1.mdimx; j++)
-                for (size_t k = 0; k < mdimx; k++)
-                    MAT_ELEM(result,i, j) += MAT_ELEM(*this,i, k) * MAT_ELEM(op1, k, j);
+        matrixProduct(*this, op1, result);
         return result;
     }
 
@@ -1774,6 +1832,20 @@ bool operator==(const Matrix2D<T>& op1, const Matrix2D<T>& op2)
     return op1.equal(op2);
 }
 
+/** Matrix product C=A*B.
+ * This is the product behind operator*. For double matrices, large products
+ * are computed by the blocked, multithreaded version (see matrixOperation_AB).
+ */
+template<typename T>
+void matrixProduct(const Matrix2D<T> &A, const Matrix2D<T> &B, Matrix2D<T> &C)
+{
+    C.initZeros(MAT_YSIZE(A), MAT_XSIZE(B));
+    for (size_t i = 0; i < MAT_YSIZE(A); i++)
+        for (size_t j = 0; j < MAT_XSIZE(B); j++)
+            for (size_t k = 0; k < MAT_XSIZE(A); k++)
+                MAT_ELEM(C, i, j) += MAT_ELEM(A, i, k) * MAT_ELEM(B, k, j);
+}
+
 /**@name Matrix Related functions
  * These functions are not methods of Matrix2D
  */
@@ -1851,12 +1923,18 @@ void svdcmp(const Matrix2D< T >& a,
 /** Generalized eigenvector decomposition.
  * Solves the problem Av=dBv.
  * The decomposition is such that A=B P D P^-1. A and B must be square matrices of the same size.
+ * All the eigenpairs are computed, so this is the single threaded alglib
+ * decomposition; block subspace iteration, as in firstEigs, only pays off
+ * when a few eigenvectors are needed.
  */
 void generalizedEigs(const Matrix2D<double> &A, const Matrix2D<double> &B, Matrix1D<double> &D, Matrix2D<double> &P);
 
 /** First eigenvectors of a real, symmetric matrix.
  * Solves the problem Av=dv.
- * Only the eigenvectors of the largest M eigenvalues are returned as columns of P
+ * Only the eigenvectors of the largest M eigenvalues are returned as columns of P.
+ * When M is small compared to the size of A, the eigenvectors are computed by
+ * block subspace iteration on top of the blocked matrix products; if it does not
+ * converge fast enough, the full tridiagonal decomposition is used instead.
  */
 void firstEigs(const Matrix2D<double> &A, size_t M, Matrix1D<double> &D, Matrix2D<double> &P, bool Pneeded=true);
 
@@ -1869,6 +1947,8 @@ void lastEigs(const Matrix2D<double> &A, size_t M, Matrix1D<double> &D, Matrix2D
 /** Compute eigenvectors between two indexes of a real, symmetric matrix.
  * Solves the problem Av=dv.
  * Only the eigenvectors of the smallest eigenvalues between indexes I1 and I2 are returned as columns of P. Indexes start at 0.
+ * The callers ask for the smallest eigenvalues, where subspace iteration on
+ * the matrix products converges slowest, so the alglib decomposition is used.
  */
 void eigsBetween(const Matrix2D<double> &A, size_t I1, size_t I2, Matrix1D<double> &D, Matrix2D<double> &P);
 
@@ -1964,13 +2044,28 @@ void normalizeColumnsBetween0and1(Matrix2D<double> &A);
  */
 void subtractColumnMeans(Matrix2D<double> &A);
 
+/** Number of threads of the dense matrix operations.
+ * The matrix products (operator* and matrixOperation_XX), firstEigs and the
+ * products of SparseMatrix2D use this number of threads for large matrices. It is a process-wide setting
+ * whose default is 1; programs set it from their --thr parameter.
+ */
+void setMatrix2DThreads(int nThreads);
+
+/** Number of threads of the dense matrix operations. */
+int getMatrix2DThreads();
+
 /** Matrix operation: B=A^t*A. */
 void matrixOperation_AtA(const Matrix2D <double> &A, Matrix2D<double> &B);
 
 /** Matrix operation: C=A*A^t. */
 void matrixOperation_AAt(const Matrix2D <double> &A, Matrix2D<double> &C);
 
-/** Matrix operation: C=A*B. */
+/** Matrix operation: C=A*B.
+ * The products of this family (AB, ABt, AtB, AtBt, AtA, AAt, XtAX) are
+ * computed with the plain loops for small matrices. Large products are
+ * blocked for the caches, vectorized and split by rows of C among
+ * getMatrix2DThreads() threads.
+ */
 void matrixOperation_AB(const Matrix2D <double> &A, const Matrix2D<double> &B, Matrix2D<double> &C);
 
 /** Matrix operation: y=A*x. */
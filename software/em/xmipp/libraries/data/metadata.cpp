@@ -138,6 +138,7 @@ void MetaData::init(const std::vector<MDLabel> *labelsVector)
 {
     _clear();
     _maxRows = 0; //by default read all rows
+    _offsetRows = 0; //starting from the first one
     _parsedLines = 0; //no parsed line;
     if (labelsVector != NULL)
         this->activeLabels = *labelsVector;
@@ -213,16 +214,10 @@ bool MetaData::getValue(MDObject &mdValueOut, size_t id) const
 
 void MetaData::getColumnValues(const MDLabel label, std::vector<MDObject> &valuesOut) const
 {
-    MDObject mdValueOut(label);
-    std::vector<size_t> objectsId;
-    findObjects(objectsId);
-    size_t n = objectsId.size();
-    valuesOut.resize(n,mdValueOut);
-    for (size_t i = 0; i < n; ++i)
-    {
-        getValue(mdValueOut, objectsId[i]);
-        valuesOut[i] = mdValueOut;
-    }
+    if (label == MDL_OBJID || containsLabel(label))
+        myMDSql->getColumnValues(label, valuesOut);
+    else //missing columns are filled with default values
+        valuesOut.assign(size(), MDObject(label));
 }
 
 void MetaData::setColumnValues(const std::vector<MDObject> &valuesIn)
@@ -232,18 +227,17 @@ void MetaData::setColumnValues(const std::vector<MDObject> &valuesIn)
         addObjects=true;
     if (valuesIn.size()!=size() && !addObjects)
         REPORT_ERROR(ERR_MD_OBJECTNUMBER,"Input vector must be of the same size as the metadata");
-    if (!addObjects)
-    {
-        size_t n=0;
-        FOR_ALL_OBJECTS_IN_METADATA(*this)
-        setValue(valuesIn[n++],__iter.objId);
-    }
-    else
+    if (valuesIn.empty())
+        return;
+    if (addObjects)
     {
         size_t nmax=valuesIn.size();
         for (size_t n=0; n<nmax; ++n)
-            setValue(valuesIn[n],addObject());
+            addObject();
     }
+    //add label if not exists, this is checked in addlabel
+    addLabel(valuesIn[0].label);
+    myMDSql->setColumnValues(valuesIn);
 }
 
 bool MetaData::getRow(MDRow &row, size_t id) const
@@ -1071,51 +1065,130 @@ void MetaData::_readRows(std::istream& is, std::vector<MDObject*> & columnValues
     }
 }
 
+/* Return true if the line between iter and newline contains data,
+ * i.e., it is not empty nor a comment
+ */
+static inline bool isStarDataLine(const char * iter, const char * newline)
+{
+    while (iter < newline && isspace(*iter))
+        ++iter;
+    return iter < newline && *iter != '#';
+}
+
+/* Skip the spaces before the value starting at iter and return
+ * a pointer just after it. Quoted values may contain spaces.
+ */
+static inline char * skipStarValue(char *&iter, char * end)
+{
+    while (iter < end && isspace(*iter))
+        ++iter;
+    char * p = iter;
+    if (p < end && (*p == _QUOT || *p == _DQUOT))
+    {
+        char quote = *p++;
+        while (p < end && !(*p == quote && (p + 1 == end || isspace(p[1]))))
+            ++p;
+        if (p < end)
+            ++p;
+    }
+    else
+        while (p < end && !isspace(*p))
+            ++p;
+    return p;
+}
+
 /* This function will be used to parse the rows data in START format
  */
-void MetaData::_readRowsStar(mdBlock &block, std::vector<MDObject*> & columnValues, const std::vector<MDLabel> *desiredLabels)
+void MetaData::_readRowsStar(mdBlock &block, std::vector<MDObject*> & columnValues, const std::vector<MDLabel> *desiredLabels,
+                             const mdBlockIndex *index)
 {
-    String line;
-    std::stringstream ss;
     size_t nCol = columnValues.size();
-    size_t id, n = block.end - block.loop;
-    bool	firstTime=true;
+    bool firstTime = true;
 
-    if (n==0)
+    _parsedLines = 0; //Check how many lines the md have
+    if (block.loop >= block.end)
         return;
 
-    char * buffer = new char[n];
-    memcpy(buffer, block.loop, n);
-    char *iter = buffer, *end = iter + n, * newline = NULL;
-    _parsedLines = 0; //Check how many lines the md have
+    //Only the defined columns are converted, the others are just skipped
+    std::vector<MDObject*> parsedValues;
+    std::vector<bool> parseColumn(nCol);
+    for (size_t i = 0; i < nCol; ++i)
+        if ((parseColumn[i] = (columnValues[i]->label != MDL_UNDEFINED)))
+            parsedValues.push_back(columnValues[i]);
+    bool projectColumns = parsedValues.size() < nCol;
+
+    //Window of rows to be parsed, _maxRows would be > 0 if we only want
+    //to read some rows from the md for performance reasons...
+    //anyway the number of lines will be counted in _parsedLines
+    size_t firstRow = _offsetRows;
+    size_t lastRow = (_maxRows == 0) ? (size_t) -1 : firstRow + _maxRows;
+    size_t row = 0;
+    char *iter = block.loop, *end = block.end, * newline = NULL;
+
+    //Seek to the closest indexed row before the window
+    if (index != NULL && !index->marks.empty())
+    {
+        size_t mark = XMIPP_MIN(firstRow / STAR_INDEX_STRIDE, index->marks.size() - 1);
+        if (mark > 0)
+        {
+            iter = block.begin - index->begin + index->marks[mark];
+            row = mark * STAR_INDEX_STRIDE;
+        }
+    }
+
+    String line;
+    std::stringstream ss;
     while (iter < end) //while there are data lines
     {
         //Assing \n position and check if NULL at the same time
         if (!(newline = END_OF_LINE()))
             newline = end;
-        line.assign(iter, newline - iter);
-        trim(line);
 
-        if (!line.empty() && line[0] != '#')
+        if (isStarDataLine(iter, newline))
         {
-            //_maxRows would be > 0 if we only want to read some
-            // rows from the md for performance reasons...
-            // anyway the number of lines will be counted in _parsedLines
-            if (_maxRows == 0 || _parsedLines < _maxRows)
+            if (row >= lastRow)
+            {
+                //The index already knows how many rows remain
+                if (index != NULL)
+                {
+                    row = index->rows;
+                    break;
+                }
+            }
+            else if (row >= firstRow)
             {
-            	std::stringstream ss(line);
-            	_parseObjects( ss, columnValues, desiredLabels, firstTime);
-            	firstTime=false;
+                if (projectColumns)
+                {
+                    line.clear();
+                    for (size_t i = 0; i < nCol; ++i)
+                    {
+                        char * valueEnd = skipStarValue(iter, newline);
+                        if (parseColumn[i])
+                            line.append(iter, valueEnd - iter).append(1, ' ');
+                        iter = valueEnd;
+                    }
+                }
+                else
+                    line.assign(iter, newline - iter);
+
+                if (parsedValues.empty() && desiredLabels == NULL)
+                    addObject();
+                else
+                {
+                    ss.clear();
+                    ss.str(line);
+                    _parseObjects(ss, parsedValues, desiredLabels, firstTime);
+                    firstTime = false;
+                }
             }
-            _parsedLines++;
+            ++row;
         }
         iter = newline + 1; //go to next line
     }
+    _parsedLines = row;
 
     // Finalize statement.
     myMDSql->finalizePreparedStmt();
-
-    delete[] buffer;
 }
 
 /*This function will read the md data if is in row format */
@@ -1269,6 +1342,139 @@ bool MetaData::existsBlock(const FileName &_inFile)
     REPORT_ERROR(ERR_MMAP,"Mapping not supported in Windows");
 #endif
 }
+/* Line index of STAR files ------------------------------------------------ */
+#define STAR_INDEX_HEADER "# XMIPP_STAR_INDEX_1"
+
+void MetaData::_buildStarIndex(const mdBuffer &bufferMap, std::vector<mdBlockIndex> &index)
+{
+    BUFFER_COPY(bufferMap, buffer);
+    BLOCK_CREATE(block);
+    index.clear();
+    while (nextBlock(buffer, block))
+    {
+        index.push_back(mdBlockIndex());
+        mdBlockIndex &blockIndex = index.back();
+        blockIndex.begin = block.begin - bufferMap.begin;
+        blockIndex.nameSize = block.nameSize;
+        blockIndex.end = block.end - bufferMap.begin;
+        blockIndex.loop = 0;
+        blockIndex.rows = 0;
+        if (block.loop == NULL)
+            continue;
+        blockIndex.loop = block.loop - bufferMap.begin;
+
+        char *iter = block.loop, *end = block.end, *newline = NULL;
+        bool inLabels = true;
+        for (; iter < end; iter = newline + 1)
+        {
+            if (!(newline = END_OF_LINE()))
+                newline = end;
+            if (!isStarDataLine(iter, newline))
+                continue;
+            if (inLabels)
+            {
+                char * p = iter;
+                while (isspace(*p))
+                    ++p;
+                if (*p == '_')
+                    continue;
+                inLabels = false;
+            }
+            if (blockIndex.rows % STAR_INDEX_STRIDE == 0)
+                blockIndex.marks.push_back(iter - bufferMap.begin);
+            ++blockIndex.rows;
+        }
+    }
+}
+
+/* Read the line index of a STAR file, return false if it does not exist
+ * or it is outdated
+ */
+static bool readStarIndex(const FileName &fnStar, std::vector<mdBlockIndex> &index)
+{
+    struct stat fileStatus;
+    if (stat(fnStar.c_str(), &fileStatus) != 0)
+        return false;
+
+    std::ifstream fhIndex((fnStar + STAR_INDEX_EXTENSION).c_str());
+    String line;
+    if (!getline(fhIndex, line) || line != STAR_INDEX_HEADER)
+        return false;
+
+    size_t fileSize, stride, nBlocks, nMarks;
+    long int fileTime;
+    fhIndex >> fileSize >> fileTime >> stride >> nBlocks;
+    if (fhIndex.fail() || fileSize != (size_t) fileStatus.st_size ||
+        fileTime != (long int) fileStatus.st_mtime || stride != STAR_INDEX_STRIDE)
+        return false;
+
+    index.resize(nBlocks);
+    for (size_t n = 0; n < nBlocks && !fhIndex.fail(); ++n)
+    {
+        mdBlockIndex &blockIndex = index[n];
+        fhIndex >> blockIndex.begin >> blockIndex.nameSize >> blockIndex.end
+        >> blockIndex.loop >> blockIndex.rows >> nMarks;
+        blockIndex.marks.resize(fhIndex.fail() ? 0 : nMarks);
+        for (size_t i = 0; i < blockIndex.marks.size(); ++i)
+            fhIndex >> blockIndex.marks[i];
+        if (blockIndex.end > fileSize)
+            fhIndex.setstate(std::ios::failbit);
+    }
+    if (fhIndex.fail())
+    {
+        index.clear();
+        return false;
+    }
+    return true;
+}
+
+/* Save the line index next to the STAR file. The index is written to a
+ * temporary file and renamed, so that several processes can build it
+ * at the same time. Errors (e.g. read-only directories) are ignored.
+ */
+static void writeStarIndex(const FileName &fnStar, const std::vector<mdBlockIndex> &index)
+{
+    struct stat fileStatus;
+    if (stat(fnStar.c_str(), &fileStatus) != 0)
+        return;
+
+    FileName fnIndex = fnStar + STAR_INDEX_EXTENSION;
+    FileName fnTmp = formatString("%s.%d", fnIndex.c_str(), (int) getpid());
+    std::ofstream fhIndex(fnTmp.c_str());
+    if (!fhIndex)
+        return;
+    fhIndex << STAR_INDEX_HEADER << std::endl
+    << (size_t) fileStatus.st_size << " " << (long int) fileStatus.st_mtime << " "
+    << STAR_INDEX_STRIDE << " " << index.size() << std::endl;
+    for (size_t n = 0; n < index.size(); ++n)
+    {
+        const mdBlockIndex &blockIndex = index[n];
+        fhIndex << blockIndex.begin << " " << blockIndex.nameSize << " " << blockIndex.end << " "
+        << blockIndex.loop << " " << blockIndex.rows << " " << blockIndex.marks.size() << std::endl;
+        for (size_t i = 0; i < blockIndex.marks.size(); ++i)
+            fhIndex << blockIndex.marks[i] << std::endl;
+    }
+    fhIndex.close();
+    if (fhIndex.fail() || rename(fnTmp.c_str(), fnIndex.c_str()) != 0)
+        unlink(fnTmp.c_str());
+}
+
+/* Set the block pointers from the n-th entry of the line index */
+static bool nextIndexedBlock(const mdBuffer &bufferMap, const std::vector<mdBlockIndex> &index,
+                             size_t &n, mdBlock &block)
+{
+    BLOCK_INIT(block);
+    if (n >= index.size())
+        return false;
+    const mdBlockIndex &blockIndex = index[n++];
+    block.begin = bufferMap.begin + blockIndex.begin;
+    block.nameSize = blockIndex.nameSize;
+    block.end = bufferMap.begin + blockIndex.end;
+    if (blockIndex.loop)
+        block.loop = bufferMap.begin + blockIndex.loop;
+    return true;
+}
+
 void MetaData::readXML(const FileName &filename,
                        const std::vector<MDLabel> *desiredLabels,
                        const String & blockRegExp,
@@ -1282,7 +1488,7 @@ void MetaData::readDB(const FileName &filename,
                       const String & blockRegExp,
                       bool decomposeStack)//what is decompose stack for?
 {
-    myMDSql->copyTableFromFileDB(blockRegExp, filename, desiredLabels, _maxRows);
+    myMDSql->copyTableFromFileDB(blockRegExp, filename, desiredLabels, _maxRows, _offsetRows);
 }
 void MetaData::readStar(const FileName &filename,
                         const std::vector<MDLabel> *desiredLabels,
@@ -1381,9 +1587,20 @@ void MetaData::readStar(const FileName &filename,
         bool firstBlock = true;
         bool singleBlock = blockRegExp.find_first_of(".[*+")==String::npos;
 
+        //When reading only a window of rows from a big file, use its line index
+        //to avoid scanning the whole file
+        std::vector<mdBlockIndex> index;
+        bool useIndex = (_maxRows > 0 || _offsetRows > 0) && bufferMap.size >= STAR_INDEX_MIN_SIZE;
+        if (useIndex && !readStarIndex(inFile, index))
+        {
+            _buildStarIndex(bufferMap, index);
+            writeStarIndex(inFile, index);
+        }
+        size_t nBlock = 0;
+
         String blockName;
 
-        while (nextBlock(buffer, block))
+        while (useIndex ? nextIndexedBlock(bufferMap, index, nBlock, block) : nextBlock(buffer, block))
             //startingPoint, remainingSize, firstData, secondData, firstloop))
         {
             BLOCK_NAME(block, blockName);
@@ -1397,7 +1614,7 @@ void MetaData::readStar(const FileName &filename,
                     // If block is empty, makes block.loop and block.end equal
                     if(block.loop == (block.end + 1))
                         block.loop--;
-                    _readRowsStar(block, columnValues, desiredLabels);
+                    _readRowsStar(block, columnValues, desiredLabels, useIndex ? &index[nBlock - 1] : NULL);
                 }
                 else
                 {
@@ -148,6 +148,27 @@ mdBlock;
 #define BLOCK_INIT(b) b.begin = b.end = b.loop = NULL; b.nameSize = 0
 #define BLOCK_NAME(b, s) s.assign(b.begin, b.nameSize)
 
+/** Line index of a STAR data block.
+ * It is stored in a sidecar file next to big STAR files (see MetaData::setRowOffset)
+ * and allows to seek to a given row without scanning the previous ones.
+ */
+typedef struct
+{
+    size_t begin; //Offset of the block name in the file
+    size_t nameSize; //Number of characters of the block name
+    size_t end; //Offset of the block end in the file
+    size_t loop; //Offset of the first line after loop_, 0 if not loop_
+    size_t rows; //Number of data rows in the block
+    std::vector<size_t> marks; //Offset of every STAR_INDEX_STRIDE-th data row
+}
+mdBlockIndex;
+/// Rows between two marks of the line index
+#define STAR_INDEX_STRIDE 1024
+/// STAR files smaller than this are never indexed
+#define STAR_INDEX_MIN_SIZE (16 * 1024 * 1024)
+/// Extension added to the STAR filename to name its line index
+#define STAR_INDEX_EXTENSION ".lidx"
+
 ////////////////////////////// MetaData Iterator ////////////////////////////
 /** Iterates over metadatas */
 class MDIterator
@@ -280,18 +301,22 @@ protected:
                       const std::vector<MDLabel>* desiredLabels = NULL);
     void _readRows(std::istream& is, std::vector<MDObject*> & columnValues, bool useCommentAsImage);
     /** This function will be used to parse the rows data in START format
+     * Only the rows in the window set by setRowOffset and setMaxRows are parsed
+     * and columns not present in desiredLabels are skipped without conversion.
      * @param[out] columnValues MDRow with values to fill in
-     * @param pchStart pointer to the position of '_loop' in memory
-     * @param pEnd  pointer to the position of the next '_data' in memory
-     * @param maxRows if this number if greater than 0, only this number of rows will be parsed.
+     * @param block pointers to the data block, block.loop should be after the labels
+     * @param index if not NULL, line index of this block used to seek to the first row
      */
-    void _readRowsStar(mdBlock &block, std::vector<MDObject*> & columnValues, const std::vector<MDLabel> *desiredLabels);
+    void _readRowsStar(mdBlock &block, std::vector<MDObject*> & columnValues, const std::vector<MDLabel> *desiredLabels,
+                       const mdBlockIndex *index = NULL);
+    /** Build the line index of all the blocks of a mapped STAR file */
+    void _buildStarIndex(const mdBuffer &bufferMap, std::vector<mdBlockIndex> &index);
     void _readRowFormat(std::istream& is);
 
-    /** This two variables will be used to read the metadata information (labels and size)
+    /** This variables will be used to read the metadata information (labels and size)
      * or maybe a few rows only
      */
-    size_t _maxRows, _parsedLines;
+    size_t _maxRows, _offsetRows, _parsedLines;
 
 public:
     /** @name Constructors
@@ -354,6 +379,18 @@ public:
       _maxRows = maxRows;
     }
 
+    /** Skip the first rows when reading from file.
+     * Together with setMaxRows this defines the window of rows to be read,
+     * for example to read only the part of a metadata processed by one MPI node.
+     * When reading STAR files larger than STAR_INDEX_MIN_SIZE with a window,
+     * a line index is saved next to the file (filename + STAR_INDEX_EXTENSION)
+     * so that later reads seek directly to the first row of the window.
+     */
+    void setRowOffset(size_t offset=0)
+    {
+      _offsetRows = offset;
+    }
+
     /** Return the number of lines in the metadata file.
      * Serves to know the number of items even is read with
      * maxRows != 0
@@ -561,15 +598,13 @@ public:
     void getColumnValues(const MDLabel label, std::vector<T> &valuesOut) const
     {
         T value;
-        MDObject mdValueOut(label);
-        std::vector<size_t> objectsId;
-        findObjects(objectsId);
-        size_t n = objectsId.size();
+        std::vector<MDObject> values;
+        getColumnValues(label, values);
+        size_t n = values.size();
         valuesOut.resize(n);
         for (size_t i = 0; i < n; ++i)
         {
-            getValue(mdValueOut, objectsId[i]);
-            mdValueOut.getValue(value);
+            values[i].getValue(value);
             valuesOut[i] = value;
         }
     }
@@ -584,24 +619,20 @@ public:
     template<class T>
     void setColumnValues(const MDLabel label, const std::vector<T> &valuesIn)
     {
-        bool addObjects=false;
-        if (size()==0)
-            addObjects=true;
-        if (valuesIn.size()!=size() && !addObjects)
-            REPORT_ERROR(ERR_MD_OBJECTNUMBER,"Input vector must be of the same size as the metadata");
-        size_t n=0;
-        if (!addObjects)
-            FOR_ALL_OBJECTS_IN_METADATA(*this)
-            setValue(label,valuesIn[n++],__iter.objId);
-        else
+        std::vector<MDObject> values;
+        size_t n = valuesIn.size();
+        values.reserve(n);
+        for (size_t i = 0; i < n; ++i)
         {
-            size_t nmax=valuesIn.size();
-            for (size_t n=0; n<nmax; ++n)
-                setValue(label,valuesIn[n],addObject());
+            T value = valuesIn[i];
+            values.push_back(MDObject(label, value));
         }
+        setColumnValues(values);
     }
 
-    /** Get all values of a column as a vector.
+    /** Set all values of a column as a vector.
+     * All the values should have the same label. If the metadata is
+     * empty, one object is added for each value.
      */
     void setColumnValues(const std::vector<MDObject> &valuesIn);
 
@@ -371,6 +371,30 @@ void mpiSelectPart(MetaData &md, int rank, int size, int &num_img_tot)
     md.selectSplitPart(aux, size, rank);
 }
 
+void mpiSelectPart(const FileName &fnMd, MetaData &md, int rank, int size, int &num_img_tot)
+{
+    MetaData aux;
+    aux.setMaxRows(1);
+    aux.read(fnMd);
+    num_img_tot = aux.getParsedLines();
+    if (num_img_tot == 0) //old formats are always read completely
+    {
+        num_img_tot = aux.size();
+        md.selectSplitPart(aux, size, rank);
+        return;
+    }
+    if (size > num_img_tot)
+        REPORT_ERROR(ERR_MD, "mpiSelectPart: Couldn't split a metadata in more parts than its size");
+
+    size_t first, last;
+    size_t n = divide_equally(num_img_tot, size, rank, first, last);
+    md.setRowOffset(first);
+    md.setMaxRows(n);
+    md.read(fnMd);
+    md.setRowOffset();
+    md.setMaxRows();
+}
+
 void readMetaDataWithTwoPossibleImages(const FileName &fn, MetaData &md)
 {
     if (fn.isStar1(true))
@@ -71,9 +71,19 @@ bool compareTwoMetadataFiles(const FileName &fn1, const FileName &fn2);
 /** Maximum length of the filenames inside */
 int maxFileNameLength(const MetaData &md, MDLabel image_label=MDL_IMAGE);
 
-/** Choose a part of the metadata for MPI */
+/** Choose a part of the metadata for MPI.
+ * The whole metadata has to be read by every node. When the metadata
+ * comes directly from a file, the overload below reads only the part.
+ */
 void mpiSelectPart(MetaData &md, int rank, int size, int &num_img_tot);
 
+/** Read from file only the part of the metadata for MPI.
+ * The part is the same as with mpiSelectPart, but each node only parses
+ * its own rows (see MetaData::setRowOffset). Old formats without a
+ * row count are still read completely.
+ */
+void mpiSelectPart(const FileName &fnMd, MetaData &md, int rank, int size, int &num_img_tot);
+
 /** Read a 1 or two column list of micrographs.
  *  Two column files are interpreted as Random Conical Tilt pairs.
  */
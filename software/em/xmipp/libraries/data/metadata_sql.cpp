@@ -34,15 +34,50 @@
 
 //This is needed for static memory allocation
 int MDSql::table_counter = 0;
-sqlite3 *MDSql::db;
 MDSqlStaticInit MDSql::initialization;
-char *MDSql::errmsg;
-const char *MDSql::zLeftover;
-int MDSql::rc;
-Mutex sqlMutex; //Mutex to syncronize db access
+bool MDSql::mathExtensions = false;
+bool MDSql::regExtensions = false;
+int MDSql::busyTimeOut = -1;
+// Locks are always taken in this order: instancesMutex, the mutex of each
+// MDSql (in address order, see MDSqlLock) and finally sqlMutex, which
+// only protects the table counter and is never held while taking another
+Mutex sqlMutex; //Mutex to syncronize the table counter
+Mutex instancesMutex; //Mutex to syncronize the list of live connections
+
+/** Scoped lock over the connections of one or several metadatas.
+ * The locks are taken in address order to avoid deadlocks
+ * when two threads operate with the same pair of metadatas.
+ */
+class MDSqlLock
+{
+    const MDSql * sql[3];
+    int n;
+public:
+    MDSqlLock(const MDSql *sql1, const MDSql *sql2 = NULL, const MDSql *sql3 = NULL)
+    {
+        const MDSql * in[3] = {sql1, sql2, sql3};
+        n = 0;
+        for (int i = 0; i < 3; ++i)
+        {
+            if (in[i] == NULL)
+                continue;
+            bool repeated = false;
+            for (int j = 0; j < n; ++j)
+                repeated = repeated || sql[j] == in[i];
+            if (!repeated)
+                sql[n++] = in[i];
+        }
+        std::sort(sql, sql + n);
+        for (int i = 0; i < n; ++i)
+            pthread_mutex_lock(&(sql[i]->mutex));
+    }
 
-std::stringstream MDSql::preparedStream;	// Stream.
-sqlite3_stmt * MDSql::preparedStmt;
+    ~MDSqlLock()
+    {
+        for (int i = n - 1; i >= 0; --i)
+            pthread_mutex_unlock(&(sql[i]->mutex));
+    }
+};
 
 void sqlite_regexp(sqlite3_context* context, int argc, sqlite3_value** values) {
     int ret;
@@ -102,54 +137,89 @@ int getBlocksInMetaDataFileDB(const FileName &inFile, StringVector& blockList)
     return rows;
 }
 
+std::set<MDSql*> &MDSql::instances()
+{
+    // Never destroyed, metadatas can be still alive at exit
+    static std::set<MDSql*> * live = new std::set<MDSql*>();
+    return *live;
+}
+
 int MDSql::getUniqueId()
 {
-    //    if (table_counter == 0)
-    //        sqlBegin();
-    return ++table_counter;
+    sqlMutex.lock();
+    int id = ++table_counter;
+    sqlMutex.unlock();
+    return id;
 }
 
 MDSql::MDSql(MetaData *md)
 {
-    sqlMutex.lock();
-    tableId = getUniqueId();
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    db = NULL;
+    errmsg = NULL;
+    zLeftover = NULL;
+    rc = SQLITE_OK;
+    tableId = dbId = getUniqueId();
     //std::cerr << ">>>> creating md with table id: " << tableId << std::endl;
-    sqlMutex.unlock();
     myMd = md;
     myCache = new MDCache();
 
+    sqlOpen();
+    instancesMutex.lock();
+    bool ok = applySettings();
+    if (ok)
+        instances().insert(this);
+    instancesMutex.unlock();
+    if (!ok)
+    {
+        // The destructor is not called if the constructor throws
+        delete myCache;
+        sqlClose();
+        pthread_mutex_destroy(&mutex);
+        REPORT_ERROR(ERR_MD_SQL,"Cannot apply sqlite settings (extensions or busy timeout)");
+    }
 }
 
 MDSql::~MDSql()
 {
+    instancesMutex.lock();
+    instances().erase(this);
+    instancesMutex.unlock();
+
     delete myCache;
+    sqlClose();
+    pthread_mutex_destroy(&mutex);
 }
 
 bool MDSql::createMd()
 {
-    sqlMutex.lock();
+    MDSqlLock lock(this);
     //std::cerr << "creating md" <<std::endl;
     bool result = createTable(&(myMd->activeLabels));
     //std::cerr << "leave creating md" <<std::endl;
-    sqlMutex.unlock();
 
     return result;
 }
 
 bool MDSql::clearMd()
 {
-    sqlMutex.lock();
+    MDSqlLock lock(this);
     //std::cerr << "clearing md" <<std::endl;
     myCache->clear();
     bool result = dropTable();
     //std::cerr << "leave clearing md" <<std::endl;
-    sqlMutex.unlock();
 
     return result;
 }
 
 size_t MDSql::addRow()
 {
+    MDSqlLock lock(this);
     //Fixme: this can be done in the constructor of MDCache only once
     sqlite3_stmt * &stmt = myCache->addRowStmt;
     //sqlite3_stmt * stmt = NULL;
@@ -177,28 +247,60 @@ size_t MDSql::addRow()
 
 bool MDSql::addColumn(MDLabel column)
 {
+    MDSqlLock lock(this);
     std::stringstream ss;
     ss << "ALTER TABLE " << tableName(tableId)
     << " ADD COLUMN " << MDL::label2SqlColumn(column) <<";";
     return execSingleStmt(ss);
 }
 
+bool MDSql::applyToAllInstances()
+{
+    bool ok = true;
+    instancesMutex.lock();
+    for (std::set<MDSql*>::iterator it = instances().begin(); it != instances().end(); ++it)
+        ok = (*it)->applySettings() && ok;
+    instancesMutex.unlock();
+    return ok;
+}
+
 bool  MDSql::activateMathExtensions(void)
 {
-    const char* lib = "libXmippSqliteExt.so";
-    sqlite3_enable_load_extension(db, 1);
-    if( sqlite3_load_extension(db, lib, 0, 0)!= SQLITE_OK)
+    mathExtensions = true;
+    if (!applyToAllInstances())
+    {
+        mathExtensions = false;
         REPORT_ERROR(ERR_MD_SQL,"Cannot activate sqlite extensions");
-    else
-        return true;
+    }
+    return true;
 }
 
 bool  MDSql::activateRegExtensions(void)
 {
-	if( sqlite3_create_function(db, "regexp", 2, SQLITE_ANY,0, &sqlite_regexp,0,0)!= SQLITE_OK)
+    regExtensions = true;
+    if (!applyToAllInstances())
+    {
+        regExtensions = false;
         REPORT_ERROR(ERR_MD_SQL,"Cannot activate sqlite extensions");
-    else
-        return true;
+    }
+    return true;
+}
+
+bool MDSql::applySettings()
+{
+    MDSqlLock lock(this);
+    bool ok = true;
+    if (mathExtensions)
+    {
+        const char* lib = "libXmippSqliteExt.so";
+        sqlite3_enable_load_extension(db, 1);
+        ok = ok && sqlite3_load_extension(db, lib, 0, 0) == SQLITE_OK;
+    }
+    if (regExtensions)
+        ok = ok && sqlite3_create_function(db, "regexp", 2, SQLITE_ANY,0, &sqlite_regexp,0,0) == SQLITE_OK;
+    if (busyTimeOut >= 0)
+        ok = ok && sqlite3_busy_timeout(db, busyTimeOut) == SQLITE_OK;
+    return ok;
 }
 
 bool  MDSql::deactivateThreadMuting(void)
@@ -224,11 +326,10 @@ bool MDSql::renameColumn(const std::vector<MDLabel> oldLabel, const std::vector<
          ++itOld, ++itNew )
         std::replace(v1.begin(), v1.end(), *itOld, *itNew);
 
+    MDSqlLock lock(this);
     int oldTableId = tableId;
-    sqlMutex.lock();
     tableId = getUniqueId();
     createTable(&v1);
-    sqlMutex.unlock();
     //2 Now we can copy the original data to the new table:
     String oldLabelString=" objID";
     String newLabelString=" objID";
@@ -264,6 +365,7 @@ bool MDSql::renameColumn(const std::vector<MDLabel> oldLabel, const std::vector<
 
 size_t MDSql::size(void)
 {
+    MDSqlLock lock(this);
     std::stringstream ss;
     ss << "SELECT COUNT(*) FROM "<< tableName(tableId) << ";";
     return execSingleIntStmt(ss);
@@ -271,49 +373,52 @@ size_t MDSql::size(void)
 
 bool MDSql::setObjectValues(const std::vector<MDObject*> & columnValues, const std::vector<MDLabel> *desiredLabels, bool firstTime)
 {
+    MDSqlLock lock(this);
     bool r = true;			// Return value.
     int i=0, j=0;			// Loop indexes.
+    std::stringstream &preparedStream = myCache->preparedStream;
+    sqlite3_stmt * &preparedStmt = myCache->preparedStmt;
 
     if (firstTime)
     {
     	// Clear preparedStream.
-    	this->preparedStream.str(std::string());
+    	preparedStream.str(std::string());
 
     	// Initialize SQL sentence.
-    	this->preparedStream << "INSERT INTO " << tableName(tableId);
+    	preparedStream << "INSERT INTO " << tableName(tableId);
 
     	// Add columns.
-    	this->preparedStream << " (";
+    	preparedStream << " (";
 
     	// If desired labels is null then add all columns.
     	if (desiredLabels==NULL)
     	{
-    		this->preparedStream << MDL::label2StrSql(columnValues[0]->label);
+    		preparedStream << MDL::label2StrSql(columnValues[0]->label);
     		for (i=1; i<columnValues.size() ;i++)
     		{
-    			this->preparedStream << "," << MDL::label2StrSql(columnValues[i]->label);
+    			preparedStream << "," << MDL::label2StrSql(columnValues[i]->label);
     		}
     	}
     	// Add only desired columns.
     	else
     	{
-    		this->preparedStream << MDL::label2StrSql((*desiredLabels)[0]);
+    		preparedStream << MDL::label2StrSql((*desiredLabels)[0]);
     		for (i=1; i<desiredLabels->size() ;i++)
     		{
-    			this->preparedStream << "," << MDL::label2StrSql((*desiredLabels)[i]);
+    			preparedStream << "," << MDL::label2StrSql((*desiredLabels)[i]);
     		}
     	}
-    	this->preparedStream << ")";
+    	preparedStream << ")";
 
     	// Add ? symbols.
-    	this->preparedStream << " VALUES (?";
+    	preparedStream << " VALUES (?";
 
     	// If desired labels is null then add all columns.
     	if (desiredLabels==NULL)
     	{
     		for (i=1; i<columnValues.size() ;i++)
     		{
-    			this->preparedStream << ",?";
+    			preparedStream << ",?";
     		}
     	}
     	// Add only desired columns.
@@ -321,22 +426,22 @@ bool MDSql::setObjectValues(const std::vector<MDObject*> & columnValues, const s
     	{
     		for (i=1; i<desiredLabels->size() ;i++)
     		{
-    			this->preparedStream << ",?";
+    			preparedStream << ",?";
     		}
     	}
-    	this->preparedStream << ");";
+    	preparedStream << ");";
 
     	// Prepare statement.
-    	rc = sqlite3_prepare_v2(db, this->preparedStream.str().c_str(), -1, &this->preparedStmt, &zLeftover);
+    	rc = sqlite3_prepare_v2(db, preparedStream.str().c_str(), -1, &preparedStmt, &zLeftover);
     }
 
     // Add values.
     if (desiredLabels==NULL)
     {
-        bindValue( this->preparedStmt, 1, *(columnValues[0]));
+        bindValue( preparedStmt, 1, *(columnValues[0]));
         for (i=1; i<columnValues.size() ;i++)
         {
-        	bindValue( this->preparedStmt, i+1, *(columnValues[i]));
+        	bindValue( preparedStmt, i+1, *(columnValues[i]));
         }
     }
     // Add only desired columns.
@@ -348,7 +453,7 @@ bool MDSql::setObjectValues(const std::vector<MDObject*> & columnValues, const s
 			{
 				if (columnValues[j]->label == (*desiredLabels)[i])
 				{
-					bindValue( this->preparedStmt, i+1, *(columnValues[j]));
+					bindValue( preparedStmt, i+1, *(columnValues[j]));
 					break;
 				}
 			}
@@ -356,34 +461,36 @@ bool MDSql::setObjectValues(const std::vector<MDObject*> & columnValues, const s
     }
 
     // Execute statement.
-    rc = sqlite3_step( this->preparedStmt);
+    rc = sqlite3_step( preparedStmt);
     if (rc != SQLITE_OK && rc != SQLITE_ROW && rc != SQLITE_DONE)
     {
         std::cerr << "MDSql::setObjectValue(MDObject): " << std::endl
-        << "   " << this->preparedStream.str() << std::endl
+        << "   " << preparedStream.str() << std::endl
         <<"    code: " << rc << " error: " << sqlite3_errmsg(db) << std::endl;
         r = false;
     }
 
     // Reset statement and bindings.
-    sqlite3_clear_bindings(this->preparedStmt);
-    sqlite3_reset(this->preparedStmt);
+    sqlite3_clear_bindings(preparedStmt);
+    sqlite3_reset(preparedStmt);
 
     return r;
 }
 
 void MDSql::finalizePreparedStmt(void)
 {
-	if (this->preparedStmt != NULL)
+    MDSqlLock lock(this);
+	if (myCache->preparedStmt != NULL)
 	{
-		sqlite3_finalize( this->preparedStmt);
-		this->preparedStmt = NULL;
+		sqlite3_finalize(myCache->preparedStmt);
+		myCache->preparedStmt = NULL;
 	}
 }
 
 //set column with a given value
 bool MDSql::setObjectValue(const MDObject &value)
 {
+    MDSqlLock lock(this);
     bool r = true;
     MDLabel column = value.label;
     std::stringstream ss;
@@ -406,6 +513,7 @@ bool MDSql::setObjectValue(const MDObject &value)
 
 bool MDSql::setObjectValue(const int objId, const MDObject &value)
 {
+    MDSqlLock lock(this);
     bool r = true;
     MDLabel column = value.label;
     std::stringstream ss;
@@ -442,8 +550,10 @@ bool MDSql::setObjectValue(const int objId, const MDObject &value)
 
 bool MDSql::initializeGetObjectsValuesStatement(std::vector<MDLabel> labels)
 {
+    MDSqlLock lock(this);
 	int 	i=0;					// Loop counter.
 	bool	initialized=true;		// Return value.
+	sqlite3_stmt * &preparedStmt = myCache->preparedStmt;
 
 	// Add columns names.
 	if (labels.size() > 0)
@@ -461,17 +571,17 @@ bool MDSql::initializeGetObjectsValuesStatement(std::vector<MDLabel> labels)
 			}
 		}
 		ss << " FROM " << tableName(tableId) << " WHERE objID=?";
-		rc = sqlite3_prepare_v2(db, ss.str().c_str(), -1, &this->preparedStmt, &zLeftover);
+		rc = sqlite3_prepare_v2(db, ss.str().c_str(), -1, &preparedStmt, &zLeftover);
 		if (rc != SQLITE_OK)
 		{
 			initialized = false;
 			printf( "could not prepare statement: %s\n", sqlite3_errmsg(db) );
-			this->preparedStmt = NULL;
+			preparedStmt = NULL;
 		}
 	}
 	else
 	{
-		this->preparedStmt = NULL;
+		preparedStmt = NULL;
 	}
 
 	return(initialized);
@@ -479,14 +589,16 @@ bool MDSql::initializeGetObjectsValuesStatement(std::vector<MDLabel> labels)
 
 bool MDSql::getObjectsValues(const size_t objId, std::vector<MDLabel> labels, std::vector<MDObject> *values)
 {
+    MDSqlLock lock(this);
 	bool ret=true;				// Return value.
 	int i=0;					// Loop counter.
+	sqlite3_stmt * &preparedStmt = myCache->preparedStmt;
 
 	// Bind object id.
-	rc = sqlite3_bind_int(this->preparedStmt, 1, objId);
+	rc = sqlite3_bind_int(preparedStmt, 1, objId);
 
 	// Execute statement.
-	rc = sqlite3_step(this->preparedStmt);
+	rc = sqlite3_step(preparedStmt);
 	while (rc == SQLITE_ROW)
 	{
 		for (i=0; i<labels.size() ;i++)
@@ -494,13 +606,13 @@ bool MDSql::getObjectsValues(const size_t objId, std::vector<MDLabel> labels, st
 			if (labels[i] != MDL_STAR_COMMENT)
 			{
 				MDObject value(labels[i]);
-				extractValue(this->preparedStmt, i, value);
+				extractValue(preparedStmt, i, value);
 				(*values).push_back(value);
 			}
 		}
 
 		// Next row.
-		rc = sqlite3_step(this->preparedStmt);
+		rc = sqlite3_step(preparedStmt);
 	}
 
 	// Check error in last sqlite3_step call.
@@ -512,14 +624,15 @@ bool MDSql::getObjectsValues(const size_t objId, std::vector<MDLabel> labels, st
 	}
 
 	// Reset statement and bindings.
-	sqlite3_clear_bindings(this->preparedStmt);
-	sqlite3_reset(this->preparedStmt);
+	sqlite3_clear_bindings(preparedStmt);
+	sqlite3_reset(preparedStmt);
 
 	return(ret);
 }
 
 bool MDSql::getObjectValue(const int objId, MDObject  &value)
 {
+    MDSqlLock lock(this);
     std::stringstream ss;
     MDLabel column = value.label;
     sqlite3_stmt * &stmt = myCache->getValueCache[column];
@@ -558,8 +671,71 @@ bool MDSql::getObjectValue(const int objId, MDObject  &value)
     return true;
 }
 
+bool MDSql::getColumnValues(const MDLabel column, std::vector<MDObject> &valuesOut)
+{
+    MDSqlLock lock(this);
+    std::stringstream ss;
+    sqlite3_stmt *stmt;
+    MDObject value(column);
+    valuesOut.clear();
+
+    ss << "SELECT " << MDL::label2StrSql(column)
+    << " FROM " << tableName(tableId) << " ORDER BY objID;";
+    rc = sqlite3_prepare_v2(db, ss.str().c_str(), -1, &stmt, &zLeftover);
+    if (rc != SQLITE_OK)
+    {
+        std::cerr << "MDSql::getColumnValues: " << std::endl
+        << "   " << ss.str() << std::endl
+        <<"    code: " << rc << " error: " << sqlite3_errmsg(db) << std::endl;
+        return false;
+    }
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+        extractValue(stmt, 0, value);
+        valuesOut.push_back(value);
+    }
+    sqlite3_finalize(stmt);
+    return rc == SQLITE_DONE;
+}
+
+bool MDSql::setColumnValues(const std::vector<MDObject> &valuesIn)
+{
+    MDSqlLock lock(this);
+    if (valuesIn.empty())
+        return true;
+
+    bool r = true;
+    std::vector<size_t> objects;
+    MDQuery query;
+    selectObjects(objects, &query);
+    size_t n = XMIPP_MIN(objects.size(), valuesIn.size());
+
+    std::stringstream ss;
+    sqlite3_stmt *stmt;
+    ss << "UPDATE " << tableName(tableId)
+    << " SET " << MDL::label2StrSql(valuesIn[0].label) << "=? WHERE objID=?;";
+    rc = sqlite3_prepare_v2(db, ss.str().c_str(), -1, &stmt, &zLeftover);
+    for (size_t i = 0; i < n && r; ++i)
+    {
+        bindValue(stmt, 1, valuesIn[i]);
+        sqlite3_bind_int(stmt, 2, objects[i]);
+        rc = sqlite3_step(stmt);
+        if (rc != SQLITE_OK && rc != SQLITE_ROW && rc != SQLITE_DONE)
+        {
+            std::cerr << "MDSql::setColumnValues: " << std::endl
+            << "   " << ss.str() << std::endl
+            <<"    code: " << rc << " error: " << sqlite3_errmsg(db) << std::endl;
+            r = false;
+        }
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    return r;
+}
+
 void MDSql::selectObjects(std::vector<size_t> &objectsOut, const MDQuery *queryPtr)
 {
+    MDSqlLock lock(this);
     std::stringstream ss;
     sqlite3_stmt *stmt;
     objectsOut.clear();
@@ -586,6 +762,7 @@ void MDSql::selectObjects(std::vector<size_t> &objectsOut, const MDQuery *queryP
 
 size_t MDSql::deleteObjects(const MDQuery *queryPtr)
 {
+    MDSqlLock lock(this);
     std::stringstream ss;
     ss << "DELETE FROM " << tableName(tableId);
     if (queryPtr != NULL)
@@ -609,8 +786,9 @@ size_t MDSql::copyObjects(MDSql * sqlOut, const MDQuery *queryPtr) const
     //NOTE: Is assumed that the destiny table has
     // the same columns that the source table, if not
     // the INSERT will fail
+    MDSqlLock lock(this, sqlOut);
     std::stringstream ss, ss2;
-    ss << "INSERT INTO " << tableName(sqlOut->tableId);
+    ss << "INSERT INTO " << sqlOut->tableName(sqlOut->tableId);
     //Add columns names to the insert and also to select
     //* couldn't be used because maybe are duplicated objID's
     std::string sep = " ";
@@ -622,28 +800,31 @@ size_t MDSql::copyObjects(MDSql * sqlOut, const MDQuery *queryPtr) const
         sep = ", ";
     }
     ss << "(" << ss2.str() << ") SELECT " << ss2.str();
-    ss << " FROM " << tableName(tableId);
+    ss << " FROM " << sqlOut->tableName(this);
     if (queryPtr != NULL)
     {
         ss << queryPtr->whereString();
         ss << queryPtr->orderByString();
         ss << queryPtr->limitString();
     }
+    size_t copied = 0;
+    sqlOut->attachOthers(this);
     if (sqlOut->execSingleStmt(ss))
-    {
-        return sqlite3_changes(db);
-    }
-    return 0;
+        copied = sqlite3_changes(sqlOut->db);
+    sqlOut->detachOthers(this);
+    return copied;
 }
 
 void MDSql::aggregateMd(MetaData *mdPtrOut,
                         const std::vector<AggregateOperation> &operations,
                         const std::vector<MDLabel>            &operateLabel)
 {
+    MDSql * sqlOut = mdPtrOut->myMDSql;
+    MDSqlLock lock(this, sqlOut);
     std::stringstream ss;
     std::stringstream ss2;
     std::string aggregateStr = MDL::label2StrSql(mdPtrOut->activeLabels[0]);
-    ss << "INSERT INTO " << tableName(mdPtrOut->myMDSql->tableId)
+    ss << "INSERT INTO " << sqlOut->tableName(sqlOut->tableId)
     << "(" << aggregateStr;
     ss2 << aggregateStr;
     //Start iterating on second label, first is the
@@ -676,11 +857,13 @@ void MDSql::aggregateMd(MetaData *mdPtrOut,
         << ") AS " << MDL::label2StrSql(mdPtrOut->activeLabels[i+1]);
     }
     ss << ") SELECT " << ss2.str();
-    ss << " FROM " << tableName(tableId);
+    ss << " FROM " << sqlOut->tableName(this);
     ss << " GROUP BY " << aggregateStr;
     ss << " ORDER BY " << aggregateStr << ";";
     //std::cerr << "ss " << ss.str() <<std::endl;
-    execSingleStmt(ss);
+    sqlOut->attachOthers(this);
+    sqlOut->execSingleStmt(ss);
+    sqlOut->detachOthers(this);
 }
 
 
@@ -690,6 +873,8 @@ void MDSql::aggregateMdGroupBy(MetaData *mdPtrOut,
                                MDLabel operateLabel,
                                MDLabel resultLabel)
 {
+    MDSql * sqlOut = mdPtrOut->myMDSql;
+    MDSqlLock lock(this, sqlOut);
     std::stringstream ss;
     std::stringstream ss2;
     std::stringstream groupByStr;
@@ -698,7 +883,7 @@ void MDSql::aggregateMdGroupBy(MetaData *mdPtrOut,
     for (size_t i = 1; i < groupByLabels.size(); i++)
         groupByStr << ", " << MDL::label2StrSql(groupByLabels[i]);
 
-    ss << "INSERT INTO " << tableName(mdPtrOut->myMDSql->tableId) << "("
+    ss << "INSERT INTO " << sqlOut->tableName(sqlOut->tableId) << "("
     << groupByStr.str() << ", " << MDL::label2StrSql(resultLabel) << ")";
 
     ss2 << groupByStr.str() << ", ";
@@ -726,18 +911,21 @@ void MDSql::aggregateMdGroupBy(MetaData *mdPtrOut,
     ss2 << ") AS " << MDL::label2StrSql(resultLabel);
 
     ss << " SELECT " << ss2.str();
-    ss << " FROM " << tableName(tableId);
+    ss << " FROM " << sqlOut->tableName(this);
     ss << " GROUP BY " << groupByStr.str();
     ss << " ORDER BY " << groupByStr.str() << ";";
 
     //std::cerr << "ss " << ss.str() <<std::endl;
-    execSingleStmt(ss);
+    sqlOut->attachOthers(this);
+    sqlOut->execSingleStmt(ss);
+    sqlOut->detachOthers(this);
 }
 
 
 double MDSql::aggregateSingleDouble(const AggregateOperation operation,
                                     MDLabel operateLabel)
 {
+    MDSqlLock lock(this);
     std::stringstream ss;
     ss << "SELECT ";
     //Start iterating on second label, first is the
@@ -770,6 +958,7 @@ double MDSql::aggregateSingleDouble(const AggregateOperation operation,
 size_t MDSql::aggregateSingleSizeT(const AggregateOperation operation,
                                    MDLabel operateLabel)
 {
+    MDSqlLock lock(this);
     std::stringstream ss;
     ss << "SELECT ";
     //Start iterating on second label, first is the
@@ -801,6 +990,7 @@ size_t MDSql::aggregateSingleSizeT(const AggregateOperation operation,
 
 void MDSql::indexModify(const std::vector<MDLabel> columns, bool create)
 {
+    MDSqlLock lock(this);
     std::stringstream ss,index_name,index_column;
     std::string sep1=" ";
     std::string sep2=" ";
@@ -827,6 +1017,7 @@ void MDSql::indexModify(const std::vector<MDLabel> columns, bool create)
 
 size_t MDSql::firstRow()
 {
+    MDSqlLock lock(this);
     std::stringstream ss;
     ss << "SELECT COALESCE(MIN(objID), -1) AS MDSQL_FIRST_ID FROM "
     << tableName(tableId) << ";";
@@ -835,6 +1026,7 @@ size_t MDSql::firstRow()
 
 size_t MDSql::lastRow()
 {
+    MDSqlLock lock(this);
     std::stringstream ss;
     ss << "SELECT COALESCE(MAX(objID), -1) AS MDSQL_LAST_ID FROM "
     << tableName(tableId) << ";";
@@ -843,6 +1035,7 @@ size_t MDSql::lastRow()
 
 size_t MDSql::nextRow(size_t currentRow)
 {
+    MDSqlLock lock(this);
     std::stringstream ss;
     ss << "SELECT COALESCE(MIN(objID), -1) AS MDSQL_NEXT_ID FROM "
     << tableName(tableId)
@@ -852,6 +1045,7 @@ size_t MDSql::nextRow(size_t currentRow)
 
 size_t MDSql::previousRow(size_t currentRow)
 {
+    MDSqlLock lock(this);
     std::stringstream ss;
     ss << "SELECT COALESCE(MAX(objID), -1) AS MDSQL_PREV_ID FROM "
     << tableName(tableId)
@@ -861,6 +1055,7 @@ size_t MDSql::previousRow(size_t currentRow)
 
 int MDSql::columnMaxLength(MDLabel column)
 {
+    MDSqlLock lock(this);
     std::stringstream ss;
     ss << "SELECT MAX(COALESCE(LENGTH("<< MDL::label2StrSql(column)
     <<"), -1)) AS MDSQL_STRING_LENGTH FROM "
@@ -870,6 +1065,8 @@ int MDSql::columnMaxLength(MDLabel column)
 
 void MDSql::setOperate(MetaData *mdPtrOut, const std::vector<MDLabel> &columns, SetOperation operation)
 {
+    MDSql * sqlOut = mdPtrOut->myMDSql;
+    MDSqlLock lock(this, sqlOut);
     std::stringstream ss, ss2;
     bool execStmt = true;
     int size;
@@ -890,10 +1087,10 @@ void MDSql::setOperate(MetaData *mdPtrOut, const std::vector<MDLabel> &columns,
             ss2 << sep << MDL::label2StrSql( myMd->activeLabels[i]);
             sep = ", ";
         }
-        ss << "INSERT INTO " << tableName(mdPtrOut->myMDSql->tableId)
+        ss << "INSERT INTO " << sqlOut->tableName(sqlOut->tableId)
         << " (" << ss2.str() << ")"
         << " SELECT " << ss2.str()
-        << " FROM " << tableName(tableId)
+        << " FROM " << sqlOut->tableName(this)
         << " WHERE ";
         for (size_t j=0; j<columns.size(); ++j)
         {
@@ -901,7 +1098,7 @@ void MDSql::setOperate(MetaData *mdPtrOut, const std::vector<MDLabel> &columns,
         		ss << " AND ";
         	ss << MDL::label2StrSql(columns[j])
 				<< " NOT IN (SELECT " << MDL::label2StrSql(columns[j])
-				<< " FROM " << tableName(mdPtrOut->myMDSql->tableId) << ") ";
+				<< " FROM " << sqlOut->tableName(sqlOut->tableId) << ") ";
         }
         ss << ";";
         break;
@@ -924,15 +1121,15 @@ void MDSql::setOperate(MetaData *mdPtrOut, const std::vector<MDLabel> &columns,
             ss2 << sep << MDL::label2StrSql( labelVector->at(i));
             sep = ", ";
         }
-        ss << "INSERT INTO " << tableName(mdPtrOut->myMDSql->tableId)
+        ss << "INSERT INTO " << sqlOut->tableName(sqlOut->tableId)
         << " (" << ss2.str() << ")"
         << " SELECT DISTINCT " << ss2.str()
-        << " FROM " << tableName(tableId)
+        << " FROM " << sqlOut->tableName(this)
         << ";";
         break;
     case INTERSECTION:
     case SUBSTRACTION:
-        ss << "DELETE FROM " << tableName(mdPtrOut->myMDSql->tableId)
+        ss << "DELETE FROM " << sqlOut->tableName(sqlOut->tableId)
         << " WHERE ";
         for (size_t j=0; j<columns.size(); ++j)
         {
@@ -942,7 +1139,7 @@ void MDSql::setOperate(MetaData *mdPtrOut, const std::vector<MDLabel> &columns,
             if (operation == INTERSECTION)
                 ss << " NOT";
 			ss << " IN (SELECT " << MDL::label2StrSql(columns[j])
-			   << " FROM " << tableName(tableId) << ") ";
+			   << " FROM " << sqlOut->tableName(this) << ") ";
         }
         ss << ";";
         break;
@@ -951,11 +1148,16 @@ void MDSql::setOperate(MetaData *mdPtrOut, const std::vector<MDLabel> &columns,
     }
     //std::cerr << "ss" << ss.str() <<std::endl;
     if (execStmt)
-        execSingleStmt(ss);
+    {
+        sqlOut->attachOthers(this);
+        sqlOut->execSingleStmt(ss);
+        sqlOut->detachOthers(this);
+    }
 }
 
 bool MDSql::equals(const MDSql &op)
 {
+    MDSqlLock lock(this, &op);
     std::vector<MDLabel> v1(myMd->activeLabels),v2(op.myMd->activeLabels);
     std::sort(v1.begin(),v1.end());
     std::sort(v2.begin(),v2.end());
@@ -993,12 +1195,15 @@ bool MDSql::equals(const MDSql &op)
     FROM " <<   tableName(tableId)
     <<      " UNION ALL \
     SELECT " << ss2.str() << "\
-    FROM " << tableName(op.tableId)
+    FROM " << tableName(&op)
     <<     ") tmp"
     << " GROUP BY " << ss2Group.str()
     << " HAVING COUNT(*) <> 2"
     << ") tmp1";
-    return (execSingleIntStmt(sqlQuery)==0);
+    attachOthers(&op);
+    bool result = (execSingleIntStmt(sqlQuery)==0);
+    detachOthers(&op);
+    return result;
 }
 
 void MDSql::setOperate(const MetaData *mdInLeft,
@@ -1007,6 +1212,9 @@ void MDSql::setOperate(const MetaData *mdInLeft,
 					   const std::vector<MDLabel> &columnsRight,
                        SetOperation operation)
 {
+    MDSql * sqlLeft = mdInLeft->myMDSql;
+    MDSql * sqlRight = mdInRight->myMDSql;
+    MDSqlLock lock(this, sqlLeft, sqlRight);
     std::stringstream ss, ss2, ss3;
     size_t size;
     std::string join_type = "", sep = "";
@@ -1064,17 +1272,17 @@ void MDSql::setOperate(const MetaData *mdInLeft,
         ss2 << sep << MDL::label2StrSql( myMd->activeLabels[i]);
         ss3 << sep;
         if (i < sizeLeft && mdInLeft->activeLabels[i] == myMd->activeLabels[i])
-            ss3 << tableName(mdInLeft->myMDSql->tableId) << ".";
+            ss3 << tableName(sqlLeft) << ".";
         else
-            ss3 << tableName(mdInRight->myMDSql->tableId) << ".";
+            ss3 << tableName(sqlRight) << ".";
         ss3 << MDL::label2StrSql( myMd->activeLabels[i]);
         sep = ", ";
     }
     ss << "INSERT INTO " << tableName(tableId)
     << " (" << ss2.str() << ")"
     << " SELECT " << ss3.str()
-    << " FROM " << tableName(mdInLeft->myMDSql->tableId)
-    << join_type << " JOIN " << tableName(mdInRight->myMDSql->tableId);
+    << " FROM " << tableName(sqlLeft)
+    << join_type << " JOIN " << tableName(sqlRight);
 
     if (operation != NATURAL_JOIN)
     {
@@ -1083,8 +1291,8 @@ void MDSql::setOperate(const MetaData *mdInLeft,
         {
         	if (j>0)
         		ss << " AND ";
-        	ss << tableName(mdInLeft->myMDSql->tableId) << "." << MDL::label2StrSql(columnsLeft[j])
-               << "=" << tableName(mdInRight->myMDSql->tableId) << "." << MDL::label2StrSql(columnsRight[j]);
+        	ss << tableName(sqlLeft) << "." << MDL::label2StrSql(columnsLeft[j])
+               << "=" << tableName(sqlRight) << "." << MDL::label2StrSql(columnsRight[j]);
         }
         ss << ") ";
     }
@@ -1098,10 +1306,10 @@ void MDSql::setOperate(const MetaData *mdInLeft,
                 if(mdInRight->activeLabels[i] == mdInLeft->activeLabels[j])
                 {
                     ss << sep
-                    << tableName(mdInRight->myMDSql->tableId) << "."
+                    << tableName(sqlRight) << "."
                     << MDL::label2StrSql(mdInRight->activeLabels[i])
                     << " = "
-                    << tableName(mdInLeft->myMDSql->tableId) << "."
+                    << tableName(sqlLeft) << "."
                     << MDL::label2StrSql(mdInLeft->activeLabels[j]);
                     sep = " AND ";
                 }
@@ -1113,7 +1321,9 @@ void MDSql::setOperate(const MetaData *mdInLeft,
     //     std::cerr << "mdInRight->activeLabels:" << mdInRight->activeLabels[0] << std::endl;
     //    for (int j = 0; j < sizeLeft; j++)
     //     std::cerr << "mdInLeft->activeLabels:"  << mdInLeft->activeLabels[1] << std::endl;
+    attachOthers(sqlLeft, sqlRight);
     execSingleStmt(ss);
+    detachOthers(sqlLeft, sqlRight);
     //std::cerr << "ss:" << ss.str() << std::endl;
     //dumpToFile("kk.sqlite");
     //exit(0);
@@ -1121,6 +1331,7 @@ void MDSql::setOperate(const MetaData *mdInLeft,
 
 bool MDSql::operate(const String &expression)
 {
+    MDSqlLock lock(this);
     std::stringstream ss;
     ss << "UPDATE " << tableName(tableId) << " SET " << expression;
 
@@ -1130,32 +1341,43 @@ bool MDSql::operate(const String &expression)
 void MDSql::dumpToFile(const FileName &fileName)
 {
     sqlite3 *pTo;
-    sqlite3_backup *pBackup;
+    char *errmsg;
 
-    sqlCommitTrans();
-    rc = sqlite3_open(fileName.c_str(), &pTo);
-    if( rc==SQLITE_OK )
+    if (sqlite3_open_v2(fileName.c_str(), &pTo,
+                        SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_URI, NULL) != SQLITE_OK)
+        REPORT_ERROR(ERR_MD_SQL, "dumpToFile: error opening db file");
+
+    instancesMutex.lock();
+    for (std::set<MDSql*>::iterator it = instances().begin(); it != instances().end(); ++it)
     {
-        pBackup = sqlite3_backup_init(pTo, "main", db, "main");
-        if( pBackup )
+        MDSql * sql = *it;
+        MDSqlLock lock(sql);
+        sql->sqlCommitTrans();
+        String sqlCommand = formatString("ATTACH database '%s' AS src;", sql->dbName().c_str());
+        sqlCommand += formatString("DROP TABLE IF EXISTS main.%s;", sql->tableName(sql->tableId).c_str());
+        sqlCommand += formatString("CREATE TABLE main.%s AS SELECT * FROM src.%s;",
+                                   sql->tableName(sql->tableId).c_str(), sql->tableName(sql->tableId).c_str());
+        if (sqlite3_exec(pTo, sqlCommand.c_str(), NULL, NULL, &errmsg) != SQLITE_OK)
         {
-            sqlite3_backup_step(pBackup, -1);
-            sqlite3_backup_finish(pBackup);
+            std::cerr << "dumpToFile: couldn't copy table " << sql->tableName(sql->tableId)
+            << ": " << errmsg << std::endl;
+            sqlite3_free(errmsg);
         }
-        rc = sqlite3_errcode(pTo);
+        sqlite3_exec(pTo, "DETACH src", NULL, NULL, NULL);
+        sql->sqlBeginTrans();
     }
-    else
-        REPORT_ERROR(ERR_MD_SQL, "dumpToFile: error opening db file");
+    instancesMutex.unlock();
     sqlite3_close(pTo);
-    sqlBeginTrans();
 }
 
 void MDSql::copyTableFromFileDB(const FileName blockname,
                                 const FileName filename,
                                 const std::vector<MDLabel> *desiredLabels,
-                                const size_t maxRows
+                                const size_t maxRows,
+                                const size_t offsetRows
                                )
 {
+    MDSqlLock lock(this);
     char **results;
     int rows;
     int columns;
@@ -1239,14 +1461,15 @@ void MDSql::copyTableFromFileDB(const FileName blockname,
     String selectCmd = formatString("SELECT %s FROM load.%s", activeLabel.c_str(), _blockname.c_str());
     sqlCommand = formatString("INSERT INTO %s %s", tableName(tableId).c_str(), selectCmd.c_str());
 
-    if (maxRows)
+    if (maxRows || offsetRows)
     {
         std::stringstream ss;
         ss << "SELECT COUNT(objId) FROM load." << _blockname;
         myMd->_parsedLines = execSingleIntStmt(ss);
         //std::cerr << ss.str() << " = " << myMd->_parsedLines << std::endl;
 
-        sqlCommand += formatString(" LIMIT %lu", maxRows);
+        //LIMIT -1 means no limit
+        sqlCommand += formatString(" LIMIT %ld OFFSET %lu", maxRows ? (long) maxRows : -1L, offsetRows);
     }
 
     if (sqlite3_exec(db, sqlCommand.c_str(),NULL,NULL,&errmsg) != SQLITE_OK)
@@ -1262,6 +1485,7 @@ void MDSql::copyTableFromFileDB(const FileName blockname,
 
 void MDSql::copyTableToFileDB(const FileName blockname, const FileName &fileName)
 {
+    MDSqlLock lock(this);
     sqlCommitTrans();
     String _blockname;
     if(blockname.empty())
@@ -1293,10 +1517,31 @@ void MDSql::copyTableToFileDB(const FileName blockname, const FileName &fileName
 
 bool MDSql::sqlBegin()
 {
-    if (table_counter > 0)
-        return true;
-    //std::cerr << "entering sqlBegin" <<std::endl;
-    rc = sqlite3_open("", &db);
+    return sqlite3_initialize() == SQLITE_OK;
+}
+
+void MDSql::sqlEnd()
+{
+    //Connections are closed by each metadata, nothing to do here
+}
+
+String MDSql::dbName() const
+{
+    // Named in-memory database, it can be attached from other
+    // connections (only needed for operations between metadatas)
+    return formatString("file:xmipp_md_%d?mode=memory&cache=shared", dbId);
+}
+
+bool MDSql::sqlOpen()
+{
+    //std::cerr << "entering sqlOpen" <<std::endl;
+    // The connection is protected by our own mutex, so there is no
+    // need for SQLite to serialize it again
+    rc = sqlite3_open_v2(dbName().c_str(), &db,
+                         SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE |
+                         SQLITE_OPEN_URI | SQLITE_OPEN_NOMUTEX, NULL);
+    if (rc != SQLITE_OK)
+        REPORT_ERROR(ERR_MD_SQL,formatString("Error opening database code: %d message: %s",rc,sqlite3_errmsg(db)));
 
     sqlite3_exec(db, "PRAGMA temp_store=MEMORY",NULL, NULL, &errmsg);
     sqlite3_exec(db, "PRAGMA synchronous=OFF",NULL, NULL, &errmsg);
@@ -1306,22 +1551,53 @@ bool MDSql::sqlBegin()
     return sqlBeginTrans();
 }
 
+void MDSql::sqlClose()
+{
+    sqlCommitTrans();
+    sqlite3_close(db);
+    db = NULL;
+    //std::cerr << "Database successfully closed." <<std::endl;
+}
+
 void MDSql::sqlTimeOut(int miliseconds)
 {
-    if (sqlite3_busy_timeout(db, miliseconds) != SQLITE_OK)
-    {
-        std::cerr << "Couldn't not set timeOut:  " << std::endl;
-        exit(0);
+    busyTimeOut = miliseconds;
+    if (!applyToAllInstances())
+        REPORT_ERROR(ERR_MD_SQL, formatString("Couldn't set busy timeout of %d ms", miliseconds));
+}
 
+void MDSql::attachOthers(const MDSql *other1, const MDSql *other2)
+{
+    const MDSql * others[2] = {other1, other2};
+    sqlCommitTrans();
+    for (int i = 0; i < 2; ++i)
+    {
+        MDSql * other = const_cast<MDSql*>(others[i]);
+        if (other == NULL || other == this || (i == 1 && other == others[0]))
+            continue;
+        other->sqlCommitTrans();
+        String sqlCommand = formatString("ATTACH database '%s' AS md_%d;",
+                                         other->dbName().c_str(), other->dbId);
+        if (sqlite3_exec(db, sqlCommand.c_str(), NULL, NULL, &errmsg) != SQLITE_OK)
+            REPORT_ERROR(ERR_MD_SQL, formatString("Couldn't attach metadata table: %s", errmsg));
     }
-
+    sqlBeginTrans();
 }
 
-void MDSql::sqlEnd()
+void MDSql::detachOthers(const MDSql *other1, const MDSql *other2)
 {
+    const MDSql * others[2] = {other1, other2};
     sqlCommitTrans();
-    sqlite3_close(db);
-    //std::cerr << "Database successfully closed." <<std::endl;
+    for (int i = 0; i < 2; ++i)
+    {
+        MDSql * other = const_cast<MDSql*>(others[i]);
+        if (other == NULL || other == this || (i == 1 && other == others[0]))
+            continue;
+        String sqlCommand = formatString("DETACH md_%d;", other->dbId);
+        sqlite3_exec(db, sqlCommand.c_str(), NULL, NULL, &errmsg);
+        other->sqlBeginTrans();
+    }
+    sqlBeginTrans();
 }
 
 bool MDSql::sqlBeginTrans()
@@ -1446,6 +1722,15 @@ std::string MDSql::tableName(const int tableId) const
     return ss.str();
 }
 
+std::string MDSql::tableName(const MDSql *other) const
+{
+    if (other == this)
+        return tableName(tableId);
+    std::stringstream ss;
+    ss << "md_" << other->dbId << ".MDTable_" << other->tableId;
+    return ss.str();
+}
+
 int MDSql::bindValue(sqlite3_stmt *stmt, const int position, const MDObject &valueIn)
 {
     //First reset the statement
@@ -1517,6 +1802,7 @@ MDCache::MDCache()
 {
     this->addRowStmt = NULL;
     this->iterStmt = NULL;
+    this->preparedStmt = NULL;
 }
 
 MDCache::~MDCache()
@@ -1548,4 +1834,10 @@ void MDCache::clear()
         sqlite3_finalize(addRowStmt);
         addRowStmt = NULL;
     }
+
+    if (preparedStmt != NULL)
+    {
+        sqlite3_finalize(preparedStmt);
+        preparedStmt = NULL;
+    }
 }
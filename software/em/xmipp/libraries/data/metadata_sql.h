@@ -28,6 +28,8 @@
 
 #include <iostream>
 #include <map>
+#include <set>
+#include <pthread.h>
 #include "xmipp_strings.h"
 #include <sqlite3.h>
 #include "metadata_label.h"
@@ -69,11 +71,19 @@ void sqlite_regexp(sqlite3_context* context, int argc, sqlite3_value** values);
 
 /** This class will manage SQL database interactions.
  * This class is designed to used inside a MetaData.
+ * Each instance owns its own SQLite connection to a private in-memory
+ * database (and its own statement cache), so different MetaData can be
+ * used from different threads at the same time. Accesses to the same
+ * MetaData are serialized by a per-object lock. Operations involving
+ * several metadatas (copy, join, set operations...) temporarily attach
+ * the other databases to the connection that receives the result.
  */
 class MDSql
 {
 public:
+    /** Dump the tables of all live metadatas into a sqlite file */
     static void dumpToFile(const FileName &fileName);
+    /** Set the busy timeout of all the connections (current and future) */
     static void sqlTimeOut(int miliSeconds);
 
     /**This library will provide common mathematical and string functions in
@@ -119,12 +129,13 @@ private:
     void copyTableToFileDB(const FileName blockname, const FileName &fileName);
 
     /** read metadata from sqlite table
-     *
+     * if maxRows or offsetRows are not 0 only that window of rows is copied
      */
     void copyTableFromFileDB(const FileName blockname,
                              const FileName filename,
                              const std::vector<MDLabel> *desiredLabels,
-                             const size_t maxRows=0
+                             const size_t maxRows=0,
+                             const size_t offsetRows=0
                              );
     /** This will create the table to store the metada objects.
      * Will return false if the mdId table is already present.
@@ -169,6 +180,17 @@ private:
      */
     bool getObjectValue(const int objId, MDObject  &value);
 
+    /** Get the values of a column for all objects (sorted by objID)
+     * with a single query.
+     */
+    bool getColumnValues(const MDLabel column, std::vector<MDObject> &valuesOut);
+
+    /** Set the values of a column for all objects (sorted by objID)
+     * with a single prepared statement. All values should have the same label
+     * and there should be one value per object.
+     */
+    bool setColumnValues(const std::vector<MDObject> &valuesIn);
+
     /** This function will select some elements from table.
      * The 'limit' is the maximum number of object
      * returned, if is -1, all will be returned
@@ -256,21 +278,41 @@ private:
     ~MDSql();
 
     static int table_counter;
-    static sqlite3 *db;
 
     static MDSqlStaticInit initialization; //Just for initialization
 
+    /// Live instances, needed to apply global settings to every connection
+    static std::set<MDSql*> &instances();
+    /// Global settings applied to every new connection
+    static bool mathExtensions, regExtensions;
+    static int busyTimeOut;
+
     ///Just call this function once, at static initialization
     static bool sqlBegin();
     static void sqlEnd();
-    static bool sqlBeginTrans();
-    static bool sqlCommitTrans();
+
+    /** Open the connection to the private database of this metadata */
+    bool sqlOpen();
+    /** Close the connection, all cached statements should be finalized */
+    void sqlClose();
+    bool sqlBeginTrans();
+    bool sqlCommitTrans();
+    /** Apply math and regexp extensions and timeout to this connection */
+    bool applySettings();
+    static bool applyToAllInstances();
     /** Return an unique id for each metadata
      * this function should be called once for each
      * metada and the id will be used for operations
      */
     int getUniqueId();
 
+    /** Make the tables of other metadatas visible from this connection.
+     * Pending transactions are committed and the databases attached.
+     * Should be paired with a call to detachOthers.
+     */
+    void attachOthers(const MDSql *other1, const MDSql *other2 = NULL);
+    void detachOthers(const MDSql *other1, const MDSql *other2 = NULL);
+
     bool dropTable();
     bool createTable(const std::vector<MDLabel> * labelsVector = NULL, bool withObjID=true);
     bool insertValues(double a, double b);
@@ -282,24 +324,29 @@ private:
     double execSingleDoubleStmt(const std::stringstream &ss);
 
     String tableName(const int tableId) const;
+    /** Name of the table of other metadata as seen from this connection */
+    String tableName(const MDSql *other) const;
+    /** Name of the in-memory database of this metadata (URI) */
+    String dbName() const;
 
     int bindValue(sqlite3_stmt *stmt, const int position, const MDObject &valueIn);
     void extractValue(sqlite3_stmt *stmt, const int position, MDObject &valueOut);
 
-    static char *errmsg;
-    static const char *zLeftover;
-    static int rc;
-    static sqlite3_stmt *stmt;
-
-    static std::stringstream preparedStream;	// Stream.
-    static sqlite3_stmt * preparedStmt;	// SQL statement.
-
     ///Non-static attributes
+    sqlite3 *db;
+    char *errmsg;
+    const char *zLeftover;
+    int rc;
+    /// Serialize the use of the connection, recursive
+    mutable pthread_mutex_t mutex;
+
     int tableId;
+    int dbId;
     MetaData *myMd;
     MDCache *myCache;
 
     friend class MDSqlStaticInit;
+    friend class MDSqlLock;
     friend class MetaData;
     friend class MDIterator;
     ///similar to "operator"
@@ -677,6 +724,9 @@ public:
     std::map<MDLabel, sqlite3_stmt*> getValueCache;
     std::map<MDLabel, sqlite3_stmt*> setValueCache;
     sqlite3_stmt *addRowStmt;
+    /// Statement used for bulk inserts and for reading whole rows
+    sqlite3_stmt *preparedStmt;
+    std::stringstream preparedStream;
 
     MDCache();
     ~MDCache();
@@ -358,56 +358,6 @@ void MultidimArray< std::complex< double > >::maxIndex(size_t &lmax, int& kmax,
     REPORT_ERROR(ERR_NOT_IMPLEMENTED,"MultidimArray::maxIndex not implemented for complex.");
 }
 
-template<>
-void MultidimArray<double>::computeAvgStdev(double& avg, double& stddev) const
-{
-    if (NZYXSIZE(*this) <= 0)
-        return;
-
-    avg = 0;
-    stddev = 0;
-
-    double* ptr=&DIRECT_MULTIDIM_ELEM(*this,0);
-    size_t nmax=(nzyxdim/4)*4;
-
-    double val;
-    for (size_t n=0; n<nmax; n+=4, ptr+=4)
-    {
-        val=*ptr;
-        avg += val;
-        stddev += val * val;
-        val=*(ptr+1);
-        avg += val;
-        stddev += val * val;
-        val=*(ptr+2);
-        avg += val;
-        stddev += val * val;
-        val=*(ptr+3);
-        avg += val;
-        stddev += val * val;
-    }
-    for (size_t n=nmax; n<nzyxdim; ++n, ptr+=1)
-    {
-        val=*ptr;
-        avg += val;
-        stddev += val * val;
-    }
-
-    avg /= NZYXSIZE(*this);
-
-    if (NZYXSIZE(*this) > 1)
-    {
-        stddev = stddev / NZYXSIZE(*this) - avg * avg;
-        stddev *= NZYXSIZE(*this) / (NZYXSIZE(*this) - 1);
-
-        // Foreseeing numerical instabilities
-        stddev = sqrt(fabs(stddev));
-    }
-    else
-        stddev = 0;
-}
-
-
 template<>
 bool operator==(const MultidimArray< std::complex< double > >& op1, const MultidimArray< std::complex< double > >& op2)
 {
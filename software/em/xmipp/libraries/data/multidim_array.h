@@ -29,12 +29,15 @@
 #ifdef XMIPP_MMAP
 #include <sys/mman.h>
 #endif
+#include <algorithm>
 /// Consider biblib as external library
 /// for compilation, xmipp/external should be passed as -I
 #include <bilib/types/tsplinebasis.h>
 #include <bilib/headers/kernel.h>
 
 #include "xmipp_strings.h"
+#include "xmipp_memory.h"
+#include "xmipp_simd.h"
 #include "matrix1d.h"
 #include "matrix2d.h"
 
@@ -635,6 +638,9 @@ void selfCoreArrayByArrayMask(const MultidimArray<T>& op1, const MultidimArray<T
                           MultidimArray<T>& result, char operation,
                           const MultidimArray<T> *mask);
 
+template<typename E>
+class MultidimExpr;
+
 /**
  *  Structure with the dimensions information of an image
  */
@@ -1249,6 +1255,42 @@ public:
         *this = V;
     }
 
+#if __cplusplus >= 201103L
+    /** Move constructor
+     *
+     * The data of V is taken without copying it and V is left empty.
+     * If V does not own its data (it is an alias) the data is copied.
+     *
+     * @code
+     * std::vector< MultidimArray<double> > v;
+     * v.push_back(MultidimArray<double>(128, 128));
+     * @endcode
+     */
+    MultidimArray(MultidimArray<T>&& V)
+    {
+        coreInit();
+        if (V.destroyData)
+            swap(V);
+        else
+            *this = V;
+    }
+#endif
+
+    /** Constructor from an array expression.
+     *
+     * The expression is evaluated in a single pass (see lazy()).
+     *
+     * @code
+     * MultidimArray< double > V3 = lazy(V1) * 2. + V2;
+     * @endcode
+     */
+    template<typename E>
+    MultidimArray(const MultidimExpr<E>& expr)
+    {
+        coreInit();
+        *this = expr;
+    }
+
     /** Copy constructor from a Matrix1D.
      * The Size constructor creates an array with memory associated,
      * and fills it with zeros.
@@ -1341,8 +1383,6 @@ public:
     {
         if(data!=NULL)
             REPORT_ERROR(ERR_MEM_NOTDEALLOC, "do not allocate space for an image if you have not deallocate it first");
-        if (nzyxdim < 0)
-            REPORT_ERROR(ERR_MEM_BADREQUEST,"coreAllocate:Cannot allocate a negative number of bytes");
 
         if (mmapOn)
             mFd = mmapFile(data, nzyxdim);
@@ -1350,7 +1390,7 @@ public:
         {
             try
             {
-                data = new T [nzyxdim];
+                data = askAlignedMemory<T>(nzyxdim);
                 if (data == NULL)
                 {
                     setMmap(true);
@@ -1380,14 +1420,12 @@ public:
         else if (nzyxdim > nzyxdimAlloc)
             coreDeallocate();
 
-        if (nzyxdim < 0)
-            REPORT_ERROR(ERR_MEM_BADREQUEST,"coreAllocateReuse:Cannot allocate a negative number of bytes");
 
         if (mmapOn)
             mFd = mmapFile(data, nzyxdim);
         else
         {
-            data = new T [nzyxdim];
+            data = askAlignedMemory<T>(nzyxdim);
             if (data == NULL)
                 REPORT_ERROR(ERR_MEM_NOTENOUGH, "Allocate: No space left");
         }
@@ -1438,13 +1476,42 @@ public:
 
             }
             else
-                delete[] data;
+                freeAlignedMemory(data);
         }
         data = NULL;
         destroyData = true;
         nzyxdimAlloc = 0;
     }
 
+    /** Swap two multidimarrays.
+     *
+     * The shapes, origins and data of both arrays are exchanged without
+     * copying any element. This is the cheap way to return or exchange
+     * arrays when the compiler does not support move semantics.
+     *
+     * @code
+     * V1.swap(V2);
+     * @endcode
+     */
+    void swap(MultidimArray<T> &V)
+    {
+        std::swap(destroyData, V.destroyData);
+        std::swap(ndim, V.ndim);
+        std::swap(zdim, V.zdim);
+        std::swap(ydim, V.ydim);
+        std::swap(xdim, V.xdim);
+        std::swap(yxdim, V.yxdim);
+        std::swap(zyxdim, V.zyxdim);
+        std::swap(nzyxdim, V.nzyxdim);
+        std::swap(zinit, V.zinit);
+        std::swap(yinit, V.yinit);
+        std::swap(xinit, V.xinit);
+        std::swap(mmapOn, V.mmapOn);
+        std::swap(mFd, V.mFd);
+        std::swap(nzyxdimAlloc, V.nzyxdimAlloc);
+        std::swap(data, V.data);
+    }
+
     /** Alias a multidimarray.
      *
      * Treat the multidimarray as if it were a volume. The data is not copied
@@ -1600,7 +1667,7 @@ public:
             if (mmapOn)
                 new_mFd = mmapFile(new_data, NZYXdim);
             else
-                new_data = new T [NZYXdim];
+                new_data = askAlignedMemory<T>(NZYXdim);
 
             memset(new_data,0,NZYXdim*sizeof(T));
         }
@@ -2596,6 +2663,26 @@ public:
         return (T) LIN_INTERP(fx, d0, d1);
     }
 
+    /** Weights and mirrored indexes of the 4 taps of a cubic B-spline.
+     * The taps start at l1 and are evaluated at x, indexes are mirrored at
+     * the borders of an axis of size dim as in the B-spline interpolators.
+     */
+    static inline void cubicBSplineTaps(double x, int l1, int dim, double *w, int *idx)
+    {
+        for (int t = 0; t < 4; t++)
+        {
+            int l = l1 + t;
+            double xminusl = x - (double) l;
+            BSPLINE03(w[t], xminusl);
+            if      (l<0)
+                idx[t]=-l-1;
+            else if (l>=dim)
+                idx[t]=2*dim-l-1;
+            else
+                idx[t]=l;
+        }
+    }
+
     /** Interpolates the value of the nth 3D matrix M at the point (x,y,z) knowing
      * that this image is a set of B-spline coefficients.
      *
@@ -2625,6 +2712,31 @@ public:
         int Xdim=(int)XSIZE(*this);
         int Ydim=(int)YSIZE(*this);
         int Zdim=(int)ZSIZE(*this);
+        if (SplineDegree == 3)
+        {
+            // Cubic splines: weights and mirrored indexes are computed once
+            // per axis, the inner loops are a plain weighted sum
+            double wx[4], wy[4], wz[4];
+            int ix[4], iy[4], iz[4];
+            cubicBSplineTaps(x, l1, Xdim, wx, ix);
+            cubicBSplineTaps(y, m1, Ydim, wy, iy);
+            cubicBSplineTaps(z, n1, Zdim, wz, iz);
+            for (int nn = 0; nn < 4; nn++)
+            {
+                double yxsum = 0.0;
+                for (int m = 0; m < 4; m++)
+                {
+                    const T *row = &DIRECT_A3D_ELEM(*this, iz[nn], iy[m], 0);
+                    double xsum = 0.0;
+                    for (int l = 0; l < 4; l++)
+                        xsum += (double) row[ix[l]] * wx[l];
+                    yxsum += xsum * wy[m];
+                }
+                zyxsum += yxsum * wz[nn];
+            }
+            return (T) zyxsum;
+        }
+
         for (int nn = n1; nn <= n2; nn++)
         {
             int equivalent_nn=nn;
@@ -2779,6 +2891,24 @@ public:
         double aux;
         int Ydim=(int)YSIZE(*this);
         int Xdim=(int)XSIZE(*this);
+        if (SplineDegree == 3)
+        {
+            // Cubic splines: see interpolatedElementBSpline3D
+            double wx[4], wy[4];
+            int ix[4], iy[4];
+            cubicBSplineTaps(x, l1, Xdim, wx, ix);
+            cubicBSplineTaps(y, m1, Ydim, wy, iy);
+            for (int m = 0; m < 4; m++)
+            {
+                const T *row = &DIRECT_A2D_ELEM(*this, iy[m], 0);
+                double rows = 0.0;
+                for (int l = 0; l < 4; l++)
+                    rows += (double) row[ix[l]] * wx[l];
+                columns += rows * wy[m];
+            }
+            return (T) columns;
+        }
+
         for (int m = m1; m <= m2; m++)
         {
             int equivalent_m=m;
@@ -3149,18 +3279,8 @@ public:
         if (NZYXSIZE(*this) <= 0)
             return;
 
-        T* ptr=NULL;
-        size_t n;
-        T Tmin=DIRECT_MULTIDIM_ELEM(*this,0);
-        T Tmax=Tmin;
-        FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY_ptr(*this,n,ptr)
-        {
-            T val=*ptr;
-            if (val < Tmin)
-                Tmin = val;
-            else if (val > Tmax)
-                Tmax = val;
-        }
+        T Tmin, Tmax;
+        simdMinMax(data, NZYXSIZE(*this), Tmin, Tmax);
         minval = static_cast< double >(Tmin);
         maxval = static_cast< double >(Tmax);
     }
@@ -3200,14 +3320,7 @@ public:
         if (NZYXSIZE(*this) <= 0)
             return 0;
 
-        double sum = 0;
-
-        T* ptr=NULL;
-        size_t n;
-        FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY_ptr(*this,n,ptr)
-        sum += static_cast< double >(*ptr);
-
-        return sum / NZYXSIZE(*this);
+        return simdSum(data, NZYXSIZE(*this)) / NZYXSIZE(*this);
     }
 
     /** Standard deviation of the values in the array.
@@ -3221,16 +3334,8 @@ public:
         if (NZYXSIZE(*this) <= 1)
             return 0;
 
-        double avg = 0, stddev = 0;
-
-        T* ptr=NULL;
-        size_t n;
-        FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY_ptr(*this,n,ptr)
-        {
-            double val=static_cast< double >(*ptr);
-            avg += val;
-            stddev += val * val;
-        }
+        double avg, stddev;
+        simdSumSum2(data, NZYXSIZE(*this), avg, stddev);
 
         avg /= NZYXSIZE(*this);
         stddev = stddev / NZYXSIZE(*this) - avg * avg;
@@ -3252,25 +3357,7 @@ public:
         if (NZYXSIZE(*this) <= 0)
             return;
 
-        avg = 0;
-        stddev = 0;
-
-        minval = maxval = data[0];
-
-        T* ptr=NULL;
-        size_t n;
-        FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY_ptr(*this,n,ptr)
-        {
-            T Tval=*ptr;
-            double val=Tval;
-            avg += val;
-            stddev += val * val;
-
-            if (Tval > maxval)
-                maxval = Tval;
-            else if (Tval < minval)
-                minval = Tval;
-        }
+        simdStats(data, NZYXSIZE(*this), avg, stddev, minval, maxval);
 
         avg /= NZYXSIZE(*this);
 
@@ -3296,18 +3383,7 @@ public:
         if (NZYXSIZE(*this) <= 0)
             return;
 
-        avg = 0;
-        stddev = 0;
-
-        T* ptr=NULL;
-        size_t n;
-        FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY_ptr(*this,n,ptr)
-        {
-            T Tval=*ptr;
-            double val=Tval;
-            avg += val;
-            stddev += val * val;
-        }
+        simdSumSum2(data, NZYXSIZE(*this), avg, stddev);
 
         avg /= NZYXSIZE(*this);
 
@@ -3588,17 +3664,7 @@ public:
 
         b = avgF - a * avg0;
 
-        T* ptr=&DIRECT_MULTIDIM_ELEM(*this,0);
-        size_t nmax=(nzyxdim/4)*4;
-        for (size_t n=0; n<nmax; n+=4, ptr+=4)
-        {
-            *(ptr  )= static_cast< T >(a * (*(ptr  )) + b);
-            *(ptr+1)= static_cast< T >(a * (*(ptr+1)) + b);
-            *(ptr+2)= static_cast< T >(a * (*(ptr+2)) + b);
-            *(ptr+3)= static_cast< T >(a * (*(ptr+3)) + b);
-        }
-        for (size_t n=nmax; n<nzyxdim; ++n, ptr+=1)
-            *(ptr  )= static_cast< T >(a * (*(ptr  )) + b);
+        simdAffine(data, nzyxdim, a, b);
     }
     //@}
 
@@ -3867,24 +3933,7 @@ public:
     {
         if (!sameShape(op1))
             REPORT_ERROR(ERR_MULTIDIM_SIZE,"The two arrays for dot product are not of the same shape");
-        double dot=0;
-        size_t n;
-        T* ptrOp1=NULL;
-        T* ptrOp2=NULL;
-        const size_t unroll=4;
-        size_t nmax=unroll*(MULTIDIM_SIZE(*this)/unroll);
-        for (n=0, ptrOp1=data,ptrOp2=op1.data;
-             n<nmax; n+=unroll, ptrOp1+=unroll, ptrOp2+=unroll)
-        {
-            dot += *ptrOp1 * *ptrOp2;
-            dot += *(ptrOp1+1) * *(ptrOp2+1);
-            dot += *(ptrOp1+2) * *(ptrOp2+2);
-            dot += *(ptrOp1+3) * *(ptrOp2+3);
-        }
-        for (n=nmax, ptrOp1=data+nmax, ptrOp2=op1.data+nmax;
-             n<MULTIDIM_SIZE(*this); ++n, ++ptrOp1, ++ptrOp2)
-            dot += *ptrOp1 * *ptrOp2;
-        return dot;
+        return simdDot(data, op1.data, MULTIDIM_SIZE(*this));
     }
     //@}
 
@@ -4232,6 +4281,66 @@ public:
         initZeros(1, Zdim, Ydim, Xdim);
     }
 
+    /** Initialize to zeros with a given size from several threads.
+     *
+     * This is meant for the large volumes that are later processed by
+     * nThreads workers. The memory is allocated again and zeroed by the
+     * workers, each one a contiguous band of slices (see firstTouchZeros),
+     * so that in NUMA machines the pages are distributed over the sockets of
+     * the workers instead of living all in the socket of the calling thread.
+     * The result is the same as initZeros(Zdim, Ydim, Xdim).
+     *
+     * @code
+     * setThreadAffinityPolicy(AFFINITY_SOCKETS);
+     * V.initZerosFirstTouch(512, 512, 512, Nthreads);
+     * @endcode
+     */
+    void initZerosFirstTouch(size_t Zdim, size_t Ydim, size_t Xdim, int nThreads)
+    {
+        if (nThreads <= 1 || mmapOn || !destroyData)
+        {
+            initZeros(1, Zdim, Ydim, Xdim);
+            return;
+        }
+        if (Zdim == 0 || Ydim == 0 || Xdim == 0)
+        {
+            clear();
+            return;
+        }
+        coreDeallocate();
+        setDimensions(Xdim, Ydim, Zdim, 1);
+        try
+        {
+            data = askAlignedMemory<T>(nzyxdim);
+        }
+        catch (std::bad_alloc &)
+        {
+            data = NULL;
+        }
+        if (data == NULL)
+        {
+            // Fall back to the mapped file of coreAllocate
+            setMmap(true);
+            mFd = mmapFile(data, nzyxdim);
+        }
+        nzyxdimAlloc = nzyxdim;
+        firstTouchZeros(data, nzyxdim*sizeof(T), nThreads);
+    }
+
+    /** Initialize to zeros from several threads following a pattern.
+     *
+     * The size and origin of the pattern are adopted.
+     * See initZerosFirstTouch(Zdim, Ydim, Xdim, nThreads).
+     */
+    template <typename T1>
+    void initZerosFirstTouch(const MultidimArray<T1>& op, int nThreads)
+    {
+        initZerosFirstTouch(ZSIZE(op), YSIZE(op), XSIZE(op), nThreads);
+        STARTINGZ(*this) = STARTINGZ(op);
+        STARTINGY(*this) = STARTINGY(op);
+        STARTINGX(*this) = STARTINGX(op);
+    }
+
     /** Linear initialization (only for 1D)
      *
      * The 1D vector is filled with values increasing/decreasing linearly within a
@@ -4940,12 +5049,7 @@ public:
      */
     double sum() const
     {
-        double sum = 0;
-        T* ptr=NULL;
-        size_t n;
-        FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY_ptr(*this,n,ptr)
-        sum += *ptr;
-        return sum;
+        return simdSum(data, NZYXSIZE(*this));
     }
 
     /** Sum of squared vector values.
@@ -4959,26 +5063,7 @@ public:
      */
     double sum2() const
     {
-        double sum = 0;
-
-        // Unroll the loop
-        const size_t unroll=4;
-        size_t nmax=(NZYXSIZE(*this)/unroll)*unroll;
-        T* ptr = MULTIDIM_ARRAY(*this);
-        for (size_t n=0; n<nmax; n+=unroll, ptr+=unroll)
-        {
-            sum+= (*ptr)*(*ptr);
-            T* ptr1=ptr+1;
-            sum+= (*ptr1)*(*ptr1);
-            T* ptr2=ptr+2;
-            sum+= (*ptr2)*(*ptr2);
-            T* ptr3=ptr+3;
-            sum+= (*ptr3)*(*ptr3);
-        }
-        // Do the remaining elements
-        for (size_t n=nmax; n<NZYXSIZE(*this); ++n, ++ptr)
-            sum+=(*ptr)*(*ptr);
-        return sum;
+        return simdSum2(data, NZYXSIZE(*this));
     }
 
     /** Log10.
@@ -5211,6 +5296,33 @@ public:
         return *this;
     }
 
+#if __cplusplus >= 201103L
+    /** Move assignment.
+     *
+     * The data of op1 is taken without copying it and op1 is left empty.
+     * The values are copied if any of the arrays does not own its data,
+     * so that assigning to an alias keeps writing on the aliased memory.
+     *
+     * @code
+     * v1 = v2 + v3;
+     * @endcode
+     */
+    MultidimArray<T>& operator=(MultidimArray<T>&& op1)
+    {
+        if (&op1 != this)
+        {
+            if (op1.destroyData && (destroyData || data == NULL))
+            {
+                clear();
+                swap(op1);
+            }
+            else
+                *this = op1;
+        }
+        return *this;
+    }
+#endif
+
     /** Assignment.
      *
      * You can build as complex assignment expressions as you like. Multiple
@@ -5231,6 +5343,82 @@ public:
         return *this;
     }
 
+    /** Assignment of an array expression.
+     *
+     * The expression is evaluated element by element in a single loop,
+     * without any temporary array. All the arrays in the expression must
+     * have the same shape, and this array may be one of them.
+     *
+     * @code
+     * v1 = lazy(v2) * 2. + v3 - v4;
+     * v1 = lazy(v1) * alpha + v2;
+     * @endcode
+     */
+    template<typename E>
+    MultidimArray<T>& operator=(const MultidimExpr<E>& expr)
+    {
+        const MultidimArray<T>& shape = expr.checkShape();
+        if (data == NULL || !sameShape(shape))
+            resizeNoCopy(shape);
+        const E e = expr.node();
+        T* ptr = data;
+        for (size_t n = 0; n < nzyxdim; ++n)
+            ptr[n] = e[n];
+        return *this;
+    }
+
+    /** v1 += expression, in a single pass.
+     */
+    template<typename E>
+    void operator+=(const MultidimExpr<E>& expr)
+    {
+        if (!sameShape(expr.checkShape()))
+            REPORT_ERROR(ERR_MULTIDIM_SIZE, "operator+=: different shapes");
+        const E e = expr.node();
+        T* ptr = data;
+        for (size_t n = 0; n < nzyxdim; ++n)
+            ptr[n] += e[n];
+    }
+
+    /** v1 -= expression, in a single pass.
+     */
+    template<typename E>
+    void operator-=(const MultidimExpr<E>& expr)
+    {
+        if (!sameShape(expr.checkShape()))
+            REPORT_ERROR(ERR_MULTIDIM_SIZE, "operator-=: different shapes");
+        const E e = expr.node();
+        T* ptr = data;
+        for (size_t n = 0; n < nzyxdim; ++n)
+            ptr[n] -= e[n];
+    }
+
+    /** v1 *= expression, in a single pass.
+     */
+    template<typename E>
+    void operator*=(const MultidimExpr<E>& expr)
+    {
+        if (!sameShape(expr.checkShape()))
+            REPORT_ERROR(ERR_MULTIDIM_SIZE, "operator*=: different shapes");
+        const E e = expr.node();
+        T* ptr = data;
+        for (size_t n = 0; n < nzyxdim; ++n)
+            ptr[n] *= e[n];
+    }
+
+    /** v1 /= expression, in a single pass.
+     */
+    template<typename E>
+    void operator/=(const MultidimExpr<E>& expr)
+    {
+        if (!sameShape(expr.checkShape()))
+            REPORT_ERROR(ERR_MULTIDIM_SIZE, "operator/=: different shapes");
+        const E e = expr.node();
+        T* ptr = data;
+        for (size_t n = 0; n < nzyxdim; ++n)
+            ptr[n] /= e[n];
+    }
+
     /** Unary minus.
      *
      * It is used to build arithmetic expressions. You can make a minus
@@ -5525,6 +5713,282 @@ std::ostream& operator<< (std::ostream& ostrm, const MultidimArray<T>& v)
 }
 //@}
 
+/// @name Array expressions
+/// @{
+
+/** Array expression.
+ *
+ * The element-wise operators of MultidimArray return a new array for each
+ * operation, so that V = A * c + B - C creates three temporaries and goes
+ * three times through the memory. An array expression only records the
+ * operations and it is evaluated element by element, in a single loop,
+ * when it is assigned to an array.
+ *
+ * Expressions are started with lazy(), the rest of the operands may be
+ * arrays, scalars or other expressions. All the arrays must have the same
+ * shape, this is checked when the expression is evaluated.
+ *
+ * @code
+ * V = lazy(A) * c + B - C;
+ * V += lazy(A) * alpha;
+ * MultidimArray<double> W = (lazy(A) + B) * 0.5;
+ * @endcode
+ *
+ * The arrays of the expression are referenced, not copied, so an
+ * expression should not be kept beyond the statement that builds it.
+ */
+template<typename E>
+class MultidimExpr
+{
+public:
+    typedef typename E::value_type value_type;
+
+    /// Root node of the expression
+    E e;
+
+    /// Constructor
+    MultidimExpr(const E &_e): e(_e)
+    {}
+
+    /// Root node
+    const E& node() const
+    {
+        return e;
+    }
+
+    /// Value of the n-th element
+    inline value_type operator[](size_t n) const
+    {
+        return e[n];
+    }
+
+    /** Check that all the arrays have the same shape.
+     * One of the arrays is returned as reference for the shape.
+     */
+    const MultidimArray<value_type>& checkShape() const
+    {
+        const MultidimArray<value_type> *shape = e.shape();
+        if (!e.sameShape(*shape))
+            REPORT_ERROR(ERR_MULTIDIM_SIZE, "Array expression: different shapes");
+        return *shape;
+    }
+};
+
+/** Expression node of an array. */
+template<typename T>
+class MultidimExprArray
+{
+public:
+    typedef T value_type;
+    const MultidimArray<T> *array;
+    const T *data;
+
+    MultidimExprArray(const MultidimArray<T> &v): array(&v), data(v.data)
+    {}
+
+    inline T operator[](size_t n) const
+    {
+        return data[n];
+    }
+
+    const MultidimArray<T>* shape() const
+    {
+        return array;
+    }
+
+    bool sameShape(const MultidimArray<T> &v) const
+    {
+        return array->sameShape(v);
+    }
+};
+
+/** Expression node of a scalar. */
+template<typename T>
+class MultidimExprScalar
+{
+public:
+    typedef T value_type;
+    T value;
+
+    MultidimExprScalar(const T &_value): value(_value)
+    {}
+
+    inline T operator[](size_t) const
+    {
+        return value;
+    }
+
+    const MultidimArray<T>* shape() const
+    {
+        return NULL;
+    }
+
+    bool sameShape(const MultidimArray<T> &) const
+    {
+        return true;
+    }
+};
+
+/** Expression node of a binary operation. */
+template<typename L, typename R, typename Op>
+class MultidimExprBinary
+{
+public:
+    typedef typename L::value_type value_type;
+    L l;
+    R r;
+
+    MultidimExprBinary(const L &_l, const R &_r): l(_l), r(_r)
+    {}
+
+    inline value_type operator[](size_t n) const
+    {
+        return Op::apply(l[n], r[n]);
+    }
+
+    const MultidimArray<value_type>* shape() const
+    {
+        const MultidimArray<value_type> *s = l.shape();
+        return (s == NULL) ? r.shape() : s;
+    }
+
+    bool sameShape(const MultidimArray<value_type> &v) const
+    {
+        return l.sameShape(v) && r.sameShape(v);
+    }
+};
+
+/** Expression node of the unary minus. */
+template<typename E>
+class MultidimExprMinus
+{
+public:
+    typedef typename E::value_type value_type;
+    E e;
+
+    MultidimExprMinus(const E &_e): e(_e)
+    {}
+
+    inline value_type operator[](size_t n) const
+    {
+        return -e[n];
+    }
+
+    const MultidimArray<value_type>* shape() const
+    {
+        return e.shape();
+    }
+
+    bool sameShape(const MultidimArray<value_type> &v) const
+    {
+        return e.sameShape(v);
+    }
+};
+
+/// Element-wise operations of the expression nodes
+struct MultidimExprAdd
+{
+    template<typename T>
+    static inline T apply(const T &a, const T &b)
+    {
+        return a + b;
+    }
+};
+struct MultidimExprSubtract
+{
+    template<typename T>
+    static inline T apply(const T &a, const T &b)
+    {
+        return a - b;
+    }
+};
+struct MultidimExprMultiply
+{
+    template<typename T>
+    static inline T apply(const T &a, const T &b)
+    {
+        return a * b;
+    }
+};
+struct MultidimExprDivide
+{
+    template<typename T>
+    static inline T apply(const T &a, const T &b)
+    {
+        return a / b;
+    }
+};
+
+/** Start an array expression.
+ *
+ * @code
+ * V = lazy(A) * c + B - C;
+ * @endcode
+ */
+template<typename T>
+inline MultidimExpr< MultidimExprArray<T> > lazy(const MultidimArray<T> &v)
+{
+    return MultidimExpr< MultidimExprArray<T> >(MultidimExprArray<T>(v));
+}
+
+/** Unary minus of an expression. */
+template<typename E>
+inline MultidimExpr< MultidimExprMinus<E> > operator-(const MultidimExpr<E> &op)
+{
+    return MultidimExpr< MultidimExprMinus<E> >(MultidimExprMinus<E>(op.node()));
+}
+
+/** Binary operators between an expression and an expression, an array or a
+ * scalar. The scalar and the arrays must be of the type of the expression.
+ */
+#define MULTIDIM_EXPR_OPERATOR(OP, OPCLASS) \
+template<typename E1, typename E2> \
+inline MultidimExpr< MultidimExprBinary<E1, E2, OPCLASS> > \
+operator OP(const MultidimExpr<E1> &op1, const MultidimExpr<E2> &op2) \
+{ \
+    typedef MultidimExprBinary<E1, E2, OPCLASS> Node; \
+    return MultidimExpr<Node>(Node(op1.node(), op2.node())); \
+} \
+template<typename E> \
+inline MultidimExpr< MultidimExprBinary<E, MultidimExprArray<typename E::value_type>, OPCLASS> > \
+operator OP(const MultidimExpr<E> &op1, const MultidimArray<typename E::value_type> &op2) \
+{ \
+    typedef MultidimExprArray<typename E::value_type> Leaf; \
+    typedef MultidimExprBinary<E, Leaf, OPCLASS> Node; \
+    return MultidimExpr<Node>(Node(op1.node(), Leaf(op2))); \
+} \
+template<typename E> \
+inline MultidimExpr< MultidimExprBinary<MultidimExprArray<typename E::value_type>, E, OPCLASS> > \
+operator OP(const MultidimArray<typename E::value_type> &op1, const MultidimExpr<E> &op2) \
+{ \
+    typedef MultidimExprArray<typename E::value_type> Leaf; \
+    typedef MultidimExprBinary<Leaf, E, OPCLASS> Node; \
+    return MultidimExpr<Node>(Node(Leaf(op1), op2.node())); \
+} \
+template<typename E> \
+inline MultidimExpr< MultidimExprBinary<E, MultidimExprScalar<typename E::value_type>, OPCLASS> > \
+operator OP(const MultidimExpr<E> &op1, typename E::value_type op2) \
+{ \
+    typedef MultidimExprScalar<typename E::value_type> Leaf; \
+    typedef MultidimExprBinary<E, Leaf, OPCLASS> Node; \
+    return MultidimExpr<Node>(Node(op1.node(), Leaf(op2))); \
+} \
+template<typename E> \
+inline MultidimExpr< MultidimExprBinary<MultidimExprScalar<typename E::value_type>, E, OPCLASS> > \
+operator OP(typename E::value_type op1, const MultidimExpr<E> &op2) \
+{ \
+    typedef MultidimExprScalar<typename E::value_type> Leaf; \
+    typedef MultidimExprBinary<Leaf, E, OPCLASS> Node; \
+    return MultidimExpr<Node>(Node(Leaf(op1), op2.node())); \
+}
+
+MULTIDIM_EXPR_OPERATOR(+, MultidimExprAdd)
+MULTIDIM_EXPR_OPERATOR(-, MultidimExprSubtract)
+MULTIDIM_EXPR_OPERATOR(*, MultidimExprMultiply)
+MULTIDIM_EXPR_OPERATOR(/, MultidimExprDivide)
+#undef MULTIDIM_EXPR_OPERATOR
+/// @}
+
 // Specializations cases for complex numbers
 template<>
 std::ostream& operator<<(std::ostream& ostrm, const MultidimArray< std::complex<double> >& v);
@@ -5539,8 +6003,6 @@ double MultidimArray< std::complex< double > >::computeAvg() const;
 template<>
 void MultidimArray< std::complex< double > >::maxIndex(size_t &lmax, int& kmax, int& imax, int& jmax) const;
 template<>
-void MultidimArray<double>::computeAvgStdev(double& avg, double& stddev) const;
-template<>
 bool operator==(const MultidimArray< std::complex< double > >& op1,
                 const MultidimArray< std::complex< double > >& op2);
 template<>
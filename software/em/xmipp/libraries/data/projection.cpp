@@ -373,18 +373,15 @@ void ParametersProjectionTomography::calculateProjectionAngles(Projection &P, do
 }
 
 // Projection from a voxel volume ==========================================
-/* Project a voxel volume -------------------------------------------------- */
-//#define DEBUG
-void projectVolume(MultidimArray<double> &V, Projection &P, int Ydim, int Xdim,
-                   double rot, double tilt, double psi,
-                   const Matrix1D<double> *roffset)
+/* Project rows of a projection from a voxel volume ------------------------ */
+// The four rays of each pixel are traced through the voxels they cross
+// and their line integrals are averaged. The volume is only read, so that
+// several threads may project it at the same time. The direction must not
+// have zero components (see projectVolume).
+static void projectVolumeRows(const MultidimArray<double> &V, const Matrix2D<double> &eulert,
+                              const Matrix1D<double> &direction, const Matrix1D<double> *roffset,
+                              MultidimArray<double> &mP, int i0, int i1)
 {
-    SPEED_UP_temps012;
-
-    // Initialise projection
-    P.reset(Ydim, Xdim);
-    P.setAngles(rot, tilt, psi);
-
     // Compute the distance for this line crossing one voxel
     int x_0 = STARTINGX(V), x_F = FINISHINGX(V);
     int y_0 = STARTINGY(V), y_F = FINISHINGY(V);
@@ -393,244 +390,341 @@ void projectVolume(MultidimArray<double> &V, Projection &P, int Ydim, int Xdim,
     // Distances in X and Y between the center of the projection pixel begin
     // computed and each computed ray
     double step = 1.0 / 3.0;
-
-    // Avoids divisions by zero and allows orthogonal rays computation
-    if (XX(P.direction) == 0)
-        XX(P.direction) = XMIPP_EQUAL_ACCURACY;
-    if (YY(P.direction) == 0)
-        YY(P.direction) = XMIPP_EQUAL_ACCURACY;
-    if (ZZ(P.direction) == 0)
-        ZZ(P.direction) = XMIPP_EQUAL_ACCURACY;
+    const double ray_x[4] = {-step, -step, step, step};
+    const double ray_y[4] = {-step, step, -step, step};
 
     // Some precalculated variables
-    int x_sign = SGN(XX(P.direction));
-    int y_sign = SGN(YY(P.direction));
-    int z_sign = SGN(ZZ(P.direction));
+    double dir_x = XX(direction), dir_y = YY(direction), dir_z = ZZ(direction);
+    int x_sign = SGN(dir_x);
+    int y_sign = SGN(dir_y);
+    int z_sign = SGN(dir_z);
     double half_x_sign = 0.5 * x_sign;
     double half_y_sign = 0.5 * y_sign;
     double half_z_sign = 0.5 * z_sign;
-    double iXXP_direction=1.0/XX(P.direction);
-    double iYYP_direction=1.0/YY(P.direction);
-    double iZZP_direction=1.0/ZZ(P.direction);
-
-    MultidimArray<double> &mP = P();
-    Matrix1D<double>  v(3);
-    Matrix1D<double> r_p(3); // r_p are the coordinates of the
-    // pixel being projected in the
-    // coordinate system attached to the
-    // projection
-    Matrix1D<double> p1(3);  // coordinates of the pixel in the
-    // universal space
-    Matrix1D<double> p1_shifted(3); // shifted half a pixel
-    FOR_ALL_ELEMENTS_IN_ARRAY2D(mP)
+    double iXXP_direction=1.0/dir_x;
+    double iYYP_direction=1.0/dir_y;
+    double iZZP_direction=1.0/dir_z;
+    double e00 = MAT_ELEM(eulert,0,0), e01 = MAT_ELEM(eulert,0,1), e02 = MAT_ELEM(eulert,0,2);
+    double e10 = MAT_ELEM(eulert,1,0), e11 = MAT_ELEM(eulert,1,1), e12 = MAT_ELEM(eulert,1,2);
+    double e20 = MAT_ELEM(eulert,2,0), e21 = MAT_ELEM(eulert,2,1), e22 = MAT_ELEM(eulert,2,2);
+    double offset_x = 0, offset_y = 0, offset_z = 0;
+    if (roffset!=NULL)
     {
-        double ray_sum = 0.0;    // Line integral value
-
-        // Computes 4 different rays for each pixel.
-        for (int rays_per_pixel = 0; rays_per_pixel < 4; rays_per_pixel++)
-        {
-            // universal coordinate system
-            switch (rays_per_pixel)
-            {
-            case 0:
-                VECTOR_R3(r_p, j - step, i - step, 0);
-                break;
-            case 1:
-                VECTOR_R3(r_p, j - step, i + step, 0);
-                break;
-            case 2:
-                VECTOR_R3(r_p, j + step, i - step, 0);
-                break;
-            case 3:
-                VECTOR_R3(r_p, j + step, i + step, 0);
-                break;
-            }
-
-            // Express r_p in the universal coordinate system
-            if (roffset!=NULL)
-                r_p-=*roffset;
-            M3x3_BY_V3x1(p1, P.eulert, r_p);
-            XX(p1_shifted)=XX(p1)-half_x_sign;
-            YY(p1_shifted)=YY(p1)-half_y_sign;
-            ZZ(p1_shifted)=ZZ(p1)-half_z_sign;
-
-            // Compute the minimum and maximum alpha for the ray
-            // intersecting the given volume
-            double alpha_xmin = (x_0 - 0.5 - XX(p1))* iXXP_direction;
-            double alpha_xmax = (x_F + 0.5 - XX(p1))* iXXP_direction;
-            double alpha_ymin = (y_0 - 0.5 - YY(p1))* iYYP_direction;
-            double alpha_ymax = (y_F + 0.5 - YY(p1))* iYYP_direction;
-            double alpha_zmin = (z_0 - 0.5 - ZZ(p1))* iZZP_direction;
-            double alpha_zmax = (z_F + 0.5 - ZZ(p1))* iZZP_direction;
-
-            double auxMin, auxMax;
-            if (alpha_xmin<alpha_xmax)
-            {
-                auxMin=alpha_xmin;
-                auxMax=alpha_xmax;
-            }
-            else
-            {
-                auxMin=alpha_xmax;
-                auxMax=alpha_xmin;
-            }
-            double alpha_min=auxMin;
-            double alpha_max=auxMax;
-            if (alpha_ymin<alpha_ymax)
-            {
-                auxMin=alpha_ymin;
-                auxMax=alpha_ymax;
-            }
-            else
-            {
-                auxMin=alpha_ymax;
-                auxMax=alpha_ymin;
-            }
-            alpha_min=fmax(auxMin,alpha_min);
-            alpha_max=fmin(auxMax,alpha_max);
-            if (alpha_zmin<alpha_zmax)
-            {
-                auxMin=alpha_zmin;
-                auxMax=alpha_zmax;
-            }
-            else
-            {
-                auxMin=alpha_zmax;
-                auxMax=alpha_zmin;
-            }
-            alpha_min=fmax(auxMin,alpha_min);
-            alpha_max=fmin(auxMax,alpha_max);
-            if (alpha_max - alpha_min < XMIPP_EQUAL_ACCURACY)
-                continue;
-
-#ifdef DEBUG
-
-            std::cout << "Pixel:  " << r_p.transpose() << std::endl
-            << "Univ:   " << p1.transpose() << std::endl
-            << "Dir:    " << P.direction.transpose() << std::endl
-            << "Alpha x:" << alpha_xmin << " " << alpha_xmax << std::endl
-            << "   " << (p1 + alpha_xmin*P.direction).transpose() << std::endl
-            << "   " << (p1 + alpha_xmax*P.direction).transpose() << std::endl
-            << "Alpha y:" << alpha_ymin << " " << alpha_ymax << std::endl
-            << "   " << (p1 + alpha_ymin*P.direction).transpose() << std::endl
-            << "   " << (p1 + alpha_ymax*P.direction).transpose() << std::endl
-            << "Alpha z:" << alpha_zmin << " " << alpha_zmax << std::endl
-            << "   " << (p1 + alpha_zmin*P.direction).transpose() << std::endl
-            << "   " << (p1 + alpha_zmax*P.direction).transpose() << std::endl
-            << "alpha  :" << alpha_min  << " " << alpha_max  << std::endl
-            << std::endl;
-#endif
-
-            // Compute the first point in the volume intersecting the ray
-            double zz_idxd, yy_idxd, xx_idxd;
-            int    zz_idx , yy_idx , xx_idx;
-            V3_BY_CT(v, P.direction, alpha_min);
-            V3_PLUS_V3(v, p1, v);
-
-            // Compute the index of the first voxel
-            xx_idx = ROUND(XX(v));
-            yy_idx = ROUND(YY(v));
-            zz_idx = ROUND(ZZ(v));
-
-            xx_idxd = xx_idx = CLIP(xx_idx, x_0, x_F);
-            yy_idxd = yy_idx = CLIP(yy_idx, y_0, y_F);
-            zz_idxd = zz_idx = CLIP(zz_idx, z_0, z_F);
+        offset_x = XX(*roffset);
+        offset_y = YY(*roffset);
+        offset_z = ZZ(*roffset);
+    }
 
-#ifdef DEBUG
+    // Steps in memory when the ray moves to the next voxel
+    const double *ptrV = MULTIDIM_ARRAY(V);
+    long x_step = x_sign;
+    long y_step = y_sign * (long)XSIZE(V);
+    long z_step = z_sign * (long)YXSIZE(V);
 
-            std::cout << "First voxel: " << v.transpose() << std::endl;
-            std::cout << "   First index: " << idx.transpose() << std::endl;
-            std::cout << "   Alpha_min: " << alpha_min << std::endl;
-#endif
+    for (int i = i0; i <= i1; i++)
+        for (int j = STARTINGX(mP); j <= FINISHINGX(mP); j++)
+        {
+            double ray_sum = 0.0;    // Line integral value
 
-            // Follow the ray
-            double alpha = alpha_min;
-            do
+            // Computes 4 different rays for each pixel.
+            for (int rays_per_pixel = 0; rays_per_pixel < 4; rays_per_pixel++)
             {
-#ifdef DEBUG
-                std::cout << " \n\nCurrent Value: " << V(zz_idx, yy_idx, xx_idx) << std::endl;
-#endif
+                // Coordinates of the ray in the coordinate system
+                // attached to the projection
+                double r_x = j + ray_x[rays_per_pixel];
+                double r_y = i + ray_y[rays_per_pixel];
+                double r_z = 0;
+                if (roffset!=NULL)
+                {
+                    r_x -= offset_x;
+                    r_y -= offset_y;
+                    r_z -= offset_z;
+                }
 
-                double alpha_x = (xx_idxd - XX(p1_shifted))* iXXP_direction;
-                double alpha_y = (yy_idxd - YY(p1_shifted))* iYYP_direction;
-                double alpha_z = (zz_idxd - ZZ(p1_shifted))* iZZP_direction;
-
-                // Which dimension will ray move next step into?, it isn't necessary to be only
-                // one.
-                double diffx = fabs(alpha-alpha_x);
-                double diffy = fabs(alpha-alpha_y);
-                double diffz = fabs(alpha-alpha_z);
-                int diff_source=0;
-                double diff_alpha=diffx;
-                if (diffy<diff_alpha)
+                // Express r_p in the universal coordinate system
+                double p1_x = e00 * r_x + e01 * r_y + e02 * r_z;
+                double p1_y = e10 * r_x + e11 * r_y + e12 * r_z;
+                double p1_z = e20 * r_x + e21 * r_y + e22 * r_z;
+                double p1_shifted_x = p1_x - half_x_sign;
+                double p1_shifted_y = p1_y - half_y_sign;
+                double p1_shifted_z = p1_z - half_z_sign;
+
+                // Compute the minimum and maximum alpha for the ray
+                // intersecting the given volume
+                double alpha_xmin = (x_0 - 0.5 - p1_x)* iXXP_direction;
+                double alpha_xmax = (x_F + 0.5 - p1_x)* iXXP_direction;
+                double alpha_ymin = (y_0 - 0.5 - p1_y)* iYYP_direction;
+                double alpha_ymax = (y_F + 0.5 - p1_y)* iYYP_direction;
+                double alpha_zmin = (z_0 - 0.5 - p1_z)* iZZP_direction;
+                double alpha_zmax = (z_F + 0.5 - p1_z)* iZZP_direction;
+
+                double auxMin, auxMax;
+                if (alpha_xmin<alpha_xmax)
                 {
-                    diff_source=1;
-                    diff_alpha=diffy;
+                    auxMin=alpha_xmin;
+                    auxMax=alpha_xmax;
                 }
-                if (diffz<diff_alpha)
+                else
                 {
-                    diff_source=2;
-                    diff_alpha=diffz;
+                    auxMin=alpha_xmax;
+                    auxMax=alpha_xmin;
                 }
-                ray_sum += diff_alpha * A3D_ELEM(V, zz_idx, yy_idx, xx_idx);
-
-                switch (diff_source)
+                double alpha_min=auxMin;
+                double alpha_max=auxMax;
+                if (alpha_ymin<alpha_ymax)
+                {
+                    auxMin=alpha_ymin;
+                    auxMax=alpha_ymax;
+                }
+                else
+                {
+                    auxMin=alpha_ymax;
+                    auxMax=alpha_ymin;
+                }
+                alpha_min=fmax(auxMin,alpha_min);
+                alpha_max=fmin(auxMax,alpha_max);
+                if (alpha_zmin<alpha_zmax)
+                {
+                    auxMin=alpha_zmin;
+                    auxMax=alpha_zmax;
+                }
+                else
+                {
+                    auxMin=alpha_zmax;
+                    auxMax=alpha_zmin;
+                }
+                alpha_min=fmax(auxMin,alpha_min);
+                alpha_max=fmin(auxMax,alpha_max);
+                if (alpha_max - alpha_min < XMIPP_EQUAL_ACCURACY)
+                    continue;
+
+                // Compute the index of the first voxel intersecting the ray
+                int xx_idx = ROUND(p1_x + dir_x * alpha_min);
+                int yy_idx = ROUND(p1_y + dir_y * alpha_min);
+                int zz_idx = ROUND(p1_z + dir_z * alpha_min);
+
+                double zz_idxd, yy_idxd, xx_idxd;
+                xx_idxd = xx_idx = CLIP(xx_idx, x_0, x_F);
+                yy_idxd = yy_idx = CLIP(yy_idx, y_0, y_F);
+                zz_idxd = zz_idx = CLIP(zz_idx, z_0, z_F);
+                long idx = ((zz_idx - z_0) * (long)YSIZE(V) + (yy_idx - y_0)) * (long)XSIZE(V) + (xx_idx - x_0);
+
+                // Follow the ray
+                double alpha = alpha_min;
+                do
                 {
-                case 0:
-                    alpha = alpha_x;
-                    xx_idx += x_sign;
-                    xx_idxd = xx_idx;
-                    break;
-                case 1:
-                    alpha = alpha_y;
-                    yy_idx += y_sign;
-                    yy_idxd = yy_idx;
-                    break;
-                default:
-                    alpha = alpha_z;
-                    zz_idx += z_sign;
-                    zz_idxd = zz_idx;
+                    double alpha_x = (xx_idxd - p1_shifted_x)* iXXP_direction;
+                    double alpha_y = (yy_idxd - p1_shifted_y)* iYYP_direction;
+                    double alpha_z = (zz_idxd - p1_shifted_z)* iZZP_direction;
+
+                    // Which dimension will ray move next step into?, it isn't necessary to be only
+                    // one.
+                    double diffx = fabs(alpha-alpha_x);
+                    double diffy = fabs(alpha-alpha_y);
+                    double diffz = fabs(alpha-alpha_z);
+                    int diff_source=0;
+                    double diff_alpha=diffx;
+                    if (diffy<diff_alpha)
+                    {
+                        diff_source=1;
+                        diff_alpha=diffy;
+                    }
+                    if (diffz<diff_alpha)
+                    {
+                        diff_source=2;
+                        diff_alpha=diffz;
+                    }
+                    ray_sum += diff_alpha * ptrV[idx];
+
+                    switch (diff_source)
+                    {
+                    case 0:
+                        alpha = alpha_x;
+                        xx_idx += x_sign;
+                        xx_idxd = xx_idx;
+                        idx += x_step;
+                        break;
+                    case 1:
+                        alpha = alpha_y;
+                        yy_idx += y_sign;
+                        yy_idxd = yy_idx;
+                        idx += y_step;
+                        break;
+                    default:
+                        alpha = alpha_z;
+                        zz_idx += z_sign;
+                        zz_idxd = zz_idx;
+                        idx += z_step;
+                    }
                 }
+                while ((alpha_max - alpha) > XMIPP_EQUAL_ACCURACY);
+            } // for
 
-#ifdef DEBUG
-                std::cout << "Alpha x,y,z: " << alpha_x << " " << alpha_y
-                << " " << alpha_z << " ---> " << alpha << std::endl;
-
-                XX(v) += diff_alpha * XX(P.direction);
-                YY(v) += diff_alpha * YY(P.direction);
-                ZZ(v) += diff_alpha * ZZ(P.direction);
-
-                std::cout << "    Next entry point: " << v.transpose() << std::endl
-                << "    Index: " << idx.transpose() << std::endl
-                << "    diff_alpha: " << diff_alpha << std::endl
-                << "    ray_sum: " << ray_sum << std::endl
-                << "    Alfa tot: " << alpha << "alpha_max: " << alpha_max <<
-                std::endl;
-#endif
+            A2D_ELEM(mP, i, j) = ray_sum * 0.25;
+        }
+}
 
-            }
-            while ((alpha_max - alpha) > XMIPP_EQUAL_ACCURACY);
-        } // for
+// Avoids divisions by zero and allows orthogonal rays computation
+static void avoidZeroDirection(Matrix1D<double> &direction)
+{
+    if (XX(direction) == 0)
+        XX(direction) = XMIPP_EQUAL_ACCURACY;
+    if (YY(direction) == 0)
+        YY(direction) = XMIPP_EQUAL_ACCURACY;
+    if (ZZ(direction) == 0)
+        ZZ(direction) = XMIPP_EQUAL_ACCURACY;
+}
 
-        A2D_ELEM(IMGMATRIX(P), i, j) = ray_sum * 0.25;
-#ifdef DEBUG
+struct ProjectVolumeArgs
+{
+    const MultidimArray<double> *V;
+    // Single projection
+    Projection *P;
+    const Matrix1D<double> *roffset;
+    // Batch of projections
+    const Matrix2D<double> *angles;
+    const Matrix2D<double> *offsets;
+    MultidimArray<double> *projections;
+    int Ydim, Xdim;
+    ThreadTaskDistributor *distributor;
+};
+
+// Rows of a single projection
+static void projectVolumeThread(ThreadArgument &thArg)
+{
+    ProjectVolumeArgs *args = (ProjectVolumeArgs *) thArg.data;
+    Projection &P = *(args->P);
+    MultidimArray<double> &mP = P();
+    size_t first, last;
+    while (args->distributor->getTasks(first, last))
+        projectVolumeRows(*(args->V), P.eulert, P.direction, args->roffset, mP,
+                          STARTINGY(mP) + (int)first, STARTINGY(mP) + (int)last);
+}
 
-        std::cout << "Assigning P(" << i << "," << j << ")=" << ray_sum << std::endl;
-#endif
+// Rows of a batch of projections, the task n*Ydim+i is the row i of the
+// projection n
+static void projectVolumeBatchThread(ThreadArgument &thArg)
+{
+    ProjectVolumeArgs *args = (ProjectVolumeArgs *) thArg.data;
+    const Matrix2D<double> &angles = *(args->angles);
+    size_t Ydim = args->Ydim;
+
+    // Geometry of the current projection of this worker
+    MultidimArray<double> mP;
+    Matrix2D<double> euler, eulert;
+    Matrix1D<double> direction, roffset(3);
+    size_t current = (size_t)-1;
+
+    size_t first, last;
+    while (args->distributor->getTasks(first, last))
+        for (size_t t = first; t <= last; )
+        {
+            size_t n = t / Ydim;
+            if (n != current)
+            {
+                current = n;
+                mP.aliasImageInStack(*(args->projections), n);
+                mP.setXmippOrigin();
+                Euler_angles2matrix(MAT_ELEM(angles,n,0), MAT_ELEM(angles,n,1), MAT_ELEM(angles,n,2), euler);
+                eulert = euler.transpose();
+                euler.getRow(2, direction);
+                direction.selfTranspose();
+                avoidZeroDirection(direction);
+                if (args->offsets != NULL)
+                    VECTOR_R3(roffset, MAT_ELEM(*(args->offsets),n,0), MAT_ELEM(*(args->offsets),n,1),
+                              MAT_ELEM(*(args->offsets),n,2));
+            }
+            // Rows of this projection within the task block
+            size_t tLast = XMIPP_MIN(last, (n + 1) * Ydim - 1);
+            projectVolumeRows(*(args->V), eulert, direction, args->offsets == NULL ? NULL : &roffset, mP,
+                              STARTINGY(mP) + (int)(t - n * Ydim), STARTINGY(mP) + (int)(tLast - n * Ydim));
+            t = tLast + 1;
+        }
+}
 
+// Run the workers in this thread, in the threads of thMgr or in nThreads
+// new threads
+static void runProjectVolumeThreads(ThreadFunction function, ProjectVolumeArgs &args, int nThreads,
+                                    ThreadManager *thMgr=NULL)
+{
+    if (thMgr != NULL)
+        thMgr->run(function, &args);
+    else if (nThreads <= 1)
+    {
+        ThreadArgument thArg;
+        thArg.thread_id = 0;
+        thArg.threads = 1;
+        thArg.data = &args;
+        function(thArg);
+    }
+    else
+    {
+        ThreadManager thMgr(nThreads);
+        thMgr.run(function, &args);
     }
 }
-#undef DEBUG
+
+/* Project a voxel volume -------------------------------------------------- */
+void projectVolume(const MultidimArray<double> &V, Projection &P, int Ydim, int Xdim,
+                   double rot, double tilt, double psi,
+                   const Matrix1D<double> *roffset, int nThreads,
+                   ThreadManager *thMgr)
+{
+    // Initialise projection
+    P.reset(Ydim, Xdim);
+    P.setAngles(rot, tilt, psi);
+    avoidZeroDirection(P.direction);
+
+    ProjectVolumeArgs args;
+    args.V = &V;
+    args.P = &P;
+    args.roffset = roffset;
+    if (thMgr != NULL)
+        nThreads = thMgr->threads;
+    nThreads = XMIPP_MAX(1, XMIPP_MIN(nThreads, Ydim));
+    ThreadTaskDistributor distributor(Ydim, XMIPP_MAX(1, XMIPP_MIN(Ydim / (4 * nThreads), 8)));
+    args.distributor = &distributor;
+    runProjectVolumeThreads(projectVolumeThread, args, nThreads, thMgr);
+}
+
+/* Project a voxel volume in several directions ---------------------------- */
+void projectVolumeBatch(const MultidimArray<double> &V, const Matrix2D<double> &angles,
+                        MultidimArray<double> &projections, int Ydim, int Xdim,
+                        int nThreads, const Matrix2D<double> *offsets)
+{
+    size_t N = MAT_YSIZE(angles);
+    if (N > 0 && MAT_XSIZE(angles) < 3)
+        REPORT_ERROR(ERR_MATRIX_SIZE, "projectVolumeBatch: the angles must have 3 columns (rot, tilt, psi)");
+    if (offsets != NULL && (MAT_YSIZE(*offsets) != N || MAT_XSIZE(*offsets) < 3))
+        REPORT_ERROR(ERR_MATRIX_SIZE, "projectVolumeBatch: there must be one offset (x, y, z) per projection");
+    projections.resizeNoCopy(N, 1, Ydim, Xdim);
+    if (N == 0)
+        return;
+
+    ProjectVolumeArgs args;
+    args.V = &V;
+    args.angles = &angles;
+    args.offsets = offsets;
+    args.projections = &projections;
+    args.Ydim = Ydim;
+    args.Xdim = Xdim;
+    size_t nRows = N * Ydim;
+    nThreads = XMIPP_MAX(1, (int)XMIPP_MIN((size_t)nThreads, nRows));
+    ThreadTaskDistributor distributor(nRows, XMIPP_MAX(1, XMIPP_MIN(nRows / (4 * nThreads), (size_t)Ydim)));
+    args.distributor = &distributor;
+    runProjectVolumeThreads(projectVolumeBatchThread, args, nThreads);
+}
 
 /* Project a voxel volume with respect to an offcentered axis -------------- */
 //#define DEBUG
-void projectVolumeOffCentered(MultidimArray<double> &V, Projection &P,
-                              int Ydim, int Xdim)
+void projectVolumeOffCentered(const MultidimArray<double> &V, Projection &P,
+                              int Ydim, int Xdim, int nThreads,
+                              ThreadManager *thMgr)
 {
     Matrix1D<double> roffset(3);
     P.getShifts(XX(roffset), YY(roffset), ZZ(roffset));
 
-    projectVolume(V, P, Ydim, Xdim, P.rot(), P.tilt(), P.psi(), &roffset);
+    projectVolume(V, P, Ydim, Xdim, P.rot(), P.tilt(), P.psi(), &roffset, nThreads, thMgr);
 }
 
 // Perform a backprojection ================================================
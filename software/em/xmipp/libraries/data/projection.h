@@ -257,10 +257,29 @@ void project_SimpleGrid(Image<T> *vol, const SimpleGrid *grid,
     rproj=E*r+roffset => r=E^t (rproj-roffset)
 
     Set it to NULL if you don't want to use it
+
+    Four rays are traced per pixel through the voxels they cross. The rows
+    of the projection are shared by nThreads threads, the volume is only
+    read. Programs that project many times should create the threads once
+    and give them in thMgr, nThreads is then ignored.
  */
-void projectVolume(MultidimArray<double> &V, Projection &P, int Ydim, int Xdim,
+void projectVolume(const MultidimArray<double> &V, Projection &P, int Ydim, int Xdim,
                    double rot, double tilt, double psi,
-                   const Matrix1D<double> *roffset=NULL);
+                   const Matrix1D<double> *roffset=NULL, int nThreads=1,
+                   ThreadManager *thMgr=NULL);
+
+/** From voxel volumes, several directions.
+    Row n of angles holds the rot, tilt and psi of projection n, which is
+    stored in the image n of projections (it is resized to angles.mdimy
+    images of Ydim x Xdim pixels). If offsets is given, its row n is the
+    offset of projection n as in projectVolume. This is useful for tilt
+    series and galleries: the rows of all the projections are shared by
+    nThreads threads, which read the volume at the same time. The
+    projections are identical to projectVolume's.
+ */
+void projectVolumeBatch(const MultidimArray<double> &V, const Matrix2D<double> &angles,
+                        MultidimArray<double> &projections, int Ydim, int Xdim,
+                        int nThreads=1, const Matrix2D<double> *offsets=NULL);
 
 /** From voxel volumes, off-centered tilt axis.
     This routine projects a volume that is rotating (angle) degrees
@@ -277,8 +296,9 @@ void projectVolume(MultidimArray<double> &V, Projection &P, int Ydim, int Xdim,
     Where Raxis is the 3D rotation matrix given by the axis and
     the angle.
 */
-void projectVolumeOffCentered(MultidimArray<double> &V, Projection &P,
-                              int Ydim, int Xdim);
+void projectVolumeOffCentered(const MultidimArray<double> &V, Projection &P,
+                              int Ydim, int Xdim, int nThreads=1,
+                              ThreadManager *thMgr=NULL);
 
 /** Single Weighted Back Projection.
    Projects a single particle into a voxels volume by updating its components this way:
@@ -374,6 +394,7 @@ void *project_SimpleGridThread( void * params )
 
     int thread_id = thread_data->thread_id;
     int threads_count = thread_data->threads_count;
+    applyThreadAffinity(thread_id);
 
     const Basis * basis;
 
@@ -401,6 +422,7 @@ void *project_SimpleGridThread( void * params )
 
         if( thread_data->destroy == true )
             break;
+        logThreadPlacement(thread_id);
 
         vol = thread_data->vol;
         grid = thread_data->grid;
@@ -24,8 +24,66 @@
  ***************************************************************************/
 
 
+#include <algorithm>
+#include <alglib/src/ap.h>
+#include <alglib/src/linalg.h>
+
 #include "sparse_matrix2d.h"
+#include "xmipp_threads.h"
+
+// Minimum number of elements processed by each thread
+#define SPARSE_MIN_WORK_PER_THREAD 65536
+
+/* Bands of rows ----------------------------------------------------------- */
+typedef void (*SparseRowsFunction)(void *data, int row0, int rowF, int band);
+
+struct SparseRowsArgs
+{
+    SparseRowsFunction function;
+    void *data;
+    const int *bounds;
+};
+
+static void sparseRowsThread(ThreadArgument &thArg)
+{
+    SparseRowsArgs &args = *((SparseRowsArgs *) thArg.data);
+    int band = thArg.thread_id;
+    args.function(args.data, args.bounds[band], args.bounds[band + 1], band);
+}
 
+// Split the rows of A in bands with about the same number of elements, so
+// that each thread does the same work. work is the total number of operations
+static void rowBands(const SparseMatrix2D &A, size_t work, std::vector<int> &bounds)
+{
+    int nThreads = (int)XMIPP_MIN((size_t)getMatrix2DThreads(), work / SPARSE_MIN_WORK_PER_THREAD);
+    nThreads = XMIPP_MAX(XMIPP_MIN(nThreads, A.N), 1);
+    bounds.resize(nThreads + 1);
+    const int *rowPtr = MULTIDIM_ARRAY(A.iIdx);
+    size_t nnz = A.nnz();
+    bounds[0] = 0;
+    for (int t = 1; t < nThreads; ++t)
+    {
+        int target = (int)(1 + (nnz * t) / nThreads);
+        bounds[t] = XMIPP_MAX(bounds[t - 1], (int)(std::lower_bound(rowPtr, rowPtr + A.N, target) - rowPtr));
+    }
+    bounds[nThreads] = A.N;
+}
+
+static void runOnRowBands(const std::vector<int> &bounds, SparseRowsFunction function, void *data)
+{
+    int nBands = (int)bounds.size() - 1;
+    if (nBands > 1)
+    {
+        SparseRowsArgs args;
+        args.function = function;
+        args.data = data;
+        args.bounds = &bounds[0];
+        ThreadManager thMgr(nBands);
+        thMgr.run(sparseRowsThread, &args);
+    }
+    else
+        function(data, bounds[0], bounds[1], 0);
+}
 
 // Sparse matrices --------------------------------------------------------
 SparseMatrix2D::SparseMatrix2D(){
@@ -34,41 +92,113 @@ SparseMatrix2D::SparseMatrix2D(){
 
 SparseMatrix2D::SparseMatrix2D(std::vector<SparseElement> &_elements, int _Nelements)
 {
-	//First of all, we sort the elements by rows and then by columns
-	std::sort(_elements.begin(),_elements.end());
+	fromElements(_elements, _Nelements);
+}
 
-	size_t ln = _elements.size();
-	N      = _Nelements;
+// Sort the elements of each row by column, adding the repeated ones
+struct SortRowsArgs
+{
+    SparseMatrix2D *A;
+    std::vector<int> *rowCount;
+};
 
-	values.resizeNoCopy(ln);
-	jIdx.resizeNoCopy(ln);
-	iIdx.resizeNoCopy(N);
+static void sortRows(void *data, int row0, int rowF, int)
+{
+    SortRowsArgs &args = *((SortRowsArgs *) data);
+    int *rowPtr = MULTIDIM_ARRAY(args.A->iIdx);
+    int *col = MULTIDIM_ARRAY(args.A->jIdx);
+    double *val = MULTIDIM_ARRAY(args.A->values);
+    std::vector< std::pair<int, double> > row;
+    for (int i = row0; i < rowF; ++i)
+    {
+        int kBeg = rowPtr[i] - 1, kEnd = rowPtr[i + 1] - 1;
+        row.clear();
+        for (int k = kBeg; k < kEnd; ++k)
+            row.push_back(std::make_pair(col[k], val[k]));
+        std::sort(row.begin(), row.end());
+        int n = 0;
+        for (size_t l = 0; l < row.size(); )
+        {
+            int j = row[l].first;
+            double aux = 0.;
+            for (; l < row.size() && row[l].first == j; ++l)
+                aux += row[l].second;
+            if (aux != 0.0)
+            {
+                col[kBeg + n] = j;
+                val[kBeg + n] = aux;
+                ++n;
+            }
+        }
+        (*args.rowCount)[i] = n;
+    }
+}
+
+void SparseMatrix2D::fromElements(const std::vector<SparseElement> &_elements, int _N)
+{
+	N = _N;
+	size_t ln = _elements.size();
 
-	int actualRow = -1;
-	int i         =  0; // Iterator for the vectors "values" and "jIdx"
+	// Count the elements of each row
+	iIdx.initZeros(N + 1);
+	size_t nnz = 0;
+	for (size_t k = 0; k < ln; ++k)
+	{
+		const SparseElement &e = _elements[k];
+		if (e.i >= (size_t)N || e.j >= (size_t)N)
+			REPORT_ERROR(ERR_INDEX_OUTOFBOUNDS, formatString("Element (%lu,%lu) out of a %dx%d sparse matrix",
+			             e.i, e.j, N, N));
+		if (e.value != 0.0) // Searching that there isn't any zero value
+		{
+			DIRECT_MULTIDIM_ELEM(iIdx, e.i + 1)++;
+			++nnz;
+		}
+	}
+	DIRECT_MULTIDIM_ELEM(iIdx, 0) = 1;
+	for (int i = 0; i < N; ++i)
+		DIRECT_MULTIDIM_ELEM(iIdx, i + 1) += DIRECT_MULTIDIM_ELEM(iIdx, i);
+
+	// Put each element in its row
+	values.resizeNoCopy(nnz);
+	jIdx.resizeNoCopy(nnz);
+	std::vector<int> next(MULTIDIM_ARRAY(iIdx), MULTIDIM_ARRAY(iIdx) + N);
+	for (size_t k = 0; k < ln; ++k)
+	{
+		const SparseElement &e = _elements[k];
+		if (e.value != 0.0)
+		{
+			int pos = next[e.i]++ - 1;
+			DIRECT_MULTIDIM_ELEM(values, pos) = e.value;
+			DIRECT_MULTIDIM_ELEM(jIdx, pos) = (int)e.j + 1;
+		}
+	}
 
-	for (size_t k=0 ; k< ln ; ++k )// Iterator for vector of SparseElemets
+	// Sort the rows in parallel and remove the gaps left by repeated elements
+	std::vector<int> rowCount(N);
+	SortRowsArgs args;
+	args.A = this;
+	args.rowCount = &rowCount;
+	std::vector<int> bounds;
+	rowBands(*this, nnz * 8, bounds);
+	runOnRowBands(bounds, sortRows, &args);
+
+	int pos = 0;
+	for (int i = 0; i < N; ++i)
 	{
-		if(_elements.at(k).value != 0.0) // Searching that there isn't any zero value
+		int kBeg = DIRECT_MULTIDIM_ELEM(iIdx, i) - 1;
+		DIRECT_MULTIDIM_ELEM(iIdx, i) = pos + 1;
+		for (int n = 0; n < rowCount[i]; ++n, ++pos)
 		{
-			DIRECT_MULTIDIM_ELEM(values,i) = _elements.at(k).value;
-			DIRECT_MULTIDIM_ELEM(jIdx,i)   = _elements.at(k).j +1;
-
-			int rse = _elements.at(k).i;
-			while( rse > actualRow )
-			{
-				actualRow++;
-				if( rse == actualRow )
-					// The first element in row number "x" is in position iIdx(x-1)
-					DIRECT_MULTIDIM_ELEM(iIdx,actualRow) = i+1;
-
-				else
-					// If there isn't any nonzero value on this row, the value in this vector is 0
-					DIRECT_MULTIDIM_ELEM(iIdx,actualRow) = 0;
-			}
-			++i;
+			DIRECT_MULTIDIM_ELEM(values, pos) = DIRECT_MULTIDIM_ELEM(values, kBeg + n);
+			DIRECT_MULTIDIM_ELEM(jIdx, pos) = DIRECT_MULTIDIM_ELEM(jIdx, kBeg + n);
 		}
 	}
+	DIRECT_MULTIDIM_ELEM(iIdx, N) = pos + 1;
+	if ((size_t)pos != nnz)
+	{
+		values.resize(pos);
+		jIdx.resize(pos);
+	}
 }
 
 /*
@@ -76,38 +206,11 @@ SparseMatrix2D::SparseMatrix2D(std::vector<SparseElement> &_elements, int _Nelem
  */
 void SparseMatrix2D::sparseMatrix2DFromVector(std::vector<SparseElement> &_elements)
 {
-	std::sort(_elements.begin(),_elements.end());
-
 	size_t ln = _elements.size();
-	N = _elements.at(ln-1).j;
-	values.resizeNoCopy(ln);
-	jIdx.resizeNoCopy(ln);
-	iIdx.resizeNoCopy(N);
-
-	int actualRow = -1;
-	int i         =  0;
-
+	int Nmax = 0;
 	for (size_t k=0 ; k< ln ; ++k )
-	{
-		if(_elements.at(k).value != 0.0) // Seaching that there isn't any zero value
-		{
-			DIRECT_MULTIDIM_ELEM(values,i) = _elements.at(k).value;
-			DIRECT_MULTIDIM_ELEM(jIdx,i)   = _elements.at(k).j +1;
-
-			int rse = _elements.at(k).i;
-			while( rse > actualRow )
-			{
-				actualRow++;
-				if( rse == actualRow )
-					DIRECT_MULTIDIM_ELEM(iIdx,actualRow) = i+1;
-
-				else
-					DIRECT_MULTIDIM_ELEM(iIdx,actualRow) = 0;
-			}
-			++i;
-		}
-	}
-	N = actualRow+1;
+		Nmax = XMIPP_MAX(Nmax, (int)XMIPP_MAX(_elements[k].i, _elements[k].j) + 1);
+	fromElements(_elements, Nmax);
 }
 
 SparseMatrix2D &SparseMatrix2D::operator =(const SparseMatrix2D &X)
@@ -125,32 +228,40 @@ SparseMatrix2D &SparseMatrix2D::operator =(const SparseMatrix2D &X)
 /**
  * It computes y <- this*x
  */
-void SparseMatrix2D::multMv(double* x, double* y)
+struct MultMvArgs
 {
-	int col, rowEnd, rowBeg;
-	double val;
-	memset(y,0,N*sizeof(double));
+    const SparseMatrix2D *A;
+    const double *x;
+    double *y;
+};
 
-	size_t nnz=XSIZE(values);
-    for(int i = 0; i< N; i++)
+static void multMvRows(void *data, int row0, int rowF, int)
+{
+    MultMvArgs &args = *((MultMvArgs *) data);
+    const int *rowPtr = MULTIDIM_ARRAY(args.A->iIdx);
+    const int *col = MULTIDIM_ARRAY(args.A->jIdx);
+    const double *val = MULTIDIM_ARRAY(args.A->values);
+    const double *x = args.x - 1; // Columns start at 1
+    for (int i = row0; i < rowF; ++i)
     {
-    	// We get the gap where are the elements of the row i in value's vector
-		rowBeg = DIRECT_MULTIDIM_ELEM(iIdx,i) -1;
-		if( i != N-1 )
-			rowEnd = DIRECT_MULTIDIM_ELEM(iIdx,i+1) -1;
-		else
-			rowEnd = nnz;
-
-		val = 0.0;
-		for(int j = rowBeg; j < rowEnd ; j++)
-		{
-			col = DIRECT_MULTIDIM_ELEM(jIdx,j) -1;// Column with a nonzero element in this row of the matrix
-			val += DIRECT_MULTIDIM_ELEM(values,j) * x[col];
-		}
-		y[i] = val;
+        double aux = 0.0;
+        for (int k = rowPtr[i] - 1; k < rowPtr[i + 1] - 1; ++k)
+            aux += val[k] * x[col[k]];
+        args.y[i] = aux;
     }
 }
 
+void SparseMatrix2D::multMv(const double* x, double* y) const
+{
+	MultMvArgs args;
+	args.A = this;
+	args.x = x;
+	args.y = y;
+	std::vector<int> bounds;
+	rowBands(*this, nnz(), bounds);
+	runOnRowBands(bounds, multMvRows, &args);
+}
+
 /*
  * It shows the sparse matrix as a full matrix. If the sparse matrix is real big, you shoudn't use it
  * */
@@ -171,58 +282,153 @@ std::ostream & operator << (std::ostream &out, const SparseMatrix2D &X)
  */
 double SparseMatrix2D::getElemIJ(int row, int col) const
 {
-	int rowBeg = DIRECT_MULTIDIM_ELEM(iIdx,row) -1;
-	int rowEnd;
-
-	if( row != N-1 )
-		rowEnd = DIRECT_MULTIDIM_ELEM(iIdx,row+1) -1;
-	else
-		rowEnd = XSIZE(values);
-
-	// If there is a non-zero element, the column is in jIdx
-	for(int i = rowBeg; i < rowEnd ; i++)
-		if( DIRECT_MULTIDIM_ELEM(jIdx,i)-1 == col )
-			return DIRECT_MULTIDIM_ELEM(values,i);
+	const int *rowBeg = MULTIDIM_ARRAY(jIdx) + DIRECT_MULTIDIM_ELEM(iIdx,row) - 1;
+	const int *rowEnd = MULTIDIM_ARRAY(jIdx) + DIRECT_MULTIDIM_ELEM(iIdx,row+1) - 1;
+
+	// The columns of each row are sorted
+	const int *ptr = std::lower_bound(rowBeg, rowEnd, col + 1);
+	if (ptr != rowEnd && *ptr == col + 1)
+		return DIRECT_MULTIDIM_ELEM(values, ptr - MULTIDIM_ARRAY(jIdx));
 	return 0.0;
 }
 
 /// Computes y=SparseMatrixThis*SparseMatrixX
-void SparseMatrix2D::multMM(const SparseMatrix2D &X, SparseMatrix2D &Y)
+/*
+ * Each row of Y is the combination of the rows of X selected by the nonzero
+ * elements of the same row of this matrix (Gustavson's algorithm). Every band
+ * of rows is accumulated in a dense row and stored apart, and then the bands
+ * are put together.
+ */
+struct MultMMArgs
+{
+    const SparseMatrix2D *A;
+    const SparseMatrix2D *X;
+    std::vector<int> rowCount;
+    std::vector< std::vector<int> > bandCols;
+    std::vector< std::vector<double> > bandValues;
+};
+
+static void multMMRows(void *data, int row0, int rowF, int band)
 {
-	size_t nnz=XSIZE(X.values);
+    MultMMArgs &args = *((MultMMArgs *) data);
+    const SparseMatrix2D &A = *args.A, &X = *args.X;
+    std::vector<double> accumulator(X.N, 0.0);
+    std::vector<int> marker(X.N, -1), touched;
+    std::vector<int> &cols = args.bandCols[band];
+    std::vector<double> &vals = args.bandValues[band];
+    for (int i = row0; i < rowF; ++i)
+    {
+        touched.clear();
+        for (int k = DIRECT_MULTIDIM_ELEM(A.iIdx, i) - 1; k < DIRECT_MULTIDIM_ELEM(A.iIdx, i + 1) - 1; ++k)
+        {
+            double a = DIRECT_MULTIDIM_ELEM(A.values, k);
+            int row = DIRECT_MULTIDIM_ELEM(A.jIdx, k) - 1;
+            for (int l = DIRECT_MULTIDIM_ELEM(X.iIdx, row) - 1; l < DIRECT_MULTIDIM_ELEM(X.iIdx, row + 1) - 1; ++l)
+            {
+                int j = DIRECT_MULTIDIM_ELEM(X.jIdx, l) - 1;
+                if (marker[j] != i)
+                {
+                    marker[j] = i;
+                    accumulator[j] = 0.0;
+                    touched.push_back(j);
+                }
+                accumulator[j] += a * DIRECT_MULTIDIM_ELEM(X.values, l);
+            }
+        }
+        std::sort(touched.begin(), touched.end());
+        int n = 0;
+        for (size_t l = 0; l < touched.size(); ++l)
+        {
+            int j = touched[l];
+            if (accumulator[j] != 0.0) // If there is a nonzero element in (row,col) position, we include that in the matrix
+            {
+                cols.push_back(j + 1);
+                vals.push_back(accumulator[j]);
+                ++n;
+            }
+        }
+        args.rowCount[i] = n;
+    }
+}
 
-	Y.N = X.N;
- 	Y.values.initZeros(nnz);
-	Y.jIdx.initZeros(nnz);
-	Y.iIdx.initZeros(N);
+void SparseMatrix2D::multMM(const SparseMatrix2D &X, SparseMatrix2D &Y) const
+{
+	if (X.N != N)
+		REPORT_ERROR(ERR_MATRIX_SIZE, "Not compatible sizes in sparse matrix multiplication");
+	MultMMArgs args;
+	args.A = this;
+	args.X = &X;
+	args.rowCount.resize(N);
+	std::vector<int> bounds;
+	rowBands(*this, nnz() * (X.nnz() / XMIPP_MAX(X.N, 1) + 1), bounds);
+	args.bandCols.resize(bounds.size() - 1);
+	args.bandValues.resize(bounds.size() - 1);
+	runOnRowBands(bounds, multMMRows, &args);
 
 	size_t nnzY = 0;
-	int Nelems  = X.N;
-	for(int row = 0; row < Nelems ; ++row){
-		int firstElemRow = 0;
-		for(int col = 0; col < Nelems ; ++col){
-			double aij = 0.0;
-			for(int k = 0; k < Nelems ; ++k ){
-				double val=getElemIJ(row, k);
-				if(val != 0.0){ // If GetElemIJ(row, k) is 0, the product is 0.
-					double val2=X.getElemIJ(k,col);
-					aij += val * val2;
-				}
-			}
-
-			if(aij != 0.0){ // If there is a nonzero element in (row,col) position, we include that in the matrix
-				if(firstElemRow == 0)
-					firstElemRow = nnzY +1;
-				DIRECT_MULTIDIM_ELEM(Y.values,nnzY) = aij;
-				DIRECT_MULTIDIM_ELEM(Y.jIdx,nnzY)   = col+1;
-				++nnzY;
-			}
+	for (size_t band = 0; band < args.bandCols.size(); ++band)
+		nnzY += args.bandCols[band].size();
+	Y.N = N;
+	Y.iIdx.resizeNoCopy(N + 1);
+	Y.jIdx.resizeNoCopy(nnzY);
+	Y.values.resizeNoCopy(nnzY);
+	DIRECT_MULTIDIM_ELEM(Y.iIdx, 0) = 1;
+	for (int i = 0; i < N; ++i)
+		DIRECT_MULTIDIM_ELEM(Y.iIdx, i + 1) = DIRECT_MULTIDIM_ELEM(Y.iIdx, i) + args.rowCount[i];
+	size_t pos = 0;
+	for (size_t band = 0; band < args.bandCols.size(); ++band)
+	{
+		size_t n = args.bandCols[band].size();
+		if (n > 0)
+		{
+			memcpy(&DIRECT_MULTIDIM_ELEM(Y.jIdx, pos), &args.bandCols[band][0], n * sizeof(int));
+			memcpy(&DIRECT_MULTIDIM_ELEM(Y.values, pos), &args.bandValues[band][0], n * sizeof(double));
 		}
-		// Indicates where is the first element of the row
-		DIRECT_MULTIDIM_ELEM(Y.iIdx,row) = firstElemRow;
+		pos += n;
 	}
-	Y.values.resize(nnzY);
-	Y.jIdx.resize(nnzY);
+}
+
+/// Computes Y=SparseMatrixThis*X, X being dense
+struct MultMDenseArgs
+{
+    const SparseMatrix2D *A;
+    const Matrix2D<double> *X;
+    Matrix2D<double> *Y;
+};
+
+static void multMDenseRows(void *data, int row0, int rowF, int)
+{
+    MultMDenseArgs &args = *((MultMDenseArgs *) data);
+    const SparseMatrix2D &A = *args.A;
+    const Matrix2D<double> &X = *args.X;
+    size_t K = MAT_XSIZE(X);
+    for (int i = row0; i < rowF; ++i)
+    {
+        double *y = &MAT_ELEM(*args.Y, i, 0);
+        for (int k = DIRECT_MULTIDIM_ELEM(A.iIdx, i) - 1; k < DIRECT_MULTIDIM_ELEM(A.iIdx, i + 1) - 1; ++k)
+        {
+            double a = DIRECT_MULTIDIM_ELEM(A.values, k);
+            const double *x = &MAT_ELEM(X, DIRECT_MULTIDIM_ELEM(A.jIdx, k) - 1, 0);
+            for (size_t l = 0; l < K; ++l)
+                y[l] += a * x[l];
+        }
+    }
+}
+
+void SparseMatrix2D::multMM(const Matrix2D<double> &X, Matrix2D<double> &Y) const
+{
+	if ((int)MAT_YSIZE(X) != N)
+		REPORT_ERROR(ERR_MATRIX_SIZE, "Not compatible sizes in sparse matrix multiplication");
+	Y.initZeros(N, MAT_XSIZE(X));
+	if (MAT_XSIZE(X) == 0)
+		return;
+	MultMDenseArgs args;
+	args.A = this;
+	args.X = &X;
+	args.Y = &Y;
+	std::vector<int> bounds;
+	rowBands(*this, nnz() * MAT_XSIZE(X), bounds);
+	runOnRowBands(bounds, multMDenseRows, &args);
 }
 
 /// Computes y=SparseMatrixThis*SparseMatrix
@@ -235,36 +441,16 @@ void SparseMatrix2D::multMM(const SparseMatrix2D &X, SparseMatrix2D &Y)
  *
  *	Vectors iIdx and jIdx are the same as the non diagonal matrix
  *	Vector Values is the same as the non diagonal matrix multiply each row by each d_row
- *
- *	The values are obtain from the last to the beginning.
- * *
  */
-void SparseMatrix2D::multMMDiagonal(const MultidimArray<double> &D, SparseMatrix2D &Y)
+void SparseMatrix2D::multMMDiagonal(const MultidimArray<double> &D, SparseMatrix2D &Y) const
 {
-	int actualRow = N-1;
-
 	Y=*this;
-
-	// We see where is the first element in the next row
-	int until = DIRECT_MULTIDIM_ELEM(iIdx,actualRow) -1;
-
-	// Obtain the value that we have to multiply by the first row.
-	double dx = DIRECT_MULTIDIM_ELEM(D,actualRow);
-	size_t nnz=XSIZE(values);
-	for(int i = nnz-1; i >= 0 ; --i)
+	for (int i = 0; i < N; ++i)
 	{
 		// Yij = Aij * Dii / Y = A => Yij = Yij * Dii
-		DIRECT_MULTIDIM_ELEM(Y.values,i) *= dx;
-
-		if(until == i && i > 0){
-			--actualRow;
-			// Search for a row with nonzero elements
-			while( DIRECT_MULTIDIM_ELEM(iIdx,actualRow) == 0 )
-				--actualRow;
-
-			until = DIRECT_MULTIDIM_ELEM(iIdx,actualRow) -1;
-			dx    = DIRECT_MULTIDIM_ELEM(D,actualRow);
-		}
+		double dx = DIRECT_MULTIDIM_ELEM(D,i);
+		for (int k = DIRECT_MULTIDIM_ELEM(iIdx,i) - 1; k < DIRECT_MULTIDIM_ELEM(iIdx,i+1) - 1; ++k)
+			DIRECT_MULTIDIM_ELEM(Y.values,k) *= dx;
 	}
 }
 
@@ -295,3 +481,156 @@ void SparseMatrix2D::loadMatrix(const FileName &fn)
 	sparseMatrix2DFromVector(elems);
 }
 
+/* Eigenvectors ------------------------------------------------------------ */
+/* Thick-restart Lanczos for the M smallest (or largest) eigenvalues of the
+   symmetric matrix A. The Lanczos vectors are the rows of V, and they are
+   fully reorthogonalized, so that the projected matrix H=V^t*A*V is computed
+   explicitly. After each cycle of m vectors, the Krylov subspace is shrunk to
+   the best k Ritz vectors plus the residual vector, and it grows again. */
+static void lanczosEigs(const SparseMatrix2D &A, size_t M, bool largest, Matrix1D<double> &D, Matrix2D<double> &P)
+{
+    const size_t N = A.N;
+    if (M > N)
+        REPORT_ERROR(ERR_ARG_INCORRECT, "Asking for more eigenvectors than the size of the matrix");
+    const size_t m = XMIPP_MIN(N, XMIPP_MAX(3 * M, M + 30)); // Size of the subspace
+    const size_t k = XMIPP_MIN(m - 1, M + (m - M) / 2);       // Vectors kept at restarts
+
+    // Small problems go to the dense decomposition
+    if (N <= 200 || m == N)
+    {
+        Matrix2D<double> Adense;
+        Adense.initZeros(N, N);
+        for (size_t i = 0; i < N; ++i)
+            for (int l = DIRECT_MULTIDIM_ELEM(A.iIdx, i) - 1; l < DIRECT_MULTIDIM_ELEM(A.iIdx, i + 1) - 1; ++l)
+                MAT_ELEM(Adense, i, DIRECT_MULTIDIM_ELEM(A.jIdx, l) - 1) = DIRECT_MULTIDIM_ELEM(A.values, l);
+        if (largest)
+            firstEigs(Adense, M, D, P);
+        else
+            lastEigs(Adense, M, D, P);
+        return;
+    }
+
+    // The smallest eigenvalues of sign*A
+    const double sign = largest ? -1 : 1;
+    const double tol = 1e-10;
+    const int maxRestarts = 1000;
+
+    Matrix2D<double> V(m + 1, N), H, Zk, Vk;
+    H.initZeros(m, m);
+    unsigned int seed = 12345;
+    for (size_t n = 0; n < N; ++n)
+        MAT_ELEM(V, 0, n) = (double)rand_r(&seed) / RAND_MAX - 0.5;
+    double *v0 = &MAT_ELEM(V, 0, 0);
+    double norm = sqrt(simdDot(v0, v0, N));
+    for (size_t n = 0; n < N; ++n)
+        v0[n] /= norm;
+
+    size_t j0 = 0;
+    alglib::real_1d_array d;
+    alglib::real_2d_array z;
+    for (int restart = 0; restart < maxRestarts; ++restart)
+    {
+        double beta = 0;
+        for (size_t j = j0; j < m; ++j)
+        {
+            double *w = &MAT_ELEM(V, j + 1, 0);
+            A.multMv(&MAT_ELEM(V, j, 0), w);
+            if (largest)
+                for (size_t n = 0; n < N; ++n)
+                    w[n] = -w[n];
+            double normAv = sqrt(simdDot(w, w, N));
+
+            // Full reorthogonalization (twice). The projections are the
+            // column j of H
+            for (int pass = 0; pass < 2; ++pass)
+                for (size_t i = 0; i <= j; ++i)
+                {
+                    const double *vi = &MAT_ELEM(V, i, 0);
+                    double h = simdDot(w, vi, N);
+                    for (size_t n = 0; n < N; ++n)
+                        w[n] -= h * vi[n];
+                    MAT_ELEM(H, i, j) += h;
+                }
+            for (size_t i = 0; i < j; ++i)
+                MAT_ELEM(H, j, i) = MAT_ELEM(H, i, j);
+
+            beta = sqrt(simdDot(w, w, N));
+            if (beta <= 1e-12 * normAv)
+            {
+                // Invariant subspace: continue with any orthogonal direction
+                beta = 0;
+                do
+                {
+                    for (size_t n = 0; n < N; ++n)
+                        w[n] = (double)rand_r(&seed) / RAND_MAX - 0.5;
+                    for (int pass = 0; pass < 2; ++pass)
+                        for (size_t i = 0; i <= j; ++i)
+                        {
+                            const double *vi = &MAT_ELEM(V, i, 0);
+                            double h = simdDot(w, vi, N);
+                            for (size_t n = 0; n < N; ++n)
+                                w[n] -= h * vi[n];
+                        }
+                    norm = sqrt(simdDot(w, w, N));
+                }
+                while (norm == 0);
+            }
+            else
+                norm = beta;
+            for (size_t n = 0; n < N; ++n)
+                w[n] /= norm;
+        }
+
+        // Rayleigh-Ritz. The residual of the Ritz pair (theta,V^t*y) is
+        // beta*|y_m|
+        alglib::real_2d_array h;
+        h.setcontent(m, m, MATRIX2D_ARRAY(H));
+        if (!alglib::smatrixevd(h, m, 1, true, d, z))
+            REPORT_ERROR(ERR_NUMERICAL, "Could not perform eigenvector decomposition");
+        double scale = XMIPP_MAX(fabs(d(0)), fabs(d(m - 1)));
+        bool converged = true;
+        for (size_t l = 0; l < M; ++l)
+            if (beta * fabs(z(m - 1, l)) > tol * scale)
+            {
+                converged = false;
+                break;
+            }
+
+        // Ritz vectors, which are also the first vectors of the next cycle
+        size_t nRitz = converged ? M : k;
+        Zk.initZeros(m + 1, nRitz);
+        for (size_t i = 0; i < m; ++i)
+            for (size_t l = 0; l < nRitz; ++l)
+                MAT_ELEM(Zk, i, l) = z(i, l);
+        matrixOperation_AtB(Zk, V, Vk);
+        if (converged)
+        {
+            D.resizeNoCopy(M);
+            P.resizeNoCopy(N, M);
+            for (size_t l = 0; l < M; ++l)
+            {
+                VEC_ELEM(D, l) = sign * d(l);
+                for (size_t n = 0; n < N; ++n)
+                    MAT_ELEM(P, n, l) = MAT_ELEM(Vk, l, n);
+            }
+            return;
+        }
+        memcpy(&MAT_ELEM(V, 0, 0), &MAT_ELEM(Vk, 0, 0), k * N * sizeof(double));
+        memcpy(&MAT_ELEM(V, k, 0), &MAT_ELEM(V, m, 0), N * sizeof(double));
+        H.initZeros();
+        for (size_t l = 0; l < k; ++l)
+            MAT_ELEM(H, l, l) = d(l);
+        j0 = k;
+    }
+    REPORT_ERROR(ERR_NUMERICAL, "Lanczos iterations did not converge");
+}
+
+void firstEigs(const SparseMatrix2D &A, size_t M, Matrix1D<double> &D, Matrix2D<double> &P)
+{
+    lanczosEigs(A, M, true, D, P);
+}
+
+void lastEigs(const SparseMatrix2D &A, size_t M, Matrix1D<double> &D, Matrix2D<double> &P)
+{
+    lanczosEigs(A, M, false, D, P);
+}
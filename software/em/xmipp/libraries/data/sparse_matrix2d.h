@@ -39,10 +39,12 @@
  *
  * We store that information with a Compressed Row Storage (CRS).
  * This method stores a vector with the non-zero values (values), their column position (jIdx)
- * and another vector with the position on values's vector of the element
- * which is the first non-zero elements of each row (iIdx). The value 0 on iIdx vector means that
- * there aren't nonzero values in that row.
- * iIdx and jIdx have the first element in position 1. Value 0 is for no elements on a row.
+ * and another vector with the position on values's vector of the first
+ * element of each row (iIdx). iIdx has N+1 elements, the last one being one past
+ * the last element of the matrix, so that the elements of row i are those between
+ * iIdx(i) and iIdx(i+1)-1 (empty rows have iIdx(i)=iIdx(i+1)).
+ * iIdx and jIdx have the first element in position 1.
+ * Within each row the elements are sorted by column.
  *
  * i.e.:
 
@@ -53,13 +55,16 @@
   1,  2,  1,  2,  2,  4,  4
 
  Vector iIdx
- 1, 3, 5, 7
+ 1, 3, 5, 7, 8
 
  Matriz A:
  _4_   3  0  0
  _1_   2  0  0
   0  _1_  0  4
   0   0  0 _3_
+
+ * The products and the construction from the list of elements are split among
+ * getMatrix2DThreads() threads.
  */
 class SparseMatrix2D
 {
@@ -86,32 +91,52 @@ public:
         return N;
     }
 
+    /// Number of nonzero elements
+    size_t nnz() const
+    {
+        return XSIZE(values);
+    }
+
     /// Empty constructor
     SparseMatrix2D();
 
     /** Constructor from a set of i,j indexes and their corresponding values.
-     * N is the total dimension of the square, sparse matrix.
+     * N is the total dimension of the square, sparse matrix. Repeated
+     * positions are added, and zero values are not stored.
      */
     SparseMatrix2D(std::vector<SparseElement> &_elements, int _Nelements);
 
     /** Assig operator *this=X */
     SparseMatrix2D &operator =(const SparseMatrix2D &X);
 
-    /// Fill the sparse matrix A with the elements of the vector.
+    /** Fill the sparse matrix A with the elements of the vector.
+     * The size of the matrix is given by the largest index.
+     */
     void sparseMatrix2DFromVector(std::vector<SparseElement> &_elements);
 
+    /** Fill the sparse matrix from a list of elements, the matrix being NxN.
+     * Repeated positions are added, and zero values are not stored.
+     */
+    void fromElements(const std::vector<SparseElement> &_elements, int _N);
+
     /** Computes y=this*x
      * y and x are vectors of size Nx1
      */
-    void multMv(double* x, double* y);
+    void multMv(const double* x, double* y) const;
 
     /// Computes Y=this*X
-    void multMM(const SparseMatrix2D &X, SparseMatrix2D &Y);
+    void multMM(const SparseMatrix2D &X, SparseMatrix2D &Y) const;
+
+    /** Computes Y=this*X for a dense matrix X.
+     * X must have N rows. This is the product of the sparse matrix by a block of
+     * column vectors.
+     */
+    void multMM(const Matrix2D<double> &X, Matrix2D<double> &Y) const;
 
     /** Computes Y=this*D where D is a diagonal matrix.
      * It is assumed that the size of this sparse matrix is NxN and that the length of y is N.
     */
-    void multMMDiagonal(const MultidimArray<double> &D, SparseMatrix2D &Y);
+    void multMMDiagonal(const MultidimArray<double> &D, SparseMatrix2D &Y) const;
 
     /// Shows the dense Matrix associated
     friend std::ostream & operator << (std::ostream &out, const SparseMatrix2D &X);
@@ -134,6 +159,23 @@ public:
      */
     void loadMatrix(const FileName &fn);
 };
+
+/** First eigenvectors of a real, symmetric, sparse matrix.
+ * Solves the problem Av=dv.
+ * Only the eigenvectors of the largest M eigenvalues are returned as columns of P
+ * (in decreasing order of eigenvalue). The eigenvectors are computed by
+ * thick-restart Lanczos, so that only products of A by vectors are needed.
+ * Small matrices are solved by the dense decomposition.
+ */
+void firstEigs(const SparseMatrix2D &A, size_t M, Matrix1D<double> &D, Matrix2D<double> &P);
+
+/** Last eigenvectors of a real, symmetric, sparse matrix.
+ * Solves the problem Av=dv.
+ * Only the eigenvectors of the smallest M eigenvalues are returned as columns of P
+ * (in increasing order of eigenvalue). This is the usual case of the graph
+ * Laplacians of the embeddings. See firstEigs.
+ */
+void lastEigs(const SparseMatrix2D &A, size_t M, Matrix1D<double> &D, Matrix2D<double> &P);
 //@}
 
 #endif /* SPARSE_MATRIX2D_H_ */
@@ -73,6 +73,7 @@ void ProgTransformGeometry::defineParams()
     addParamsLine("                                    : and the alignment information is stored in metadata");
     addParamsLine("[--dont_wrap]                       : By default, the image/volume is wrapped");
     addParamsLine("[--write_matrix]                    : Print transformation matrix to screen");
+    addParamsLine("[--thr <n=1>]                       : Number of threads to transform each image or volume");
     //examples
     addExampleLine("Write a metadata with geometrical transformations keeping the reference to original images:", false);
     addExampleLine("xmipp_transform_geometry -i mD1.xmd --shift 2 3 4 --scale 1.2 --rotate 23 -o newGeo.xmd");
@@ -101,6 +102,7 @@ void ProgTransformGeometry::readParams()
     else if (degree == "linear")
         splineDegree = LINEAR;
     flip = checkParam("--flip");
+    setApplyGeometryThreads(getIntParam("--thr"));
 
     /** In most cases output "-o" is a metadata with the new geometry keeping the names of input images
      *  so we set the flags to keep the same image names in the output metadata
@@ -26,6 +26,10 @@
 
 #include "transformations.h"
 #include "filters.h"
+#include "xmipp_fftw.h"
+#include <bilib/configs.h>
+#include <bilib/headers/getpoles.h>
+#include <bilib/headers/iirconvolve.h>
 
 void geo2TransformationMatrix(const MDRow &imageGeo, Matrix2D<double> &A,
                               bool only_apply_shifts)
@@ -418,6 +422,18 @@ void scale3DMatrix(const Matrix1D<double> &sc, Matrix2D<double>& result,
     dMij(result,2, 2) = ZZ(sc);
 }
 
+static int applyGeometryThreads = 1;
+
+void setApplyGeometryThreads(int nThreads)
+{
+    applyGeometryThreads = XMIPP_MAX(nThreads, 1);
+}
+
+int getApplyGeometryThreads()
+{
+    return applyGeometryThreads;
+}
+
 // Special case for complex numbers
 template<>
 void applyGeometry(int SplineDegree,
@@ -476,6 +492,286 @@ void applyGeometry(int SplineDegree,
 
 }
 
+/* Transformation builder -------------------------------------------------- */
+TransformationBuilder::TransformationBuilder(int dim)
+{
+    if (dim != 2 && dim != 3)
+        REPORT_ERROR(ERR_ARG_INCORRECT, "TransformationBuilder: only for 2D or 3D");
+    useFourierShift = true;
+    A.initIdentity(dim + 1);
+}
+
+void TransformationBuilder::clear()
+{
+    A.initIdentity();
+}
+
+TransformationBuilder& TransformationBuilder::geo(const MDRow &row, bool only_apply_shifts)
+{
+    Matrix2D<double> M(MAT_YSIZE(A), MAT_XSIZE(A));
+    geo2TransformationMatrix(row, M, only_apply_shifts);
+    return matrix(M);
+}
+
+TransformationBuilder& TransformationBuilder::matrix(const Matrix2D<double> &M, bool inv)
+{
+    if (MAT_XSIZE(M) != MAT_XSIZE(A) || MAT_YSIZE(M) != MAT_YSIZE(A))
+        REPORT_ERROR(ERR_MATRIX_SIZE, "TransformationBuilder: the matrix size does not match the dimension");
+    if (inv)
+        A = M.inv() * A;
+    else
+        A = M * A;
+    return *this;
+}
+
+TransformationBuilder& TransformationBuilder::shift(double x, double y, double z)
+{
+    size_t dim = MAT_XSIZE(A) - 1;
+    Matrix2D<double> T;
+    T.initIdentity(dim + 1);
+    dMij(T, 0, dim) = x;
+    dMij(T, 1, dim) = y;
+    if (dim == 3)
+        dMij(T, 2, dim) = z;
+    return matrix(T);
+}
+
+TransformationBuilder& TransformationBuilder::shift(const Matrix1D<double> &v)
+{
+    return shift(XX(v), YY(v), VEC_XSIZE(v) > 2 ? ZZ(v) : 0.);
+}
+
+TransformationBuilder& TransformationBuilder::rotate(double ang, char axis)
+{
+    Matrix2D<double> R;
+    if (MAT_XSIZE(A) == 3)
+        rotation2DMatrix(ang, R);
+    else
+        rotation3DMatrix(ang, axis, R);
+    return matrix(R);
+}
+
+TransformationBuilder& TransformationBuilder::scale(double factor)
+{
+    size_t dim = MAT_XSIZE(A) - 1;
+    Matrix2D<double> S;
+    S.initIdentity(dim + 1);
+    for (size_t i = 0; i < dim; ++i)
+        dMij(S, i, i) = factor;
+    return matrix(S);
+}
+
+TransformationBuilder& TransformationBuilder::mirrorX()
+{
+    Matrix2D<double> S;
+    S.initIdentity(MAT_XSIZE(A));
+    dMij(S, 0, 0) = -1;
+    return matrix(S);
+}
+
+bool TransformationBuilder::isTranslation() const
+{
+    size_t dim = MAT_XSIZE(A) - 1;
+    for (size_t i = 0; i < dim; ++i)
+        for (size_t j = 0; j < dim; ++j)
+            if (fabs(dMij(A, i, j) - (i == j ? 1. : 0.)) > XMIPP_EQUAL_ACCURACY)
+                return false;
+    return true;
+}
+
+void TransformationBuilder::apply(int SplineDegree, MultidimArray<double> &out,
+                                  const MultidimArray<double> &in, bool wrap, double outside) const
+{
+    size_t dim = MAT_XSIZE(A) - 1;
+    if (in.getDim() != (int) dim)
+        REPORT_ERROR(ERR_MULTIDIM_DIM, "TransformationBuilder: the array does not have the dimension of the transformation");
+    if (!(useFourierShift && wrap && SplineDegree > LINEAR && isTranslation() &&
+          (XSIZE(out) == 0 || SAME_SHAPE3D(out, in)) && !A.isIdentity()))
+    {
+        applyGeometry(SplineDegree, out, in, A, IS_NOT_INV, wrap, outside);
+        return;
+    }
+
+    // Phase shift in Fourier space. The phases are separable, so they are
+    // tabulated along each axis
+    out = in;
+    MultidimArray< std::complex<double> > Fout;
+    FourierTransformer transformer;
+    transformer.FourierTransform(out, Fout, false);
+
+    double shiftX = dMij(A, 0, dim);
+    double shiftY = dMij(A, 1, dim);
+    double shiftZ = (dim == 3) ? dMij(A, 2, dim) : 0.;
+    std::vector< std::complex<double> > phaseX(XSIZE(Fout)), phaseY(YSIZE(Fout)), phaseZ(ZSIZE(Fout));
+    double freq, s, c;
+    for (size_t j = 0; j < XSIZE(Fout); ++j)
+    {
+        FFT_IDX2DIGFREQ(j, XSIZE(out), freq);
+        sincos(-2 * PI * freq * shiftX, &s, &c);
+        phaseX[j] = std::complex<double>(c, s);
+    }
+    for (size_t i = 0; i < YSIZE(Fout); ++i)
+    {
+        FFT_IDX2DIGFREQ(i, YSIZE(out), freq);
+        sincos(-2 * PI * freq * shiftY, &s, &c);
+        phaseY[i] = std::complex<double>(c, s);
+    }
+    for (size_t k = 0; k < ZSIZE(Fout); ++k)
+    {
+        FFT_IDX2DIGFREQ(k, ZSIZE(out), freq);
+        sincos(-2 * PI * freq * shiftZ, &s, &c);
+        phaseZ[k] = std::complex<double>(c, s);
+    }
+
+    for (size_t k = 0; k < ZSIZE(Fout); ++k)
+        for (size_t i = 0; i < YSIZE(Fout); ++i)
+        {
+            std::complex<double> phaseZY = phaseZ[k] * phaseY[i];
+            std::complex<double> *ptr = &DIRECT_A3D_ELEM(Fout, k, i, 0);
+            for (size_t j = 0; j < XSIZE(Fout); ++j)
+                ptr[j] *= phaseZY * phaseX[j];
+        }
+    transformer.inverseFourierTransform();
+}
+
+void TransformationBuilder::selfApply(int SplineDegree, MultidimArray<double> &V,
+                                      bool wrap, double outside) const
+{
+    MultidimArray<double> aux = V;
+    V.clear();
+    apply(SplineDegree, V, aux, wrap, outside);
+}
+
+/* B-spline prefilter ------------------------------------------------------ */
+// Columns gathered together in the passes along Y and Z
+#define BSPLINE_PREFILTER_TILE 16
+
+struct BSplinePrefilterArgs
+{
+    double *data;
+    size_t Nx, Ny, Nz;
+    double poles[4];
+    long Npoles;
+    TBoundaryConvention convention;
+    double tolerance;
+    int pass;        // 0: X, 1: Y, 2: Z
+    size_t tasks;    // Lines (X) or tiles of lines (Y, Z) of the current pass
+    bool error;
+};
+
+// Filter n lines of length L stored one after the other in buffer
+static bool bsplinePrefilterLines(BSplinePrefilterArgs &args, double *buffer, double *cbuffer,
+                                  size_t n, size_t L)
+{
+    for (size_t l = 0; l < n; ++l)
+    {
+        if (IirConvolvePoles(buffer + l * L, cbuffer, L, args.poles, args.Npoles,
+                             args.convention, args.tolerance) == ERROR)
+            return false;
+        memcpy(buffer + l * L, cbuffer, L * sizeof(double));
+    }
+    return true;
+}
+
+static void bsplinePrefilterTasks(BSplinePrefilterArgs &args, size_t task0, size_t taskF)
+{
+    const size_t Nx = args.Nx, Ny = args.Ny, Nxy = Nx * Ny;
+    const size_t L = (args.pass == 0) ? Nx : (args.pass == 1 ? Ny : args.Nz);
+    const size_t stride = (args.pass == 1) ? Nx : Nxy;
+    const size_t tilesPerRow = (Nx + BSPLINE_PREFILTER_TILE - 1) / BSPLINE_PREFILTER_TILE;
+    std::vector<double> buffer(L * BSPLINE_PREFILTER_TILE), cbuffer(L);
+    bool ok = true;
+    for (size_t task = task0; task < taskF && ok; ++task)
+    {
+        if (args.pass == 0)
+        {
+            // Lines along X are contiguous
+            double *line = args.data + task * Nx;
+            memcpy(&buffer[0], line, Nx * sizeof(double));
+            ok = bsplinePrefilterLines(args, &buffer[0], &cbuffer[0], 1, Nx);
+            memcpy(line, &buffer[0], Nx * sizeof(double));
+        }
+        else
+        {
+            // A tile of neighbouring lines along Y (in the slice k) or Z (in the row i)
+            size_t outer = task / tilesPerRow;
+            size_t j0 = (task % tilesPerRow) * BSPLINE_PREFILTER_TILE;
+            size_t n = XMIPP_MIN((size_t) BSPLINE_PREFILTER_TILE, Nx - j0);
+            double *origin = args.data + j0 + ((args.pass == 1) ? outer * Nxy : outer * Nx);
+            for (size_t m = 0; m < L; ++m)
+            {
+                const double *ptr = origin + m * stride;
+                for (size_t l = 0; l < n; ++l)
+                    buffer[l * L + m] = ptr[l];
+            }
+            ok = bsplinePrefilterLines(args, &buffer[0], &cbuffer[0], n, L);
+            for (size_t m = 0; m < L; ++m)
+            {
+                double *ptr = origin + m * stride;
+                for (size_t l = 0; l < n; ++l)
+                    ptr[l] = buffer[l * L + m];
+            }
+        }
+    }
+    if (!ok)
+        args.error = true;
+}
+
+static void bsplinePrefilterThread(ThreadArgument &thArg)
+{
+    BSplinePrefilterArgs &args = *((BSplinePrefilterArgs *) thArg.data);
+    size_t task0 = (args.tasks * thArg.thread_id) / thArg.threads;
+    size_t taskF = (args.tasks * (thArg.thread_id + 1)) / thArg.threads;
+    bsplinePrefilterTasks(args, task0, taskF);
+}
+
+void bsplinePrefilter(int SplineDegree, MultidimArray< double > &coeffs, int nThreads)
+{
+    bsplinePrefilter(SplineDegree, MULTIDIM_ARRAY(coeffs), XSIZE(coeffs), YSIZE(coeffs), ZSIZE(coeffs),
+                     MirrorOffBounds, DBL_EPSILON, nThreads);
+}
+
+void bsplinePrefilter(int SplineDegree, double *data, size_t Nx, size_t Ny, size_t Nz,
+                      TBoundaryConvention convention, double tolerance, int nThreads)
+{
+    if (SplineDegree < 2)
+        return;
+    BSplinePrefilterArgs args;
+    args.data = data;
+    args.Nx = Nx;
+    args.Ny = Ny;
+    args.Nz = Nz;
+    args.convention = convention;
+    args.tolerance = tolerance;
+    args.Npoles = SplineDegree / 2;
+    args.error = false;
+    int Status;
+    if (args.Npoles > 4 || GetBsplinePoles(args.poles, SplineDegree, tolerance, &Status) == ERROR)
+        REPORT_ERROR(ERR_VALUE_INCORRECT, formatString("B-spline of degree %d not supported", SplineDegree));
+
+    size_t tilesPerRow = (args.Nx + BSPLINE_PREFILTER_TILE - 1) / BSPLINE_PREFILTER_TILE;
+    size_t maxThreads = (Nx * Ny * Nz) / APPLYGEO_MIN_PIXELS_PER_THREAD;
+    nThreads = (int)XMIPP_MAX(XMIPP_MIN((size_t) nThreads, maxThreads), (size_t) 1);
+    ThreadManager *thMgr = (nThreads > 1) ? new ThreadManager(nThreads) : NULL;
+    size_t N[3] = {args.Nx, args.Ny, args.Nz};
+    for (args.pass = 0; args.pass < 3; ++args.pass)
+    {
+        if (N[args.pass] < 2)
+            continue;
+        if (args.pass == 0)
+            args.tasks = args.Ny * args.Nz;
+        else
+            args.tasks = tilesPerRow * ((args.pass == 1) ? args.Nz : args.Ny);
+        if (thMgr != NULL && args.tasks > 1)
+            thMgr->run(bsplinePrefilterThread, &args);
+        else
+            bsplinePrefilterTasks(args, 0, args.tasks);
+    }
+    delete thMgr;
+    if (args.error)
+        REPORT_ERROR(ERR_UNCLASSIFIED, "Error in bsplinePrefilter");
+}
+
 // Special case for complex arrays
 void produceSplineCoefficients(int SplineDegree,
                                MultidimArray< double > &coeffs,
@@ -37,6 +37,7 @@
 #include "multidim_array_generic.h"
 #include "geometry.h"
 #include "metadata.h"
+#include "xmipp_threads.h"
 #define IS_INV true
 #define IS_NOT_INV false
 #define DONT_WRAP false
@@ -199,133 +200,60 @@ void scale3DMatrix(const Matrix1D< double >& sc, Matrix2D< double > &m,
 #define BSPLINE3 3
 #define BSPLINE4 4
 
-/** Applies a geometrical transformation.
+/** Number of threads used by applyGeometry.
  * @ingroup GeometricalTransformations
  *
- * Any geometrical transformation defined by the matrix A (double (4x4)!!
- * ie, in homogeneous R3 coordinates) is applied to the volume V1.
- * The result is stored in V2 (it cannot be the same as the input volume).
- * An exception is thrown if the transformation matrix is not 4x4.
- *
- * Structure of the transformation matrix: It should have the following
- * components
- *
- * r11 r12 r13 x
- * r21 r22 r23 y
- * r31 r32 r33 z
- * 0   0   0   1
- *
- * where (x,y,z) is the translation desired, and Rij are the components of
- * the rotation matrix R. If you want to apply a scaling factor to the
- * transformation, then multiply r11, r22 and r33 by it.
- *
- * The result volume (with ndim=1) is resized to the same
- * dimensions as V1 if V2 is empty (0x0) at the beginning, if it
- * is not, ie, if V2 has got some size then only those values in
- * the volume are filled, this is very useful for resizing the
- * volume, then you manually resize the output volume to the
- * desired size and then call this routine.
- *
- * The relationship between the output coordinates and the input ones are
- *
- * @code
- * out = A * in
- * (x, y, z) = A * (x', y', z')
- * @endcode
- *
- * This function works independently from the logical indexing of each
- * matrix, it sets the logical center and the physical center of the image
- * and work with these 2 coordinate spaces. At the end the original logical
- * indexing of each matrix is kept.
- *
- * The procedure followed goes from coordinates in the output volume
- * to the ones in the input one, so the inverse of the A matrix is
- * needed. There is a flag telling if the given matrix is already
- * the inverse one or the normal one. If it is the normal one internally
- * the matrix is inversed. If you are to do many "rotations" then
- * some time is spent in inverting the matrix. Normally the matrix is the
- * normal one.
- *
- * There is something else to tell about the geometrical tranformation.
- * The value of the voxel in the output volume is computed via
- * bilinear interpolation in the input volume. If any of the voxels
- * participating in the interpolation falls outside the input volume,
- * then automatically the corresponding output voxel is set to 0, unless
- * that the wrap flag has been set to 1. In this case if the voxel
- * falls out by the right hand then it is "wrapped" and the corresponding
- * voxel in the left hand is used. The same is appliable to top-bottom.
- * Usually wrap mode is off. Wrap mode is interesting for translations
- * but not for rotations, for example.
- *
- * The inverse mode and wrapping mode should be taken by default by the
- * routine, g++ seems to have problems with template functions outside
- * a class with default parameters. So, I'm sorry, you will have to
- * put them always. The usual combination is
- *
- * applyGeometry(..., IS_NOT_INV, DONT_WRAP).
- *
- * Although you can also use the constants IS_INV, or WRAP.
- *
- * @code
- * Matrix2D< double > A(4,4);
- * A.initIdentity;
- * applyGeometry(V2, A, V1);
- * @endcode
+ * The output rows (of all slices for volumes) are split among the threads.
+ * Outputs smaller than APPLYGEO_MIN_PIXELS_PER_THREAD pixels per thread use
+ * less threads. By default applyGeometry runs on a single thread, programs
+ * that process one image at a time should set it to their number of threads.
  */
-template<typename T1,typename T>
-void applyGeometry(int SplineDegree,
-                   MultidimArray<T>& V2,
-                   const MultidimArray<T1>& V1,
-                   const Matrix2D< double > &A, bool inv,
-                   bool wrap, T outside = 0)
-{
-#ifndef RELEASE_MODE
-    if (&V1 == (MultidimArray<T1>*)&V2)
-        REPORT_ERROR(ERR_VALUE_INCORRECT,"ApplyGeometry: Input array cannot be the same as output array");
-
-    if ( V1.getDim()==2 && ((MAT_XSIZE(A) != 3) || (MAT_YSIZE(A) != 3)) )
-        REPORT_ERROR(ERR_MATRIX_SIZE,"ApplyGeometry: 2D transformation matrix is not 3x3");
-
-    if ( V1.getDim()==3 && ((MAT_XSIZE(A) != 4) || (MAT_YSIZE(A) != 4)) )
-        REPORT_ERROR(ERR_MATRIX_SIZE,"ApplyGeometry: 3D transformation matrix is not 4x4");
-#endif
-
-    if (A.isIdentity() && ( XSIZE(V2) == 0 || SAME_SHAPE3D(V1,V2) ) )
-    {
-        typeCast(V1,V2);
-        return;
-    }
+void setApplyGeometryThreads(int nThreads);
 
-    if (XSIZE(V1) == 0)
-    {
-        V2.clear();
-        return;
-    }
-
-    MultidimArray<double> Bcoeffs;
-    Matrix2D<double> Ainv;
-    const Matrix2D<double> * Aptr=&A;
-    if (!inv)
-    {
-        Ainv = A.inv();
-        Aptr=&Ainv;
-    }
-    const Matrix2D<double> &Aref=*Aptr;
+/** Number of threads used by applyGeometry.
+ * @ingroup GeometricalTransformations
+ */
+int getApplyGeometryThreads();
 
-    // For scalings the output matrix is resized outside to the final
-    // size instead of being resized inside the routine with the
-    // same size as the input matrix
-    if (XSIZE(V2) == 0)
-        V2.resizeNoCopy(V1);
+/** Minimum number of output pixels per thread in applyGeometry.
+ * @ingroup GeometricalTransformations
+ */
+#define APPLYGEO_MIN_PIXELS_PER_THREAD 65536
 
-    if (outside != 0.)
-    {
-        // Initialize output matrix with value=outside
-        FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(V2)
-        DIRECT_MULTIDIM_ELEM(V2, n) = outside;
-    }
-    else
-        V2.initZeros();
+/** Arguments of applyGeometry shared by its threads (internal use).
+ * @ingroup GeometricalTransformations
+ */
+template<typename T1,typename T>
+struct ApplyGeometryArgs
+{
+    int SplineDegree;
+    MultidimArray<T> *V2;
+    const MultidimArray<T1> *V1;
+    const MultidimArray<double> *Bcoeffs; // Only for SplineDegree>1
+    const Matrix2D<double> *A; // Inverse transformation
+    bool wrap;
+    T outside;
+    size_t rows; // Number of output rows
+};
+
+/** Applies a geometrical transformation to a range of rows (internal use).
+ * @ingroup GeometricalTransformations
+ *
+ * Rows row0 to rowF-1 of the output are computed. For volumes the rows of
+ * all slices are numbered consecutively, i.e., row r is the row r%YSIZE
+ * of the slice r/YSIZE. The output has already been resized and filled
+ * with the outside value.
+ */
+template<typename T1,typename T>
+void applyGeometryRows(const ApplyGeometryArgs<T1,T> &args, size_t row0, size_t rowF)
+{
+    int SplineDegree = args.SplineDegree;
+    MultidimArray<T> &V2 = *args.V2;
+    const MultidimArray<T1> &V1 = *args.V1;
+    const MultidimArray<double> &Bcoeffs = *args.Bcoeffs;
+    const Matrix2D<double> &Aref = *args.A;
+    bool wrap = args.wrap;
+    T outside = args.outside;
 
     if (V1.getDim() == 2)
     {
@@ -349,14 +277,6 @@ void applyGeometry(int SplineDegree,
         size_t Xdim   = XSIZE(V1);
         size_t Ydim   = YSIZE(V1);
 
-        if (SplineDegree > 1)
-        {
-            // Build the B-spline coefficients
-            produceSplineCoefficients(SplineDegree, Bcoeffs, V1); //Bcoeffs is a single image
-            STARTINGX(Bcoeffs) = (int) minxp;
-            STARTINGY(Bcoeffs) = (int) minyp;
-        }
-
         // Now we go from the output image to the input image, ie, for any pixel
         // in the output image we calculate which are the corresponding ones in
         // the original image, make an interpolation with them and put this value
@@ -370,7 +290,7 @@ void applyGeometry(int SplineDegree,
         << "(max_xp,max_yp)=(" << maxxp  << "," << maxyp  << ")\n";
 #endif
 
-        for (size_t i = 0; i < YSIZE(V2); i++)
+        for (size_t i = row0; i < rowF; i++)
         {
             // Calculate position of the beginning of the row in the output image
             double x = -cen_x;
@@ -538,206 +458,387 @@ void applyGeometry(int SplineDegree,
         ;
 #endif
 
-        if (SplineDegree > 1)
-        {
-            // Build the B-spline coefficients
-            produceSplineCoefficients(SplineDegree, Bcoeffs, V1); //Bcoeffs is a single image
-            STARTINGX(Bcoeffs) = (int) minxp;
-            STARTINGY(Bcoeffs) = (int) minyp;
-        }
-
         // Now we go from the output MultidimArray to the input MultidimArray, ie, for any
         // voxel in the output MultidimArray we calculate which are the corresponding
         // ones in the original MultidimArray, make an interpolation with them and put
         // this value at the output voxel
 
         // V2 is not initialised to 0 because all its pixels are rewritten
-        for (size_t k = 0; k < V2.zdim; k++)
-            for (size_t i = 0; i < V2.ydim; i++)
+        for (size_t r = row0; r < rowF; r++)
+        {
+            size_t k = r / V2.ydim;
+            size_t i = r % V2.ydim;
+
+            // Calculate position of the beginning of the row in the output
+            // MultidimArray
+            x = -cen_x;
+            y = i - cen_y;
+            z = k - cen_z;
+
+            // Calculate this position in the input image according to the
+            // geometrical transformation they are related by
+            // coords_output(=x,y) = A * coords_input (=xp,yp)
+            xp = x * MAT_ELEM(Aref, 0, 0) + y * MAT_ELEM(Aref, 0, 1) + z * MAT_ELEM(Aref, 0, 2) + MAT_ELEM(Aref, 0, 3);
+            yp = x * MAT_ELEM(Aref, 1, 0) + y * MAT_ELEM(Aref, 1, 1) + z * MAT_ELEM(Aref, 1, 2) + MAT_ELEM(Aref, 1, 3);
+            zp = x * MAT_ELEM(Aref, 2, 0) + y * MAT_ELEM(Aref, 2, 1) + z * MAT_ELEM(Aref, 2, 2) + MAT_ELEM(Aref, 2, 3);
+
+            for (size_t j = 0; j < V2.xdim; j++)
             {
-                // Calculate position of the beginning of the row in the output
-                // MultidimArray
-                x = -cen_x;
-                y = i - cen_y;
-                z = k - cen_z;
-
-                // Calculate this position in the input image according to the
-                // geometrical transformation they are related by
-                // coords_output(=x,y) = A * coords_input (=xp,yp)
-                xp = x * MAT_ELEM(Aref, 0, 0) + y * MAT_ELEM(Aref, 0, 1) + z * MAT_ELEM(Aref, 0, 2) + MAT_ELEM(Aref, 0, 3);
-                yp = x * MAT_ELEM(Aref, 1, 0) + y * MAT_ELEM(Aref, 1, 1) + z * MAT_ELEM(Aref, 1, 2) + MAT_ELEM(Aref, 1, 3);
-                zp = x * MAT_ELEM(Aref, 2, 0) + y * MAT_ELEM(Aref, 2, 1) + z * MAT_ELEM(Aref, 2, 2) + MAT_ELEM(Aref, 2, 3);
-
-                for (size_t j = 0; j < V2.xdim; j++)
-                {
-                    bool interp;
-                    double tmp;
+                bool interp;
+                double tmp;
 
 #ifdef DEBUG
 
-                    bool show_debug = false;
-                    if ((i == 0 && j == 0 && k == 0) ||
-                        (i == V2.ydim - 1 && j == V2.xdim - 1 && k == V2.zdim - 1))
-                        show_debug = true;
+                bool show_debug = false;
+                if ((i == 0 && j == 0 && k == 0) ||
+                    (i == V2.ydim - 1 && j == V2.xdim - 1 && k == V2.zdim - 1))
+                    show_debug = true;
 
-                    if (show_debug)
-                        std::cout << "(x,y,z)-->(xp,yp,zp)= "
-                        << "(" << x  << "," << y  << "," << z  << ") "
-                        << "(" << xp << "," << yp << "," << zp << ")\n";
+                if (show_debug)
+                    std::cout << "(x,y,z)-->(xp,yp,zp)= "
+                    << "(" << x  << "," << y  << "," << z  << ") "
+                    << "(" << xp << "," << yp << "," << zp << ")\n";
 #endif
 
-                    // If the point is outside the volume, apply a periodic
-                    // extension of the volume, what exits by one side enters by
-                    // the other
-                    interp  = true;
-                    bool x_isOut = XMIPP_RANGE_OUTSIDE(xp, minxp, maxxp);
-                    bool y_isOut = XMIPP_RANGE_OUTSIDE(yp, minyp, maxyp);
-                    bool z_isOut = XMIPP_RANGE_OUTSIDE(zp, minzp, maxzp);
+                // If the point is outside the volume, apply a periodic
+                // extension of the volume, what exits by one side enters by
+                // the other
+                interp  = true;
+                bool x_isOut = XMIPP_RANGE_OUTSIDE(xp, minxp, maxxp);
+                bool y_isOut = XMIPP_RANGE_OUTSIDE(yp, minyp, maxyp);
+                bool z_isOut = XMIPP_RANGE_OUTSIDE(zp, minzp, maxzp);
 
-                    if (wrap)
-                    {
-                        if (x_isOut)
-                            xp = realWRAP(xp, minxp - 0.5, maxxp + 0.5);
+                if (wrap)
+                {
+                    if (x_isOut)
+                        xp = realWRAP(xp, minxp - 0.5, maxxp + 0.5);
 
-                        if (y_isOut)
-                            yp = realWRAP(yp, minyp - 0.5, maxyp + 0.5);
+                    if (y_isOut)
+                        yp = realWRAP(yp, minyp - 0.5, maxyp + 0.5);
 
-                        if (z_isOut)
-                            zp = realWRAP(zp, minzp - 0.5, maxzp + 0.5);
-                    }
-                    else if (x_isOut || y_isOut || z_isOut)
-                        interp = false;
+                    if (z_isOut)
+                        zp = realWRAP(zp, minzp - 0.5, maxzp + 0.5);
+                }
+                else if (x_isOut || y_isOut || z_isOut)
+                    interp = false;
 
-                    if (interp)
+                if (interp)
+                {
+                    if (SplineDegree == 1)
                     {
-                        if (SplineDegree == 1)
-                        {
-                            // Linear interpolation
-
-                            // Calculate the integer position in input volume, be
-                            // careful that it is not the nearest but the one at the
-                            // top left corner of the interpolation square. Ie,
-                            // (0.7,0.7) would give (0,0)
-                            // Calculate also weights for point m1+1,n1+1
-                            wx = xp + cen_xp;
-                            m1 = (int) wx;
-                            wx = wx - m1;
-                            m2 = m1 + 1;
-                            wy = yp + cen_yp;
-                            n1 = (int) wy;
-                            wy = wy - n1;
-                            n2 = n1 + 1;
-                            wz = zp + cen_zp;
-                            o1 = (int) wz;
-                            wz = wz - o1;
-                            o2 = o1 + 1;
+                        // Linear interpolation
+
+                        // Calculate the integer position in input volume, be
+                        // careful that it is not the nearest but the one at the
+                        // top left corner of the interpolation square. Ie,
+                        // (0.7,0.7) would give (0,0)
+                        // Calculate also weights for point m1+1,n1+1
+                        wx = xp + cen_xp;
+                        m1 = (int) wx;
+                        wx = wx - m1;
+                        m2 = m1 + 1;
+                        wy = yp + cen_yp;
+                        n1 = (int) wy;
+                        wy = wy - n1;
+                        n2 = n1 + 1;
+                        wz = zp + cen_zp;
+                        o1 = (int) wz;
+                        wz = wz - o1;
+                        o2 = o1 + 1;
 
 #ifdef DEBUG
 
-                            if (show_debug)
-                            {
-                                std::cout << "After wrapping(xp,yp,zp)= "
-                                << "(" << xp << "," << yp << "," << zp << ")\n";
-                                std::cout << "(m1,n1,o1)-->(m2,n2,o2)="
-                                << "(" << m1 << "," << n1 << "," << o1 << ") "
-                                << "(" << m2 << "," << n2 << "," << o2 << ")\n";
-                                std::cout << "(wx,wy,wz)="
-                                << "(" << wx << "," << wy << "," << wz << ")\n";
-                            }
+                        if (show_debug)
+                        {
+                            std::cout << "After wrapping(xp,yp,zp)= "
+                            << "(" << xp << "," << yp << "," << zp << ")\n";
+                            std::cout << "(m1,n1,o1)-->(m2,n2,o2)="
+                            << "(" << m1 << "," << n1 << "," << o1 << ") "
+                            << "(" << m2 << "," << n2 << "," << o2 << ")\n";
+                            std::cout << "(wx,wy,wz)="
+                            << "(" << wx << "," << wy << "," << wz << ")\n";
+                        }
 #endif
 
-                            // Perform interpolation
-                            // if wx == 0 means that the rightest point is useless for
-                            // this interpolation, and even it might not be defined if
-                            // m1=xdim-1
-                            // The same can be said for wy.
-                            double wx_1=1-wx;
-                            double wy_1=1-wy;
-                            double wz_1=1-wz;
+                        // Perform interpolation
+                        // if wx == 0 means that the rightest point is useless for
+                        // this interpolation, and even it might not be defined if
+                        // m1=xdim-1
+                        // The same can be said for wy.
+                        double wx_1=1-wx;
+                        double wy_1=1-wy;
+                        double wz_1=1-wz;
+
+                        double aux1=wz_1 * wy_1;
+                        double aux2=aux1*wx_1;
+                        tmp  =  aux2 * DIRECT_A3D_ELEM(V1, o1, n1, m1);
 
-                            double aux1=wz_1 * wy_1;
-                            double aux2=aux1*wx_1;
-                            tmp  =  aux2 * DIRECT_A3D_ELEM(V1, o1, n1, m1);
+                        if (wx != 0 && m2 < V1.xdim)
+                            tmp += (aux1-aux2)* DIRECT_A3D_ELEM(V1, o1, n1, m2);
 
+                        if (wy != 0 && n2 < V1.ydim)
+                        {
+                            aux1=wz_1 * wy;
+                            aux2=aux1*wx_1;
+                            tmp += aux2 * DIRECT_A3D_ELEM(V1, o1, n2, m1);
                             if (wx != 0 && m2 < V1.xdim)
-                                tmp += (aux1-aux2)* DIRECT_A3D_ELEM(V1, o1, n1, m2);
+                                tmp += (aux1-aux2) * DIRECT_A3D_ELEM(V1, o1, n2, m2);
+                        }
 
+                        if (wz != 0 && o2 < V1.zdim)
+                        {
+                            aux1=wz * wy_1;
+                            aux2=aux1*wx_1;
+                            tmp += aux2 * DIRECT_A3D_ELEM(V1, o2, n1, m1);
+                            if (wx != 0 && m2 < V1.xdim)
+                                tmp += (aux1-aux2) * DIRECT_A3D_ELEM(V1, o2, n1, m2);
                             if (wy != 0 && n2 < V1.ydim)
                             {
-                                aux1=wz_1 * wy;
+                                aux1=wz * wy;
                                 aux2=aux1*wx_1;
-                                tmp += aux2 * DIRECT_A3D_ELEM(V1, o1, n2, m1);
+                                tmp += aux2 * DIRECT_A3D_ELEM(V1, o2, n2, m1);
                                 if (wx != 0 && m2 < V1.xdim)
-                                    tmp += (aux1-aux2) * DIRECT_A3D_ELEM(V1, o1, n2, m2);
-                            }
-
-                            if (wz != 0 && o2 < V1.zdim)
-                            {
-                                aux1=wz * wy_1;
-                                aux2=aux1*wx_1;
-                                tmp += aux2 * DIRECT_A3D_ELEM(V1, o2, n1, m1);
-                                if (wx != 0 && m2 < V1.xdim)
-                                    tmp += (aux1-aux2) * DIRECT_A3D_ELEM(V1, o2, n1, m2);
-                                if (wy != 0 && n2 < V1.ydim)
-                                {
-                                    aux1=wz * wy;
-                                    aux2=aux1*wx_1;
-                                    tmp += aux2 * DIRECT_A3D_ELEM(V1, o2, n2, m1);
-                                    if (wx != 0 && m2 < V1.xdim)
-                                        tmp += (aux1-aux2) * DIRECT_A3D_ELEM(V1, o2, n2, m2);
-                                }
+                                    tmp += (aux1-aux2) * DIRECT_A3D_ELEM(V1, o2, n2, m2);
                             }
+                        }
 
 #ifdef DEBUG
-                            if (show_debug)
-                                std::cout <<
-                                "tmp1=" << DIRECT_A3D_ELEM(V1, o1, n1, m1) << " "
-                                << (T)(wz_1 *wy_1 *wx_1 * DIRECT_A3D_ELEM(V1, o1, n1, m1))
-                                << std::endl <<
-                                "tmp2=" << DIRECT_A3D_ELEM(V1, o1, n1, m2) << " "
-                                << (T)(wz_1 *wy_1 * wx * DIRECT_A3D_ELEM(V1, o1, n1, m2))
-                                << std::endl <<
-                                "tmp3=" << DIRECT_A3D_ELEM(V1, o1, n2, m1) << " "
-                                << (T)(wz_1 * wy *wx_1 * DIRECT_A3D_ELEM(V1, o1, n2, m1))
-                                << std::endl <<
-                                "tmp4=" << DIRECT_A3D_ELEM(V1, o1, n2, m2) << " "
-                                << (T)(wz_1 * wy * wx * DIRECT_A3D_ELEM(V1, o2, n1, m1))
-                                << std::endl <<
-                                "tmp6=" << DIRECT_A3D_ELEM(V1, o2, n1, m2) << " "
-                                << (T)(wz * wy_1 * wx * DIRECT_A3D_ELEM(V1, o2, n1, m2))
-                                << std::endl <<
-                                "tmp7=" << DIRECT_A3D_ELEM(V1, o2, n2, m1) << " "
-                                << (T)(wz * wy *wx_1 * DIRECT_A3D_ELEM(V1, o2, n2, m1))
-                                << std::endl <<
-                                "tmp8=" << DIRECT_A3D_ELEM(V1, o2, n2, m2) << " "
-                                << (T)(wz * wy * wx * DIRECT_A3D_ELEM(V1, o2, n2, m2))
-                                << std::endl <<
-                                "tmp= " << tmp << std::endl;
+                        if (show_debug)
+                            std::cout <<
+                            "tmp1=" << DIRECT_A3D_ELEM(V1, o1, n1, m1) << " "
+                            << (T)(wz_1 *wy_1 *wx_1 * DIRECT_A3D_ELEM(V1, o1, n1, m1))
+                            << std::endl <<
+                            "tmp2=" << DIRECT_A3D_ELEM(V1, o1, n1, m2) << " "
+                            << (T)(wz_1 *wy_1 * wx * DIRECT_A3D_ELEM(V1, o1, n1, m2))
+                            << std::endl <<
+                            "tmp3=" << DIRECT_A3D_ELEM(V1, o1, n2, m1) << " "
+                            << (T)(wz_1 * wy *wx_1 * DIRECT_A3D_ELEM(V1, o1, n2, m1))
+                            << std::endl <<
+                            "tmp4=" << DIRECT_A3D_ELEM(V1, o1, n2, m2) << " "
+                            << (T)(wz_1 * wy * wx * DIRECT_A3D_ELEM(V1, o2, n1, m1))
+                            << std::endl <<
+                            "tmp6=" << DIRECT_A3D_ELEM(V1, o2, n1, m2) << " "
+                            << (T)(wz * wy_1 * wx * DIRECT_A3D_ELEM(V1, o2, n1, m2))
+                            << std::endl <<
+                            "tmp7=" << DIRECT_A3D_ELEM(V1, o2, n2, m1) << " "
+                            << (T)(wz * wy *wx_1 * DIRECT_A3D_ELEM(V1, o2, n2, m1))
+                            << std::endl <<
+                            "tmp8=" << DIRECT_A3D_ELEM(V1, o2, n2, m2) << " "
+                            << (T)(wz * wy * wx * DIRECT_A3D_ELEM(V1, o2, n2, m2))
+                            << std::endl <<
+                            "tmp= " << tmp << std::endl;
 #endif
 
-                            dAkij(V2 , k, i, j) = (T)tmp;
-                        }
-                        else if (SplineDegree==0)
+                        dAkij(V2 , k, i, j) = (T)tmp;
+                    }
+                    else if (SplineDegree==0)
 						{
 							dAkij(V2, k, i, j)=(T)A3D_ELEM(V1,(int)trunc(zp),(int)trunc(yp),(int)trunc(xp));
 						}
-                        else
-                        {
-                            // B-spline interpolation
-                            dAkij(V2, k, i, j) =
-                                (T) Bcoeffs.interpolatedElementBSpline3D(xp, yp, zp,SplineDegree);
-                        }
-                    }
                     else
-                        dAkij(V2, k, i, j) = outside;
-
-                    // Compute new point inside input image
-                    xp += Aref00;
-                    yp += Aref10;
-                    zp += Aref20;
+                    {
+                        // B-spline interpolation
+                        dAkij(V2, k, i, j) =
+                            (T) Bcoeffs.interpolatedElementBSpline3D(xp, yp, zp,SplineDegree);
+                    }
                 }
+                else
+                    dAkij(V2, k, i, j) = outside;
+
+                // Compute new point inside input image
+                xp += Aref00;
+                yp += Aref10;
+                zp += Aref20;
             }
+        }
+    }
+}
+
+/** Thread of applyGeometry (internal use).
+ * @ingroup GeometricalTransformations
+ */
+template<typename T1,typename T>
+void applyGeometryThread(ThreadArgument &thArg)
+{
+    const ApplyGeometryArgs<T1,T> &args = *((ApplyGeometryArgs<T1,T> *) thArg.data);
+    size_t row0 = (args.rows * thArg.thread_id) / thArg.threads;
+    size_t rowF = (args.rows * (thArg.thread_id + 1)) / thArg.threads;
+    applyGeometryRows(args, row0, rowF);
+}
+
+/** Applies a geometrical transformation.
+ * @ingroup GeometricalTransformations
+ *
+ * Any geometrical transformation defined by the matrix A (double (4x4)!!
+ * ie, in homogeneous R3 coordinates) is applied to the volume V1.
+ * The result is stored in V2 (it cannot be the same as the input volume).
+ * An exception is thrown if the transformation matrix is not 4x4.
+ *
+ * Structure of the transformation matrix: It should have the following
+ * components
+ *
+ * r11 r12 r13 x
+ * r21 r22 r23 y
+ * r31 r32 r33 z
+ * 0   0   0   1
+ *
+ * where (x,y,z) is the translation desired, and Rij are the components of
+ * the rotation matrix R. If you want to apply a scaling factor to the
+ * transformation, then multiply r11, r22 and r33 by it.
+ *
+ * The result volume (with ndim=1) is resized to the same
+ * dimensions as V1 if V2 is empty (0x0) at the beginning, if it
+ * is not, ie, if V2 has got some size then only those values in
+ * the volume are filled, this is very useful for resizing the
+ * volume, then you manually resize the output volume to the
+ * desired size and then call this routine.
+ *
+ * The relationship between the output coordinates and the input ones are
+ *
+ * @code
+ * out = A * in
+ * (x, y, z) = A * (x', y', z')
+ * @endcode
+ *
+ * This function works independently from the logical indexing of each
+ * matrix, it sets the logical center and the physical center of the image
+ * and work with these 2 coordinate spaces. At the end the original logical
+ * indexing of each matrix is kept.
+ *
+ * The procedure followed goes from coordinates in the output volume
+ * to the ones in the input one, so the inverse of the A matrix is
+ * needed. There is a flag telling if the given matrix is already
+ * the inverse one or the normal one. If it is the normal one internally
+ * the matrix is inversed. If you are to do many "rotations" then
+ * some time is spent in inverting the matrix. Normally the matrix is the
+ * normal one.
+ *
+ * There is something else to tell about the geometrical tranformation.
+ * The value of the voxel in the output volume is computed via
+ * bilinear interpolation in the input volume. If any of the voxels
+ * participating in the interpolation falls outside the input volume,
+ * then automatically the corresponding output voxel is set to 0, unless
+ * that the wrap flag has been set to 1. In this case if the voxel
+ * falls out by the right hand then it is "wrapped" and the corresponding
+ * voxel in the left hand is used. The same is appliable to top-bottom.
+ * Usually wrap mode is off. Wrap mode is interesting for translations
+ * but not for rotations, for example.
+ *
+ * The inverse mode and wrapping mode should be taken by default by the
+ * routine, g++ seems to have problems with template functions outside
+ * a class with default parameters. So, I'm sorry, you will have to
+ * put them always. The usual combination is
+ *
+ * applyGeometry(..., IS_NOT_INV, DONT_WRAP).
+ *
+ * Although you can also use the constants IS_INV, or WRAP.
+ *
+ * @code
+ * Matrix2D< double > A(4,4);
+ * A.initIdentity;
+ * applyGeometry(V2, A, V1);
+ * @endcode
+ */
+template<typename T1,typename T>
+void applyGeometry(int SplineDegree,
+                   MultidimArray<T>& V2,
+                   const MultidimArray<T1>& V1,
+                   const Matrix2D< double > &A, bool inv,
+                   bool wrap, T outside = 0)
+{
+    applyGeometry(SplineDegree, V2, V1, A, inv, wrap, outside, getApplyGeometryThreads());
+}
+
+/** Applies a geometrical transformation with a given number of threads.
+ * @ingroup GeometricalTransformations
+ *
+ * The same as the previous function, but nThreads is used instead of
+ * getApplyGeometryThreads().
+ */
+template<typename T1,typename T>
+void applyGeometry(int SplineDegree,
+                   MultidimArray<T>& V2,
+                   const MultidimArray<T1>& V1,
+                   const Matrix2D< double > &A, bool inv,
+                   bool wrap, T outside, int nThreads)
+{
+#ifndef RELEASE_MODE
+    if (&V1 == (MultidimArray<T1>*)&V2)
+        REPORT_ERROR(ERR_VALUE_INCORRECT,"ApplyGeometry: Input array cannot be the same as output array");
+
+    if ( V1.getDim()==2 && ((MAT_XSIZE(A) != 3) || (MAT_YSIZE(A) != 3)) )
+        REPORT_ERROR(ERR_MATRIX_SIZE,"ApplyGeometry: 2D transformation matrix is not 3x3");
+
+    if ( V1.getDim()==3 && ((MAT_XSIZE(A) != 4) || (MAT_YSIZE(A) != 4)) )
+        REPORT_ERROR(ERR_MATRIX_SIZE,"ApplyGeometry: 3D transformation matrix is not 4x4");
+#endif
+
+    if (A.isIdentity() && ( XSIZE(V2) == 0 || SAME_SHAPE3D(V1,V2) ) )
+    {
+        typeCast(V1,V2);
+        return;
+    }
+
+    if (XSIZE(V1) == 0)
+    {
+        V2.clear();
+        return;
     }
+
+    MultidimArray<double> Bcoeffs;
+    Matrix2D<double> Ainv;
+    const Matrix2D<double> * Aptr=&A;
+    if (!inv)
+    {
+        Ainv = A.inv();
+        Aptr=&Ainv;
+    }
+    const Matrix2D<double> &Aref=*Aptr;
+
+    // For scalings the output matrix is resized outside to the final
+    // size instead of being resized inside the routine with the
+    // same size as the input matrix
+    if (XSIZE(V2) == 0)
+        V2.resizeNoCopy(V1);
+
+    if (outside != 0.)
+    {
+        // Initialize output matrix with value=outside
+        FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(V2)
+        DIRECT_MULTIDIM_ELEM(V2, n) = outside;
+    }
+    else
+        V2.initZeros();
+
+    if (SplineDegree > 1)
+    {
+        // Build the B-spline coefficients
+        produceSplineCoefficients(SplineDegree, Bcoeffs, V1, nThreads); //Bcoeffs is a single image
+        STARTINGX(Bcoeffs) = -(int)(XSIZE(V1) / 2);
+        STARTINGY(Bcoeffs) = -(int)(YSIZE(V1) / 2);
+    }
+
+    // The output rows are split among the threads
+    ApplyGeometryArgs<T1,T> args;
+    args.SplineDegree = SplineDegree;
+    args.V2 = &V2;
+    args.V1 = &V1;
+    args.Bcoeffs = &Bcoeffs;
+    args.A = &Aref;
+    args.wrap = wrap;
+    args.outside = outside;
+    args.rows = (V1.getDim() == 2) ? YSIZE(V2) : ZSIZE(V2) * YSIZE(V2);
+
+    size_t maxThreads = (args.rows * XSIZE(V2)) / APPLYGEO_MIN_PIXELS_PER_THREAD;
+    if (maxThreads > args.rows)
+        maxThreads = args.rows;
+    if (nThreads > 1 && maxThreads > 1)
+    {
+        ThreadManager thMgr(XMIPP_MIN((size_t) nThreads, maxThreads));
+        thMgr.run(applyGeometryThread<T1,T>, &args);
+    }
+    else
+        applyGeometryRows(args, 0, args.rows);
 }
 
 // Special case for input MultidimArrayGeneric
@@ -753,6 +854,117 @@ void applyGeometry(int SplineDegree,
 #undef APPLYGEO
 }
 
+/** Arguments of applyGeometryBatch shared by its threads (internal use).
+ * @ingroup GeometricalTransformations
+ */
+template<typename T1,typename T>
+struct ApplyGeometryBatchArgs
+{
+    int SplineDegree;
+    MultidimArray<T> *V2;
+    const MultidimArray<T1> *V1;
+    const std::vector< Matrix2D<double> > *A;
+    bool inv;
+    bool wrap;
+    T outside;
+    int imageThreads; // Threads per image
+};
+
+/** Applies the transformations of the images n0, n0+step, ... of a batch (internal use).
+ * @ingroup GeometricalTransformations
+ */
+template<typename T1,typename T>
+void applyGeometryBatchImages(const ApplyGeometryBatchArgs<T1,T> &args, size_t n0, size_t step)
+{
+    const MultidimArray<T1> &V1 = *args.V1;
+    MultidimArray<T> &V2 = *args.V2;
+    MultidimArray<T1> I1;
+    MultidimArray<T> I2;
+    for (size_t n = n0; n < NSIZE(V1); n += step)
+    {
+        I1.aliasImageInStack(V1, n);
+        I2.aliasImageInStack(V2, n);
+        STARTINGX(I1) = STARTINGX(V1);
+        STARTINGY(I1) = STARTINGY(V1);
+        STARTINGX(I2) = STARTINGX(V2);
+        STARTINGY(I2) = STARTINGY(V2);
+        applyGeometry(args.SplineDegree, I2, I1, (*args.A)[n], args.inv, args.wrap, args.outside,
+                      args.imageThreads);
+    }
+}
+
+/** Thread of applyGeometryBatch (internal use).
+ * @ingroup GeometricalTransformations
+ *
+ * Images are distributed cyclically among the threads.
+ */
+template<typename T1,typename T>
+void applyGeometryBatchThread(ThreadArgument &thArg)
+{
+    applyGeometryBatchImages(*((ApplyGeometryBatchArgs<T1,T> *) thArg.data),
+                             thArg.thread_id, thArg.threads);
+}
+
+/** Applies a different geometrical transformation to each image of a stack.
+ * @ingroup GeometricalTransformations
+ *
+ * The n-th image of the 2D stack V1 is transformed with the 3x3 matrix A[n]
+ * and stored as the n-th image of V2, with the same conventions as
+ * applyGeometry. If V2 is empty it is resized to the size of V1, otherwise
+ * it must have as many images as V1 (to scale the images set the image size
+ * of V2 beforehand). The images are distributed among
+ * getApplyGeometryThreads() threads.
+ *
+ * @code
+ * std::vector< Matrix2D<double> > A(NSIZE(stack));
+ * for (size_t n = 0; n < A.size(); n++)
+ *     rotation2DMatrix(angle[n], A[n]);
+ * applyGeometryBatch(BSPLINE3, alignedStack, stack, A, IS_NOT_INV, DONT_WRAP);
+ * @endcode
+ */
+template<typename T1,typename T>
+void applyGeometryBatch(int SplineDegree,
+                        MultidimArray<T>& V2,
+                        const MultidimArray<T1>& V1,
+                        const std::vector< Matrix2D<double> > &A, bool inv,
+                        bool wrap, T outside = 0)
+{
+    if (ZSIZE(V1) != 1)
+        REPORT_ERROR(ERR_MULTIDIM_DIM, "applyGeometryBatch: only for stacks of 2D images");
+    if (A.size() != NSIZE(V1))
+        REPORT_ERROR(ERR_MULTIDIM_SIZE, "applyGeometryBatch: there must be one matrix per image");
+    if (XSIZE(V2) == 0)
+        V2.resizeNoCopy(V1);
+    else if (NSIZE(V2) != NSIZE(V1) || ZSIZE(V2) != 1)
+        REPORT_ERROR(ERR_MULTIDIM_SIZE, "applyGeometryBatch: the output stack must have as many images as the input one");
+    if (NSIZE(V1) == 0 || XSIZE(V1) == 0)
+        return;
+
+    ApplyGeometryBatchArgs<T1,T> args;
+    args.SplineDegree = SplineDegree;
+    args.V2 = &V2;
+    args.V1 = &V1;
+    args.A = &A;
+    args.inv = inv;
+    args.wrap = wrap;
+    args.outside = outside;
+
+    // With several images each thread takes whole images, otherwise the
+    // threads share the rows of the single image
+    int nThreads = XMIPP_MIN((size_t) getApplyGeometryThreads(), NSIZE(V1));
+    if (nThreads > 1)
+    {
+        args.imageThreads = 1;
+        ThreadManager thMgr(nThreads);
+        thMgr.run(applyGeometryBatchThread<T1,T>, &args);
+    }
+    else
+    {
+        args.imageThreads = getApplyGeometryThreads();
+        applyGeometryBatchImages(args, 0, 1);
+    }
+}
+
 /** Applies a geometrical transformation and overwrites the input matrix.
  * @ingroup GeometricalTransformations
  *
@@ -792,33 +1004,62 @@ void applyGeometry(int SplineDegree,
                    bool wrap, double outside);
 
 
+/** B-spline prefilter of a single image or volume (in place).
+ * @ingroup  GeometricalTransformations
+ *
+ * On input coeffs has the samples, and on output their B-spline coefficients
+ * of the given degree (with the same mirror-off-bounds convention as
+ * ChangeBasisVolume, and the same result). The recursive filter runs on the
+ * lines along X, Y and Z in turn, and the lines of each pass are split among
+ * nThreads threads. Lines along Y and Z are gathered in tiles of neighbouring
+ * columns, so that memory is read by whole cache lines.
+ */
+void bsplinePrefilter(int SplineDegree, MultidimArray< double > &coeffs, int nThreads);
+
+/** B-spline prefilter of a raw Nx x Ny x Nz array (in place).
+ * @ingroup  GeometricalTransformations
+ *
+ * As above, with any of the boundary conventions and tolerances of bilib.
+ */
+void bsplinePrefilter(int SplineDegree, double *data, size_t Nx, size_t Ny, size_t Nz,
+                      TBoundaryConvention convention, double tolerance, int nThreads);
+
 /** Produce spline coefficients.
  * @ingroup  GeometricalTransformations
  *
  * Create a single image with spline coefficients for the nth image
  *
+ * The prefilter is split among nThreads threads (see bsplinePrefilter).
  */
 template<typename T>
 void produceSplineCoefficients(int SplineDegree,
                                MultidimArray< double > &coeffs,
-                               const MultidimArray< T > &V1)
+                               const MultidimArray< T > &V1,
+                               int nThreads)
 {
-
-    coeffs.initZeros(ZSIZE(V1), YSIZE(V1), XSIZE(V1));
+    coeffs.resizeNoCopy(ZSIZE(V1), YSIZE(V1), XSIZE(V1));
     STARTINGX(coeffs) = STARTINGX(V1);
     STARTINGY(coeffs) = STARTINGY(V1);
     STARTINGZ(coeffs) = STARTINGZ(V1);
 
-    int Status;
-    MultidimArray< double > aux;
-    typeCast(V1, aux); // This will create a single volume!
+    // Only the first image or volume of a stack
+    FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(coeffs)
+    DIRECT_MULTIDIM_ELEM(coeffs, n) = (double) DIRECT_MULTIDIM_ELEM(V1, n);
+    bsplinePrefilter(SplineDegree, coeffs, nThreads);
+}
 
-    ChangeBasisVolume(MULTIDIM_ARRAY(aux), MULTIDIM_ARRAY(coeffs),
-                      XSIZE(V1), YSIZE(V1), ZSIZE(V1),
-                      CardinalSpline, BasicSpline, SplineDegree,
-                      MirrorOffBounds, DBL_EPSILON, &Status);
-    if (Status)
-        REPORT_ERROR(ERR_UNCLASSIFIED, "Error in produceSplineCoefficients...");
+/** Produce spline coefficients.
+ * @ingroup  GeometricalTransformations
+ *
+ * Create a single image with spline coefficients for the nth image. It uses
+ * as many threads as applyGeometry (see setApplyGeometryThreads).
+ */
+template<typename T>
+void produceSplineCoefficients(int SplineDegree,
+                               MultidimArray< double > &coeffs,
+                               const MultidimArray< T > &V1)
+{
+    produceSplineCoefficients(SplineDegree, coeffs, V1, getApplyGeometryThreads());
 }
 
 // Special case for complex arrays
@@ -946,6 +1187,79 @@ void selfTranslate(int SplineDegree,
     translate(SplineDegree, V1, aux, v, wrap, outside);
 }
 
+/** Composition of geometrical transformations.
+ * @ingroup GeometricalTransformations
+ *
+ * Chaining rotate, translate, scale or applyGeometry interpolates the image
+ * once per step, which costs time and smooths the image each time. This
+ * class composes all the steps into a single matrix (out = A * in, as in
+ * applyGeometry) that is applied with a single interpolation. Each
+ * operation is applied after the previous ones.
+ *
+ * When the composition is a pure translation, the interpolation is spline
+ * and the image is wrapped, the shift is applied as a phase shift in
+ * Fourier space. This is exact for band-limited images and it is faster
+ * than building the B-spline coefficients and interpolating.
+ *
+ * @code
+ * TransformationBuilder T;
+ * T.geo(row).shift(0.5, -2).rotate(psi);
+ * T.apply(BSPLINE3, Iout(), I(), WRAP);
+ * @endcode
+ */
+class TransformationBuilder
+{
+public:
+    /// Composed transformation (homogeneous, out = A * in)
+    Matrix2D<double> A;
+    /// Apply pure translations in Fourier space
+    bool useFourierShift;
+
+public:
+    /** Empty constructor.
+     * Dimension 2 for images (3x3 matrices), 3 for volumes (4x4 matrices).
+     */
+    TransformationBuilder(int dim = 2);
+
+    /// Back to the identity
+    void clear();
+
+    /// Transformation of the geometry of a metadata row (see geo2TransformationMatrix)
+    TransformationBuilder& geo(const MDRow &row, bool only_apply_shifts = false);
+
+    /// Transformation given by a matrix, with the same meaning of inv as in applyGeometry
+    TransformationBuilder& matrix(const Matrix2D<double> &M, bool inv = IS_NOT_INV);
+
+    /// Shift (as in translate)
+    TransformationBuilder& shift(double x, double y, double z = 0);
+
+    /// Shift (as in translate)
+    TransformationBuilder& shift(const Matrix1D<double> &v);
+
+    /// Rotation in degrees (as in rotate), the axis is only used for volumes
+    TransformationBuilder& rotate(double ang, char axis = 'Z');
+
+    /// Isotropic scaling. Factor 0.5 halves and 2 doubles
+    TransformationBuilder& scale(double factor);
+
+    /// Mirror of the X axis (x -> -x)
+    TransformationBuilder& mirrorX();
+
+    /// The composed transformation is a translation
+    bool isTranslation() const;
+
+    /** Apply the composed transformation.
+     * The output follows the conventions of applyGeometry, in particular it
+     * may be resized beforehand to scale images.
+     */
+    void apply(int SplineDegree, MultidimArray<double> &out, const MultidimArray<double> &in,
+               bool wrap = WRAP, double outside = 0.) const;
+
+    /// Apply the composed transformation overwriting the input
+    void selfApply(int SplineDegree, MultidimArray<double> &V, bool wrap = WRAP,
+                   double outside = 0.) const;
+};
+
 /** Translate center of mass to center
  * @ingroup GeometricalTransformations
  *
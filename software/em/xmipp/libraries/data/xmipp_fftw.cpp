@@ -138,10 +138,10 @@ void FourierTransformer::setReal(MultidimArray<double> &input)
         fPlanBackward = fftw_plan_dft_c2r(ndim, N,
                                           (fftw_complex*) MULTIDIM_ARRAY(fFourier), MULTIDIM_ARRAY(*fReal),
                                           FFTW_ESTIMATE);
+        pthread_mutex_unlock(&fftw_plan_mutex);
         if (fPlanForward == NULL || fPlanBackward == NULL)
             REPORT_ERROR(ERR_PLANS_NOCREATE, "FFTW plans cannot be created");
         dataPtr=MULTIDIM_ARRAY(*fReal);
-        pthread_mutex_unlock(&fftw_plan_mutex);
     }
 }
 
@@ -194,11 +194,11 @@ void FourierTransformer::setReal(MultidimArray<std::complex<double> > &input)
         fPlanBackward=NULL;
         fPlanBackward = fftw_plan_dft(ndim, N, (fftw_complex*) MULTIDIM_ARRAY(fFourier),
                                       (fftw_complex*) MULTIDIM_ARRAY(*fComplex), FFTW_BACKWARD, FFTW_ESTIMATE);
+        pthread_mutex_unlock(&fftw_plan_mutex);
+        delete [] N;
         if (fPlanForward == NULL || fPlanBackward == NULL)
             REPORT_ERROR(ERR_PLANS_NOCREATE, "FFTW plans cannot be created");
-        delete [] N;
         complexDataPtr=MULTIDIM_ARRAY(*fComplex);
-        pthread_mutex_unlock(&fftw_plan_mutex);
     }
 }
 
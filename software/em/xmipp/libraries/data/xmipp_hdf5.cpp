@@ -26,6 +26,19 @@
 #include "xmipp_hdf5.h"
 #include "xmipp_strings.h"
 #include "xmipp_error.h"
+#include <pthread.h>
+
+static pthread_mutex_t hdf5Mutex = PTHREAD_MUTEX_INITIALIZER;
+
+HDF5Lock::HDF5Lock()
+{
+    pthread_mutex_lock(&hdf5Mutex);
+}
+
+HDF5Lock::~HDF5Lock()
+{
+    pthread_mutex_unlock(&hdf5Mutex);
+}
 
 struct H5TreeInfo
 {
@@ -66,6 +66,27 @@ H5infoProvider getProvider(hid_t fhdf5);
 
 
 
+/** Serialize the calls to the HDF5 library.
+ * The HDF5 library is built without thread-safety, so it cannot be entered
+ * by two threads at the same time. The image I/O (ImageBase::openFile,
+ * closeFile and the HDF5 reader) keeps one of these objects in scope while
+ * it calls the library. Images can then be read from the worker threads of
+ * a program or from Python threads that have released the GIL.
+ */
+class HDF5Lock
+{
+public:
+    /// Wait for the library to be free
+    HDF5Lock();
+
+    /// Let other threads use the library
+    ~HDF5Lock();
+
+private:
+    HDF5Lock(const HDF5Lock &);
+    HDF5Lock & operator=(const HDF5Lock &);
+};
+
 class XmippH5File: public H5::H5File
 {
 
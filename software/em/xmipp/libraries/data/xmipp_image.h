@@ -31,6 +31,8 @@
 #ifndef IMAGE_H
 #define IMAGE_H
 
+#include <utility>
+
 #include "xmipp_image_base.h"
 #include "xmipp_image_generic.h"
 #include "xmipp_color.h"
@@ -115,6 +117,20 @@ template<typename T>
       *this = im;
     }
 
+#if __cplusplus >= 201103L
+    /** Move constructor
+     *
+     * The data of im is taken without copying it, see the MultidimArray
+     * move constructor.
+     */
+    Image(Image<T> &&im)
+    {
+      mdaBase = (MultidimArrayBase*) &data;
+      init();
+      *this = std::move(im);
+    }
+#endif
+
     /** Constructor with MultidimArray alias
      *
      *  An image is created directly with its multidimarray aliased to im.
@@ -1004,6 +1020,24 @@ template<typename T>
       return *this;
     }
 
+#if __cplusplus >= 201103L
+    /** Move the MDA and the fields related to the (possible) original file
+     */
+    Image<T>&
+    operator=(Image<T> &&op1)
+    {
+      MD.swap(op1.MD);
+      MDMainHeader = op1.MDMainHeader;
+      filename = op1.filename;
+      transform = op1.transform;
+
+      aDimFile = op1.aDimFile;
+      data = std::move(op1.data);
+
+      return *this;
+    }
+#endif
+
     /** Data access
      *
      * This operator can be used to access the data multidimarray.
@@ -1413,6 +1447,8 @@ template<typename T>
             formatString("Image Class::mmapFile: mmap of image file failed. Error: %s", strerror(errno)));
       data.data = reinterpret_cast<T*>(map + mappedOffset);
       data.nzyxdimAlloc = XSIZE(data) * YSIZE(data) * ZSIZE(data) * NSIZE(data);
+      // The array does not own the mapped memory
+      data.destroyData = false;
 #else
 
       REPORT_ERROR(ERR_MMAP,"Mapping not supported in Windows");
@@ -1429,6 +1465,7 @@ template<typename T>
       munmap((char*) (data.data) - mappedOffset, mappedSize);
       close(mFd);
       data.data = NULL;
+      data.destroyData = true;
       mappedSize = mappedOffset = 0;
 #else
 
@@ -26,6 +26,7 @@
 #include "xmipp_image_base.h"
 #include "xmipp_image.h"
 #include "xmipp_error.h"
+#include "xmipp_hdf5.h"
 
 //This is needed for static memory allocation
 
@@ -545,7 +546,11 @@ ImageFHandler* ImageBase::openFile(const FileName &name, int mode) const
     }
     else if (ext_name.contains("hdf") || ext_name.contains("h5"))
     {
-        if ((hFile->fhdf5 = H5Fopen(fileName.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT)) == -1 )
+        {
+            HDF5Lock lock;
+            hFile->fhdf5 = H5Fopen(fileName.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+        }
+        if (hFile->fhdf5 == -1 )
             REPORT_ERROR(ERR_IO_NOTOPEN,"ImageBase::openFile: There is a problem opening the HDF5 file.");
         //        hFile->fimg = NULL;
 
@@ -661,7 +666,10 @@ void ImageBase::closeFile(ImageFHandler* hFile) const
     }
     else if (ext_name.contains("hdf") || ext_name.contains("h5"))
     {
-        H5Fclose(fhdf5);
+        {
+            HDF5Lock lock;
+            H5Fclose(fhdf5);
+        }
         if (fclose(fimg) != 0 )
             REPORT_ERROR(ERR_IO_NOCLOSED,(String)"Can not close image file "+ filename);
     }
@@ -766,7 +774,10 @@ int ImageBase::_read(const FileName &name, ImageFHandler* hFile, DataMode datamo
     else if (ext_name.contains("jpg"))//SPE
         err = readJPEG(select_img);
     else if (ext_name.contains("hdf") || ext_name.contains("h5"))//SPE
+    {
+        HDF5Lock lock;
         err = readHDF5(select_img);
+    }
     else
         err = readSPIDER(select_img);
 
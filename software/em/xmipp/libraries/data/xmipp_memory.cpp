@@ -23,8 +23,12 @@
  *  e-mail address 'xmipp@cnb.csic.es'
  ***************************************************************************/
 
+#include <pthread.h>
+#include <map>
+#include <vector>
 #include "xmipp_memory.h"
 #include "xmipp_strings.h"
+#include "xmipp_threads.h"
 
 char*  askMemory(size_t memsize)
 {
@@ -61,3 +65,227 @@ int  freeMemory(void* ptr, size_t memsize)
     ptr = NULL;
     return(0);
 }
+
+/* Aligned buffers ------------------------------------------------------- */
+/* Each buffer is preceded by XMIPP_MEMORY_ALIGNMENT bytes, the last size_t
+ * of them keeps the capacity of the buffer. In this way any buffer can be
+ * pooled, no matter if it was allocated with or without pool. */
+#define BUFFER_CAPACITY(ptr) (((size_t *)(ptr))[-1])
+
+/* Memory pool of a thread */
+struct MemoryPoolState
+{
+    // Number of active MemoryPool objects
+    int users;
+    // Maximum number of bytes kept
+    size_t maxPooledBytes;
+    // Free buffers, by size class. The capacity of the buffers in a bin is
+    // at least the size of the class.
+    std::map<size_t, std::vector<char *> > bins;
+    // Statistics
+    MemoryPoolStats stats;
+};
+
+static pthread_key_t poolKey;
+static pthread_once_t poolKeyOnce = PTHREAD_ONCE_INIT;
+
+/* Free all the buffers of a pool */
+static void releasePoolBuffers(MemoryPoolState *pool)
+{
+    std::map<size_t, std::vector<char *> >::iterator it;
+    for (it = pool->bins.begin(); it != pool->bins.end(); ++it)
+        for (size_t i = 0; i < it->second.size(); ++i)
+            free(it->second[i] - XMIPP_MEMORY_ALIGNMENT);
+    pool->bins.clear();
+    pool->stats.pooledBytes = 0;
+}
+
+/* Called at thread exit */
+static void destroyPoolState(void *ptr)
+{
+    MemoryPoolState *pool = (MemoryPoolState *) ptr;
+    releasePoolBuffers(pool);
+    delete pool;
+}
+
+static void createPoolKey()
+{
+    pthread_key_create(&poolKey, destroyPoolState);
+}
+
+/* Pool of the calling thread, it is created if needed */
+static MemoryPoolState * getPoolState(bool create)
+{
+    pthread_once(&poolKeyOnce, createPoolKey);
+    MemoryPoolState *pool = (MemoryPoolState *) pthread_getspecific(poolKey);
+    if (pool == NULL && create)
+    {
+        pool = new MemoryPoolState;
+        pool->users = 0;
+        pool->maxPooledBytes = 0;
+        memset(&pool->stats, 0, sizeof(MemoryPoolStats));
+        pthread_setspecific(poolKey, pool);
+    }
+    return pool;
+}
+
+/* Active pool of the calling thread, or NULL */
+static inline MemoryPoolState * getActivePool()
+{
+    MemoryPoolState *pool = getPoolState(false);
+    return (pool != NULL && pool->users > 0) ? pool : NULL;
+}
+
+/* Size classes, 4 per power of two. The step of bytes in [2^e,2^(e+1)) is 2^(e-2) */
+static inline size_t sizeClassStep(size_t bytes)
+{
+    size_t step = 1;
+    while ((step << 3) <= bytes)
+        step <<= 1;
+    return step;
+}
+
+void * askAlignedBytes(size_t bytes)
+{
+    MemoryPoolState *pool = getActivePool();
+    if (pool != NULL && bytes >= XMIPP_POOL_MIN_BYTES)
+    {
+        // Round up to the size class
+        size_t step = sizeClassStep(bytes);
+        bytes = ((bytes + step - 1) / step) * step;
+        pool->stats.requests++;
+        std::map<size_t, std::vector<char *> >::iterator it = pool->bins.find(bytes);
+        if (it != pool->bins.end() && !it->second.empty())
+        {
+            char *ptr = it->second.back();
+            it->second.pop_back();
+            pool->stats.hits++;
+            pool->stats.pooledBytes -= BUFFER_CAPACITY(ptr);
+            return ptr;
+        }
+    }
+
+    void *block = NULL;
+    if (posix_memalign(&block, XMIPP_MEMORY_ALIGNMENT, bytes + XMIPP_MEMORY_ALIGNMENT) != 0)
+        throw std::bad_alloc();
+    char *ptr = (char *) block + XMIPP_MEMORY_ALIGNMENT;
+    BUFFER_CAPACITY(ptr) = bytes;
+    return ptr;
+}
+
+void freeAlignedMemory(void *ptr)
+{
+    if (ptr == NULL)
+        return;
+    size_t capacity = BUFFER_CAPACITY(ptr);
+    MemoryPoolState *pool = getActivePool();
+    if (pool != NULL && capacity >= XMIPP_POOL_MIN_BYTES &&
+        pool->stats.pooledBytes + capacity <= pool->maxPooledBytes)
+    {
+        try
+        {
+            // Round down to the size class
+            size_t step = sizeClassStep(capacity);
+            pool->bins[(capacity / step) * step].push_back((char *) ptr);
+            pool->stats.pooledBytes += capacity;
+            if (pool->stats.pooledBytes > pool->stats.peakPooledBytes)
+                pool->stats.peakPooledBytes = pool->stats.pooledBytes;
+            return;
+        }
+        catch (std::bad_alloc &)
+        {
+            // No memory for the bin, just free the buffer
+        }
+    }
+    free((char *) ptr - XMIPP_MEMORY_ALIGNMENT);
+}
+
+/* Bytes of a memory page, the bands of firstTouchZeros are multiple of it */
+#define FIRST_TOUCH_PAGE 4096
+
+struct FirstTouchArgs
+{
+    char *ptr;
+    size_t bytes;
+};
+
+static void firstTouchThread(ThreadArgument &thArg)
+{
+    FirstTouchArgs *args = (FirstTouchArgs *) thArg.data;
+    size_t pages = (args->bytes + FIRST_TOUCH_PAGE - 1) / FIRST_TOUCH_PAGE;
+    size_t first = (pages * thArg.thread_id) / thArg.threads * FIRST_TOUCH_PAGE;
+    size_t last = (pages * (thArg.thread_id + 1)) / thArg.threads * FIRST_TOUCH_PAGE;
+    if (last > args->bytes)
+        last = args->bytes;
+    if (first < last)
+        memset(args->ptr + first, 0, last - first);
+}
+
+void firstTouchZeros(void *ptr, size_t bytes, int nThreads)
+{
+    if (nThreads <= 1 || bytes < (size_t) nThreads * FIRST_TOUCH_PAGE)
+    {
+        memset(ptr, 0, bytes);
+        return;
+    }
+    FirstTouchArgs args;
+    args.ptr = (char *) ptr;
+    args.bytes = bytes;
+    ThreadManager thMgr(nThreads);
+    thMgr.run(firstTouchThread, &args);
+}
+
+MemoryPool::MemoryPool(size_t maxPooledBytes)
+{
+    enabled = maxPooledBytes > 0;
+    if (!enabled)
+        return;
+    MemoryPoolState *pool = getPoolState(true);
+    if (pool->users == 0)
+    {
+        pool->maxPooledBytes = maxPooledBytes;
+        memset(&pool->stats, 0, sizeof(MemoryPoolStats));
+    }
+    pool->users++;
+}
+
+MemoryPool::~MemoryPool()
+{
+    if (!enabled)
+        return;
+    MemoryPoolState *pool = getPoolState(false);
+    if (--pool->users == 0)
+        releasePoolBuffers(pool);
+}
+
+bool MemoryPool::isActive()
+{
+    return getActivePool() != NULL;
+}
+
+MemoryPoolStats MemoryPool::getStats()
+{
+    MemoryPoolStats stats;
+    MemoryPoolState *pool = getPoolState(false);
+    if (pool == NULL)
+        memset(&stats, 0, sizeof(MemoryPoolStats));
+    else
+        stats = pool->stats;
+    return stats;
+}
+
+size_t MemoryPool::getEnvironmentLimit()
+{
+    const char * env = getenv("XMIPP_MEMORY_POOL");
+    if (env == NULL || env[0] == '\0')
+        return 0;
+    char * end;
+    long mb = strtol(env, &end, 10);
+    if (*end != '\0' || mb < 0)
+    {
+        std::cerr << "Invalid XMIPP_MEMORY_POOL=" << env
+        << ", it must be the maximum size of the pool in MB" << std::endl;
+        return 0;
+    }
+    return ((size_t) mb) << 20;
+}
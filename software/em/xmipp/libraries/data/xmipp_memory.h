@@ -27,8 +27,16 @@
 #define _XMIPP_MEMORY
 
 #include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <complex>
 #include "xmipp_error.h"
 
+/** Alignment in bytes of the data of MultidimArray, Matrix1D and Matrix2D.
+ * It is a cache line, and it is enough for any SIMD register up to AVX-512.
+ */
+#define XMIPP_MEMORY_ALIGNMENT 64
+
 /* Memory managing --------------------------------------------------------- */
 ///@defgroup MemoryManaging Memory management for numerical recipes
 /// @ingroup DataLibrary
@@ -142,6 +150,141 @@ template <class T> void free_Tvolume(T *** &m, int nsl, int nsh,
 }
 
 
+/** Ask aligned memory for a number of bytes.
+ * See askAlignedMemory.
+ */
+void * askAlignedBytes(size_t bytes);
+
+/** Initialize n elements as new T[n] does.
+ * Numbers are not initialized, complex numbers are set to 0 by their
+ * constructor, see the overload below.
+ */
+template <class T> inline void initAlignedElements(T *, size_t)
+{}
+
+/** Initialize n complex numbers to 0, as their constructor does. */
+template <class T> inline void initAlignedElements(std::complex<T> *ptr, size_t n)
+{
+    if (ptr != NULL)
+        memset(ptr, 0, n * sizeof(std::complex<T>));
+}
+
+/** Ask aligned memory for n elements of type T.
+ * The memory is aligned to XMIPP_MEMORY_ALIGNMENT bytes and it is
+ * initialized as with new T[n]: numbers are left uninitialized and complex
+ * numbers are 0. T must be a plain type (numbers, complex...). As new T[n],
+ * std::bad_alloc is thrown if there is no memory. If the calling thread
+ * has a MemoryPool, large buffers are taken from it.
+ * Free it with freeAlignedMemory.
+ */
+template <class T> T* askAlignedMemory(size_t n)
+{
+    T* ptr = (T*) askAlignedBytes(n * sizeof(T));
+    initAlignedElements(ptr, n);
+    return ptr;
+}
+
+/** Free memory got with askAlignedMemory.
+ * NULL pointers are ignored. If the calling thread has a MemoryPool,
+ * large buffers are kept in it for later requests.
+ */
+void freeAlignedMemory(void *ptr);
+
+/** Set to zero a buffer from several threads.
+ * The buffer is split in nThreads contiguous bands of whole pages, and
+ * band i is zeroed by the worker i of a ThreadManager. In NUMA machines
+ * the pages of a fresh buffer are placed in the socket of the thread that
+ * touches them first, so with a thread affinity policy (see
+ * setThreadAffinityPolicy) the bands are spread over the sockets in the
+ * same way as the workers.
+ */
+void firstTouchZeros(void *ptr, size_t bytes, int nThreads);
+
+/** Minimum size in bytes of the buffers kept in a MemoryPool.
+ * Smaller requests always go to the system allocator.
+ */
+#define XMIPP_POOL_MIN_BYTES 65536
+
+/** Default maximum of bytes kept by the MemoryPool of a thread */
+#define XMIPP_POOL_MAX_BYTES (((size_t)1) << 30)
+
+/** Statistics of the MemoryPool of a thread. */
+struct MemoryPoolStats
+{
+    /// Requests of pool sized buffers
+    size_t requests;
+    /// Requests served with a pooled buffer
+    size_t hits;
+    /// Bytes currently kept in the pool
+    size_t pooledBytes;
+    /// Maximum of pooledBytes
+    size_t peakPooledBytes;
+
+    /// Fraction of the requests served by the pool
+    double hitRate() const
+    {
+        return (requests == 0) ? 0. : (double)hits / requests;
+    }
+};
+
+/** Pool of aligned buffers of the calling thread.
+ * This is the opt-in allocation policy for hot loops that create and destroy
+ * temporaries of the same shape. While a MemoryPool object is alive, the
+ * buffers freed by its thread (MultidimArray, Matrix1D, Matrix2D) are not
+ * returned to the system but kept in the pool, and later requests of the
+ * same size class are served from it without locks nor page faults.
+ * Sizes are rounded up to 4 classes per power of two.
+ *
+ * Pools may be nested, the buffers are released when the outermost one is
+ * destroyed. Buffers may be freed by any thread, with or without pool.
+ *
+ * @code
+ * MemoryPool pool;
+ * for (size_t n = 0; n < Nimgs; ++n)
+ *     alignImages(I1, I2(n), M);   // temporaries reuse the pooled buffers
+ * std::cout << "Hit rate: " << MemoryPool::getStats().hitRate() << std::endl;
+ * @endcode
+ */
+class MemoryPool
+{
+public:
+    /** Activate the pool in the calling thread.
+     * At most maxPooledBytes are kept, the rest of the freed buffers go back
+     * to the system. In nested pools the limit of the outermost one is used.
+     * With maxPooledBytes=0 the object does nothing, and the allocations
+     * of the thread are not changed.
+     */
+    MemoryPool(size_t maxPooledBytes = XMIPP_POOL_MAX_BYTES);
+
+    /** Deactivate the pool, the outermost one releases all the buffers. */
+    ~MemoryPool();
+
+    /** True if the calling thread has an active pool. */
+    static bool isActive();
+
+    /** Statistics of the pool of the calling thread.
+     * They are reset when the outermost pool is created. */
+    static MemoryPoolStats getStats();
+
+    /** Limit of the pools that the user asked for in the environment.
+     * XMIPP_MEMORY_POOL is the maximum size of the pool in MB. If it is not
+     * set the result is 0, so that a pool built with it does nothing.
+     *
+     * @code
+     * MemoryPool pool(MemoryPool::getEnvironmentLimit());
+     * @endcode
+     */
+    static size_t getEnvironmentLimit();
+
+private:
+    // False if the pool was built with a limit of 0 bytes
+    bool enabled;
+
+    // Pools are bound to a scope
+    MemoryPool(const MemoryPool &);
+    MemoryPool & operator=(const MemoryPool &);
+};
+
 /** Allocates memory.
  * Adapted from Bsofts bfree
  *
@@ -782,6 +782,10 @@ void XmippMetadataProgram::run()
         pathBaseName   = fullBaseName.getDir();
     }
 
+    // The temporaries of processImage may reuse their buffers from image to image,
+    // only if the user asked for it with XMIPP_MEMORY_POOL
+    MemoryPool pool(MemoryPool::getEnvironmentLimit());
+
     //FOR_ALL_OBJECTS_IN_METADATA(mdIn)
     while (getImageToProcess(objId, objIndex))
     {
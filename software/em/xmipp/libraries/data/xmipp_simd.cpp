@@ -0,0 +1,624 @@
+/***************************************************************************
+ *
+ * Authors:     Carlos Oscar S. Sorzano (coss@cnb.csic.es)
+ *
+ * Unidad de  Bioinformatica of Centro Nacional de Biotecnologia , CSIC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ *  All comments concerning this program package may be sent to the
+ *  e-mail address 'xmipp@cnb.csic.es'
+ ***************************************************************************/
+
+#include "xmipp_simd.h"
+
+// The vector kernels are compiled with target attributes, so that no
+// special compilation flag is needed and the CPU is checked at run time
+#if !defined(XMIPP_NO_SIMD) && (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define XMIPP_SIMD_AVX2
+#if defined(__clang__) || __GNUC__ >= 5
+#define XMIPP_SIMD_AVX512
+#endif
+#include <immintrin.h>
+#endif
+
+/* Instruction set --------------------------------------------------------- */
+static int simdSet = -1;
+static int simdSetMax = -1;
+
+static int detectSimdInstructionSet()
+{
+#ifdef XMIPP_SIMD_AVX2
+    __builtin_cpu_init();
+#ifdef XMIPP_SIMD_AVX512
+    if (__builtin_cpu_supports("avx512f"))
+        return SIMD_AVX512;
+#endif
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return SIMD_AVX2;
+#endif
+    return SIMD_SCALAR;
+}
+
+// All the threads would write the same value, so no lock is needed
+static inline int currentSimdSet()
+{
+    if (simdSet < 0)
+    {
+        simdSetMax = detectSimdInstructionSet();
+        simdSet = simdSetMax;
+    }
+    return simdSet;
+}
+
+SimdInstructionSet getSimdInstructionSet()
+{
+    return (SimdInstructionSet)currentSimdSet();
+}
+
+SimdInstructionSet setSimdInstructionSet(SimdInstructionSet set)
+{
+    currentSimdSet();
+    simdSet = (set < simdSetMax) ? (int)set : simdSetMax;
+    return (SimdInstructionSet)simdSet;
+}
+
+const char * simdInstructionSetName(SimdInstructionSet set)
+{
+    switch (set)
+    {
+    case SIMD_AVX2:
+        return "AVX2";
+    case SIMD_AVX512:
+        return "AVX-512";
+    default:
+        return "scalar";
+    }
+}
+
+/* AVX2 kernels ------------------------------------------------------------ */
+// Floats are converted to double when loaded, 4 values per register
+#ifdef XMIPP_SIMD_AVX2
+#define XMIPP_AVX2 __attribute__((target("avx2,fma")))
+
+XMIPP_AVX2 static inline __m256d avx2Load(const double *x)
+{
+    return _mm256_loadu_pd(x);
+}
+
+XMIPP_AVX2 static inline __m256d avx2Load(const float *x)
+{
+    return _mm256_cvtps_pd(_mm_loadu_ps(x));
+}
+
+XMIPP_AVX2 static inline void avx2Store(double *x, __m256d v)
+{
+    _mm256_storeu_pd(x, v);
+}
+
+XMIPP_AVX2 static inline void avx2Store(float *x, __m256d v)
+{
+    _mm_storeu_ps(x, _mm256_cvtpd_ps(v));
+}
+
+XMIPP_AVX2 static inline double avx2Sum(__m256d v)
+{
+    __m128d s = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+}
+
+XMIPP_AVX2 static inline double avx2Min(__m256d v)
+{
+    __m128d s = _mm_min_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_min_sd(s, _mm_unpackhi_pd(s, s)));
+}
+
+XMIPP_AVX2 static inline double avx2Max(__m256d v)
+{
+    __m128d s = _mm_max_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_max_sd(s, _mm_unpackhi_pd(s, s)));
+}
+
+template <typename T, bool MINMAX>
+XMIPP_AVX2 static void avx2Stats(const T *x, size_t n, double &sum, double &sum2,
+                                 double &minval, double &maxval)
+{
+    __m256d s0 = _mm256_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+    __m256d q0 = s0, q1 = s0, q2 = s0, q3 = s0;
+    __m256d vmin = _mm256_set1_pd(x[0]), vmax = vmin;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256d v0 = avx2Load(x + i);
+        __m256d v1 = avx2Load(x + i + 4);
+        __m256d v2 = avx2Load(x + i + 8);
+        __m256d v3 = avx2Load(x + i + 12);
+        s0 = _mm256_add_pd(s0, v0);
+        s1 = _mm256_add_pd(s1, v1);
+        s2 = _mm256_add_pd(s2, v2);
+        s3 = _mm256_add_pd(s3, v3);
+        q0 = _mm256_fmadd_pd(v0, v0, q0);
+        q1 = _mm256_fmadd_pd(v1, v1, q1);
+        q2 = _mm256_fmadd_pd(v2, v2, q2);
+        q3 = _mm256_fmadd_pd(v3, v3, q3);
+        if (MINMAX)
+        {
+            vmin = _mm256_min_pd(vmin, _mm256_min_pd(_mm256_min_pd(v0, v1), _mm256_min_pd(v2, v3)));
+            vmax = _mm256_max_pd(vmax, _mm256_max_pd(_mm256_max_pd(v0, v1), _mm256_max_pd(v2, v3)));
+        }
+    }
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256d v = avx2Load(x + i);
+        s0 = _mm256_add_pd(s0, v);
+        q0 = _mm256_fmadd_pd(v, v, q0);
+        if (MINMAX)
+        {
+            vmin = _mm256_min_pd(vmin, v);
+            vmax = _mm256_max_pd(vmax, v);
+        }
+    }
+    double s = avx2Sum(_mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3)));
+    double q = avx2Sum(_mm256_add_pd(_mm256_add_pd(q0, q1), _mm256_add_pd(q2, q3)));
+    double mn = avx2Min(vmin), mx = avx2Max(vmax);
+    for (; i < n; ++i)
+    {
+        double v = x[i];
+        s += v;
+        q += v * v;
+        if (MINMAX)
+        {
+            if (v < mn)
+                mn = v;
+            if (v > mx)
+                mx = v;
+        }
+    }
+    sum = s;
+    sum2 = q;
+    if (MINMAX)
+    {
+        minval = mn;
+        maxval = mx;
+    }
+}
+
+template <typename T>
+XMIPP_AVX2 static double avx2Sum(const T *x, size_t n)
+{
+    __m256d s0 = _mm256_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        s0 = _mm256_add_pd(s0, avx2Load(x + i));
+        s1 = _mm256_add_pd(s1, avx2Load(x + i + 4));
+        s2 = _mm256_add_pd(s2, avx2Load(x + i + 8));
+        s3 = _mm256_add_pd(s3, avx2Load(x + i + 12));
+    }
+    for (; i + 4 <= n; i += 4)
+        s0 = _mm256_add_pd(s0, avx2Load(x + i));
+    double s = avx2Sum(_mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3)));
+    for (; i < n; ++i)
+        s += x[i];
+    return s;
+}
+
+template <typename T>
+XMIPP_AVX2 static double avx2Dot(const T *x, const T *y, size_t n)
+{
+    __m256d s0 = _mm256_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        s0 = _mm256_fmadd_pd(avx2Load(x + i), avx2Load(y + i), s0);
+        s1 = _mm256_fmadd_pd(avx2Load(x + i + 4), avx2Load(y + i + 4), s1);
+        s2 = _mm256_fmadd_pd(avx2Load(x + i + 8), avx2Load(y + i + 8), s2);
+        s3 = _mm256_fmadd_pd(avx2Load(x + i + 12), avx2Load(y + i + 12), s3);
+    }
+    for (; i + 4 <= n; i += 4)
+        s0 = _mm256_fmadd_pd(avx2Load(x + i), avx2Load(y + i), s0);
+    double s = avx2Sum(_mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3)));
+    for (; i < n; ++i)
+        s += (double)x[i] * y[i];
+    return s;
+}
+
+template <typename T>
+XMIPP_AVX2 static void avx2Affine(T *x, size_t n, double a, double b)
+{
+    __m256d va = _mm256_set1_pd(a), vb = _mm256_set1_pd(b);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        avx2Store(x + i, _mm256_fmadd_pd(avx2Load(x + i), va, vb));
+    for (; i < n; ++i)
+        x[i] = static_cast< T >(a * x[i] + b);
+}
+#endif
+
+/* AVX-512 kernels --------------------------------------------------------- */
+// Floats are converted to double when loaded, 8 values per register
+#ifdef XMIPP_SIMD_AVX512
+#define XMIPP_AVX512 __attribute__((target("avx512f,avx2,fma")))
+
+XMIPP_AVX512 static inline __m512d avx512Load(const double *x)
+{
+    return _mm512_loadu_pd(x);
+}
+
+XMIPP_AVX512 static inline __m512d avx512Load(const float *x)
+{
+    return _mm512_cvtps_pd(_mm256_loadu_ps(x));
+}
+
+XMIPP_AVX512 static inline void avx512Store(double *x, __m512d v)
+{
+    _mm512_storeu_pd(x, v);
+}
+
+XMIPP_AVX512 static inline void avx512Store(float *x, __m512d v)
+{
+    _mm256_storeu_ps(x, _mm512_cvtpd_ps(v));
+}
+
+XMIPP_AVX512 static inline double avx512Sum(__m512d v)
+{
+    __m256d s = _mm256_add_pd(_mm512_castpd512_pd256(v), _mm512_extractf64x4_pd(v, 1));
+    __m128d s2 = _mm_add_pd(_mm256_castpd256_pd128(s), _mm256_extractf128_pd(s, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(s2, _mm_unpackhi_pd(s2, s2)));
+}
+
+XMIPP_AVX512 static inline double avx512Min(__m512d v)
+{
+    __m256d s = _mm256_min_pd(_mm512_castpd512_pd256(v), _mm512_extractf64x4_pd(v, 1));
+    __m128d s2 = _mm_min_pd(_mm256_castpd256_pd128(s), _mm256_extractf128_pd(s, 1));
+    return _mm_cvtsd_f64(_mm_min_sd(s2, _mm_unpackhi_pd(s2, s2)));
+}
+
+XMIPP_AVX512 static inline double avx512Max(__m512d v)
+{
+    __m256d s = _mm256_max_pd(_mm512_castpd512_pd256(v), _mm512_extractf64x4_pd(v, 1));
+    __m128d s2 = _mm_max_pd(_mm256_castpd256_pd128(s), _mm256_extractf128_pd(s, 1));
+    return _mm_cvtsd_f64(_mm_max_sd(s2, _mm_unpackhi_pd(s2, s2)));
+}
+
+template <typename T, bool MINMAX>
+XMIPP_AVX512 static void avx512Stats(const T *x, size_t n, double &sum, double &sum2,
+                                     double &minval, double &maxval)
+{
+    __m512d s0 = _mm512_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+    __m512d q0 = s0, q1 = s0, q2 = s0, q3 = s0;
+    __m512d vmin = _mm512_set1_pd(x[0]), vmax = vmin;
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m512d v0 = avx512Load(x + i);
+        __m512d v1 = avx512Load(x + i + 8);
+        __m512d v2 = avx512Load(x + i + 16);
+        __m512d v3 = avx512Load(x + i + 24);
+        s0 = _mm512_add_pd(s0, v0);
+        s1 = _mm512_add_pd(s1, v1);
+        s2 = _mm512_add_pd(s2, v2);
+        s3 = _mm512_add_pd(s3, v3);
+        q0 = _mm512_fmadd_pd(v0, v0, q0);
+        q1 = _mm512_fmadd_pd(v1, v1, q1);
+        q2 = _mm512_fmadd_pd(v2, v2, q2);
+        q3 = _mm512_fmadd_pd(v3, v3, q3);
+        if (MINMAX)
+        {
+            vmin = _mm512_min_pd(vmin, _mm512_min_pd(_mm512_min_pd(v0, v1), _mm512_min_pd(v2, v3)));
+            vmax = _mm512_max_pd(vmax, _mm512_max_pd(_mm512_max_pd(v0, v1), _mm512_max_pd(v2, v3)));
+        }
+    }
+    for (; i + 8 <= n; i += 8)
+    {
+        __m512d v = avx512Load(x + i);
+        s0 = _mm512_add_pd(s0, v);
+        q0 = _mm512_fmadd_pd(v, v, q0);
+        if (MINMAX)
+        {
+            vmin = _mm512_min_pd(vmin, v);
+            vmax = _mm512_max_pd(vmax, v);
+        }
+    }
+    double s = avx512Sum(_mm512_add_pd(_mm512_add_pd(s0, s1), _mm512_add_pd(s2, s3)));
+    double q = avx512Sum(_mm512_add_pd(_mm512_add_pd(q0, q1), _mm512_add_pd(q2, q3)));
+    double mn = avx512Min(vmin), mx = avx512Max(vmax);
+    for (; i < n; ++i)
+    {
+        double v = x[i];
+        s += v;
+        q += v * v;
+        if (MINMAX)
+        {
+            if (v < mn)
+                mn = v;
+            if (v > mx)
+                mx = v;
+        }
+    }
+    sum = s;
+    sum2 = q;
+    if (MINMAX)
+    {
+        minval = mn;
+        maxval = mx;
+    }
+}
+
+template <typename T>
+XMIPP_AVX512 static double avx512Sum(const T *x, size_t n)
+{
+    __m512d s0 = _mm512_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        s0 = _mm512_add_pd(s0, avx512Load(x + i));
+        s1 = _mm512_add_pd(s1, avx512Load(x + i + 8));
+        s2 = _mm512_add_pd(s2, avx512Load(x + i + 16));
+        s3 = _mm512_add_pd(s3, avx512Load(x + i + 24));
+    }
+    for (; i + 8 <= n; i += 8)
+        s0 = _mm512_add_pd(s0, avx512Load(x + i));
+    double s = avx512Sum(_mm512_add_pd(_mm512_add_pd(s0, s1), _mm512_add_pd(s2, s3)));
+    for (; i < n; ++i)
+        s += x[i];
+    return s;
+}
+
+template <typename T>
+XMIPP_AVX512 static double avx512Dot(const T *x, const T *y, size_t n)
+{
+    __m512d s0 = _mm512_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        s0 = _mm512_fmadd_pd(avx512Load(x + i), avx512Load(y + i), s0);
+        s1 = _mm512_fmadd_pd(avx512Load(x + i + 8), avx512Load(y + i + 8), s1);
+        s2 = _mm512_fmadd_pd(avx512Load(x + i + 16), avx512Load(y + i + 16), s2);
+        s3 = _mm512_fmadd_pd(avx512Load(x + i + 24), avx512Load(y + i + 24), s3);
+    }
+    for (; i + 8 <= n; i += 8)
+        s0 = _mm512_fmadd_pd(avx512Load(x + i), avx512Load(y + i), s0);
+    double s = avx512Sum(_mm512_add_pd(_mm512_add_pd(s0, s1), _mm512_add_pd(s2, s3)));
+    for (; i < n; ++i)
+        s += (double)x[i] * y[i];
+    return s;
+}
+
+template <typename T>
+XMIPP_AVX512 static void avx512Affine(T *x, size_t n, double a, double b)
+{
+    __m512d va = _mm512_set1_pd(a), vb = _mm512_set1_pd(b);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        avx512Store(x + i, _mm512_fmadd_pd(avx512Load(x + i), va, vb));
+    for (; i < n; ++i)
+        x[i] = static_cast< T >(a * x[i] + b);
+}
+#endif
+
+/* Dispatch ---------------------------------------------------------------- */
+// The sums of the scalar path are accumulated in double also for floats
+template <typename T>
+static inline void scalarSumSum2(const T *x, size_t n, double &sum, double &sum2)
+{
+    simdSumSum2<T>(x, n, sum, sum2);
+}
+
+template <typename T>
+static inline double scalarDot(const T *x, const T *y, size_t n)
+{
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t nmax = (n / 4) * 4;
+    for (size_t i = 0; i < nmax; i += 4)
+    {
+        s0 += (double)x[i] * y[i];
+        s1 += (double)x[i+1] * y[i+1];
+        s2 += (double)x[i+2] * y[i+2];
+        s3 += (double)x[i+3] * y[i+3];
+    }
+    for (size_t i = nmax; i < n; ++i)
+        s0 += (double)x[i] * y[i];
+    return (s0 + s1) + (s2 + s3);
+}
+
+template <typename T>
+static inline void dispatchSumSum2(const T *x, size_t n, double &sum, double &sum2)
+{
+    double dummy;
+    switch (currentSimdSet())
+    {
+#ifdef XMIPP_SIMD_AVX512
+    case SIMD_AVX512:
+        if (n > 0)
+        {
+            avx512Stats<T, false>(x, n, sum, sum2, dummy, dummy);
+            return;
+        }
+        break;
+#endif
+#ifdef XMIPP_SIMD_AVX2
+    case SIMD_AVX2:
+        if (n > 0)
+        {
+            avx2Stats<T, false>(x, n, sum, sum2, dummy, dummy);
+            return;
+        }
+        break;
+#endif
+    default:
+        break;
+    }
+    scalarSumSum2(x, n, sum, sum2);
+}
+
+template <typename T>
+static inline double dispatchSum(const T *x, size_t n)
+{
+    switch (currentSimdSet())
+    {
+#ifdef XMIPP_SIMD_AVX512
+    case SIMD_AVX512:
+        return avx512Sum(x, n);
+#endif
+#ifdef XMIPP_SIMD_AVX2
+    case SIMD_AVX2:
+        return avx2Sum(x, n);
+#endif
+    default:
+        return simdSum<T>(x, n);
+    }
+}
+
+template <typename T>
+static inline void dispatchStats(const T *x, size_t n, double &sum, double &sum2, T &minval, T &maxval)
+{
+    double mn, mx;
+    switch (currentSimdSet())
+    {
+#ifdef XMIPP_SIMD_AVX512
+    case SIMD_AVX512:
+        avx512Stats<T, true>(x, n, sum, sum2, mn, mx);
+        break;
+#endif
+#ifdef XMIPP_SIMD_AVX2
+    case SIMD_AVX2:
+        avx2Stats<T, true>(x, n, sum, sum2, mn, mx);
+        break;
+#endif
+    default:
+        scalarSumSum2(x, n, sum, sum2);
+        simdMinMax<T>(x, n, minval, maxval);
+        return;
+    }
+    minval = static_cast< T >(mn);
+    maxval = static_cast< T >(mx);
+}
+
+template <typename T>
+static inline double dispatchDot(const T *x, const T *y, size_t n)
+{
+    switch (currentSimdSet())
+    {
+#ifdef XMIPP_SIMD_AVX512
+    case SIMD_AVX512:
+        return avx512Dot(x, y, n);
+#endif
+#ifdef XMIPP_SIMD_AVX2
+    case SIMD_AVX2:
+        return avx2Dot(x, y, n);
+#endif
+    default:
+        return scalarDot(x, y, n);
+    }
+}
+
+template <typename T>
+static inline void dispatchAffine(T *x, size_t n, double a, double b)
+{
+    switch (currentSimdSet())
+    {
+#ifdef XMIPP_SIMD_AVX512
+    case SIMD_AVX512:
+        avx512Affine(x, n, a, b);
+        break;
+#endif
+#ifdef XMIPP_SIMD_AVX2
+    case SIMD_AVX2:
+        avx2Affine(x, n, a, b);
+        break;
+#endif
+    default:
+        simdAffine<T>(x, n, a, b);
+    }
+}
+
+void simdSumSum2(const double *x, size_t n, double &sum, double &sum2)
+{
+    dispatchSumSum2(x, n, sum, sum2);
+}
+
+void simdSumSum2(const float *x, size_t n, double &sum, double &sum2)
+{
+    dispatchSumSum2(x, n, sum, sum2);
+}
+
+double simdSum(const double *x, size_t n)
+{
+    return dispatchSum(x, n);
+}
+
+double simdSum(const float *x, size_t n)
+{
+    return dispatchSum(x, n);
+}
+
+double simdSum2(const double *x, size_t n)
+{
+    double sum, sum2;
+    dispatchSumSum2(x, n, sum, sum2);
+    return sum2;
+}
+
+double simdSum2(const float *x, size_t n)
+{
+    double sum, sum2;
+    dispatchSumSum2(x, n, sum, sum2);
+    return sum2;
+}
+
+void simdMinMax(const double *x, size_t n, double &minval, double &maxval)
+{
+    double sum, sum2;
+    dispatchStats(x, n, sum, sum2, minval, maxval);
+}
+
+void simdMinMax(const float *x, size_t n, float &minval, float &maxval)
+{
+    double sum, sum2;
+    dispatchStats(x, n, sum, sum2, minval, maxval);
+}
+
+void simdStats(const double *x, size_t n, double &sum, double &sum2, double &minval, double &maxval)
+{
+    dispatchStats(x, n, sum, sum2, minval, maxval);
+}
+
+void simdStats(const float *x, size_t n, double &sum, double &sum2, float &minval, float &maxval)
+{
+    dispatchStats(x, n, sum, sum2, minval, maxval);
+}
+
+double simdDot(const double *x, const double *y, size_t n)
+{
+    return dispatchDot(x, y, n);
+}
+
+double simdDot(const float *x, const float *y, size_t n)
+{
+    return dispatchDot(x, y, n);
+}
+
+void simdAffine(double *x, size_t n, double a, double b)
+{
+    dispatchAffine(x, n, a, b);
+}
+
+void simdAffine(float *x, size_t n, double a, double b)
+{
+    dispatchAffine(x, n, a, b);
+}
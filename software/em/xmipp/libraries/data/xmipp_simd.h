@@ -0,0 +1,218 @@
+/***************************************************************************
+ *
+ * Authors:     Carlos Oscar S. Sorzano (coss@cnb.csic.es)
+ *
+ * Unidad de  Bioinformatica of Centro Nacional de Biotecnologia , CSIC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ *  All comments concerning this program package may be sent to the
+ *  e-mail address 'xmipp@cnb.csic.es'
+ ***************************************************************************/
+
+#ifndef _XMIPP_SIMD
+#define _XMIPP_SIMD
+
+#include <stddef.h>
+
+/* Vectorized reductions --------------------------------------------------- */
+///@defgroup SimdReductions Vectorized reductions
+/// @ingroup DataLibrary
+//@{
+/** These are the kernels behind the statistics of MultidimArray (sum, sum2,
+ * computeAvgStdev, computeStats, computeDoubleMinMax, statisticsAdjust,
+ * dotProduct) and of the correlations in filters.h.
+ *
+ * The double and float versions are vectorized with AVX2 or AVX-512. The
+ * instruction set is chosen at run time from the CPU, so that the same
+ * binary runs on any x86 machine. The sums are always accumulated in double
+ * and in several independent accumulators, which is faster and more
+ * accurate than a single running sum. For the rest of types, and when no
+ * vector instruction set is available, the templates below are used.
+ *
+ * Define XMIPP_NO_SIMD at compilation time to disable the vector kernels.
+ */
+
+/** Instruction sets of the reduction kernels. */
+enum SimdInstructionSet
+{
+    SIMD_SCALAR = 0,
+    SIMD_AVX2 = 1,
+    SIMD_AVX512 = 2
+};
+
+/** Instruction set in use.
+ * By default it is the best one supported by the CPU.
+ */
+SimdInstructionSet getSimdInstructionSet();
+
+/** Choose the instruction set.
+ * This is meant for testing and benchmarking. Sets not supported by the
+ * CPU are lowered to the best supported one, which is returned.
+ */
+SimdInstructionSet setSimdInstructionSet(SimdInstructionSet set);
+
+/** Name of an instruction set. */
+const char * simdInstructionSetName(SimdInstructionSet set);
+
+/** Sum and sum of squares of n values. */
+template <typename T>
+void simdSumSum2(const T *x, size_t n, double &sum, double &sum2)
+{
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    double q0 = 0, q1 = 0, q2 = 0, q3 = 0;
+    size_t nmax = (n / 4) * 4;
+    for (size_t i = 0; i < nmax; i += 4)
+    {
+        double v0 = x[i], v1 = x[i+1], v2 = x[i+2], v3 = x[i+3];
+        s0 += v0;
+        s1 += v1;
+        s2 += v2;
+        s3 += v3;
+        q0 += v0 * v0;
+        q1 += v1 * v1;
+        q2 += v2 * v2;
+        q3 += v3 * v3;
+    }
+    for (size_t i = nmax; i < n; ++i)
+    {
+        double v = x[i];
+        s0 += v;
+        q0 += v * v;
+    }
+    sum = (s0 + s1) + (s2 + s3);
+    sum2 = (q0 + q1) + (q2 + q3);
+}
+void simdSumSum2(const double *x, size_t n, double &sum, double &sum2);
+void simdSumSum2(const float *x, size_t n, double &sum, double &sum2);
+
+/** Sum of n values. */
+template <typename T>
+double simdSum(const T *x, size_t n)
+{
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t nmax = (n / 4) * 4;
+    for (size_t i = 0; i < nmax; i += 4)
+    {
+        s0 += x[i];
+        s1 += x[i+1];
+        s2 += x[i+2];
+        s3 += x[i+3];
+    }
+    for (size_t i = nmax; i < n; ++i)
+        s0 += x[i];
+    return (s0 + s1) + (s2 + s3);
+}
+double simdSum(const double *x, size_t n);
+double simdSum(const float *x, size_t n);
+
+/** Sum of the squares of n values.
+ * For the generic types the square is computed in the type of the array.
+ */
+template <typename T>
+double simdSum2(const T *x, size_t n)
+{
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t nmax = (n / 4) * 4;
+    for (size_t i = 0; i < nmax; i += 4)
+    {
+        s0 += x[i] * x[i];
+        s1 += x[i+1] * x[i+1];
+        s2 += x[i+2] * x[i+2];
+        s3 += x[i+3] * x[i+3];
+    }
+    for (size_t i = nmax; i < n; ++i)
+        s0 += x[i] * x[i];
+    return (s0 + s1) + (s2 + s3);
+}
+double simdSum2(const double *x, size_t n);
+double simdSum2(const float *x, size_t n);
+
+/** Minimum and maximum of n values (n>0). */
+template <typename T>
+void simdMinMax(const T *x, size_t n, T &minval, T &maxval)
+{
+    T Tmin = x[0], Tmax = x[0];
+    for (size_t i = 1; i < n; ++i)
+    {
+        T val = x[i];
+        if (val < Tmin)
+            Tmin = val;
+        else if (val > Tmax)
+            Tmax = val;
+    }
+    minval = Tmin;
+    maxval = Tmax;
+}
+void simdMinMax(const double *x, size_t n, double &minval, double &maxval);
+void simdMinMax(const float *x, size_t n, float &minval, float &maxval);
+
+/** Sum, sum of squares, minimum and maximum of n values (n>0) in one pass. */
+template <typename T>
+void simdStats(const T *x, size_t n, double &sum, double &sum2, T &minval, T &maxval)
+{
+    double s = 0, q = 0;
+    T Tmin = x[0], Tmax = x[0];
+    for (size_t i = 0; i < n; ++i)
+    {
+        T Tval = x[i];
+        double val = Tval;
+        s += val;
+        q += val * val;
+        if (Tval > Tmax)
+            Tmax = Tval;
+        else if (Tval < Tmin)
+            Tmin = Tval;
+    }
+    sum = s;
+    sum2 = q;
+    minval = Tmin;
+    maxval = Tmax;
+}
+void simdStats(const double *x, size_t n, double &sum, double &sum2, double &minval, double &maxval);
+void simdStats(const float *x, size_t n, double &sum, double &sum2, float &minval, float &maxval);
+
+/** Dot product of two vectors of n values. */
+template <typename T>
+double simdDot(const T *x, const T *y, size_t n)
+{
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t nmax = (n / 4) * 4;
+    for (size_t i = 0; i < nmax; i += 4)
+    {
+        s0 += x[i] * y[i];
+        s1 += x[i+1] * y[i+1];
+        s2 += x[i+2] * y[i+2];
+        s3 += x[i+3] * y[i+3];
+    }
+    for (size_t i = nmax; i < n; ++i)
+        s0 += x[i] * y[i];
+    return (s0 + s1) + (s2 + s3);
+}
+double simdDot(const double *x, const double *y, size_t n);
+double simdDot(const float *x, const float *y, size_t n);
+
+/** x = a * x + b for n values. */
+template <typename T>
+void simdAffine(T *x, size_t n, double a, double b)
+{
+    for (size_t i = 0; i < n; ++i)
+        x[i] = static_cast< T >(a * x[i] + b);
+}
+void simdAffine(double *x, size_t n, double a, double b);
+void simdAffine(float *x, size_t n, double a, double b);
+//@}
+#endif
@@ -24,7 +24,15 @@
  ***************************************************************************/
 
 #include <stdio.h>
+#include <string.h>
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <map>
+#ifdef __linux__
+#include <sched.h>
+#endif
 
 #include "xmipp_threads.h"
 #include "xmipp_error.h"
@@ -48,6 +56,11 @@ void Mutex::lock()
     pthread_mutex_lock(&mutex);
 }
 
+bool Mutex::tryLock()
+{
+    return pthread_mutex_trylock(&mutex) == 0;
+}
+
 void Mutex::unlock()
 {
     pthread_mutex_unlock(&mutex);
@@ -174,6 +187,7 @@ void * _threadMain(void * data)
 {
     ThreadArgument * thArg = (ThreadArgument*) data;
     ThreadManager * thMgr = thArg->manager;
+    applyThreadAffinity(thArg->thread_id);
 
     while (true)
     {
@@ -184,6 +198,7 @@ void * _threadMain(void * data)
         {
             try
             {
+                logThreadPlacement(thArg->thread_id);
                 thMgr->workFunction(*thArg);
                 thMgr->wait(); //wait for finish together
             }
@@ -362,6 +377,197 @@ bool ThreadTaskDistributor::distribute(size_t &first, size_t &last)
     return result;
 }
 
+// =================== THREAD PLACEMENT ============================
+/* Cores available to the process grouped by socket */
+struct CpuTopology
+{
+    std::vector< std::vector<int> > socketCpus; // cpus of each socket
+    std::map<int, int> cpuSocket;               // socket of each cpu
+};
+
+static CpuTopology topology;
+static pthread_once_t topologyOnce = PTHREAD_ONCE_INIT;
+static int affinityPolicy = -1;
+static Mutex placementMutex;
+
+/* Placement of one worker */
+struct WorkerPlacement
+{
+    int lastCpu;
+    std::vector<size_t> tasksPerSocket;
+};
+static std::vector<WorkerPlacement> placementLog;
+
+static void readTopology()
+{
+#ifdef __linux__
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (sched_getaffinity(0, sizeof(mask), &mask) != 0)
+        return;
+    std::map<int, int> packageIndex;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+        if (!CPU_ISSET(cpu, &mask))
+            continue;
+        std::ostringstream fn;
+        fn << "/sys/devices/system/cpu/cpu" << cpu << "/topology/physical_package_id";
+        std::ifstream fh(fn.str().c_str());
+        int package = 0;
+        if (!(fh >> package))
+            package = 0;
+        std::map<int, int>::iterator it = packageIndex.find(package);
+        int socket;
+        if (it == packageIndex.end())
+        {
+            socket = packageIndex.size();
+            packageIndex[package] = socket;
+            topology.socketCpus.push_back(std::vector<int>());
+        }
+        else
+            socket = it->second;
+        topology.socketCpus[socket].push_back(cpu);
+        topology.cpuSocket[cpu] = socket;
+    }
+#endif
+}
+
+static const CpuTopology & getTopology()
+{
+    pthread_once(&topologyOnce, readTopology);
+    return topology;
+}
+
+void setThreadAffinityPolicy(ThreadAffinityPolicy policy)
+{
+    affinityPolicy = policy;
+}
+
+ThreadAffinityPolicy getThreadAffinityPolicy()
+{
+    if (affinityPolicy < 0)
+    {
+        int policy = AFFINITY_NONE;
+        const char * env = getenv("XMIPP_THREAD_AFFINITY");
+        if (env != NULL)
+        {
+            if (strcmp(env, "cores") == 0)
+                policy = AFFINITY_CORES;
+            else if (strcmp(env, "sockets") == 0)
+                policy = AFFINITY_SOCKETS;
+            else if (strcmp(env, "none") != 0 && env[0] != '\0')
+                std::cerr << "Unknown XMIPP_THREAD_AFFINITY=" << env
+                << ", valid values are none, cores and sockets" << std::endl;
+        }
+        affinityPolicy = policy;
+    }
+    return (ThreadAffinityPolicy) affinityPolicy;
+}
+
+int getNumberOfSockets()
+{
+    size_t n = getTopology().socketCpus.size();
+    return (n == 0) ? 1 : (int) n;
+}
+
+int getCurrentSocket()
+{
+#ifdef __linux__
+    int cpu = sched_getcpu();
+    const CpuTopology &topo = getTopology();
+    std::map<int, int>::const_iterator it = topo.cpuSocket.find(cpu);
+    if (it != topo.cpuSocket.end())
+        return it->second;
+#endif
+    return 0;
+}
+
+int applyThreadAffinity(int worker)
+{
+    ThreadAffinityPolicy policy = getThreadAffinityPolicy();
+    if (policy == AFFINITY_NONE || worker < 0)
+        return -1;
+    int socket = -1;
+#ifdef __linux__
+    const CpuTopology &topo = getTopology();
+    size_t nSockets = topo.socketCpus.size();
+    if (nSockets == 0)
+        return -1;
+    socket = worker % nSockets;
+    const std::vector<int> &cpus = topo.socketCpus[socket];
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (policy == AFFINITY_CORES)
+        CPU_SET(cpus[(worker / nSockets) % cpus.size()], &mask);
+    else
+        for (size_t i = 0; i < cpus.size(); ++i)
+            CPU_SET(cpus[i], &mask);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask) != 0)
+        socket = -1;
+#endif
+    return socket;
+}
+
+void logThreadPlacement(int worker)
+{
+    if (worker < 0 || getThreadAffinityPolicy() == AFFINITY_NONE)
+        return;
+    int cpu = -1;
+#ifdef __linux__
+    cpu = sched_getcpu();
+#endif
+    int socket = getCurrentSocket();
+    placementMutex.lock();
+    if ((size_t) worker >= placementLog.size())
+    {
+        WorkerPlacement empty;
+        empty.lastCpu = -1;
+        placementLog.resize(worker + 1, empty);
+    }
+    WorkerPlacement &placement = placementLog[worker];
+    if ((size_t) socket >= placement.tasksPerSocket.size())
+        placement.tasksPerSocket.resize(socket + 1, 0);
+    placement.tasksPerSocket[socket]++;
+    placement.lastCpu = cpu;
+    placementMutex.unlock();
+}
+
+void threadPlacementReport(std::ostream &out)
+{
+    static const char * policyNames[] = {"none", "cores", "sockets"};
+    int nSockets = getNumberOfSockets();
+    std::vector<size_t> socketTotal(nSockets, 0);
+    placementMutex.lock();
+    out << "Thread placement (affinity " << policyNames[getThreadAffinityPolicy()]
+    << ", " << nSockets << " sockets)" << std::endl;
+    for (size_t w = 0; w < placementLog.size(); ++w)
+    {
+        const WorkerPlacement &placement = placementLog[w];
+        if (placement.lastCpu < 0 && placement.tasksPerSocket.empty())
+            continue;
+        out << "   worker " << w << ": last cpu " << placement.lastCpu << ", tasks per socket";
+        for (size_t s = 0; s < placement.tasksPerSocket.size(); ++s)
+        {
+            out << " " << s << ":" << placement.tasksPerSocket[s];
+            if (s < socketTotal.size())
+                socketTotal[s] += placement.tasksPerSocket[s];
+        }
+        out << std::endl;
+    }
+    placementMutex.unlock();
+    out << "   total tasks per socket";
+    for (int s = 0; s < nSockets; ++s)
+        out << " " << s << ":" << socketTotal[s];
+    out << std::endl;
+}
+
+void clearThreadPlacement()
+{
+    placementMutex.lock();
+    placementLog.clear();
+    placementMutex.unlock();
+}
+
 // =================== OLD THREADS IMPLEMENTATION ============================
 int barrier_init(barrier_t *barrier,int needed)
 {
@@ -29,6 +29,7 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <iosfwd>
 
 class ThreadManager;
 class ThreadArgument;
@@ -71,6 +72,12 @@ public:
      */
     virtual void lock();
 
+    /** Function to get the access to the mutex without waiting.
+     * It returns false if another thread has the mutex, and in
+     * that case the mutex is not taken.
+     */
+    virtual bool tryLock();
+
     /** Function to release the mutex.
      * This allow the access to the mutex to other
      * threads that are waiting for it.
@@ -466,6 +473,82 @@ public:
 }
 ;//end of class ThreadTaskDistributor
 
+/** @name Thread placement
+ * On machines with several sockets (NUMA nodes) the memory of a page lives
+ * in the socket of the thread that touched it first. Threads that work on
+ * memory of another socket pay the remote latency and share its bandwidth.
+ *
+ * The placement of the workers is opt-in. With the AFFINITY_CORES policy
+ * each worker is pinned to one core, with AFFINITY_SOCKETS it is pinned to
+ * all the cores of one socket. In both cases the workers are distributed
+ * round-robin over the sockets, worker i goes to socket i%Nsockets. The
+ * default policy is read from the environment variable
+ * XMIPP_THREAD_AFFINITY (none, cores or sockets), so that existing programs
+ * can use it without new parameters.
+ *
+ * The workers of ThreadManager apply the policy when they are created.
+ * Threads created directly with pthread_create should call
+ * applyThreadAffinity at their start. Large arrays should be initialized
+ * by the same workers (see firstTouchZeros and
+ * MultidimArray::initZerosFirstTouch) so that each part of them lives in
+ * the socket of the worker that will process it.
+ *
+ * @code
+ * setThreadAffinityPolicy(AFFINITY_SOCKETS);
+ * V.initZerosFirstTouch(Zdim, Ydim, Xdim, Nthreads);
+ * ThreadManager thMgr(Nthreads);
+ * thMgr.run(processSlabs, &V);
+ * threadPlacementReport(std::cout);
+ * @endcode
+ */
+//@{
+/** Thread affinity policies */
+enum ThreadAffinityPolicy
+{
+    AFFINITY_NONE = 0,   ///< The system decides
+    AFFINITY_CORES = 1,  ///< Each worker is pinned to one core
+    AFFINITY_SOCKETS = 2 ///< Each worker is pinned to the cores of one socket
+};
+
+/** Set the affinity policy of the workers created from now on. */
+void setThreadAffinityPolicy(ThreadAffinityPolicy policy);
+
+/** Affinity policy.
+ * The first time it is taken from XMIPP_THREAD_AFFINITY.
+ */
+ThreadAffinityPolicy getThreadAffinityPolicy();
+
+/** Number of sockets with cores available to this process. */
+int getNumberOfSockets();
+
+/** Socket in which the calling thread is running now, 0 if unknown. */
+int getCurrentSocket();
+
+/** Pin the calling thread as the worker with the given index.
+ * The current policy is used, nothing is done with AFFINITY_NONE or
+ * when the affinity cannot be set in this system. The socket assigned
+ * to the worker is returned, -1 if the thread has not been pinned.
+ */
+int applyThreadAffinity(int worker);
+
+/** Record the cpu and socket in which a worker is running now.
+ * The workers of ThreadManager call it at each task, threads created
+ * with pthread_create should call it for each block of work. Nothing is
+ * recorded with AFFINITY_NONE, so that programs that do not ask for a
+ * placement do not pay for it.
+ */
+void logThreadPlacement(int worker);
+
+/** Print the sockets in which the workers have run.
+ * For each worker index, the number of tasks executed in each socket and
+ * the last cpu are shown.
+ */
+void threadPlacementReport(std::ostream &out);
+
+/** Forget the placement logged so far. */
+void clearThreadPlacement();
+//@}
+
 /** @name Old parallel stuff. */
 /** Barrier structure */
 //@{
@@ -39,6 +39,7 @@ void ProgDimRed::readParams()
     dimRefMethod = getParam("-m");
     outputDim  = getIntParam("--dout");
     dimEstMethod = getParam("--dout",1);
+    Nthreads = getIntParam("--thr");
 
     if (dimRefMethod=="LTSA" || dimRefMethod=="LLTSA" || dimRefMethod=="LPP" || dimRefMethod=="LE" || dimRefMethod=="HLLE" ||
     	dimRefMethod=="NPE" || dimRefMethod=="SPE")
@@ -101,6 +102,7 @@ void ProgDimRed::defineParams()
     addParamsLine("       where <method>");
     addParamsLine("                  CorrDim: Correlation dimension");
     addParamsLine("                  MLE: Maximum Likelihood Estimate");
+    addParamsLine("  [--thr <n=1>]             : Number of threads of the matrix products and eigendecompositions");
     addParamsLine("  [--saveMapping <fn=\"\">] : Save mapping if available (PCA, LLTSA, LPP, pPCA, NPE) so that it can be reused later (Y=X*M)");
     addParamsLine("                            :+X is the input matrix with individuals as rows");
     addParamsLine("                            :+Y is the output matrix with individuals as rows");
@@ -109,6 +111,7 @@ void ProgDimRed::defineParams()
 // Produce Side info  ====================================================================
 void ProgDimRed::produceSideInfo()
 {
+    setMatrix2DThreads(Nthreads);
     if (dimRefMethod=="PCA")
     {
     	algorithm=&algorithmPCA;
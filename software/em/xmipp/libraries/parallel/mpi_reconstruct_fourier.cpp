@@ -68,6 +68,10 @@ void ProgMPIRecFourier::readParams()
 {
     ProgRecFourier::readParams();
     mpi_job_size=getIntParam("--mpi_job_size");
+    // Every job only inserts some images, and the accumulated volume is
+    // not symmetrized after the reduction
+    if (symmetrizeVolume)
+        REPORT_ERROR(ERR_ARG_INCORRECT,"--symmetrize_volume is not available in the MPI version");
 }
 
 /* Pre Run PreRun for all nodes but not for all works */
@@ -68,6 +68,7 @@ bool ProgMPIRecWbp::getImageToProcess(size_t &objId, size_t &objIndex)
 void ProgMPIRecWbp::finishProcessing()
 {
     MultidimArray<double> aux;
+    aux.setMmap(useMmap);
     aux.resizeNoCopy(reconstructedVolume());
     MPI_Allreduce(MULTIDIM_ARRAY(reconstructedVolume()), MULTIDIM_ARRAY(aux),
                   MULTIDIM_SIZE(aux), MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
@@ -76,7 +77,7 @@ void ProgMPIRecWbp::finishProcessing()
 
     if (node->isMaster())
     {
-        reconstructedVolume()=aux;
+        reconstructedVolume().swap(aux);
         count_thr=iaux;
         ProgRecWbp::finishProcessing();
     }
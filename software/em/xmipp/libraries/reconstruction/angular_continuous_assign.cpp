@@ -42,6 +42,7 @@
 #include <data/args.h>
 #include <data/xmipp_fft.h>
 #include <data/mask.h>
+#include <data/transformations.h>
 
 /* ------------------------------------------------------------------------- */
 // Prototypes
@@ -64,6 +65,8 @@ void ProgAngularContinuousAssign::readParams()
     max_no_iter = getIntParam("--max_iter");
     max_shift = getDoubleParam("--max_shift");
     max_angular_change = getDoubleParam("--max_angular_change");
+    Nthreads = getIntParam("--thr");
+    setApplyGeometryThreads(Nthreads);
 }
 
 // Show ====================================================================
@@ -79,6 +82,7 @@ void ProgAngularContinuousAssign::show()
     << "Max. Iter:           " << max_no_iter         << std::endl
     << "Max. Shift:          " << max_shift           << std::endl
     << "Max. Angular Change: " << max_angular_change  << std::endl
+    << "Threads:             " << Nthreads            << std::endl
     ;
 }
 
@@ -126,6 +130,7 @@ void ProgAngularContinuousAssign::defineParams()
     addParamsLine("                               :+the solution found is beyond this limit, then ");
     addParamsLine("                               :+the initial solution is returned instead of the ");
     addParamsLine("                               :+optimized one since this latter looks suspicious.");
+    addParamsLine("  [--thr <n=1>]                : Number of threads of the B-spline prefilter of the volume");
     addExampleLine("A typical use is:",false);
     addExampleLine("xmipp_angular_continuous_assign -i anglesFromDiscreteAssignment.doc --ref reference.vol -o assigned_angles.xmd");
 }
@@ -3157,26 +3162,23 @@ int return_gradhesscost(
                   return(ERROR);
               }
 
-              ChangeBasisVolume(reDftVolume, CoefRe, Nx, Ny, Nz, CardinalSpline,
-                                BasicSpline, OrderOfSpline, Periodic, epsilon, &Status);
-              if (Status == ERROR)
+              // Same as ChangeBasisVolume, with the lines split among the
+              // threads given with --thr (see setApplyGeometryThreads)
+              try
               {
-                  WRITE_ERROR(cstregistration, "ERROR");
-                  free(Parameters);
-                  FreeVolumeDouble(&CoefRe);
-                  FreeVolumeDouble(&CoefIm);
-                  return(ERROR);
+                  memcpy(CoefRe, reDftVolume, (size_t)(Nx * Ny * Nz) * sizeof(double));
+                  bsplinePrefilter(OrderOfSpline, CoefRe, Nx, Ny, Nz, Periodic, epsilon,
+                                   getApplyGeometryThreads());
+                  memcpy(CoefIm, imDftVolume, (size_t)(Nx * Ny * Nz) * sizeof(double));
+                  bsplinePrefilter(OrderOfSpline, CoefIm, Nx, Ny, Nz, Periodic, epsilon,
+                                   getApplyGeometryThreads());
               }
-
-              ChangeBasisVolume(imDftVolume, CoefIm, Nx, Ny, Nz, CardinalSpline,
-                                BasicSpline, OrderOfSpline, Periodic, epsilon, &Status);
-              if (Status == ERROR)
+              catch (...)
               {
-                  WRITE_ERROR(cstregistration, "ERROR");
                   free(Parameters);
                   FreeVolumeDouble(&CoefRe);
                   FreeVolumeDouble(&CoefIm);
-                  return(ERROR);
+                  throw;
               }
 
               Gradient = (double *)malloc((size_t) 5L * sizeof(double));
@@ -55,6 +55,8 @@ public:
     double max_shift;
     /** Maximum angular change allowed */
     double max_angular_change;
+    /** Number of threads of the B-spline prefilter */
+    int Nthreads;
 public:
     // Real part of the Fourier transform
     MultidimArray<double> reDFTVolume;
@@ -33,6 +33,7 @@ ProgAngularProjectLibrary::ProgAngularProjectLibrary()
     mysampling.setSampling(1);
     Vshears=NULL;
     Vfourier=NULL;
+    Nthreads=1;
 
 }
 
@@ -93,6 +94,7 @@ void ProgAngularProjectLibrary::readParams()
         FnexperimentalImages = getParam("--experimental_images");
     fn_groups = getParam("--groups");
     only_winner = checkParam("--only_winner");
+    Nthreads = getIntParam("--thr");
 }
 
 /* Usage ------------------------------------------------------------------- */
@@ -131,13 +133,14 @@ void ProgAngularProjectLibrary::defineParams()
     addParamsLine("                                              : maxfreq is the maximum frequency for the pixels and by default ");
     addParamsLine("                                              : pixels with frequency more than 0.25 are not considered.");
     addParamsLine("                                              : interp is the method for interpolation and the values can be: ");
-    addParamsLine("                                              : nearest:          Nearest Neighborhood  ");
-    addParamsLine("                                              : linear:           Linear  ");
+    addParamsLine("                                              : nearest:          Nearest Neighborhood (fast, single precision)");
+    addParamsLine("                                              : linear:           Linear (fast, single precision)");
     addParamsLine("                                              : bspline:          Cubic BSpline  ");
     addParamsLine("  [--perturb <sigma=0.0>]       : gaussian noise projection unit vectors ");
     addParamsLine("                                : a value=sin(sampling_rate)/4  ");
     addParamsLine("                                : may be a good starting point ");
     addParamsLine("  [--groups <selfile=\"\">]     : selfile with groups");
+    addParamsLine("  [--thr <N=1>]                 : Number of threads for the Fourier and real space projection");
     addParamsLine("  [--only_winner]               : if set each experimental");
     addParamsLine("                                : point will have a unique neighbor");
 
@@ -224,6 +227,49 @@ void ProgAngularProjectLibrary::project_angle_vector (int my_init, int my_end, b
         		                      maxFrequency,
         		                      BSplineDeg);
 
+    if (projType == FOURIER || projType == REALSPACE)
+    {
+        // Project in batches shared by the threads, and write them in order
+        const int batchSize=256;
+        Matrix2D<double> angles(batchSize,3);
+        std::vector<size_t> indexes;
+        MultidimArray<double> projections, mP;
+        P.setDataMode(_DATA_ALL);
+        for (double mypsi=0;mypsi<360;mypsi += psi_sampling)
+        {
+            for (int i0=my_init;i0<=my_end;i0+=batchSize)
+            {
+                int i1=XMIPP_MIN(i0+batchSize-1,my_end);
+                angles.resizeNoCopy(i1-i0+1,3);
+                indexes.clear();
+                for (int i=i0;i<=i1;i++)
+                {
+                    MAT_ELEM(angles,i-i0,0)=XX(mysampling.no_redundant_sampling_points_angles[i]);
+                    MAT_ELEM(angles,i-i0,1)=YY(mysampling.no_redundant_sampling_points_angles[i]);
+                    MAT_ELEM(angles,i-i0,2)=mypsi+ZZ(mysampling.no_redundant_sampling_points_angles[i]);
+                    indexes.push_back((size_t) (numberStepsPsi * i + mypsi +1));
+                }
+                if (projType == FOURIER)
+                    Vfourier->projectBatch(angles,projections,Nthreads);
+                else
+                    projectVolumeBatch(inputVol(),angles,projections,Ydim,Xdim,Nthreads);
+                for (int i=i0;i<=i1;i++)
+                {
+                    mP.aliasImageInStack(projections,i-i0);
+                    P()=mP;
+                    P().setXmippOrigin();
+                    P.setEulerAngles(MAT_ELEM(angles,i-i0,0),MAT_ELEM(angles,i-i0,1),MAT_ELEM(angles,i-i0,2));
+                    P.write(output_file,indexes[i-i0],true,WRITE_REPLACE);
+                }
+                if (verbose)
+                    progress_bar(i1-my_init);
+            }
+        }
+        if (verbose)
+            progress_bar(mySize);
+        return;
+    }
+
     for (double mypsi=0;mypsi<360;mypsi += psi_sampling)
     {
         for (int i=my_init;i<=my_end;i++)
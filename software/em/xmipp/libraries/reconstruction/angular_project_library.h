@@ -82,6 +82,8 @@ public:
     double maxFrequency;
     /// The type of interpolation (NEAR
     int BSplineDeg;
+    /// Number of threads for Fourier projection
+    int Nthreads;
 
 #ifdef NEVERDEFINED
     /** vector with valid proyection directions after looking for 
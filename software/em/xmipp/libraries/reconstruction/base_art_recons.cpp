@@ -39,6 +39,129 @@ void ARTReconsBase::preProcess(GridVolume &vol_basis0, int level, int rank)
     artPrm.produceSideInfo(vol_basis0, level, rank);
 }
 
+/* Mask of the pixels of a projection to use (gold beads and borders of
+ * shifted tomograms are excluded). It returns NULL if all pixels are used. */
+static const MultidimArray<int> *projectionMask(const BasicARTParameters &artPrm,
+        Projection &read_proj, MultidimArray<int> &mask)
+{
+    if (artPrm.goldmask<1e6 || artPrm.shiftedTomograms)
+    {
+        mask.resize(read_proj());
+        FOR_ALL_ELEMENTS_IN_ARRAY2D(read_proj())
+        {
+            mask(i,j)=1;
+            if ((read_proj(i,j)<artPrm.goldmask && artPrm.goldmask<1e6) ||
+                (ABS(read_proj(i,j))<1e-5 && artPrm.shiftedTomograms))
+                mask(i,j)=0;
+        }
+        return &mask;
+    }
+    return NULL;
+}
+
+/* Anisotropic diffusion and sparsity constraint, applied after each
+ * projection in ART and after each block in OSSIRT */
+static void applyRegularization(BasicARTParameters &artPrm, GridVolume &vol_basis, int it,
+                                Image<double> &vol_voxels, int Zoutput_volume_size,
+                                int Youtput_volume_size, int Xoutput_volume_size)
+{
+    // Apply anisotropic diffusion ...................................
+    if (it>=1 && artPrm.diffusionWeight>-1)
+    {
+        artPrm.basis.changeToVoxels(vol_basis, &(vol_voxels()),
+                                    Zoutput_volume_size, Youtput_volume_size, Xoutput_volume_size);
+        Matrix1D<double> alpha;
+        alpha=vectorR3(1.0,1.0,artPrm.diffusionWeight);
+        double regError=tomographicDiffusion(vol_voxels(),alpha,
+                                             artPrm.lambda(it)/100);
+        if (artPrm.tell&TELL_SHOW_ERROR)
+            std::cout << "Regularization error = " << regError << std::endl;
+        *artPrm.fh_hist << "Regularization error = " << regError << std::endl;
+        artPrm.basis.changeFromVoxels(vol_voxels(),vol_basis,artPrm.grid_type,
+                                      artPrm.grid_relative_size, NULL, NULL, artPrm.R, artPrm.threads);
+    }
+
+    // Apply sparsity constraint .....................................
+    if (it>=1 && artPrm.sparseEps>0 &&
+        artPrm.parallel_mode!=BasicARTParameters::SIRT &&
+        artPrm.parallel_mode!=BasicARTParameters::pSIRT &&
+        artPrm.parallel_mode!=BasicARTParameters::pfSIRT)
+    {
+        artPrm.basis.changeToVoxels(vol_basis, &(vol_voxels()),
+                                    Zoutput_volume_size, Youtput_volume_size, Xoutput_volume_size);
+        forceDWTSparsity(vol_voxels(),artPrm.sparseEps);
+        artPrm.basis.changeFromVoxels(vol_voxels(),vol_basis,artPrm.grid_type,
+                                      artPrm.grid_relative_size, NULL, NULL, artPrm.R, artPrm.threads);
+    }
+}
+
+/* Data shared by the threads that process a block of projections in OSSIRT */
+struct ARTSubsetArgs
+{
+    ARTReconsBase *recons;
+    GridVolume *vol_basis;                  // Volume to project, not modified
+    std::vector<GridVolume> *corrections;   // Correction volume of each thread
+    std::vector<double> *errors;            // Mean error of each projection, -1 if skipped
+    int first;                              // Position of the block in ordered_list
+    int N;                                  // Number of projections of the block
+    double lambda;
+    ThreadTaskDistributor *distributor;
+};
+
+/* Project the volume in the directions of the projections of the block and
+ * backproject the corrections in the correction volume of this thread.
+ * The correction is normalized by the block size as in SIRT. */
+static void threadProcessSubset(ThreadArgument &thArg)
+{
+    ARTSubsetArgs *args = (ARTSubsetArgs *) thArg.data;
+    BasicARTParameters &artPrm = args->recons->artPrm;
+    GridVolume &correction = (*args->corrections)[thArg.thread_id];
+    applyThreadAffinity(thArg.thread_id);
+
+    Projection read_proj, theo_proj, diff_proj, corr_proj, alig_proj;
+    MultidimArray<int> mask;
+    size_t first, last;
+    while (args->distributor->getTasks(first, last))
+        for (size_t n = first; n <= last; n++)
+        {
+            logThreadPlacement(thArg.thread_id);
+            int act_proj = args->first + (int)n;
+            ReconsInfo &imgInfo = artPrm.IMG_Inf[artPrm.ordered_list(act_proj)];
+            read_proj.read(imgInfo.fn_proj, artPrm.apply_shifts, DATA, &imgInfo.row);
+            read_proj().setXmippOrigin();
+            read_proj.setEulerAngles(imgInfo.rot, imgInfo.tilt, imgInfo.psi);
+
+            //skipping if  tilt greater than max_tilt
+            //tilt is in between 0 and 360
+            double aux_tilt=read_proj.tilt();
+            if((aux_tilt > artPrm.max_tilt && aux_tilt < 180.-artPrm.max_tilt) ||
+               (aux_tilt > artPrm.max_tilt + 180 && aux_tilt < 360.-artPrm.max_tilt) ||
+               ((artPrm.tell&TELL_ONLY_SYM) && imgInfo.sym != -1))
+            {
+                (*args->errors)[n] = -1;
+                continue;
+            }
+
+            // Projection extension? .........................................
+            if (artPrm.proj_ext!=0)
+                read_proj().selfWindow(
+                    STARTINGY (read_proj())-artPrm.proj_ext,
+                    STARTINGX (read_proj())-artPrm.proj_ext,
+                    FINISHINGY(read_proj())+artPrm.proj_ext,
+                    FINISHINGX(read_proj())+artPrm.proj_ext);
+
+            const MultidimArray<int> *maskPtr=projectionMask(artPrm, read_proj, mask);
+            double mean_error;
+            args->recons->singleStep(*(args->vol_basis), &correction,
+                                     theo_proj, read_proj, imgInfo.sym, diff_proj,
+                                     corr_proj, alig_proj,
+                                     mean_error, args->N, args->lambda,
+                                     act_proj, imgInfo.fn_ctf, maskPtr,
+                                     artPrm.refine);
+            (*args->errors)[n] = mean_error;
+        }
+}
+
 void ARTReconsBase::iterations(GridVolume &vol_basis, int rank)
 {
     // Some variables .......................................................
@@ -141,11 +264,24 @@ void ARTReconsBase::iterations(GridVolume &vol_basis, int rank)
         ptr_vol_out = &vol_basis;          // Output volume is the same as
         // input one
     }
+    // Ordered subsets: a correction volume per thread ......................
+    ThreadManager *thMgr = NULL;
+    std::vector<GridVolume> corrections;
+    std::vector<double> subsetErrors;
+    if (artPrm.parallel_mode==BasicARTParameters::OSSIRT)
+    {
+        int nThreads = XMIPP_MAX(1, artPrm.threads);
+        corrections.resize(nThreads, vol_basis);
+        if (nThreads > 1)
+            thMgr = new ThreadManager(nThreads, this);
+    }
+
     // Now iterate ..........................................................
     ProcessorTimeStamp time0;                    // For measuring the elapsed time
     annotate_processor_time(&time0);
     int images=0;
     double mean_error_2ndblock,pow_residual_imgs;
+    double previous_mean_error=-1;
     bool iv_launched=false;
     for (int it = 0; it < artPrm.no_it; it++)
     {
@@ -161,6 +297,78 @@ void ARTReconsBase::iterations(GridVolume &vol_basis, int rank)
                 init_progress_bar(artPrm.numIMG);
         }
 
+        // For each block of projections (OSSIRT) ----------------------------
+        if (artPrm.parallel_mode==BasicARTParameters::OSSIRT)
+        {
+            for (int first = 0; first < artPrm.numIMG; first += artPrm.block_size)
+            {
+                POCS.newProjection();
+                int N = XMIPP_MIN(artPrm.block_size, artPrm.numIMG - first);
+                if (artPrm.stop_at != 0)
+                    N = XMIPP_MIN(N, artPrm.stop_at - images);
+
+                // All threads project the same volume
+                ARTSubsetArgs args;
+                args.recons = this;
+                args.vol_basis = &vol_basis;
+                args.corrections = &corrections;
+                subsetErrors.resize(N);
+                args.errors = &subsetErrors;
+                args.first = first;
+                args.N = N;
+                args.lambda = artPrm.lambda(it);
+                ThreadTaskDistributor distributor(N, 1);
+                args.distributor = &distributor;
+                for (size_t t = 0; t < corrections.size(); t++)
+                    corrections[t].initZeros();
+                if (thMgr != NULL)
+                    thMgr->run(threadProcessSubset, &args);
+                else
+                {
+                    ThreadArgument thArg;
+                    thArg.thread_id = 0;
+                    thArg.threads = 1;
+                    thArg.data = &args;
+                    threadProcessSubset(thArg);
+                }
+
+                // Apply the corrections together. The projections are handed out
+                // dynamically, so the rounding of the sum depends on the threads
+                for (size_t t = 0; t < corrections.size(); t++)
+                    vol_basis += corrections[t];
+                images += N;
+                POCS.apply(vol_basis,it,images);
+                applyRegularization(artPrm, vol_basis, it, vol_voxels,
+                                    Zoutput_volume_size, Youtput_volume_size, Xoutput_volume_size);
+
+                // Show results ..............................................
+                for (int n = 0; n < N; n++)
+                {
+                    ReconsInfo &imgInfo = artPrm.IMG_Inf[artPrm.ordered_list(first + n)];
+                    if (subsetErrors[n] < 0)
+                    {
+                        std::cout << "Skipping Proj no: " << artPrm.ordered_list(first + n)
+                        << " tilt=" << imgInfo.tilt << " sym=" << imgInfo.sym << std::endl;
+                        continue;
+                    }
+                    global_mean_error += subsetErrors[n];
+                    *artPrm.fh_hist << imgInfo.fn_proj << ", sym="
+                    << imgInfo.sym << "\t\t" << subsetErrors[n] << std::endl;
+                    if (artPrm.tell&TELL_SHOW_ERROR)
+                        std::cout << imgInfo.fn_proj << ", sym="
+                        << imgInfo.sym << "\t\t" << subsetErrors[n] << std::endl;
+                }
+                if (POCS.apply_POCS)
+                    *artPrm.fh_hist << "\tPOCS:" << POCS.POCS_mean_error << std::endl;
+                if (!(artPrm.tell&TELL_SHOW_ERROR))
+                    progress_bar(first + N);
+
+                // Check if algorithm must stop via stop_at
+                if (images==artPrm.stop_at)
+                    break;
+            }
+        }
+        else
         // For each projection -----------------------------------------------
         for (int act_proj = 0; act_proj < artPrm.numIMG ; act_proj++)
         {
@@ -272,19 +480,7 @@ void ARTReconsBase::iterations(GridVolume &vol_basis, int rank)
 
             // Is there a mask ...............................................
             MultidimArray<int> mask;
-            const MultidimArray<int> *maskPtr=NULL;
-            if (artPrm.goldmask<1e6 || artPrm.shiftedTomograms)
-            {
-                mask.resize(read_proj());
-                FOR_ALL_ELEMENTS_IN_ARRAY2D(read_proj())
-                {
-                    mask(i,j)=1;
-                    if ((read_proj(i,j)<artPrm.goldmask && artPrm.goldmask<1e6) ||
-                        (ABS(read_proj(i,j))<1e-5 && artPrm.shiftedTomograms))
-                        mask(i,j)=0;
-                }
-                maskPtr=&mask;
-            }
+            const MultidimArray<int> *maskPtr=projectionMask(artPrm, read_proj, mask);
 
             // Apply the reconstruction algorithm ............................
             // Notice that the following function is specific for each art type
@@ -334,34 +530,9 @@ void ARTReconsBase::iterations(GridVolume &vol_basis, int rank)
             if (artPrm.variability_analysis)
                 VC.newUpdateVolume(ptr_vol_out,read_proj);
 
-            // Apply anisotropic diffusion ...................................
-            if (it>=1 && artPrm.diffusionWeight>-1)
-            {
-                artPrm.basis.changeToVoxels(vol_basis, &(vol_voxels()),
-                                            Zoutput_volume_size, Youtput_volume_size, Xoutput_volume_size);
-                Matrix1D<double> alpha;
-                alpha=vectorR3(1.0,1.0,artPrm.diffusionWeight);
-                double regError=tomographicDiffusion(vol_voxels(),alpha,
-                                                     artPrm.lambda(it)/100);
-                if (artPrm.tell&TELL_SHOW_ERROR)
-                    std::cout << "Regularization error = " << regError << std::endl;
-                *artPrm.fh_hist << "Regularization error = " << regError << std::endl;
-                artPrm.basis.changeFromVoxels(vol_voxels(),vol_basis,artPrm.grid_type,
-                                              artPrm.grid_relative_size, NULL, NULL, artPrm.R, artPrm.threads);
-            }
-
-            // Apply sparsity constraint .....................................
-            if (it>=1 && artPrm.sparseEps>0 &&
-                artPrm.parallel_mode!=BasicARTParameters::SIRT &&
-                artPrm.parallel_mode!=BasicARTParameters::pSIRT &&
-                artPrm.parallel_mode!=BasicARTParameters::pfSIRT)
-            {
-                artPrm.basis.changeToVoxels(vol_basis, &(vol_voxels()),
-                                            Zoutput_volume_size, Youtput_volume_size, Xoutput_volume_size);
-                forceDWTSparsity(vol_voxels(),artPrm.sparseEps);
-                artPrm.basis.changeFromVoxels(vol_voxels(),vol_basis,artPrm.grid_type,
-                                              artPrm.grid_relative_size, NULL, NULL, artPrm.R, artPrm.threads);
-            }
+            // Apply anisotropic diffusion and sparsity constraint ...........
+            applyRegularization(artPrm, vol_basis, it, vol_voxels,
+                                Zoutput_volume_size, Youtput_volume_size, Xoutput_volume_size);
 
             // Show results ..................................................
             *artPrm.fh_hist << imgInfo.fn_proj << ", sym="
@@ -570,7 +741,22 @@ void ARTReconsBase::iterations(GridVolume &vol_basis, int rank)
         // Check if algorithm must stop via stop_at
         if (images==artPrm.stop_at)
             break;
+
+        // Check if the error has converged (only sequential, all MPI
+        // nodes must run the same iterations)
+        if (rank==-1 && artPrm.stop_tolerance>0)
+        {
+            if (previous_mean_error>0 &&
+                previous_mean_error-global_mean_error < artPrm.stop_tolerance*previous_mean_error)
+            {
+                std::cout << "   The error has converged, stopping at iteration " << it << std::endl;
+                *artPrm.fh_hist << "   The error has converged, stopping at iteration " << it << std::endl;
+                break;
+            }
+            previous_mean_error=global_mean_error;
+        }
     }
+    delete thMgr;
 
     // Times on screen
     if (rank==-1)
@@ -678,6 +864,10 @@ void ARTReconsBase::initHistory(const GridVolume &vol_basis0)
     case BasicARTParameters::pCAV:
         *artPrm.fh_hist << "CAV (global algorithm)\n";
         break;
+    case BasicARTParameters::OSSIRT:
+        *artPrm.fh_hist << "Ordered subsets SIRT, block size=" << artPrm.block_size
+        << ", threads=" << artPrm.threads << std::endl;
+        break;
     }
     *artPrm.fh_hist << " Equation mode: ";
     if (artPrm.eq_mode==CAV)
@@ -796,7 +986,7 @@ void SinPartARTRecons::preProcess(GridVolume & vol_basis0, int level, int rank)
 
     // As this is a threaded implementation, create structures for threads, and
     // create threads
-    if( artPrm.threads > 1 )
+    if( artPrm.projectionThreads() > 1 )
     {
         th_ids = (pthread_t *)malloc( artPrm.threads * sizeof( pthread_t));
 
@@ -898,7 +1088,7 @@ void SinPartARTRecons::singleStep(GridVolume &vol_in, GridVolume *vol_out,
     project_GridVolume(vol_in, artPrm.basis, theo_proj,
                        corr_proj, YSIZE(read_proj()), XSIZE(read_proj()),
                        read_proj.rot(), read_proj.tilt(), read_proj.psi(), FORWARD, artPrm.eq_mode,
-                       artPrm.GVNeq, A, maskPtr, artPrm.ray_length, artPrm.threads);
+                       artPrm.GVNeq, A, maskPtr, artPrm.ray_length, artPrm.projectionThreads());
 
     if (fn_ctf != "" && artPrm.unmatched)
     {
@@ -1008,7 +1198,7 @@ void SinPartARTRecons::singleStep(GridVolume &vol_in, GridVolume *vol_out,
     project_GridVolume(*vol_out, artPrm.basis, theo_proj,
                        corr_proj, YSIZE(read_proj()), XSIZE(read_proj()),
                        read_proj.rot(), read_proj.tilt(), read_proj.psi(), BACKWARD, artPrm.eq_mode,
-                       artPrm.GVNeq, NULL, maskPtr, artPrm.ray_length, artPrm.threads);
+                       artPrm.GVNeq, NULL, maskPtr, artPrm.ray_length, artPrm.projectionThreads());
 
     // Remove footprints if necessary
     if (remove_footprints)
@@ -1025,7 +1215,7 @@ void SinPartARTRecons::postProcess(GridVolume & vol_basis)
     // are "slept" waiting for a barrier to be reached by the master thread to continue
     // projecting/backprojecting a new projection. Here we set the flag destroy=true so
     // the threads won't process a projections but will return.
-    if( artPrm.threads > 1 )
+    if( artPrm.projectionThreads() > 1 )
     {
         for( int c = 0 ; c < artPrm.threads ; c++ )
         {
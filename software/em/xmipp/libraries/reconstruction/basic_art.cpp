@@ -67,6 +67,7 @@ void BasicARTParameters::defaultValues()
     lambda_list.resize(1);
     lambda_list.initConstant(0.01);
     stop_at            = 0;
+    stop_tolerance     = 0;
     basis.setDefault();
     grid_relative_size = 1.41;
     grid_type          = BCC;
@@ -170,6 +171,8 @@ void BasicARTParameters::defineParams(XmippProgram * program, bool mpiMode)
     program->addParamsLine("  [--stop_at <it_stop=0>]      : Total number of iterated projections before algorithm stops. ");
     program->addParamsLine("                               :+ For instance, if there are 100 images, with two iterations and we ");
     program->addParamsLine("                               :+ want to stop at the half of the second iteration, then you must set it to 150");
+    program->addParamsLine("  [--stop_tol <tol=0>]         : Stop when the global mean squared error of an iteration decreases less than");
+    program->addParamsLine("                               : this fraction of the error of the previous one (0 means no stop)");
     program->addParamsLine("  [--equation_mode <mode=ARTK> ]: Equation to project onto the hyperplane");
     program->addParamsLine("              where <mode> ");
     program->addParamsLine("        ARTK                   : Block ART");
@@ -222,13 +225,17 @@ void BasicARTParameters::defineParams(XmippProgram * program, bool mpiMode)
     program->addParamsLine("        where <mode>");
     program->addParamsLine("               ART             : Default");
     program->addParamsLine("               SIRT            : Simultaneous Iterative Reconstruction Technique");
+    program->addParamsLine("               OSSIRT          : Ordered subsets SIRT. The projections of each block are processed at the same time");
+    program->addParamsLine("                               : by the threads and their corrections are applied together (not available with MPI)");
     program->addParamsLine("   pSIRT                       : Parallel (MPI) Simultaneous Iterative Reconstruction Technique");
     program->addParamsLine("   pfSIRT                      : Parallel (MPI) False Simultaneous Iterative Reconstruction Technique (Faster convergence than pSIRT)");
     program->addParamsLine("   pSART                       : Parallel (MPI) Simultaneous ART");
     program->addParamsLine("   pAVSP                       : Parallel (MPI) Average Strings");
     program->addParamsLine("   pBiCAV                      : Parallel (MPI) Block Iterative CAV");
     program->addParamsLine("   pCAV                        : Parallel (MPI) CAV");
-    program->addParamsLine("   [--block_size <n=1>]        : Number of projections for each block (SART and BiCAV)");
+    program->addParamsLine("   [--block_size <n=1>]        : Number of projections for each block (SART, BiCAV and OSSIRT)");
+    program->addParamsLine("                               :+In OSSIRT it should be a multiple of the number of threads. With 1 it is");
+    program->addParamsLine("                               :+equivalent to ART, and with the number of projections to SIRT.");
 
     program->addParamsLine("==+ Debugging options ==");
     program->addParamsLine("  [--print_system_matrix]      : Print the matrix of the system Ax=b. The format is:");
@@ -312,6 +319,7 @@ void BasicARTParameters::readParams(XmippProgram * program)
 
     no_it = program->getIntParam("-n");
     stop_at = program->getIntParam("--stop_at");
+    stop_tolerance = program->getDoubleParam("--stop_tol");
 
     String tempString = program->getParam("--equation_mode");
     if (tempString == "CAVK")
@@ -388,6 +396,8 @@ void BasicARTParameters::readParams(XmippProgram * program)
         parallel_mode=SIRT;
     else if (tempString == "pfSIRT")
         parallel_mode=pfSIRT;
+    else if (tempString == "OSSIRT")
+        parallel_mode=OSSIRT;
     else if (tempString == "pBiCAV")
         parallel_mode=pBiCAV;
     else if (tempString == "pAVSP")
@@ -427,6 +437,22 @@ void BasicARTParameters::readParams(XmippProgram * program)
 
     verbose = program->getIntParam("--verbose");
 
+    // The threads of OSSIRT only update the volume and the global error
+    if (parallel_mode == OSSIRT)
+    {
+        if (block_size < 1)
+            REPORT_ERROR(ERR_ARG_INCORRECT, "BasicARTParameters::read: the block size must be positive");
+        if (WLS || eq_mode == CAV)
+            REPORT_ERROR(ERR_ARG_INCORRECT, "BasicARTParameters::read: OSSIRT is not compatible"
+                         " with WLS nor with the CAV equation mode");
+        if (program->checkParam("--variability") || program->checkParam("--noisy_reconstruction"))
+            REPORT_ERROR(ERR_ARG_INCORRECT, "BasicARTParameters::read: OSSIRT is not compatible"
+                         " with the variability analysis nor with noisy reconstructions");
+        if ((tell&TELL_MANUAL_ORDER) || print_system_matrix)
+            REPORT_ERROR(ERR_ARG_INCORRECT, "BasicARTParameters::read: OSSIRT is not compatible"
+                         " with --manual_order nor with --print_system_matrix");
+    }
+
     if (program->checkParam("--variability"))
     {
         variability_analysis = true;
@@ -86,7 +86,7 @@ class BasicARTParameters
 {
 public:
     // Type of the parallel processing
-    typedef enum {ART, pCAV, pAVSP, pSART, pBiCAV, pSIRT, pfSIRT, SIRT } ARTParallelMode;
+    typedef enum {ART, pCAV, pAVSP, pSART, pBiCAV, pSIRT, pfSIRT, SIRT, OSSIRT } ARTParallelMode;
 
     /* User parameters ...................................................... */
     //@{
@@ -102,10 +102,13 @@ public:
     /** Valid methods are ART, pCAV, pAVSP, pSART, pBiCAV, pSIRT and pfSIRT
         for parallel computation. This variable establish the way that particles are
         divided into blocks for parallel processing. If sequential
-        processing is wanted, set it to ART or SIRT. This is the default.*/
+        processing is wanted, set it to ART or SIRT. This is the default.
+        OSSIRT (ordered subsets SIRT) is the threaded counterpart of pSART:
+        the projections of each block are processed at the same time by the
+        threads and their corrections are applied together. */
     ARTParallelMode parallel_mode;
 
-    /// Number of projections for each parallel block
+    /// Number of projections for each parallel block (subset in OSSIRT)
     int block_size;
 
     /** Valid modes are ARTK, CAVK and CAV.
@@ -219,6 +222,10 @@ public:
     /// Stop after this number of images, if 0 then don't use
     int stop_at;
 
+    /** Stop when the relative decrease of the global mean squared error
+        between two iterations is below this value, if 0 then don't use */
+    double stop_tolerance;
+
     /// Known volume. If -1, not applied.
     double known_volume;
 
@@ -263,6 +270,13 @@ public:
     /// Number of threads to use. Can not be different than 1 when using MPI.
     int threads;
 
+    /** Number of threads that share the projection of a single image.
+        In OSSIRT the threads work on different images, so it is 1. */
+    int projectionThreads() const
+    {
+        return (parallel_mode == OSSIRT) ? 1 : threads;
+    }
+
 #define TELL_IV                    0x100
 #define TELL_ONLY_SYM              0x80
 #define TELL_USE_INPUT_BASISVOLUME 0x40
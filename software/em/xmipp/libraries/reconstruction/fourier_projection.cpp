@@ -38,157 +38,303 @@ FourierProjector::FourierProjector(MultidimArray<double> &V, double paddFactor,
 
 void FourierProjector::project(double rot, double tilt, double psi, const MultidimArray<double> *ctf)
 {
-    double freqy, freqx;
-    std::complex< double > f;
+    projectFourier(rot,tilt,psi,E,projectionFourier,ctf);
+    transformer2D.inverseFourierTransform();
+}
+
+/* Nearest neighbour value of the centered Fourier volume (interleaved
+ * complex, see VfourierFloat) at the logical position (x,y,z).
+ * Positions outside the volume are 0. */
+static inline void interpolateNearestSlice(const MultidimArray<float> &V,
+        double x, double y, double z, double &c, double &d)
+{
+    int Xdim=(int)XSIZE(V)/2;
+    int Ydim=(int)YSIZE(V);
+    int Zdim=(int)ZSIZE(V);
+    int k=(int)round(z)-FIRST_XMIPP_INDEX(Zdim);
+    int i=(int)round(y)-FIRST_XMIPP_INDEX(Ydim);
+    int j=(int)round(x)-FIRST_XMIPP_INDEX(Xdim);
+    if (k<0 || i<0 || j<0 || k>=Zdim || i>=Ydim || j>=Xdim)
+    {
+        c=d=0;
+        return;
+    }
+    const float *ptr=&DIRECT_A3D_ELEM(V,k,i,2*j);
+    c=ptr[0];
+    d=ptr[1];
+}
+
+/* Trilinear interpolation of the centered Fourier volume (interleaved
+ * complex, see VfourierFloat) at the logical position (x,y,z). Neighbours
+ * outside the volume count as 0, as in interpolatedElement3D. */
+static inline void interpolateLinearSlice(const MultidimArray<float> &V,
+        double x, double y, double z, double &c, double &d)
+{
+    int Xdim=(int)XSIZE(V)/2;
+    int Ydim=(int)YSIZE(V);
+    int Zdim=(int)ZSIZE(V);
+    size_t YXdim=(size_t)Ydim*Xdim;
+    x-=FIRST_XMIPP_INDEX(Xdim);
+    y-=FIRST_XMIPP_INDEX(Ydim);
+    z-=FIRST_XMIPP_INDEX(Zdim);
+    int x0=(int)floor(x);
+    int y0=(int)floor(y);
+    int z0=(int)floor(z);
+    float fx=(float)(x-x0);
+    float fy=(float)(y-y0);
+    float fz=(float)(z-z0);
+    const float *ptr=MULTIDIM_ARRAY(V);
+    if (x0>=0 && y0>=0 && z0>=0 && x0+1<Xdim && y0+1<Ydim && z0+1<Zdim)
+    {
+        // All neighbours inside, consecutive complex numbers along X
+        const float *p00=ptr+2*(z0*YXdim+y0*Xdim+x0);
+        const float *p01=p00+2*Xdim;
+        const float *p10=p00+2*YXdim;
+        const float *p11=p10+2*Xdim;
+        float re00=p00[0]+fx*(p00[2]-p00[0]), im00=p00[1]+fx*(p00[3]-p00[1]);
+        float re01=p01[0]+fx*(p01[2]-p01[0]), im01=p01[1]+fx*(p01[3]-p01[1]);
+        float re10=p10[0]+fx*(p10[2]-p10[0]), im10=p10[1]+fx*(p10[3]-p10[1]);
+        float re11=p11[0]+fx*(p11[2]-p11[0]), im11=p11[1]+fx*(p11[3]-p11[1]);
+        float re0=re00+fy*(re01-re00), im0=im00+fy*(im01-im00);
+        float re1=re10+fy*(re11-re10), im1=im10+fy*(im11-im10);
+        c=re0+fz*(re1-re0);
+        d=im0+fz*(im1-im0);
+        return;
+    }
+    float re=0, im=0;
+    for (int kk=0; kk<2; ++kk)
+    {
+        int zz=z0+kk;
+        if (zz<0 || zz>=Zdim)
+            continue;
+        float wz=kk ? fz : 1-fz;
+        for (int ii=0; ii<2; ++ii)
+        {
+            int yy=y0+ii;
+            if (yy<0 || yy>=Ydim)
+                continue;
+            float wzy=wz*(ii ? fy : 1-fy);
+            for (int jj=0; jj<2; ++jj)
+            {
+                int xx=x0+jj;
+                if (xx<0 || xx>=Xdim)
+                    continue;
+                float w=wzy*(jj ? fx : 1-fx);
+                const float *p=ptr+2*(zz*YXdim+yy*Xdim+xx);
+                re+=w*p[0];
+                im+=w*p[1];
+            }
+        }
+    }
+    c=re;
+    d=im;
+}
+
+void FourierProjector::projectFourier(double rot, double tilt, double psi, Matrix2D<double> &E,
+                                      MultidimArray< std::complex<double> > &projectionFourier,
+                                      const MultidimArray<double> *ctf) const
+{
     Euler_angles2matrix(rot,tilt,psi,E);
 
     projectionFourier.initZeros();
-    double maxFreq2=maxFrequency*maxFrequency;
-    double volumePaddedSize=XSIZE(VfourierRealCoefs);
+    bool fastSlice=(BSplineDeg==0 || BSplineDeg==1);
+    double volumePaddedSize=fastSlice ? XSIZE(VfourierFloat)/2 : XSIZE(VfourierRealCoefs);
     int Xdim=(int)XSIZE(VfourierRealCoefs);
     int Ydim=(int)YSIZE(VfourierRealCoefs);
     int Zdim=(int)ZSIZE(VfourierRealCoefs);
 
-    for (size_t i=0; i<YSIZE(projectionFourier); ++i)
-    {
-        FFT_IDX2DIGFREQ(i,volumeSize,freqy);
-        double freqy2=freqy*freqy;
-
-        double freqYvol_X=MAT_ELEM(E,1,0)*freqy;
-        double freqYvol_Y=MAT_ELEM(E,1,1)*freqy;
-        double freqYvol_Z=MAT_ELEM(E,1,2)*freqy;
-        for (size_t j=0; j<XSIZE(projectionFourier); ++j)
-        {
-            // The frequency of pairs (i,j) in 2D
-            FFT_IDX2DIGFREQ(j,volumeSize,freqx);
+    // Rows of the Euler matrix scaled to volume indexes
+    double E00=MAT_ELEM(E,0,0)*volumePaddedSize, E01=MAT_ELEM(E,0,1)*volumePaddedSize, E02=MAT_ELEM(E,0,2)*volumePaddedSize;
+    double E10=MAT_ELEM(E,1,0)*volumePaddedSize, E11=MAT_ELEM(E,1,1)*volumePaddedSize, E12=MAT_ELEM(E,1,2)*volumePaddedSize;
 
-            // Do not consider pixels with high frequency
-            if ((freqy2+freqx*freqx)>maxFreq2)
-                continue;
+    size_t nSamples=sliceSamples.size();
+    for (size_t s=0; s<nSamples; ++s)
+    {
+        const SliceSample &sample=sliceSamples[s];
 
-            // Compute corresponding frequency in the volume
-            double freqvol_X=freqYvol_X+MAT_ELEM(E,0,0)*freqx;
-            double freqvol_Y=freqYvol_Y+MAT_ELEM(E,0,1)*freqx;
-            double freqvol_Z=freqYvol_Z+MAT_ELEM(E,0,2)*freqx;
+        // Compute corresponding frequency in the volume, in index units
+        double jVolume=E00*sample.freqx+E10*sample.freqy;
+        double iVolume=E01*sample.freqx+E11*sample.freqy;
+        double kVolume=E02*sample.freqx+E12*sample.freqy;
 
-            double c,d;
-            if (BSplineDeg==0)
-            {
-                // 0 order interpolation
-                // Compute corresponding index in the volume
-                int kVolume=(int)round(freqvol_Z*volumePaddedSize);
-                int iVolume=(int)round(freqvol_Y*volumePaddedSize);
-                int jVolume=(int)round(freqvol_X*volumePaddedSize);
-                c = A3D_ELEM(VfourierRealCoefs,kVolume,iVolume,jVolume);
-                d = A3D_ELEM(VfourierImagCoefs,kVolume,iVolume,jVolume);
-            }
-            else if (BSplineDeg==1)
-            {
-                // B-spline linear interpolation
-                double kVolume=freqvol_Z*volumePaddedSize;
-                double iVolume=freqvol_Y*volumePaddedSize;
-                double jVolume=freqvol_X*volumePaddedSize;
-                c=VfourierRealCoefs.interpolatedElement3D(jVolume,iVolume,kVolume);
-                d=VfourierImagCoefs.interpolatedElement3D(jVolume,iVolume,kVolume);
-            }
-            else
-            {
-                // B-spline cubic interpolation
-                double kVolume=freqvol_Z*volumePaddedSize;
-                double iVolume=freqvol_Y*volumePaddedSize;
-                double jVolume=freqvol_X*volumePaddedSize;
+        double c,d;
+        if (BSplineDeg==0)
+        {
+            // 0 order interpolation
+            interpolateNearestSlice(VfourierFloat,jVolume,iVolume,kVolume,c,d);
+        }
+        else if (BSplineDeg==1)
+        {
+            // Linear interpolation
+            interpolateLinearSlice(VfourierFloat,jVolume,iVolume,kVolume,c,d);
+        }
+        else
+        {
+            // B-spline cubic interpolation
 
-                // Commented for speed-up, the corresponding code is below
-                // c=VfourierRealCoefs.interpolatedElementBSpline3D(jVolume,iVolume,kVolume);
-                // d=VfourierImagCoefs.interpolatedElementBSpline3D(jVolume,iVolume,kVolume);
+            // Commented for speed-up, the corresponding code is below
+            // c=VfourierRealCoefs.interpolatedElementBSpline3D(jVolume,iVolume,kVolume);
+            // d=VfourierImagCoefs.interpolatedElementBSpline3D(jVolume,iVolume,kVolume);
 
-                // The code below is a replicate for speed reasons of interpolatedElementBSpline3D
-                double z=kVolume;
-                double y=iVolume;
-                double x=jVolume;
+            // The code below is a replicate for speed reasons of interpolatedElementBSpline3D
+            double z=kVolume;
+            double y=iVolume;
+            double x=jVolume;
 
-                // Logical to physical
-                z -= STARTINGZ(VfourierRealCoefs);
-                y -= STARTINGY(VfourierRealCoefs);
-                x -= STARTINGX(VfourierRealCoefs);
+            // Logical to physical
+            z -= STARTINGZ(VfourierRealCoefs);
+            y -= STARTINGY(VfourierRealCoefs);
+            x -= STARTINGX(VfourierRealCoefs);
 
-                int l1 = (int)ceil(x - 2);
-                int l2 = l1 + 3;
+            int l1 = (int)ceil(x - 2);
+            int l2 = l1 + 3;
 
-                int m1 = (int)ceil(y - 2);
-                int m2 = m1 + 3;
+            int m1 = (int)ceil(y - 2);
+            int m2 = m1 + 3;
 
-                int n1 = (int)ceil(z - 2);
-                int n2 = n1 + 3;
+            int n1 = (int)ceil(z - 2);
+            int n2 = n1 + 3;
 
-                c = d = 0.0;
-                double aux;
-                for (int nn = n1; nn <= n2; nn++)
+            c = d = 0.0;
+            double aux;
+            for (int nn = n1; nn <= n2; nn++)
+            {
+                int equivalent_nn=nn;
+                if      (nn<0)
+                    equivalent_nn=-nn-1;
+                else if (nn>=Zdim)
+                    equivalent_nn=2*Zdim-nn-1;
+                double yxsumRe = 0.0, yxsumIm = 0.0;
+                for (int m = m1; m <= m2; m++)
                 {
-                    int equivalent_nn=nn;
-                    if      (nn<0)
-                        equivalent_nn=-nn-1;
-                    else if (nn>=Zdim)
-                        equivalent_nn=2*Zdim-nn-1;
-                    double yxsumRe = 0.0, yxsumIm = 0.0;
-                    for (int m = m1; m <= m2; m++)
+                    int equivalent_m=m;
+                    if      (m<0)
+                        equivalent_m=-m-1;
+                    else if (m>=Ydim)
+                        equivalent_m=2*Ydim-m-1;
+                    double xsumRe = 0.0, xsumIm = 0.0;
+                    for (int l = l1; l <= l2; l++)
                     {
-                        int equivalent_m=m;
-                        if      (m<0)
-                            equivalent_m=-m-1;
-                        else if (m>=Ydim)
-                            equivalent_m=2*Ydim-m-1;
-                        double xsumRe = 0.0, xsumIm = 0.0;
-                        for (int l = l1; l <= l2; l++)
-                        {
-                            double xminusl = x - (double) l;
-                            int equivalent_l=l;
-                            if      (l<0)
-                                equivalent_l=-l-1;
-                            else if (l>=Xdim)
-                                equivalent_l=2*Xdim-l-1;
-                            double CoeffRe = (double) DIRECT_A3D_ELEM(VfourierRealCoefs,equivalent_nn,equivalent_m,equivalent_l);
-                            double CoeffIm = (double) DIRECT_A3D_ELEM(VfourierImagCoefs,equivalent_nn,equivalent_m,equivalent_l);
-                            BSPLINE03(aux,xminusl);
-                            xsumRe += CoeffRe * aux;
-                            xsumIm += CoeffIm * aux;
-                        }
-
-                        double yminusm = y - (double) m;
-                        BSPLINE03(aux,yminusm);
-						yxsumRe += xsumRe * aux;
-						yxsumIm += xsumIm * aux;
+                        double xminusl = x - (double) l;
+                        int equivalent_l=l;
+                        if      (l<0)
+                            equivalent_l=-l-1;
+                        else if (l>=Xdim)
+                            equivalent_l=2*Xdim-l-1;
+                        double CoeffRe = (double) DIRECT_A3D_ELEM(VfourierRealCoefs,equivalent_nn,equivalent_m,equivalent_l);
+                        double CoeffIm = (double) DIRECT_A3D_ELEM(VfourierImagCoefs,equivalent_nn,equivalent_m,equivalent_l);
+                        BSPLINE03(aux,xminusl);
+                        xsumRe += CoeffRe * aux;
+                        xsumIm += CoeffIm * aux;
                     }
 
-                    double zminusn = z - (double) nn;
-                    BSPLINE03(aux,zminusn);
-					c += yxsumRe * aux;
-					d += yxsumIm * aux;
+                    double yminusm = y - (double) m;
+                    BSPLINE03(aux,yminusm);
+                    yxsumRe += xsumRe * aux;
+                    yxsumIm += xsumIm * aux;
                 }
-            }
 
-            // Phase shift to move the origin of the image to the corner
-            double a=DIRECT_A2D_ELEM(phaseShiftImgA,i,j);
-            double b=DIRECT_A2D_ELEM(phaseShiftImgB,i,j);
-            if (ctf!=NULL)
-            {
-            	double ctfij=DIRECT_A2D_ELEM(*ctf,i,j);
-            	a*=ctfij;
-            	b*=ctfij;
+                double zminusn = z - (double) nn;
+                BSPLINE03(aux,zminusn);
+                c += yxsumRe * aux;
+                d += yxsumIm * aux;
             }
+        }
+
+        // Phase shift to move the origin of the image to the corner
+        double a=sample.a;
+        double b=sample.b;
+        if (ctf!=NULL)
+        {
+            double ctfij=DIRECT_MULTIDIM_ELEM(*ctf,sample.n);
+            a*=ctfij;
+            b*=ctfij;
+        }
+
+        // Multiply Fourier coefficient in volume times phase shift
+        double ac = a * c;
+        double bd = b * d;
+        double ab_cd = (a + b) * (c + d);
 
-            // Multiply Fourier coefficient in volume times phase shift
-            double ac = a * c;
-            double bd = b * d;
-            double ab_cd = (a + b) * (c + d);
+        // And store the multiplication
+        double *ptrI_ij=(double *)&DIRECT_MULTIDIM_ELEM(projectionFourier,sample.n);
+        *ptrI_ij = ac - bd;
+        *(ptrI_ij+1) = ab_cd - ac - bd;
+    }
+}
+
+struct FourierProjectBatchArgs
+{
+    const FourierProjector *projector;
+    const Matrix2D<double> *angles;
+    MultidimArray<double> *projections;
+    const std::vector< MultidimArray<double> > *ctfs;
+    ThreadTaskDistributor *distributor;
+};
+
+static void projectBatchThread(ThreadArgument &thArg)
+{
+    FourierProjectBatchArgs *args = (FourierProjectBatchArgs *) thArg.data;
+    const FourierProjector &projector = *(args->projector);
+    const Matrix2D<double> &angles = *(args->angles);
+    const std::vector< MultidimArray<double> > *ctfs = args->ctfs;
 
-            // And store the multiplication
-            double *ptrI_ij=(double *)&DIRECT_A2D_ELEM(projectionFourier,i,j);
-            *ptrI_ij = ac - bd;
-            *(ptrI_ij+1) = ab_cd - ac - bd;
+    // Private buffers of this worker
+    Matrix2D<double> E;
+    MultidimArray< std::complex<double> > projectionFourier;
+    MultidimArray<double> projection(projector.volumeSize,projector.volumeSize);
+    FourierTransformer transformer;
+    transformer.FourierTransform(projection,projectionFourier,false);
+    size_t imgSize=MULTIDIM_SIZE(projection)*sizeof(double);
+
+    size_t first, last;
+    while (args->distributor->getTasks(first, last))
+        for (size_t n=first; n<=last; ++n)
+        {
+            const MultidimArray<double> *ctf=NULL;
+            if (ctfs!=NULL)
+                ctf=&((*ctfs)[ctfs->size()==1 ? 0 : n]);
+            projector.projectFourier(MAT_ELEM(angles,n,0),MAT_ELEM(angles,n,1),MAT_ELEM(angles,n,2),
+                                     E,projectionFourier,ctf);
+            transformer.inverseFourierTransform();
+            memcpy(MULTIDIM_ARRAY(*args->projections)+n*MULTIDIM_SIZE(projection),
+                   MULTIDIM_ARRAY(projection),imgSize);
         }
+}
+
+void FourierProjector::projectBatch(const Matrix2D<double> &angles, MultidimArray<double> &projections,
+                                    int nThreads, const std::vector< MultidimArray<double> > *ctfs) const
+{
+    size_t N=MAT_YSIZE(angles);
+    if (N>0 && MAT_XSIZE(angles)<3)
+        REPORT_ERROR(ERR_MATRIX_SIZE,"projectBatch: the angles must have 3 columns (rot, tilt, psi)");
+    if (ctfs!=NULL && ctfs->size()!=1 && ctfs->size()!=N)
+        REPORT_ERROR(ERR_ARG_INCORRECT,"projectBatch: there must be one CTF per projection or a single one");
+    projections.resizeNoCopy(N,1,volumeSize,volumeSize);
+    if (N==0)
+        return;
+
+    FourierProjectBatchArgs args;
+    args.projector=this;
+    args.angles=&angles;
+    args.projections=&projections;
+    args.ctfs=ctfs;
+    nThreads=XMIPP_MAX(1,XMIPP_MIN(nThreads,(int)N));
+    ThreadTaskDistributor distributor(N,XMIPP_MAX(1,XMIPP_MIN(N/(4*nThreads),16)));
+    args.distributor=&distributor;
+    if (nThreads==1)
+    {
+        ThreadArgument thArg;
+        thArg.thread_id=0;
+        thArg.threads=1;
+        thArg.data=&args;
+        projectBatchThread(thArg);
+    }
+    else
+    {
+        ThreadManager thMgr(nThreads);
+        thMgr.run(projectBatchThread,&args);
     }
-    transformer2D.inverseFourierTransform();
 }
 
 void FourierProjector::produceSideInfo()
@@ -224,6 +370,15 @@ void FourierProjector::produceSideInfo()
         //VfourierRealAux.clear();
         //VfourierImagAux.clear();
     }
+    else if (BSplineDeg==0 || BSplineDeg==1)
+    {
+        // Fast slice modes, interpolate the transform itself in single precision
+        VfourierFloat.resizeNoCopy(ZSIZE(Vfourier),YSIZE(Vfourier),2*XSIZE(Vfourier));
+        const double *ptrVfourier=(const double *)MULTIDIM_ARRAY(Vfourier);
+        FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(VfourierFloat)
+        DIRECT_MULTIDIM_ELEM(VfourierFloat,n)=(float)ptrVfourier[n];
+        Vfourier.clear();
+    }
     else
         Complex2RealImag(Vfourier, VfourierRealCoefs, VfourierImagCoefs);
 
@@ -247,12 +402,87 @@ void FourierProjector::produceSideInfo()
             sincos(dotp,&DIRECT_A2D_ELEM(phaseShiftImgB,i,j),&DIRECT_A2D_ELEM(phaseShiftImgA,i,j));
         }
     }
+
+    // List the coefficients below the maximum frequency, the rest of them are always 0
+    double maxFreq2=maxFrequency*maxFrequency;
+    sliceSamples.clear();
+    SliceSample sample;
+    for (size_t i=0; i<YSIZE(projectionFourier); ++i)
+    {
+        FFT_IDX2DIGFREQ(i,volumeSize,sample.freqy);
+        for (size_t j=0; j<XSIZE(projectionFourier); ++j)
+        {
+            FFT_IDX2DIGFREQ(j,volumeSize,sample.freqx);
+            if ((sample.freqy*sample.freqy+sample.freqx*sample.freqx)>maxFreq2)
+                continue;
+            sample.n=i*XSIZE(projectionFourier)+j;
+            sample.a=DIRECT_A2D_ELEM(phaseShiftImgA,i,j);
+            sample.b=DIRECT_A2D_ELEM(phaseShiftImgB,i,j);
+            sliceSamples.push_back(sample);
+        }
+    }
+}
+
+FourierProjector::Workspace &FourierProjector::acquireWorkspace()
+{
+    workspaceMutex.lock();
+    std::list<Workspace>::iterator it=workspaces.begin();
+    while (it!=workspaces.end() && it->busy)
+        ++it;
+    bool created=(it==workspaces.end());
+    if (created)
+        it=workspaces.insert(workspaces.end(),Workspace());
+    it->busy=true;
+    workspaceMutex.unlock();
+
+    if (created)
+    {
+        // The plan is made once per workspace, outside workspaceMutex
+        it->projection.initZeros(volumeSize,volumeSize);
+        it->projection.setXmippOrigin();
+        it->transformer.FourierTransform(it->projection,it->projectionFourier,false);
+    }
+    return *it;
+}
+
+void FourierProjector::releaseWorkspace(Workspace &workspace)
+{
+    workspaceMutex.lock();
+    workspace.busy=false;
+    workspaceMutex.unlock();
 }
 
 void projectVolume(FourierProjector &projector, Projection &P, int Ydim, int Xdim,
                    double rot, double tilt, double psi, const MultidimArray<double> *ctf)
 {
-	projector.project(rot,tilt,psi,ctf);
-    P() = projector.projection();
+    if (!projector.projectionMutex.tryLock())
+    {
+        // Another thread is using the projector buffers, work on a private workspace
+        FourierProjector::Workspace &workspace=projector.acquireWorkspace();
+        try
+        {
+            projector.projectFourier(rot,tilt,psi,workspace.E,workspace.projectionFourier,ctf);
+            workspace.transformer.inverseFourierTransform();
+            P()=workspace.projection;
+        }
+        catch (...)
+        {
+            projector.releaseWorkspace(workspace);
+            throw;
+        }
+        projector.releaseWorkspace(workspace);
+        return;
+    }
+    try
+    {
+        projector.project(rot,tilt,psi,ctf);
+        P() = projector.projection();
+    }
+    catch (...)
+    {
+        projector.projectionMutex.unlock();
+        throw;
+    }
+    projector.projectionMutex.unlock();
 }
 
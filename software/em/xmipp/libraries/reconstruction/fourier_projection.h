@@ -30,6 +30,8 @@
 #include <data/filters.h>
 #include <data/xmipp_fftw.h>
 #include <data/projection.h>
+#include <data/xmipp_threads.h>
+#include <list>
 
 /**@defgroup FourierProjection Fourier projection
    @ingroup ReconsLibrary */
@@ -43,7 +45,11 @@ public:
     double paddingFactor;
     /// Maximum Frequency for pixels
     double maxFrequency;
-    /// The order of B-Spline for interpolation
+    /** The order of B-Spline for interpolation.
+     * NEAREST (0) and LINEAR (1) are fast slice modes meant for coarse searches:
+     * they interpolate a single precision copy of the volume Fourier transform
+     * (VfourierFloat) and do not need any prefilter. BSPLINE3 interpolates the
+     * cubic B-spline coefficients. */
     double BSplineDeg;
 
 public:
@@ -53,9 +59,25 @@ public:
     // Volume to project
     MultidimArray<double> *volume;
 
-    // Real and imaginary B-spline coefficients for Fourier of the volume
+    // Real and imaginary B-spline coefficients for Fourier of the volume (BSPLINE3)
     MultidimArray< double > VfourierRealCoefs, VfourierImagCoefs;
 
+    /* Centered Fourier transform of the volume in single precision (NEAREST and LINEAR).
+     * Real and imaginary parts are interleaved along X, so that XSIZE is twice the padded size */
+    MultidimArray<float> VfourierFloat;
+
+    /* Coefficient of the projection Fourier transform below the maximum frequency,
+     * with its digital frequency and the phase shift that moves the origin to the corner */
+    struct SliceSample
+    {
+        size_t n;
+        double freqx, freqy;
+        double a, b;
+    };
+
+    // Samples of the projection Fourier transform to interpolate, in memory order
+    std::vector<SliceSample> sliceSamples;
+
     // Projection in Fourier space
     MultidimArray< std::complex<double> > projectionFourier;
 
@@ -70,6 +92,28 @@ public:
 
     // Euler matrix
     Matrix2D<double> E;
+
+    /* Owner of the projection buffers above. When it is taken, other
+     * threads calling projectVolume use one of the workspaces below */
+    Mutex projectionMutex;
+
+    /* Fourier buffers of a thread that found projectionMutex taken.
+     * They are kept after the call, so that each concurrent thread
+     * plans its FFT only once */
+    struct Workspace
+    {
+        Matrix2D<double> E;
+        MultidimArray< std::complex<double> > projectionFourier;
+        MultidimArray<double> projection;
+        FourierTransformer transformer;
+        bool busy;
+    };
+
+    // Workspaces created so far, the list keeps their addresses
+    std::list<Workspace> workspaces;
+
+    // Protects the busy flags of the workspaces
+    Mutex workspaceMutex;
 public:
     /*
      * The constructor of the class
@@ -77,9 +121,37 @@ public:
     FourierProjector(MultidimArray<double> &V, double paddFactor, double maxFreq, int BSplinedegree);
 
     /**
-     * This method gets the volume's Fourier and the Euler's angles as the inputs and interpolates the related projection
+     * This method gets the volume's Fourier and the Euler's angles as the inputs and interpolates the related projection.
+     * The result is left in projection, so this method is not reentrant; use projectVolume from several threads.
      */
     void project(double rot, double tilt, double psi, const MultidimArray<double> *ctf=NULL);
+
+    /**
+     * Interpolate the Fourier transform of the projection in the given buffers.
+     * Euler and projFourier are written, projFourier must have the size of projectionFourier.
+     * The projector is not modified, so several threads may call it at the same time.
+     */
+    void projectFourier(double rot, double tilt, double psi, Matrix2D<double> &Euler,
+                        MultidimArray< std::complex<double> > &projFourier,
+                        const MultidimArray<double> *ctf=NULL) const;
+
+    /**
+     * Projections of a set of directions.
+     * Row n of angles holds the rot, tilt and psi of projection n, which is stored in the
+     * image n of projections (it is resized to angles.mdimy images of the volume size).
+     * If ctfs is given, it holds either one CTF per projection or a single CTF for all of them,
+     * with the shape of the Fourier transform of the projections (see projectFourier).
+     * The interpolated volume is shared by nThreads workers, each one with its own
+     * Fourier buffers. The projector is not modified, so it may be called from several threads.
+     */
+    void projectBatch(const Matrix2D<double> &angles, MultidimArray<double> &projections, int nThreads=1,
+                      const std::vector< MultidimArray<double> > *ctfs=NULL) const;
+
+    /// Take a free workspace, a new one is created if all of them are busy
+    Workspace &acquireWorkspace();
+
+    /// Give back a workspace taken with acquireWorkspace
+    void releaseWorkspace(Workspace &workspace);
 private:
     /*
      * This is a private method which provides the values for the class variable
@@ -88,7 +160,8 @@ private:
 };
 
 /*
- * This function gets an object form the FourierProjection class and makes the desired projection in Fourier space
+ * This function gets an object form the FourierProjection class and makes the desired projection in Fourier space.
+ * It can be called from several threads sharing the same projector.
  */
 void projectVolume(FourierProjector &projector, Projection &P, int Ydim, int Xdim,
                    double rot, double tilt, double psi, const MultidimArray<double> *ctf=NULL);
@@ -809,9 +809,10 @@ void ProgML2D::expectationSingleImage(Matrix1D<double> &opt_offsets)
     if (model.do_norm)
     {
         // 1. Calculate optimal setting of Mimg
-        MultidimArray<double> Maux2 = Mimg;
-        selfTranslate(LINEAR, Maux2, opt_offsets, true);
-        selfApplyGeometry(LINEAR, Maux2, F[iopt_flip], IS_INV, WRAP);
+        MultidimArray<double> Maux2;
+        TransformationBuilder T;
+        T.shift(opt_offsets).matrix(F[iopt_flip], IS_INV);
+        T.apply(LINEAR, Maux2, Mimg, WRAP);
         // 2. Calculate optimal setting of Mref
         int refnoipsi = (opt_refno % model.n_ref) * nr_psi + iopt_psi;
         FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY2D(Faux)
@@ -504,6 +504,8 @@ ProgMLTomo::run()
 
     writeOutputFiles(-1, wsumweds, sumw_allrefs, LL, sumcorr, conv, fsc);
 
+    if (verbose && getThreadAffinityPolicy() != AFFINITY_NONE)
+        threadPlacementReport(std::cout);
 }
 
 // Show ====================================================================
@@ -2721,6 +2723,7 @@ threadMLTomoExpectationSingleImage(void * data)
     MultidimArray<double> *sumw = thread_data->sumw;
     std::vector<size_t> * imgs_id = thread_data->imgs_id;
     ThreadTaskDistributor * distributor = thread_data->distributor;
+    applyThreadAffinity(thread_id);
 
     //#define DEBUG_THREAD
 #ifdef DEBUG_THREAD
@@ -2754,6 +2757,7 @@ threadMLTomoExpectationSingleImage(void * data)
         //Work while there are tasks to do
         while (distributor->getTasks(firstIndex, lastIndex))
         {
+            logThreadPlacement(thread_id);
             for (size_t imgno = firstIndex; imgno <= lastIndex; ++imgno)
             {
                 //TODO: Check if really needed the mutexes
@@ -36,6 +36,7 @@ void ProgProject::readParams()
     fnPhantom = getParam("-i");
     fnOut = getParam("-o");
     samplingRate  = getDoubleParam("--sampling_rate");
+    Nthreads = getIntParam("--thr");
     singleProjection = false;
     if (STR_EQUAL(getParam("--method"), "real_space"))
         projType = REALSPACE;
@@ -114,6 +115,7 @@ void ProgProject::defineParams()
     addParamsLine("                                              : linear:           Linear BSpline  ");
     addParamsLine("                                              :+++                        %BR% ");
     addParamsLine("                                              : bspline:          Cubic BSpline  ");
+    addParamsLine("  [--thr <N=1>]                               : Number of threads for the real space projection");
     addParamsLine("== Generating a set of projections == ");
     addParamsLine("  [--params <parameters_file>]           : File containing projection parameters");
     addParamsLine("                                         : Check the manual for a description of the parameters");
@@ -915,6 +917,7 @@ void PROJECT_Side_Info::produce_Side_Info(ParametersProjection &prm,
     paddFactor = prog_prm.paddFactor;
     maxFrequency = prog_prm.maxFrequency;
     BSplineDeg = prog_prm.BSplineDeg;
+    Nthreads = prog_prm.Nthreads;
 }
 
 /* Effectively project ===================================================== */
@@ -973,6 +976,10 @@ int PROJECT_Effectively_project(const FileName &fnOut,
     if (projType == FOURIER && side.phantomMode==PROJECT_Side_Info::VOXEL)//////////////////////
         Vfourier=new FourierProjector(side.phantomVol(),side.paddFactor,side.maxFrequency,side.BSplineDeg);
                                      ///                   1              .5                        NEAREST
+    // The threads of the real space projection are created once
+    ThreadManager *thMgr=NULL;
+    if (projType == REALSPACE && side.phantomMode==PROJECT_Side_Info::VOXEL && side.Nthreads > 1)
+        thMgr=new ThreadManager(side.Nthreads);
     fn_proj=fnOut;
     if (side.doCrystal)
         createEmptyFile(fn_proj, prm_crystal.crystal_Xdim, prm_crystal.crystal_Ydim,
@@ -1071,7 +1078,7 @@ int PROJECT_Effectively_project(const FileName &fnOut,
                               rot, tilt, psi);
             else if (projType == REALSPACE)
                 projectVolume(side.phantomVol(), proj, prm.proj_Ydim, prm.proj_Xdim,
-                              rot, tilt, psi);
+                              rot, tilt, psi, NULL, side.Nthreads, thMgr);
 
             if (hasCTF)
             	ctf.applyCTF(proj(),sampling_rate, prm.doPhaseFlip);
@@ -1147,6 +1154,7 @@ int PROJECT_Effectively_project(const FileName &fnOut,
     // release memory
     delete Vshears;
     delete Vfourier;
+    delete thMgr;
 
     return NumProjs;
 }
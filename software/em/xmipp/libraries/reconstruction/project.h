@@ -83,6 +83,8 @@ public:
     double maxFrequency;
     /// The type of interpolation (NEAR
     int BSplineDeg;
+    /// Number of threads for the real space projection
+    int Nthreads;
 
 public:
     /** Read parameters. */
@@ -233,6 +235,8 @@ public:
     int BSplineDeg;
     /// Is this a crystal projection
     bool doCrystal;
+    /// Number of threads for the real space projection
+    int Nthreads;
 
 public:
     /** Produce Project Side information.
@@ -34,6 +34,7 @@ void ProgProjectTomography::defineParams()
     addSeeAlsoLine("phantom_create, phantom_project, xray_project");
     //Params
     projParam.defineParams(this);
+    addParamsLine("[--thr <N=1>]            : Number of threads sharing the rows of each projection");
     //Examples
     addExampleLine("Generating a set of projections using a projection parameter:", false);
     addExampleLine("xmipp_xray_project -i volume.vol --oroot images --params projParams.xmd");
@@ -50,6 +51,7 @@ void ProgProjectTomography::defineParams()
 void ProgProjectTomography::readParams()
 {
     projParam.readParams(this);
+    Nthreads = getIntParam("--thr");
 }
 
 void ProgProjectTomography::run()
@@ -76,6 +78,10 @@ void ProgProjectTomography::run()
     FileName fn_proj;              // Projection name
     int idx = 1;
     size_t objId;
+    // The threads that share the rows are created once for all projections
+    ThreadManager *thMgr=NULL;
+    if (Nthreads > 1 && !projParam.only_create_angles)
+        thMgr=new ThreadManager(Nthreads);
 
     for (double angle=projParam.tilt0; angle<=projParam.tiltF; angle+=projParam.tiltStep)
     {
@@ -95,7 +101,7 @@ void ProgProjectTomography::run()
         // Really project ....................................................
         if (!projParam.only_create_angles)
             projectVolumeOffCentered(side.phantomVol(), proj,
-                                     projParam.proj_Ydim, projParam.proj_Xdim);
+                                     projParam.proj_Ydim, projParam.proj_Xdim, Nthreads, thMgr);
 
         // Add noise in angles and voxels ....................................
         proj.getEulerAngles(tRot, tTilt,tPsi);
@@ -135,6 +141,7 @@ void ProgProjectTomography::run()
         numProjs++;
         idx++;
     }
+    delete thMgr;
     if (!projParam.show_angles)
         progress_bar(expectedNumProjs);
 
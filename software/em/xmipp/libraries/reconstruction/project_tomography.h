@@ -43,6 +43,8 @@ public:
     FileName fn_sel_file;
     /// Projection parameters
     ParametersProjectionTomography projParam;
+    /// Number of threads sharing the rows of each projection
+    int Nthreads;
 
 protected:
     virtual void defineParams();
@@ -40,6 +40,14 @@ ProgReconsADMM::ProgReconsADMM(): XmippProgram()
 {
 	rank=0;
 	Nprocs=1;
+	Nthreads=1;
+	useFloat=false;
+	thMgr=NULL;
+}
+
+ProgReconsADMM::~ProgReconsADMM()
+{
+	delete thMgr;
 }
 
 void ProgReconsADMM::defineParams()
@@ -67,6 +75,9 @@ void ProgReconsADMM::defineParams()
     addParamsLine(" [--positivity]: Positivity constraint");
     addParamsLine(" [--sym <s=c1>]: Symmetry constraint");
     addParamsLine(" [--saveIntermediate]: Save Htb and HtKH volumes for posterior calls");
+    addParamsLine(" [--thr <N=1>]: Number of threads for the conjugate gradient and its Fourier transforms");
+    addParamsLine(" [--float]: Keep the conjugate gradient vectors and the kernel in single precision");
+    addParamsLine("          : This reduces the memory needed by large volumes");
 
     mask.defineParams(this,INT_MASK);
 }
@@ -96,6 +107,8 @@ void ProgReconsADMM::readParams()
 	Nadmmiter=getIntParam("--admmiter");
 	positivity=checkParam("--positivity");
 	saveIntermediate=checkParam("--saveIntermediate");
+	Nthreads=getIntParam("--thr");
+	useFloat=checkParam("--float");
 
 	applyMask=checkParam("--mask");
 	if (applyMask)
@@ -182,12 +195,40 @@ void ProgReconsADMM::produceSideInfo()
 		kernelV.read(fnHtKH);
 		kernelV().setXmippOrigin();
 	}
+	prepareConjugateGradient(kernelV());
+
+	// Prepare mask
+	if (applyMask)
+		mask.generate_mask(CHtb());
+	synchronize();
+}
+
+void ProgReconsADMM::prepareConjugateGradient(MultidimArray<double> &kernelV)
+{
+	// Threads for the conjugate gradient. FFTW plans created from now on
+	// are also threaded
+	if (Nthreads>1 && thMgr==NULL)
+	{
+		thMgr=new ThreadManager(Nthreads,this);
+		transformerPaddedx.setThreadsNumber(Nthreads);
+	}
+
 	FourierTransformer transformer;
-	transformer.FourierTransform(kernelV(),fourierKernelV,true);
+	transformer.FourierTransform(kernelV,fourierKernelV,true);
 
 	// Add regularization in Fourier space
 	addRegularizationTerms();
 
+	// Keep the kernel in single precision
+	if (useFloat)
+	{
+		fourierKernelVf.resizeNoCopy(2*MULTIDIM_SIZE(fourierKernelV));
+		const double *ptrKernel=(const double *)MULTIDIM_ARRAY(fourierKernelV);
+		FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(fourierKernelVf)
+			DIRECT_MULTIDIM_ELEM(fourierKernelVf,n)=(float)ptrKernel[n];
+		fourierKernelV.clear();
+	}
+
 	// Resize u and d volumes
 	ux.initZeros(CHtb());
 	ux.setXmippOrigin();
@@ -209,11 +250,6 @@ void ProgReconsADMM::produceSideInfo()
 
 	ud=ux;
 	transformerL.setReal(ud);
-
-	// Prepare mask
-	if (applyMask)
-		mask.generate_mask(CHtb());
-	synchronize();
 }
 
 void ProgReconsADMM::show()
@@ -489,37 +525,198 @@ void ProgReconsADMM::addRegularizationTerms()
 	}
 }
 
-void ProgReconsADMM::applyKernel3D(MultidimArray<double> &x, MultidimArray<double> &AtAx)
+void ProgReconsADMM::runThreads(ThreadFunction function, void *data)
+{
+	if (thMgr!=NULL)
+		thMgr->run(function,data);
+	else
+	{
+		ThreadArgument thArg;
+		thArg.thread_id=0;
+		thArg.threads=1;
+		thArg.data=data;
+		thArg.workClass=this;
+		function(thArg);
+	}
+}
+
+template <typename T>
+struct AdmmPaddingArgs
 {
-	paddedx.initZeros(2*ZSIZE(x)-1,2*YSIZE(x)-1,2*XSIZE(x)-1);
+	const MultidimArray<T> *x;
+	MultidimArray<double> *paddedx;
+	ThreadTaskDistributor *distributor;
+};
+
+/* Copy x into the center of the zero padded volume, distributing slices */
+template <typename T>
+static void threadPadVolume(ThreadArgument &thArg)
+{
+	AdmmPaddingArgs<T> *args=(AdmmPaddingArgs<T> *) thArg.data;
+	const MultidimArray<T> &x=*(args->x);
+	MultidimArray<double> &paddedx=*(args->paddedx);
+	size_t rowSize=XSIZE(paddedx)*sizeof(double);
+	int j0=STARTINGX(x)-STARTINGX(paddedx);
+
+	size_t first, last;
+	while (args->distributor->getTasks(first,last))
+		for (size_t kp=first; kp<=last; ++kp)
+		{
+			int k=(int)kp+STARTINGZ(paddedx);
+			for (size_t ip=0; ip<YSIZE(paddedx); ++ip)
+			{
+				int i=(int)ip+STARTINGY(paddedx);
+				double *ptrPadded=&DIRECT_A3D_ELEM(paddedx,kp,ip,0);
+				memset(ptrPadded,0,rowSize);
+				if (k>=STARTINGZ(x) && k<=FINISHINGZ(x) && i>=STARTINGY(x) && i<=FINISHINGY(x))
+				{
+					ptrPadded+=j0;
+					const T *ptrX=&A3D_ELEM(x,k,i,STARTINGX(x));
+					for (size_t j=0; j<XSIZE(x); ++j)
+						ptrPadded[j]=ptrX[j];
+				}
+			}
+		}
+}
+
+struct AdmmKernelArgs
+{
+	MultidimArray< std::complex<double> > *fourier;
+	const MultidimArray< std::complex<double> > *kernel;
+	const MultidimArray<float> *kernelf;
+	double K;
+	ThreadTaskDistributor *distributor;
+};
+
+/* Multiply the Fourier transform by the kernel */
+static void threadApplyFourierKernel(ThreadArgument &thArg)
+{
+	AdmmKernelArgs *args=(AdmmKernelArgs *) thArg.data;
+	MultidimArray< std::complex<double> > &fourier=*(args->fourier);
+	double K=args->K;
+	size_t first, last;
+	while (args->distributor->getTasks(first,last))
+		if (args->kernelf==NULL)
+		{
+			const MultidimArray< std::complex<double> > &kernel=*(args->kernel);
+			for (size_t n=first; n<=last; ++n)
+			{
+				DIRECT_MULTIDIM_ELEM(fourier,n)*=DIRECT_MULTIDIM_ELEM(kernel,n);
+				DIRECT_MULTIDIM_ELEM(fourier,n)*=K;
+			}
+		}
+		else
+		{
+			const float *ptrKernel=MULTIDIM_ARRAY(*(args->kernelf));
+			for (size_t n=first; n<=last; ++n)
+			{
+				DIRECT_MULTIDIM_ELEM(fourier,n)*=std::complex<double>(ptrKernel[2*n],ptrKernel[2*n+1]);
+				DIRECT_MULTIDIM_ELEM(fourier,n)*=K;
+			}
+		}
+}
+
+template <typename T>
+struct AdmmCropArgs
+{
+	const MultidimArray<double> *paddedx;
+	MultidimArray<T> *AtAx;
+	const MultidimArray<T> *p;
+	std::vector<size_t> kp, ip, jp; // Index in paddedx of each index of AtAx
+	std::vector<double> dot; // Dot product of each slice
+	ThreadTaskDistributor *distributor;
+};
+
+/* Crop the central region of the padded volume, which is not centered
+ * after the inverse Fourier transform, and compute the dot product with p */
+template <typename T>
+static void threadCropVolume(ThreadArgument &thArg)
+{
+	AdmmCropArgs<T> *args=(AdmmCropArgs<T> *) thArg.data;
+	const MultidimArray<double> &paddedx=*(args->paddedx);
+	MultidimArray<T> &AtAx=*(args->AtAx);
+	const size_t *jp=&(args->jp[0]);
+
+	size_t first, last;
+	while (args->distributor->getTasks(first,last))
+		for (size_t k=first; k<=last; ++k)
+		{
+			double dot=0;
+			for (size_t i=0; i<YSIZE(AtAx); ++i)
+			{
+				const double *ptrPadded=&DIRECT_A3D_ELEM(paddedx,args->kp[k],args->ip[i],0);
+				T *ptrAtAx=&DIRECT_A3D_ELEM(AtAx,k,i,0);
+				for (size_t j=0; j<XSIZE(AtAx); ++j)
+					ptrAtAx[j]=(T)ptrPadded[jp[j]];
+				if (args->p!=NULL)
+				{
+					const T *ptrP=&DIRECT_A3D_ELEM(*(args->p),k,i,0);
+					for (size_t j=0; j<XSIZE(AtAx); ++j)
+						dot+=(double)ptrP[j]*ptrAtAx[j];
+				}
+			}
+			args->dot[k]=dot;
+		}
+}
+
+/* Index of the padded volume that goes to each logical index after CenterFFT(paddedx,false) */
+static void centeredIndexes(size_t size, int startingPadded, size_t sizePadded, int starting, std::vector<size_t> &idx)
+{
+	idx.resize(size);
+	for (size_t n=0; n<size; ++n)
+		idx[n]=((int)n+starting-startingPadded+sizePadded/2)%sizePadded;
+}
+
+template <typename T1, typename T2>
+double ProgReconsADMM::applyKernel3D(const MultidimArray<T1> &x, MultidimArray<T2> &AtAx, const MultidimArray<T2> *p)
+{
+	paddedx.resizeNoCopy(2*ZSIZE(x)-1,2*YSIZE(x)-1,2*XSIZE(x)-1);
 	paddedx.setXmippOrigin();
 
-	// Copy Vk into paddedx
-	for (int k=STARTINGZ(x); k<=FINISHINGZ(x); ++k)
-		for (int i=STARTINGY(x); i<=FINISHINGY(x); ++i)
-			memcpy(&A3D_ELEM(paddedx,k,i,STARTINGX(x)),&A3D_ELEM(x,k,i,STARTINGX(x)),XSIZE(x)*sizeof(double));
+	// Copy x into paddedx
+	AdmmPaddingArgs<T1> padArgs;
+	padArgs.x=&x;
+	padArgs.paddedx=&paddedx;
+	ThreadTaskDistributor padDistributor(ZSIZE(paddedx),1);
+	padArgs.distributor=&padDistributor;
+	runThreads(threadPadVolume<T1>,&padArgs);
 
 	// Compute Fourier transform of paddedx
 	transformerPaddedx.setReal(paddedx);
 	transformerPaddedx.FourierTransform();
 
 	// Apply kernel
-	double K=MULTIDIM_SIZE(paddedx);
-	FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(transformerPaddedx.fFourier)
-	{
-		DIRECT_MULTIDIM_ELEM(transformerPaddedx.fFourier,n)*=DIRECT_MULTIDIM_ELEM(fourierKernelV,n);
-		DIRECT_MULTIDIM_ELEM(transformerPaddedx.fFourier,n)*=K;
-	}
+	AdmmKernelArgs kernelArgs;
+	kernelArgs.fourier=&transformerPaddedx.fFourier;
+	kernelArgs.kernel=&fourierKernelV;
+	kernelArgs.kernelf=useFloat ? &fourierKernelVf : NULL;
+	kernelArgs.K=MULTIDIM_SIZE(paddedx);
+	size_t Nfourier=MULTIDIM_SIZE(transformerPaddedx.fFourier);
+	ThreadTaskDistributor kernelDistributor(Nfourier,XMIPP_MIN(Nfourier,(size_t)16384));
+	kernelArgs.distributor=&kernelDistributor;
+	runThreads(threadApplyFourierKernel,&kernelArgs);
 
 	// Inverse Fourier transform
 	transformerPaddedx.inverseFourierTransform();
-	CenterFFT(paddedx,false);
 
 	// Crop central region
-	AtAx.resize(x);
-	for (int k=STARTINGZ(x); k<=FINISHINGZ(x); ++k)
-		for (int i=STARTINGY(x); i<=FINISHINGY(x); ++i)
-			memcpy(&A3D_ELEM(AtAx,k,i,STARTINGX(x)),&A3D_ELEM(paddedx,k,i,STARTINGX(x)),XSIZE(x)*sizeof(double));
+	AtAx.resizeNoCopy(x);
+	AdmmCropArgs<T2> cropArgs;
+	cropArgs.paddedx=&paddedx;
+	cropArgs.AtAx=&AtAx;
+	cropArgs.p=p;
+	centeredIndexes(ZSIZE(x),STARTINGZ(paddedx),ZSIZE(paddedx),STARTINGZ(x),cropArgs.kp);
+	centeredIndexes(YSIZE(x),STARTINGY(paddedx),YSIZE(paddedx),STARTINGY(x),cropArgs.ip);
+	centeredIndexes(XSIZE(x),STARTINGX(paddedx),XSIZE(paddedx),STARTINGX(x),cropArgs.jp);
+	cropArgs.dot.resize(ZSIZE(x));
+	ThreadTaskDistributor cropDistributor(ZSIZE(x),1);
+	cropArgs.distributor=&cropDistributor;
+	runThreads(threadCropVolume<T2>,&cropArgs);
+
+	double dot=0;
+	for (size_t k=0; k<ZSIZE(x); ++k)
+		dot+=cropArgs.dot[k];
+	return dot;
 }
 
 void ProgReconsADMM::applyLFilter(MultidimArray< std::complex<double> > &fourierL, bool adjoint)
@@ -533,76 +730,181 @@ void ProgReconsADMM::applyLFilter(MultidimArray< std::complex<double> > &fourier
 		ud*=-1;
 }
 
+
+/* Vector operations of the conjugate gradient. They are distributed among the
+ * threads in chunks of fixed size and the partial sums are added in order, so
+ * that the result does not depend on the number of threads. */
+#define ADMM_CHUNK 32768
+
+enum AdmmVectorOperation
+{
+	ADMM_SET,        // r=ud
+	ADMM_ADD,        // r+=ud
+	ADMM_RESIDUAL,   // r=(r+ud)*alpha+b-AtAp, returns |r|^2
+	ADMM_UPDATE,     // r-=alpha*AtAp, x+=alpha*p, returns |r|^2
+	ADMM_DIRECTION,  // p=r+alpha*p
+	ADMM_DIFFERENCE  // ud=u-d
+};
+
+template <typename T>
+struct AdmmVectorArgs
+{
+	AdmmVectorOperation op;
+	size_t N;
+	double alpha;
+	T *r, *p, *AtAp;
+	double *x, *b, *ud;
+	const double *u, *d;
+	std::vector<double> sum2; // Sum of squares of each chunk
+	ThreadTaskDistributor *distributor;
+};
+
+template <typename T>
+static void threadVectorOperation(ThreadArgument &thArg)
+{
+	AdmmVectorArgs<T> *args=(AdmmVectorArgs<T> *) thArg.data;
+	T *r=args->r, *p=args->p, *AtAp=args->AtAp;
+	double *x=args->x, *ud=args->ud;
+	const double *b=args->b, *u=args->u, *d=args->d;
+	double alpha=args->alpha;
+
+	size_t first, last;
+	while (args->distributor->getTasks(first,last))
+		for (size_t chunk=first; chunk<=last; ++chunk)
+		{
+			size_t n0=chunk*ADMM_CHUNK;
+			size_t nF=XMIPP_MIN(n0+ADMM_CHUNK,args->N);
+			double sum2=0;
+			switch (args->op)
+			{
+			case ADMM_SET:
+				for (size_t n=n0; n<nF; ++n)
+					r[n]=(T)ud[n];
+				break;
+			case ADMM_ADD:
+				for (size_t n=n0; n<nF; ++n)
+					r[n]+=ud[n];
+				break;
+			case ADMM_RESIDUAL:
+				for (size_t n=n0; n<nF; ++n)
+				{
+					r[n]=(T)((r[n]+ud[n])*alpha+b[n]-AtAp[n]);
+					sum2+=(double)r[n]*r[n];
+				}
+				break;
+			case ADMM_UPDATE:
+				for (size_t n=n0; n<nF; ++n)
+				{
+					r[n]-=alpha*AtAp[n];
+					x[n]+=alpha*p[n];
+					sum2+=(double)r[n]*r[n];
+				}
+				break;
+			case ADMM_DIRECTION:
+				for (size_t n=n0; n<nF; ++n)
+					p[n]=(T)(r[n]+alpha*p[n]);
+				break;
+			case ADMM_DIFFERENCE:
+				for (size_t n=n0; n<nF; ++n)
+					ud[n]=u[n]-d[n];
+				break;
+			}
+			args->sum2[chunk]=sum2;
+		}
+}
+
+/* Run a vector operation and return the sum of squares of its result */
+template <typename T>
+static double vectorOperation(ProgReconsADMM &prog, AdmmVectorArgs<T> &args, AdmmVectorOperation op, double alpha=0)
+{
+	size_t Nchunks=(args.N+ADMM_CHUNK-1)/ADMM_CHUNK;
+	args.op=op;
+	args.alpha=alpha;
+	args.sum2.resize(Nchunks);
+	ThreadTaskDistributor distributor(Nchunks,1);
+	args.distributor=&distributor;
+	prog.runThreads(threadVectorOperation<T>,&args);
+
+	double sum2=0;
+	for (size_t chunk=0; chunk<Nchunks; ++chunk)
+		sum2+=args.sum2[chunk];
+	return sum2;
+}
+
 void ProgReconsADMM::applyLtFilter(MultidimArray< std::complex<double> > &fourierL, MultidimArray<double> &u, MultidimArray<double> &d)
 {
-	FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(ud)
-		DIRECT_MULTIDIM_ELEM(ud,n)=DIRECT_MULTIDIM_ELEM(u,n)-DIRECT_MULTIDIM_ELEM(d,n);
+	AdmmVectorArgs<double> args;
+	args.N=MULTIDIM_SIZE(ud);
+	args.ud=MULTIDIM_ARRAY(ud);
+	args.u=MULTIDIM_ARRAY(u);
+	args.d=MULTIDIM_ARRAY(d);
+	vectorOperation(*this,args,ADMM_DIFFERENCE);
 	applyLFilter(fourierL,true);
 }
 
-void ProgReconsADMM::applyConjugateGradient()
+template <typename T>
+void ProgReconsADMM::conjugateGradient(MultidimArray<T> &r, MultidimArray<T> &p, MultidimArray<T> &AtAp)
 {
-	// Conjugate gradient is solving Ax=b, when A is symmetric (=> positive semidefinite) and we apply it
-	// to the problem
-	// (H^T K H+mu L^TL + lambda I) x = H^Tb + mu L^T(u-d)
-	// Being H the projection operator
-	//       K the CTF operator
-	//       L the gradient operator
+	MultidimArray<double> &mCk=Ck();
+	r.resizeNoCopy(mCk);
+	p.resizeNoCopy(mCk);
+	AtAp.resizeNoCopy(mCk);
+
+	AdmmVectorArgs<T> args;
+	args.N=MULTIDIM_SIZE(mCk);
+	args.r=MULTIDIM_ARRAY(r);
+	args.p=MULTIDIM_ARRAY(p);
+	args.AtAp=MULTIDIM_ARRAY(AtAp);
+	args.x=MULTIDIM_ARRAY(mCk);
+	args.b=MULTIDIM_ARRAY(CHtb());
+	args.ud=MULTIDIM_ARRAY(ud);
+
+	// Apply A^tA to the current estimate of the reconstruction
+	applyKernel3D(mCk,AtAp);
 
 	// Compute H^tb+mu*L^t(u-d)
-	MultidimArray<double> r;
 	applyLtFilter(fourierLx,ux,dx);
-	r=ud;
+	vectorOperation(*this,args,ADMM_SET);
 	applyLtFilter(fourierLy,uy,dy);
-	r+=ud;
+	vectorOperation(*this,args,ADMM_ADD);
 	applyLtFilter(fourierLz,uz,dz);
-	r+=ud;
-	r*=mu;
-
-	r+=CHtb();
-
-	// Apply A^tA to the current estimate of the reconstruction
-	MultidimArray<double> AtAVk;
-	applyKernel3D(Ck(),AtAVk);
 
 	// Compute first residual. This is the negative gradient of ||Ax-b||^2
-	r-=AtAVk;
-	double d=r.sum2();
+	double d=vectorOperation(*this,args,ADMM_RESIDUAL,mu);
 
 	// Search direction
-	MultidimArray<double> p, AtAp;
 	p=r;
 
 	// Perform CG iterations
-	MultidimArray<double> &mCk=Ck();
-
 	for (int iter=0; iter<Ncgiter; ++iter)
 	{
-		applyKernel3D(p,AtAp);
-		double alpha=d/p.dotProduct(AtAp);
+		double alpha=d/applyKernel3D(p,AtAp,&p);
 
 		// Update residual and current estimate
-		FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(r)
-		{
-			DIRECT_MULTIDIM_ELEM(r,n)  -=alpha*DIRECT_MULTIDIM_ELEM(AtAp,n);
-			DIRECT_MULTIDIM_ELEM(mCk,n)+=alpha*DIRECT_MULTIDIM_ELEM(p,n);
-		}
-		double newd=r.sum2();
+		double newd=vectorOperation(*this,args,ADMM_UPDATE,alpha);
 		double beta=newd/d;
 		d=newd;
 
 		// Update search direction
-		FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(p)
-			DIRECT_MULTIDIM_ELEM(p,n)  = DIRECT_MULTIDIM_ELEM(r,n)+beta*DIRECT_MULTIDIM_ELEM(p,n);
-
-//		Image<double> save;
-//		save()=Vk();
-//		save.write("PPPVk.vol");
-//		std::cout << "Press any key" << std::endl;
-//		char c; std::cin >> c;
+		vectorOperation(*this,args,ADMM_DIRECTION,beta);
 	}
 }
 
+void ProgReconsADMM::applyConjugateGradient()
+{
+	// Conjugate gradient is solving Ax=b, when A is symmetric (=> positive semidefinite) and we apply it
+	// to the problem
+	// (H^T K H+mu L^TL + lambda I) x = H^Tb + mu L^T(u-d)
+	// Being H the projection operator
+	//       K the CTF operator
+	//       L the gradient operator
+	// The work vectors are kept between calls, in single precision if requested
+	if (useFloat)
+		conjugateGradient(cgRf,cgPf,cgAtApf);
+	else
+		conjugateGradient(cgR,cgP,cgAtAp);
+}
+
 void ProgReconsADMM::doPOCSProjection()
 {
 	if (applyMask)
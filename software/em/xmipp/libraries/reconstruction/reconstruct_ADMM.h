@@ -32,6 +32,7 @@
 #include <data/ctf.h>
 #include <data/mask.h>
 #include <data/symmetries.h>
+#include <data/xmipp_threads.h>
 
 /**@defgroup ReconstructADMMProgram Reconstruct Alternating Direction Method of Multipliers
    @ingroup ReconsLibrary */
@@ -93,10 +94,13 @@ public:
 	Mask mask; // Mask
 	String symmetry;
 	bool saveIntermediate;
+	int Nthreads; // Number of threads
+	bool useFloat; // Conjugate gradient vectors and kernel in single precision
 	size_t Nprocs;
 	size_t rank;
 public:
 	ProgReconsADMM();
+	~ProgReconsADMM();
     void defineParams();
     void readParams();
     void show();
@@ -122,8 +126,16 @@ public:
     /** Add regularization to the kernel */
     void addRegularizationTerms();
 
-    /** Apply kernel 3D */
-    void applyKernel3D(MultidimArray<double> &x, MultidimArray<double> &AtAx);
+    /** Prepare the conjugate gradient from H^t*K*H.
+        The kernel with the regularization terms, the filters of the gradients and the
+        threads are set up. CHtb and Ck must have been initialized. */
+    void prepareConjugateGradient(MultidimArray<double> &kernelV);
+
+    /** Apply kernel 3D.
+     * If p is given, the dot product between p and AtAx is returned.
+     * The volumes can be in single or double precision. */
+    template <typename T1, typename T2>
+    double applyKernel3D(const MultidimArray<T1> &x, MultidimArray<T2> &AtAx, const MultidimArray<T2> *p=NULL);
 
     /** Apply Lt filter */
     void applyLFilter(MultidimArray< std::complex<double> > &fourierL, bool adjoint=false);
@@ -132,6 +144,13 @@ public:
     /** Apply conjugate gradient */
     void applyConjugateGradient();
 
+    /** Conjugate gradient iterations with r, p and A^tAp as work vectors */
+    template <typename T>
+    void conjugateGradient(MultidimArray<T> &r, MultidimArray<T> &p, MultidimArray<T> &AtAp);
+
+    /** Run a function in all threads, or in the calling thread if there is only one */
+    void runThreads(ThreadFunction function, void *data);
+
     /** POCS projection */
     void doPOCSProjection();
 
@@ -153,12 +172,18 @@ public:
 	Image<double>        Ck, Vk; // Reconstructed volume
 	MetaData             mdIn; // Set of images and angles
 	MultidimArray<std::complex<double> > fourierKernelV;
+	MultidimArray<float>  fourierKernelVf; // Single precision kernel, real and imaginary parts interleaved
 	MultidimArray<double> paddedx;
 	FourierTransformer    transformerPaddedx, transformerL;
 
 	MultidimArray<double> ux, uy, uz, dx, dy, dz, ud;
 	MultidimArray< std::complex<double> > fourierLx, fourierLy, fourierLz;
 	SymList SL;
+
+	// Conjugate gradient work vectors, kept between ADMM iterations
+	MultidimArray<double> cgR, cgP, cgAtAp;
+	MultidimArray<float>  cgRf, cgPf, cgAtApf;
+	ThreadManager        *thMgr;
 };
 
 //@}
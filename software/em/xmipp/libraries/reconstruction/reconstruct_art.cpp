@@ -113,6 +113,8 @@ void ProgReconsART::defineParams()
     addExampleLine("reconstruct_art -i projections.sel -o artrec --noisy_reconstruction");
     //    addExampleLine("Reconstruct using SIRT parallelization algorithm for five iterations:",false);
     //    addExampleLine("reconstruct_art -i projections.sel -o artrec -n 5 --parallel_mode SIRT");
+    addExampleLine("Reconstruct with ordered subsets of 32 projections processed by 8 threads, until the error decreases less than 1%:",false);
+    addExampleLine("reconstruct_art -i projections.sel -o artrec -n 20 -l 0.5 --parallel_mode OSSIRT --block_size 32 --thr 8 --stop_tol 0.01");
     addExampleLine("Save the basis information at each iteration:",false);
     addExampleLine("reconstruct_art -i projections.sel -o artrec -n 3 --save_basis");
 }
@@ -135,7 +137,14 @@ void ProgReconsART::readParams()
 
     if (artRecons->artPrm.threads > 1 && isMpi)
         REPORT_ERROR(ERR_ARG_BADCMDLINE, "Threads not compatible in mpi version.");
-    if (!isMpi && artRecons->artPrm.parallel_mode != BasicARTParameters::ART)
+    if (artRecons->artPrm.parallel_mode == BasicARTParameters::OSSIRT)
+    {
+        if (isMpi)
+            REPORT_ERROR(ERR_ARG_BADCMDLINE, "OSSIRT is a threaded mode, it is not available in the mpi version.");
+        if (checkParam("--crystal"))
+            REPORT_ERROR(ERR_ARG_BADCMDLINE, "OSSIRT is not available for crystals.");
+    }
+    else if (!isMpi && artRecons->artPrm.parallel_mode != BasicARTParameters::ART)
         REPORT_ERROR(ERR_ARG_BADCMDLINE, "If --parallel_mode is passed, then mpi version must be used.");
 
 }
@@ -229,5 +238,8 @@ void ProgReconsART::run()
     std::cout << "PROCESS_TIME: " << (double)process_usecs/(double)1000000 << std::endl;
     std::cout << "FINISH_TIME: " << (double)finish_usecs/(double)1000000 << std::endl;
 
+    if (verbose > 0 && artPrm.threads > 1 && getThreadAffinityPolicy() != AFFINITY_NONE)
+        threadPlacementReport(std::cout);
+
 }
 
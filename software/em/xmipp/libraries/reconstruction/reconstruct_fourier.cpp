@@ -39,6 +39,16 @@ void ProgRecFourier::defineParams()
     addParamsLine("  [-o <volume_file=\"rec_fourier.vol\">]  : Filename for output volume");
     addParamsLine("  [--iter <iterations=1>]      : Number of iterations for weight correction");
     addParamsLine("  [--sym <symfile=c1>]              : Enforce symmetry in projections");
+    addParamsLine("  [--symmetrize_volume]          : Insert each projection once and apply the symmetry to the accumulated");
+    addParamsLine("                                 : Fourier volume. This is much faster for high symmetries (e.g. i1) but");
+    addParamsLine("                                 : needs memory for a copy of the Fourier volume and weights. Groups whose");
+    addParamsLine("                                 : rotations do not map the Fourier grid onto itself (e.g. c3, d3, i1)");
+    addParamsLine("                                 : interpolate the accumulated data, which changes the result by a few percent");
+    addParamsLine("  [--mmap]                       : Keep the Fourier volume and weights in memory mapped files");
+    addParamsLine("                                 : of the temporary directory, for volumes larger than the memory");
+    addParamsLine("  [--slabs <n=1> <batch=0>]      : Number of Z slabs of the volume and number of images read together");
+    addParamsLine("                                 : (0 for one image per thread). The images of a batch are inserted");
+    addParamsLine("                                 : slab by slab, which keeps the working set bounded with --mmap");
     addParamsLine("  [--padding <proj=2.0> <vol=2.0>]  : Padding used for projections and volume");
     addParamsLine("  [--prepare_fsc <fscfile>]      : Filename root for FSC files");
     addParamsLine("  [--max_resolution <p=0.5>]     : Max resolution (Nyquist=0.5)");
@@ -54,6 +64,8 @@ void ProgRecFourier::defineParams()
     addParamsLine("                                 : CTF values (in absolute value) below this one will not be corrected");
     addExampleLine("For reconstruct enforcing i3 symmetry and using stored weights:", false);
     addExampleLine("   xmipp_reconstruct_fourier  -i reconstruction.sel --sym i3 --weight");
+    addExampleLine("For a faster reconstruction with icosahedral symmetry:", false);
+    addExampleLine("   xmipp_reconstruct_fourier  -i reconstruction.sel --sym i1 --symmetrize_volume --thr 4");
 }
 
 // Read arguments ==========================================================
@@ -62,6 +74,10 @@ void ProgRecFourier::readParams()
     fn_sel = getParam("-i");
     fn_out = getParam("-o");
     fn_sym = getParam("--sym");
+    symmetrizeVolume = checkParam("--symmetrize_volume");
+    useMmap = checkParam("--mmap");
+    Nslabs = XMIPP_MAX(getIntParam("--slabs", 0), 1);
+    batchSize = XMIPP_MAX(getIntParam("--slabs", 1), 0);
     if(checkParam("--prepare_fsc"))
         fn_fsc = getParam("--prepare_fsc");
     do_weights = checkParam("--weight");
@@ -95,6 +111,14 @@ void ProgRecFourier::show()
         std::cout << " Output volume             : "  << fn_out << std::endl;
         if (fn_sym != "")
             std::cout << " Symmetry file for projections : "  << fn_sym << std::endl;
+        if (symmetrizeVolume)
+            std::cout << " Symmetry applied to the accumulated volume" << std::endl;
+        if (useMmap)
+            std::cout << " Fourier volume and weights in memory mapped files" << std::endl;
+        if (Nslabs > 1)
+            std::cout << " Number of slabs           : "  << Nslabs << std::endl;
+        if (batchSize > 0)
+            std::cout << " Images per batch          : "  << batchSize << std::endl;
         if (fn_fsc != "")
             std::cout << " File root for FSC files: " << fn_fsc << std::endl;
         if (do_weights)
@@ -148,6 +172,8 @@ void ProgRecFourier::run()
 
     //Computing interpolated volume
     processImages(0, SF.size() - 1, !fn_fsc.empty(), false);
+    if (fn_fsc.empty())
+        symmetrizeAccumulatedVolume(false);
 
     // Correcting the weights
     correctWeight();
@@ -162,6 +188,9 @@ void ProgRecFourier::run()
     for ( int nt = 0 ; nt < numThreads ; nt ++ )
         pthread_join(*(th_ids+nt), NULL);
     barrier_destroy( &barrier );
+
+    if (verbose && getThreadAffinityPolicy()!=AFFINITY_NONE)
+        threadPlacementReport(std::cout);
 }
 
 
@@ -187,8 +216,22 @@ void ProgRecFourier::produceSideinfo()
         REPORT_ERROR(ERR_MULTIDIM_SIZE,"This algorithm only works for squared images");
     imgSize=Xdim;
     volPadSizeX = volPadSizeY = volPadSizeZ=(int)(Xdim*padding_factor_vol);
+    if (Nslabs > volPadSizeZ)
+        Nslabs = volPadSizeZ;
+    if (useMmap)
+    {
+        Vout().setMmap(true);
+        transformerVol.fFourier.setMmap(true);
+        FourierWeights.setMmap(true);
+        VoutFourierAsym.setMmap(true);
+        FourierWeightsAsym.setMmap(true);
+    }
     Vout().initZeros(volPadSizeZ,volPadSizeY,volPadSizeX);
 
+    // The Fourier volume and the weights are zeroed by the threads that will
+    // fill them, so that their pages are spread over the NUMA nodes
+    transformerVol.fFourier.initZerosFirstTouch(volPadSizeZ,volPadSizeY,volPadSizeX/2+1,numThreads);
+
     //use threads for volume inverse fourier transform, plan is created in setReal()
     transformerVol.setThreadsNumber(numThreads);
     transformerVol.setReal(Vout());
@@ -196,7 +239,7 @@ void ProgRecFourier::produceSideinfo()
     Vout().clear(); // Free the memory so that it is available for FourierWeights
     transformerVol.getFourierAlias(VoutFourier);
     VoutFourier.initZeros();
-    FourierWeights.initZeros(VoutFourier);
+    FourierWeights.initZerosFirstTouch(VoutFourier,numThreads);
 
     // Ask for memory for the padded images
     size_t paddedImgSize=(size_t)(Xdim*padding_factor_proj);
@@ -270,12 +313,280 @@ void ProgRecFourier::produceSideinfo()
     }
 }
 
+/* Trilinear interpolation of a half Fourier volume at the frequency index
+ * (px,py,pz), which may be negative. As when the images are inserted, the
+ * neighbours with x<0 are read from their Hermitian pair. If V is NULL only
+ * the weight is interpolated. */
+static void interpolateHalfFourier(const MultidimArray< std::complex<double> > *V,
+                                   const MultidimArray<double> &W, double px, double py, double pz,
+                                   std::complex<double> &value, double &weight)
+{
+    int x0=(int)floor(px);
+    int y0=(int)floor(py);
+    int z0=(int)floor(pz);
+    double fx=px-x0, fy=py-y0, fz=pz-z0;
+    int zsize=(int)ZSIZE(W), ysize=(int)YSIZE(W), xsize=(int)XSIZE(W);
+    int zHalf=zsize/2, yHalf=ysize/2;
+
+    value=0;
+    weight=0;
+    for (int dz=0; dz<=1; ++dz)
+    {
+        int z=z0+dz;
+        if (z<-zHalf || z>zHalf)
+            continue;
+        double wz=dz ? fz : 1-fz;
+        for (int dy=0; dy<=1; ++dy)
+        {
+            int y=y0+dy;
+            if (y<-yHalf || y>yHalf)
+                continue;
+            double wzy=wz*(dy ? fy : 1-fy);
+            for (int dx=0; dx<=1; ++dx)
+            {
+                int x=x0+dx, xp=x, yp=y, zp=z;
+                bool conjugate=false;
+                if (x<0)
+                {
+                    xp=-x;
+                    yp=-y;
+                    zp=-z;
+                    conjugate=true;
+                }
+                if (xp>=xsize)
+                    continue;
+                int iz=(zp<0) ? zp+zsize : zp;
+                int iy=(yp<0) ? yp+ysize : yp;
+                double w=wzy*(dx ? fx : 1-fx);
+                weight+=w*DIRECT_A3D_ELEM(W,iz,iy,xp);
+                if (V!=NULL)
+                {
+                    const std::complex<double> &v=DIRECT_A3D_ELEM(*V,iz,iy,xp);
+                    value+=w*(conjugate ? std::conj(v) : v);
+                }
+            }
+        }
+    }
+}
+
+void FourierGriddingKernel::initialize(const Matrix1D<double> &blobTableSqrt, double _iDeltaSqrt,
+                                       double _blobRadius, int _xsize, int _ysize, int _zsize)
+{
+    iDeltaSqrt=_iDeltaSqrt;
+    blobRadius=_blobRadius;
+    xsize=_xsize;
+    ysize=_ysize;
+    zsize=_zsize;
+    blobTable.resizeNoCopy(VEC_XSIZE(blobTableSqrt));
+    FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY1D(blobTable)
+    DIRECT_A1D_ELEM(blobTable,i)=(float)VEC_ELEM(blobTableSqrt,i);
+    maxScaledDistance2=(float)(blobRadius*blobRadius*iDeltaSqrt);
+    if (maxScaledDistance2>XSIZE(blobTable)-1)
+        maxScaledDistance2=XSIZE(blobTable)-1;
+
+    // The samples are within the sphere of radius size/2 plus the blob
+    // radius, a range of 3*size covers them with margin
+    MultidimArray<int> *wrapped[3]={&xWrapped, &yWrapped, &zWrapped};
+    MultidimArray<int> *negWrapped[3]={&xNegWrapped, &yNegWrapped, &zNegWrapped};
+    int sizes[3]={xsize, ysize, zsize};
+    for (int d=0; d<3; ++d)
+    {
+        MultidimArray<int> &mWrapped=*wrapped[d];
+        MultidimArray<int> &mNegWrapped=*negWrapped[d];
+        int size_1=sizes[d]-1;
+        mWrapped.resizeNoCopy(3*sizes[d]);
+        mWrapped.setXmippOrigin();
+        mNegWrapped.resizeNoCopy(mWrapped);
+        mNegWrapped.setXmippOrigin();
+        FOR_ALL_ELEMENTS_IN_ARRAY1D(mWrapped)
+        {
+            int idx, idxNeg;
+            fastIntWRAP(idx, i, 0, size_1);
+            int midx=-idx;
+            fastIntWRAP(idxNeg, midx, 0, size_1);
+            A1D_ELEM(mWrapped,i)=idx;
+            A1D_ELEM(mNegWrapped,i)=idxNeg;
+        }
+    }
+
+    int boxSize=2*(int)ceil(blobRadius)+1;
+    boxX2.resizeNoCopy(boxSize);
+    boxY2.resizeNoCopy(boxSize);
+    boxZ2.resizeNoCopy(boxSize);
+    boxX.resizeNoCopy(boxSize);
+    boxXConj.resizeNoCopy(boxSize);
+    setSlab(0, zsize-1);
+}
+
+void FourierGriddingKernel::setSlab(int z0, int z1)
+{
+    slabZ0=z0;
+    slabZ1=z1;
+}
+
+void FourierGriddingKernel::prepareBox(double px, double py, double pz)
+{
+    x0=CEIL(px-blobRadius);
+    y0=CEIL(py-blobRadius);
+    z0=CEIL(pz-blobRadius);
+    x1=FLOOR(px+blobRadius);
+    y1=FLOOR(py+blobRadius);
+    z1=FLOOR(pz+blobRadius);
+
+    float *ptrZ2=MULTIDIM_ARRAY(boxZ2);
+    for (int intz=z0; intz<=z1; ++intz)
+    {
+        double z=intz-pz;
+        *ptrZ2++=(float)(z*z*iDeltaSqrt);
+    }
+    float *ptrY2=MULTIDIM_ARRAY(boxY2);
+    for (int inty=y0; inty<=y1; ++inty)
+    {
+        double y=inty-py;
+        *ptrY2++=(float)(y*y*iDeltaSqrt);
+    }
+    int xsizeHalf_1=xsize/2;
+    float *ptrX2=MULTIDIM_ARRAY(boxX2);
+    int *ptrX=MULTIDIM_ARRAY(boxX);
+    int *ptrXConj=MULTIDIM_ARRAY(boxXConj);
+    for (int intx=x0; intx<=x1; ++intx)
+    {
+        double x=intx-px;
+        *ptrX2++=(float)(x*x*iDeltaSqrt);
+        int ix=A1D_ELEM(xWrapped,intx);
+        if (ix>xsizeHalf_1)
+        {
+            *ptrX++=A1D_ELEM(xNegWrapped,intx);
+            *ptrXConj++=1;
+        }
+        else
+        {
+            *ptrX++=ix;
+            *ptrXConj++=0;
+        }
+    }
+}
+
+void FourierGriddingKernel::addSample(MultidimArray< std::complex<double> > &V, MultidimArray<double> &W,
+                                      double px, double py, double pz, double re, double im, double weight)
+{
+    prepareBox(px,py,pz);
+    const float *table=MULTIDIM_ARRAY(blobTable);
+    const float *ptrX2=MULTIDIM_ARRAY(boxX2);
+    const int *ptrX=MULTIDIM_ARRAY(boxX);
+    const int *ptrXConj=MULTIDIM_ARRAY(boxXConj);
+    float maxD2=maxScaledDistance2;
+    double *ptrV=(double *)MULTIDIM_ARRAY(V);
+    double *ptrW=MULTIDIM_ARRAY(W);
+    size_t xdim=XSIZE(V), yxdim=YXSIZE(V);
+    int nx=x1-x0+1;
+    // The imaginary part changes its sign for the Hermitian pairs
+    double imConj[2]={im, -im};
+    for (int intz=z0; intz<=z1; ++intz)
+    {
+        float z2=DIRECT_A1D_ELEM(boxZ2,intz-z0);
+        if (z2>maxD2)
+            continue;
+        // The plane of the coefficient and the plane of its Hermitian pair
+        // may be in different slabs
+        int iz=A1D_ELEM(zWrapped,intz), izNeg=A1D_ELEM(zNegWrapped,intz);
+        bool inSlab[2]={iz>=slabZ0 && iz<=slabZ1, izNeg>=slabZ0 && izNeg<=slabZ1};
+        if (!inSlab[0] && !inSlab[1])
+            continue;
+        bool wholePlane=inSlab[0] && inSlab[1];
+        size_t offsetZ=yxdim*iz;
+        size_t offsetZNeg=yxdim*izNeg;
+        for (int inty=y0; inty<=y1; ++inty)
+        {
+            float y2z2=DIRECT_A1D_ELEM(boxY2,inty-y0)+z2;
+            if (y2z2>maxD2)
+                continue;
+            size_t offset[2];
+            offset[0]=offsetZ+xdim*A1D_ELEM(yWrapped,inty);
+            offset[1]=offsetZNeg+xdim*A1D_ELEM(yNegWrapped,inty);
+            // This loop is not vectorized: a row of the box has at most
+            // 2*blobRadius+1 (4 for the default blob) coefficients, the blob
+            // is a gather from the table and the coefficients of a row may
+            // be split between the half volume and the Hermitian pairs
+            for (int n=0; n<nx; ++n)
+            {
+                float d2=ptrX2[n]+y2z2;
+                if (d2>maxD2)
+                    continue;
+                int conj=ptrXConj[n];
+                if (!wholePlane && !inSlab[conj])
+                    continue;
+                double b=table[(int)(d2+0.5f)];
+                size_t memIdx=offset[conj]+ptrX[n];
+                double *ptrOut=ptrV+2*memIdx;
+                ptrOut[0]+=b*re;
+                ptrOut[1]+=b*imConj[conj];
+                ptrW[memIdx]+=b*weight;
+            }
+        }
+    }
+}
+
+void FourierGriddingKernel::addWeight(MultidimArray<double> &W, const MultidimArray< std::complex<double> > *Vweights,
+                                      double px, double py, double pz, double weight)
+{
+    prepareBox(px,py,pz);
+    const float *table=MULTIDIM_ARRAY(blobTable);
+    const float *ptrX2=MULTIDIM_ARRAY(boxX2);
+    const int *ptrX=MULTIDIM_ARRAY(boxX);
+    const int *ptrXConj=MULTIDIM_ARRAY(boxXConj);
+    float maxD2=maxScaledDistance2;
+    const double *ptrV=(Vweights==NULL) ? NULL : (const double *)MULTIDIM_ARRAY(*Vweights);
+    double *ptrW=MULTIDIM_ARRAY(W);
+    size_t xdim=XSIZE(W), yxdim=YXSIZE(W);
+    int nx=x1-x0+1;
+    for (int intz=z0; intz<=z1; ++intz)
+    {
+        float z2=DIRECT_A1D_ELEM(boxZ2,intz-z0);
+        if (z2>maxD2)
+            continue;
+        // The plane of the coefficient and the plane of its Hermitian pair
+        // may be in different slabs
+        int iz=A1D_ELEM(zWrapped,intz), izNeg=A1D_ELEM(zNegWrapped,intz);
+        bool inSlab[2]={iz>=slabZ0 && iz<=slabZ1, izNeg>=slabZ0 && izNeg<=slabZ1};
+        if (!inSlab[0] && !inSlab[1])
+            continue;
+        bool wholePlane=inSlab[0] && inSlab[1];
+        size_t offsetZ=yxdim*iz;
+        size_t offsetZNeg=yxdim*izNeg;
+        for (int inty=y0; inty<=y1; ++inty)
+        {
+            float y2z2=DIRECT_A1D_ELEM(boxY2,inty-y0)+z2;
+            if (y2z2>maxD2)
+                continue;
+            size_t offset[2];
+            offset[0]=offsetZ+xdim*A1D_ELEM(yWrapped,inty);
+            offset[1]=offsetZNeg+xdim*A1D_ELEM(yNegWrapped,inty);
+            for (int n=0; n<nx; ++n)
+            {
+                float d2=ptrX2[n]+y2z2;
+                if (d2>maxD2)
+                    continue;
+                int conj=ptrXConj[n];
+                if (!wholePlane && !inSlab[conj])
+                    continue;
+                double w=table[(int)(d2+0.5f)]*weight;
+                size_t memIdx=offset[conj]+ptrX[n];
+                if (ptrV!=NULL)
+                    w*=ptrV[2*memIdx];
+                ptrW[memIdx]+=w;
+            }
+        }
+    }
+}
+
 void * ProgRecFourier::processImageThread( void * threadArgs )
 {
 
     ImageThreadParams * threadParams = (ImageThreadParams *) threadArgs;
     ProgRecFourier * parent = threadParams->parent;
     barrier_t * barrier = &(parent->barrier);
+    applyThreadAffinity(threadParams->myThreadID);
 
     int minSeparation;
 
@@ -296,25 +607,10 @@ void * ProgRecFourier::processImageThread( void * threadArgs )
     threadParams->selFile->findObjects(objId);
     ApplyGeoParams params;
     params.only_apply_shifts = true;
-    MultidimArray<int> zWrapped(3*parent->volPadSizeZ),yWrapped(3*parent->volPadSizeY),xWrapped(3*parent->volPadSizeX),
-    zNegWrapped, yNegWrapped, xNegWrapped;
-    zWrapped.initConstant(-1);
-    yWrapped.initConstant(-1);
-    xWrapped.initConstant(-1);
-    zWrapped.setXmippOrigin();
-    yWrapped.setXmippOrigin();
-    xWrapped.setXmippOrigin();
-    zNegWrapped=zWrapped;
-    yNegWrapped=yWrapped;
-    xNegWrapped=xWrapped;
-
-    MultidimArray<double> x2precalculated(XSIZE(xWrapped)), y2precalculated(XSIZE(yWrapped)), z2precalculated(XSIZE(zWrapped));
-    x2precalculated.initConstant(-1);
-    y2precalculated.initConstant(-1);
-    z2precalculated.initConstant(-1);
-    x2precalculated.setXmippOrigin();
-    y2precalculated.setXmippOrigin();
-    z2precalculated.setXmippOrigin();
+    MultidimArray<double> localModulator;
+    FourierGriddingKernel kernel;
+    kernel.initialize(parent->blobTableSqrt, parent->iDeltaSqrt, parent->blob.radius,
+                      parent->volPadSizeX, parent->volPadSizeY, parent->volPadSizeZ);
 
     bool hasCTF=(threadParams->selFile->containsLabel(MDL_CTF_MODEL) || threadParams->selFile->containsLabel(MDL_CTF_DEFOCUSU)) &&
                 parent->useCTF;
@@ -326,6 +622,7 @@ void * ProgRecFourier::processImageThread( void * threadArgs )
     do
     {
         barrier_wait( barrier );
+        logThreadPlacement(threadParams->myThreadID);
 
         switch ( parent->threadOpCode )
         {
@@ -391,6 +688,49 @@ void * ProgRecFourier::processImageThread( void * threadArgs )
                         localTransformerImg.getFourierAlias(localPaddedFourier);
                     }
 
+                    // Correct the CTF once per image instead of once per symmetry.
+                    // The modulator keeps the weight of the coefficients whose
+                    // CTF is too small to be inverted
+                    threadParams->localModulator = NULL;
+                    if (hasCTF && !threadParams->reprocessFlag)
+                    {
+                        // The padding factor is not considered here, but later when the indexes
+                        // are converted to digital frequencies
+                        double iTs=1.0/parent->Ts;
+                        int xsizeImg = XSIZE(parent->paddedImg), ysizeImg = YSIZE(parent->paddedImg);
+                        localModulator.initZeros(localPaddedFourier);
+                        FOR_ALL_ELEMENTS_IN_ARRAY2D(localPaddedFourier)
+                        {
+                            double freqX, freqY;
+                            FFT_IDX2DIGFREQ(j,xsizeImg,freqX);
+                            FFT_IDX2DIGFREQ(i,ysizeImg,freqY);
+                            if (freqX*freqX+freqY*freqY>parent->maxResolution2)
+                                continue;
+                            threadParams->ctf.precomputeValues(freqX*iTs,freqY*iTs);
+                            double wCTF=threadParams->ctf.getValuePureNoKAt();
+                            double wModulator=1.0;
+                            if (std::isnan(wCTF))
+                            {
+                                if (i==0 && j==0)
+                                    wModulator=wCTF=1.0;
+                                else
+                                    wModulator=wCTF=0.0;
+                            }
+                            if (fabs(wCTF)<parent->minCTF)
+                            {
+                                wModulator=fabs(wCTF);
+                                wCTF=SGN(wCTF);
+                            }
+                            else
+                                wCTF=1.0/wCTF;
+                            if (parent->phaseFlipped)
+                                wCTF=fabs(wCTF);
+                            A2D_ELEM(localPaddedFourier,i,j)*=wCTF;
+                            A2D_ELEM(localModulator,i,j)=wModulator;
+                        }
+                        threadParams->localModulator = &localModulator;
+                    }
+
                     // Compute the coordinate axes associated to this image
                     Euler_angles2matrix(rot, tilt, psi, localA);
                     localAinv=localA.transpose();
@@ -461,6 +801,63 @@ void * ProgRecFourier::processImageThread( void * threadArgs )
                         }
                 break;
             }
+        case SYMMETRIZE_VOLUME:
+            {
+                // The data accumulated at the frequency R^t*f is moved to f
+                // by the symmetry matrix R, as when the image is inserted
+                // with R*Ainv. When reprocessing, the images only add the
+                // blob weights, which are multiplied here by the current
+                // weight estimates kept in VoutFourier
+                const MultidimArray< std::complex<double> > *VoutFourierAsym=NULL;
+                if (MULTIDIM_SIZE(parent->VoutFourierAsym)>0)
+                    VoutFourierAsym=&(parent->VoutFourierAsym);
+                const MultidimArray<double> &FourierWeightsAsym=parent->FourierWeightsAsym;
+                MultidimArray< std::complex<double> > &VoutFourier=parent->VoutFourier;
+                MultidimArray<double> &mFourierWeights=parent->FourierWeights;
+                const std::vector< Matrix2D<double> > &R_repository=parent->R_repository;
+                int zsize=(int)ZSIZE(mFourierWeights), ysize=(int)YSIZE(mFourierWeights);
+                std::complex<double> value;
+                double weight;
+                for (int k=threadParams->myThreadID; k<zsize; k+=parent->numThreads)
+                {
+                    double fz=(k<=zsize/2) ? k : k-zsize;
+                    for (int i=0; i<ysize; i++)
+                    {
+                        double fy=(i<=ysize/2) ? i : i-ysize;
+                        for (int j=0; j<(int)XSIZE(mFourierWeights); j++)
+                        {
+                            double fx=j;
+                            std::complex<double> sumValue=0;
+                            double sumWeight=0;
+                            for (size_t isym=0; isym<R_repository.size(); isym++)
+                            {
+                                const Matrix2D<double> &R=R_repository[isym];
+                                double px=MAT_ELEM(R,0,0)*fx+MAT_ELEM(R,1,0)*fy+MAT_ELEM(R,2,0)*fz;
+                                double py=MAT_ELEM(R,0,1)*fx+MAT_ELEM(R,1,1)*fy+MAT_ELEM(R,2,1)*fz;
+                                double pz=MAT_ELEM(R,0,2)*fx+MAT_ELEM(R,1,2)*fy+MAT_ELEM(R,2,2)*fz;
+                                interpolateHalfFourier(VoutFourierAsym,FourierWeightsAsym,px,py,pz,value,weight);
+                                sumValue+=value;
+                                sumWeight+=weight;
+                            }
+                            // The plane x=0 keeps half of the data, the other
+                            // half is at its Hermitian pair
+                            if (j==0)
+                            {
+                                sumValue*=0.5;
+                                sumWeight*=0.5;
+                            }
+                            if (threadParams->reprocessFlag)
+                                DIRECT_A3D_ELEM(mFourierWeights,k,i,j)=sumWeight*DIRECT_A3D_ELEM(VoutFourier,k,i,j).real();
+                            else
+                            {
+                                DIRECT_A3D_ELEM(mFourierWeights,k,i,j)=sumWeight;
+                                DIRECT_A3D_ELEM(VoutFourier,k,i,j)=sumValue;
+                            }
+                        }
+                    }
+                }
+                break;
+            }
         case PROCESS_IMAGE:
             {
                 MultidimArray< std::complex<double> > *paddedFourier = threadParams->paddedFourier;
@@ -474,9 +871,6 @@ void * ProgRecFourier::processImageThread( void * threadArgs )
                 bool breakCase;
                 bool assigned;
 
-                // Get the inverse of the sampling rate
-                double iTs=1.0/parent->Ts; // The padding factor is not considered here, but later when the indexes
-                                           // are converted to digital frequencies
                 do
                 {
                     minAssignedRow = -1;
@@ -550,229 +944,67 @@ void * ProgRecFourier::processImageThread( void * threadArgs )
                     }
 
                     Matrix2D<double> * A_SL = threadParams->symmetry;
-
-                    // Loop over all Fourier coefficients in the padded image
-                    Matrix1D<double> freq(3), gcurrent(3), real_position(3), contFreq(3);
-                    Matrix1D<int> corner1(3), corner2(3);
+                    kernel.setSlab(threadParams->slabZ0, threadParams->slabZ1);
 
                     // Some alias and calculations moved from heavy loops
-                    double wCTF=1, wModulator=1.0;
-                    double blobRadiusSquared = parent->blob.radius * parent->blob.radius;
-                    double iDeltaSqrt = parent->iDeltaSqrt;
-                    Matrix1D<double> & blobTableSqrt = parent->blobTableSqrt;
-                    int xsize_1 = XSIZE(parent->VoutFourier) - 1;
-                    int zsize_1 = ZSIZE(parent->VoutFourier) - 1;
                     MultidimArray< std::complex<double> > &VoutFourier=parent->VoutFourier;
                     MultidimArray<double> &fourierWeights = parent->FourierWeights;
-                    //                    MultidimArray<double> &prefourierWeights = parent->preFourierWeights;
-                    // Get i value for the thread
+                    const MultidimArray<double> *modulator = threadParams->modulator;
+                    bool symmetrizeWeights = parent->symmetrizeVolume && parent->R_repository.size()>1;
+                    const MultidimArray< std::complex<double> > *VoutWeights = symmetrizeWeights ? NULL : &VoutFourier;
+                    double weight = threadParams->weight;
+                    int xsizeImg = XSIZE(parent->paddedImg), ysizeImg = YSIZE(parent->paddedImg);
+                    // Columns of A_SL scaled to the size of the volume
+                    double ax = MAT_ELEM(*A_SL,0,0)*parent->volPadSizeX, bx = MAT_ELEM(*A_SL,0,1)*parent->volPadSizeX;
+                    double ay = MAT_ELEM(*A_SL,1,0)*parent->volPadSizeY, by = MAT_ELEM(*A_SL,1,1)*parent->volPadSizeY;
+                    double az = MAT_ELEM(*A_SL,2,0)*parent->volPadSizeZ, bz = MAT_ELEM(*A_SL,2,1)*parent->volPadSizeZ;
+
+                    // Loop over all Fourier coefficients in the padded image
                     for (int i = minAssignedRow; i <= maxAssignedRow ; i ++ )
                     {
                         // Discarded rows can be between minAssignedRow and maxAssignedRow, check
-                        if ( statusArray[i] == -1 )
-                            for (int j=STARTINGX(*paddedFourier); j<=FINISHINGX(*paddedFourier); j++)
+                        if ( statusArray[i] != -1 )
+                            continue;
+                        double freqY;
+                        FFT_IDX2DIGFREQ(i,ysizeImg,freqY);
+                        double freqY2 = freqY*freqY;
+                        double pyx = bx*freqY, pyy = by*freqY, pyz = bz*freqY;
+                        for (int j=STARTINGX(*paddedFourier); j<=FINISHINGX(*paddedFourier); j++)
+                        {
+                            // Compute the frequency of this coefficient in the
+                            // universal coordinate system
+                            double freqX;
+                            FFT_IDX2DIGFREQ(j,xsizeImg,freqX);
+                            if (freqX*freqX+freqY2>parent->maxResolution2)
+                                continue;
+
+                            // Look for the corresponding index in the volume Fourier transform
+                            double px = ax*freqX+pyx, py = ay*freqX+pyy, pz = az*freqX+pyz;
+                            if (px<0)
+                                px+=parent->volPadSizeX;
+                            if (py<0)
+                                py+=parent->volPadSizeY;
+                            if (pz<0)
+                                pz+=parent->volPadSizeZ;
+
+                            // The CTF has been corrected when the image was read,
+                            // the modulator attenuates the weight of the coefficients
+                            // whose CTF is too small
+                            double w = weight;
+                            if (modulator!=NULL)
+                                w *= DIRECT_A2D_ELEM(*modulator,i,j);
+                            if (reprocessFlag)
                             {
-                                // Compute the frequency of this coefficient in the
-                                // universal coordinate system
-                                FFT_IDX2DIGFREQ(j,XSIZE(parent->paddedImg),XX(freq));
-                                FFT_IDX2DIGFREQ(i,YSIZE(parent->paddedImg),YY(freq));
-                                ZZ(freq)=0;
-                                if (XX(freq)*XX(freq)+YY(freq)*YY(freq)>parent->maxResolution2)
-                                    continue;
-                                wModulator=1.0;
-                                if (hasCTF && !reprocessFlag)
-                                {
-                                    XX(contFreq)=XX(freq)*iTs;
-                                    YY(contFreq)=YY(freq)*iTs;
-                                    threadParams->ctf.precomputeValues(XX(contFreq),YY(contFreq));
-                                    //wCTF=threadParams->ctf.getValueAt();
-                                    wCTF=threadParams->ctf.getValuePureNoKAt();
-                                    //wCTF=threadParams->ctf.getValuePureWithoutDampingAt();
-
-                                    if (std::isnan(wCTF))
-                                    {
-                                    	if (i==0 && j==0)
-                                    		wModulator=wCTF=1.0;
-                                    	else
-                                    		wModulator=wCTF=0.0;
-                                    }
-                                    if (fabs(wCTF)<parent->minCTF)
-                                    {
-                                        wModulator=fabs(wCTF);
-                                        wCTF=SGN(wCTF);
-                                    }
-                                    else
-                                        wCTF=1.0/wCTF;
-                                    if (parent->phaseFlipped)
-                                        wCTF=fabs(wCTF);
-                                }
-
-                                SPEED_UP_temps012;
-                                M3x3_BY_V3x1(freq,*A_SL,freq);
-
-                                // Look for the corresponding index in the volume Fourier transform
-                                DIGFREQ2FFT_IDX_DOUBLE(XX(freq),parent->volPadSizeX,XX(real_position));
-                                DIGFREQ2FFT_IDX_DOUBLE(YY(freq),parent->volPadSizeY,YY(real_position));
-                                DIGFREQ2FFT_IDX_DOUBLE(ZZ(freq),parent->volPadSizeZ,ZZ(real_position));
-
-                                // Put a box around that coefficient
-                                XX(corner1)=CEIL (XX(real_position)-parent->blob.radius);
-                                YY(corner1)=CEIL (YY(real_position)-parent->blob.radius);
-                                ZZ(corner1)=CEIL (ZZ(real_position)-parent->blob.radius);
-                                XX(corner2)=FLOOR(XX(real_position)+parent->blob.radius);
-                                YY(corner2)=FLOOR(YY(real_position)+parent->blob.radius);
-                                ZZ(corner2)=FLOOR(ZZ(real_position)+parent->blob.radius);
-
-#ifdef DEBUG
-
-                                std::cout << "Idx Img=(0," << i << "," << j << ") -> Freq Img=("
-                                << freq.transpose() << ") ->\n    Idx Vol=("
-                                << real_position.transpose() << ")\n"
-                                << "   Corner1=" << corner1.transpose() << std::endl
-                                << "   Corner2=" << corner2.transpose() << std::endl;
-#endif
-                                // Loop within the box
-                                double *ptrIn=(double *)&(A2D_ELEM(*paddedFourier, i,j));
-
-                                // Some precalculations
-                                for (int intz = ZZ(corner1); intz <= ZZ(corner2); ++intz)
-                                {
-                                    double z = intz - ZZ(real_position);
-                                    A1D_ELEM(z2precalculated,intz)=z*z;
-                                    if (A1D_ELEM(zWrapped,intz)<0)
-                                    {
-                                        int iz, izneg;
-                                        fastIntWRAP(iz, intz, 0, zsize_1);
-                                        A1D_ELEM(zWrapped,intz)=iz;
-                                        int miz=-iz;
-                                        fastIntWRAP(izneg, miz,0,zsize_1);
-                                        A1D_ELEM(zNegWrapped,intz)=izneg;
-                                    }
-                                }
-                                for (int inty = YY(corner1); inty <= YY(corner2); ++inty)
-                                {
-                                    double y = inty - YY(real_position);
-                                    A1D_ELEM(y2precalculated,inty)=y*y;
-                                    if (A1D_ELEM(yWrapped,inty)<0)
-                                    {
-                                        int iy, iyneg;
-                                        fastIntWRAP(iy, inty, 0, zsize_1);
-                                        A1D_ELEM(yWrapped,inty)=iy;
-                                        int miy=-iy;
-                                        fastIntWRAP(iyneg, miy,0,zsize_1);
-                                        A1D_ELEM(yNegWrapped,inty)=iyneg;
-                                    }
-                                }
-                                for (int intx = XX(corner1); intx <= XX(corner2); ++intx)
-                                {
-                                    double x = intx - XX(real_position);
-                                    A1D_ELEM(x2precalculated,intx)=x*x;
-                                    if (A1D_ELEM(xWrapped,intx)<0)
-                                    {
-                                        int ix, ixneg;
-                                        fastIntWRAP(ix, intx, 0, zsize_1);
-                                        A1D_ELEM(xWrapped,intx)=ix;
-                                        int mix=-ix;
-                                        fastIntWRAP(ixneg, mix,0,zsize_1);
-                                        A1D_ELEM(xNegWrapped,intx)=ixneg;
-                                    }
-                                }
-
-                                // Actually compute
-                                for (int intz = ZZ(corner1); intz <= ZZ(corner2); ++intz)
-                                {
-                                    double z2 = A1D_ELEM(z2precalculated,intz);
-                                    int iz=A1D_ELEM(zWrapped,intz);
-                                    int izneg=A1D_ELEM(zNegWrapped,intz);
-
-                                    for (int inty = YY(corner1); inty <= YY(corner2); ++inty)
-                                    {
-                                        double y2z2 = A1D_ELEM(y2precalculated,inty) + z2;
-                                        if (y2z2 > blobRadiusSquared)
-                                            continue;
-                                        int iy=A1D_ELEM(yWrapped,inty);
-                                        int iyneg=A1D_ELEM(yNegWrapped,inty);
-
-                                        int	size1=YXSIZE(VoutFourier)*(izneg)+((iyneg)*XSIZE(VoutFourier));
-                                        int	size2=YXSIZE(VoutFourier)*(iz)+((iy)*XSIZE(VoutFourier));
-                                        int	fixSize=0;
-
-                                        for (int intx = XX(corner1); intx <= XX(corner2); ++intx)
-                                        {
-                                            // Compute distance to the center of the blob
-                                            // Compute blob value at that distance
-                                            double d2 = A1D_ELEM(x2precalculated,intx) + y2z2;
-
-                                            if (d2 > blobRadiusSquared)
-                                                continue;
-                                            int aux = (int)(d2 * iDeltaSqrt + 0.5);//Same as ROUND but avoid comparison
-                                            double w = VEC_ELEM(blobTableSqrt, aux)*threadParams->weight *wModulator;
-
-                                            // Look for the location of this logical index
-                                            // in the physical layout
-#ifdef DEBUG
-
-                                            std::cout << "   gcurrent=" << gcurrent.transpose()
-                                            << " d=" << d << std::endl;
-                                            std::cout << "   1: intx=" << intx
-                                            << " inty=" << inty
-                                            << " intz=" << intz << std::endl;
-#endif
-
-                                            int ix=A1D_ELEM(xWrapped,intx);
-#ifdef DEBUG
-
-                                            std::cout << "   2: ix=" << ix << " iy=" << iy
-                                            << " iz=" << iz << std::endl;
-#endif
-
-                                            bool conjugate=false;
-                                            int izp, iyp, ixp;
-                                            if (ix > xsize_1)
-                                            {
-                                                izp = izneg;
-                                                iyp = iyneg;
-                                                ixp = A1D_ELEM(xNegWrapped,intx);
-                                                conjugate=true;
-                                                fixSize = size1;
-                                            }
-                                            else
-                                            {
-                                                izp=iz;
-                                                iyp=iy;
-                                                ixp=ix;
-                                                fixSize = size2;
-                                            }
-#ifdef DEBUG
-                                            std::cout << "   3: ix=" << ix << " iy=" << iy
-                                            << " iz=" << iz << " conj="
-                                            << conjugate << std::endl;
-#endif
-
-                                            // Add the weighted coefficient
-                                            if (reprocessFlag)
-                                            {
-                                                // Use VoutFourier as temporary to save the memory
-                                                double *ptrOut=(double *)&(DIRECT_A3D_ELEM(VoutFourier, izp,iyp,ixp));
-                                                DIRECT_A3D_ELEM(fourierWeights, izp,iyp,ixp) += (w * ptrOut[0]);
-                                            }
-                                            else
-                                            {
-                                                double wEffective=w*wCTF;
-                                                size_t memIdx=fixSize + ixp;//YXSIZE(VoutFourier)*(izp)+((iyp)*XSIZE(VoutFourier))+(ixp);
-                                                double *ptrOut=(double *)&(DIRECT_A1D_ELEM(VoutFourier, memIdx));
-                                                ptrOut[0] += wEffective * ptrIn[0];
-                                                DIRECT_A1D_ELEM(fourierWeights, memIdx) += w;
-
-                                                if (conjugate)
-                                                    ptrOut[1]-=wEffective*ptrIn[1];
-                                                else
-                                                    ptrOut[1]+=wEffective*ptrIn[1];
-                                            }
-                                        }
-                                    }
-                                }
+                                // Use VoutFourier as temporary to save the memory.
+                                // If the volume is symmetrized, it is applied later
+                                kernel.addWeight(fourierWeights, VoutWeights, px, py, pz, w);
+                            }
+                            else
+                            {
+                                const double *ptrIn=(const double *)&(DIRECT_A2D_ELEM(*paddedFourier, i,j));
+                                kernel.addSample(VoutFourier, fourierWeights, px, py, pz, w*ptrIn[0], w*ptrIn[1], w);
                             }
+                        }
                     }
 
                     pthread_mutex_lock( &(parent->workLoadMutex) );
@@ -821,62 +1053,104 @@ void ProgRecFourier::processImages( int firstImageIndex, int lastImageIndex, boo
 
     int repaint = (int)ceil((double)SF.size()/60);
 
-    bool processed;
     int imgno = 0;
     int imgIndex = firstImageIndex;
 
     // This index tells when to save work for later FSC usage
     int FSCIndex = (firstImageIndex + lastImageIndex)/2;
 
-    // Index of the image that has just been processed. Used for
-    // FSC purposes
-    int current_index;
+    // Images read together, and the Z planes of each slab of the volume
+    int batchCapacity = (batchSize > 0) ? batchSize : numThreads;
+    if ((int)batch.size() < batchCapacity)
+        batch.resize(batchCapacity);
+    int slabSize = (volPadSizeZ + Nslabs - 1)/Nslabs;
+    // A batch read in a single round (e.g., --slabs 1 0) stays in the
+    // buffers of the threads until the next batch, so it is not copied
+    bool aliasBatch = batchCapacity <= numThreads;
 
-    do
+    while ( imgIndex <= lastImageIndex )
     {
-        threadOpCode = PRELOAD_IMAGE;
-
-        for ( int nt = 0 ; nt < numThreads ; nt ++ )
+        // Read a batch of images, each thread reads a different image
+        // and computes its fft. The batch ends at the image after which
+        // the first half is saved for the FSC
+        int lastBatchIndex = lastImageIndex;
+        if ( saveFSC && imgIndex <= FSCIndex )
+            lastBatchIndex = FSCIndex;
+        int nBatch = 0;
+        while ( nBatch < batchCapacity && imgIndex <= lastBatchIndex )
         {
-            if ( imgIndex <= lastImageIndex )
+            threadOpCode = PRELOAD_IMAGE;
+
+            int nRound = 0;
+            for ( int nt = 0 ; nt < numThreads ; nt ++ )
             {
-                th_args[nt].imageIndex = imgIndex;
-                th_args[nt].reprocessFlag = reprocessFlag;
-                imgIndex++;
+                if ( imgIndex <= lastBatchIndex && nBatch + nRound < batchCapacity )
+                {
+                    th_args[nt].imageIndex = imgIndex;
+                    th_args[nt].reprocessFlag = reprocessFlag;
+                    imgIndex++;
+                    nRound++;
+                }
+                else
+                {
+                    th_args[nt].imageIndex = -1;
+                }
             }
-            else
+
+            // Awaking sleeping threads
+            barrier_wait( &barrier );
+            // Threads are working now, wait for them to finish
+            // reading their projections
+            barrier_wait( &barrier );
+
+            for ( int nt = 0 ; nt < numThreads ; nt ++ )
             {
-                th_args[nt].imageIndex = -1;
+                if ( th_args[nt].read == 1 )
+                {
+                    if (verbose && imgno++%repaint==0)
+                        progress_bar(imgno);
+
+                    FourierBatchImage &img = batch[nBatch++];
+                    img.hasModulator = th_args[nt].localModulator != NULL;
+                    if (aliasBatch)
+                    {
+                        img.fourier.alias(*(th_args[nt].localPaddedFourier));
+                        if (img.hasModulator)
+                            img.modulator.alias(*(th_args[nt].localModulator));
+                    }
+                    else
+                    {
+                        img.fourier = *(th_args[nt].localPaddedFourier);
+                        if (img.hasModulator)
+                            img.modulator = *(th_args[nt].localModulator);
+                    }
+                    img.Ainv = *(th_args[nt].localAInv);
+                    img.weight = th_args[nt].localweight;
+                    img.index = th_args[nt].imageIndex;
+                }
             }
         }
 
-        // Awaking sleeping threads
-        barrier_wait( &barrier );
-        // here each thread is reading a different image and compute fft
-        // Threads are working now, wait for them to finish
-        // processing current projection
-        barrier_wait( &barrier );
-
-        // each threads have read a different image and now
-        // all the thread will work in a different part of a single image.
+        // All the threads work in a different part of a single image.
+        // The batch is inserted slab by slab, and each slab receives the
+        // images in the order in which they were read
         threadOpCode = PROCESS_IMAGE;
 
-        processed = false;
-
-        for ( int nt = 0 ; nt < numThreads ; nt ++ )
+        for ( int slabZ0 = 0 ; slabZ0 < volPadSizeZ && nBatch > 0 ; slabZ0 += slabSize )
         {
-            if ( th_args[nt].read == 2 )
-                processed = true;
-            else if ( th_args[nt].read == 1 )
+            for ( int th = 0 ; th < numThreads ; th ++ )
             {
-                processed = true;
-                if (verbose && imgno++%repaint==0)
-                    progress_bar(imgno);
+                th_args[th].slabZ0 = slabZ0;
+                th_args[th].slabZ1 = XMIPP_MIN(slabZ0 + slabSize, volPadSizeZ) - 1;
+            }
 
-                double weight = th_args[nt].localweight;
-                paddedFourier = th_args[nt].localPaddedFourier;
-                current_index = th_args[nt].imageIndex;
-                Matrix2D<double> *Ainv = th_args[nt].localAInv;
+            for ( int n = 0 ; n < nBatch ; n ++ )
+            {
+                FourierBatchImage &img = batch[n];
+                double weight = img.weight;
+                paddedFourier = &(img.fourier);
+                MultidimArray<double> *modulator = img.hasModulator ? &(img.modulator) : NULL;
+                Matrix2D<double> *Ainv = &(img.Ainv);
 
                 //#define DEBUG22
 #ifdef DEBUG22
@@ -907,8 +1181,10 @@ void ProgRecFourier::processImages( int firstImageIndex, int lastImageIndex, boo
                 size_t conserveRows=(size_t)ceil((double)paddedFourier->ydim * maxResolution * 2.0);
                 conserveRows=(size_t)ceil((double)conserveRows/2.0);
 
-                // Loop over all symmetries
-                for (size_t isym = 0; isym < R_repository.size(); isym++)
+                // Loop over all symmetries, or only the identity if the
+                // symmetry is applied to the accumulated volume
+                size_t Nsym = symmetrizeVolume ? 1 : R_repository.size();
+                for (size_t isym = 0; isym < Nsym; isym++)
                 {
                     rowsProcessed = 0;
 
@@ -921,6 +1197,7 @@ void ProgRecFourier::processImages( int firstImageIndex, int lastImageIndex, boo
                         // Passing parameters to each thread
                         th_args[th].symmetry = &A_SL;
                         th_args[th].paddedFourier = paddedFourier;
+                        th_args[th].modulator = modulator;
                         th_args[th].weight = weight;
                         th_args[th].reprocessFlag = reprocessFlag;
                     }
@@ -967,33 +1244,36 @@ void ProgRecFourier::processImages( int firstImageIndex, int lastImageIndex, boo
                     #undef DEBUG2
 
                 }
-
-                if ( current_index == FSCIndex && saveFSC )
-                {
-                    // Save Current Fourier, Reconstruction and Weights
-                    Image<double> save;
-                    save().alias( FourierWeights );
-                    save.write((std::string)fn_fsc + "_1_Weights.vol");
-
-                    Image< std::complex<double> > save2;
-                    save2().alias( VoutFourier );
-                    save2.write((std::string) fn_fsc + "_1_Fourier.vol");
-
-                    finishComputations(FileName((std::string) fn_fsc + "_1_recons.vol"));
-                    Vout().initZeros(volPadSizeZ, volPadSizeY, volPadSizeX);
-                    transformerVol.setReal(Vout());
-                    Vout().clear();
-                    transformerVol.getFourierAlias(VoutFourier);
-                    FourierWeights.initZeros(VoutFourier);
-                    VoutFourier.initZeros();
-                }
             }
         }
+
+        if ( imgIndex - 1 == FSCIndex && saveFSC )
+        {
+            symmetrizeAccumulatedVolume(reprocessFlag);
+
+            // Save Current Fourier, Reconstruction and Weights
+            Image<double> save;
+            save().alias( FourierWeights );
+            save.write((std::string)fn_fsc + "_1_Weights.vol");
+
+            Image< std::complex<double> > save2;
+            save2().alias( VoutFourier );
+            save2.write((std::string) fn_fsc + "_1_Fourier.vol");
+
+            finishComputations(FileName((std::string) fn_fsc + "_1_recons.vol"));
+            Vout().initZeros(volPadSizeZ, volPadSizeY, volPadSizeX);
+            transformerVol.setReal(Vout());
+            Vout().clear();
+            transformerVol.getFourierAlias(VoutFourier);
+            FourierWeights.initZeros(VoutFourier);
+            VoutFourier.initZeros();
+        }
     }
-    while ( processed );
 
     if( saveFSC )
     {
+        symmetrizeAccumulatedVolume(reprocessFlag);
+
         // Save Current Fourier, Reconstruction and Weights
         Image<double> auxVolume;
         auxVolume().alias( FourierWeights );
@@ -1033,6 +1313,42 @@ void ProgRecFourier::processImages( int firstImageIndex, int lastImageIndex, boo
     }
 }
 
+void ProgRecFourier::symmetrizeAccumulatedVolume(bool reprocessFlag)
+{
+    if (!symmetrizeVolume || R_repository.size()==1)
+        return;
+
+    // The threads read the data accumulated so far from a copy. The images
+    // add the coefficients of the plane x=0 to (k,i,0) or to its Hermitian
+    // pair, so both are put together in the copy
+    FourierWeightsAsym=FourierWeights;
+    if (!reprocessFlag)
+        VoutFourierAsym=VoutFourier;
+    int zsize=(int)ZSIZE(FourierWeights), ysize=(int)YSIZE(FourierWeights);
+    for (int k=0; k<zsize; k++)
+    {
+        int ksym=(zsize-k)%zsize;
+        for (int i=0; i<ysize; i++)
+        {
+            int isym=(ysize-i)%ysize;
+            DIRECT_A3D_ELEM(FourierWeightsAsym,k,i,0)+=DIRECT_A3D_ELEM(FourierWeights,ksym,isym,0);
+            if (!reprocessFlag)
+                DIRECT_A3D_ELEM(VoutFourierAsym,k,i,0)+=std::conj(DIRECT_A3D_ELEM(VoutFourier,ksym,isym,0));
+        }
+    }
+
+    threadOpCode = SYMMETRIZE_VOLUME;
+    for (int nt = 0; nt < numThreads; nt++)
+        th_args[nt].reprocessFlag = reprocessFlag;
+    // Awake threads
+    barrier_wait( &barrier );
+    // Threads are working now, wait for them to finish
+    barrier_wait( &barrier );
+
+    FourierWeightsAsym.clear();
+    VoutFourierAsym.clear();
+}
+
 void ProgRecFourier::correctWeight()
 {
     // If NiterWeight=0 then set the weights to one
@@ -1047,6 +1363,7 @@ void ProgRecFourier::correctWeight()
     {
         // Temporary save the Fourier of the volume
         MultidimArray< std::complex<double> > VoutFourierTmp;
+        VoutFourierTmp.setMmap(useMmap);
         VoutFourierTmp=VoutFourier;
         forceWeightSymmetry(FourierWeights);
         // Prepare the VoutFourier
@@ -1062,6 +1379,8 @@ void ProgRecFourier::correctWeight()
             FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY3D(FourierWeights)
             A3D_ELEM(FourierWeights,k,i,j)=0;
             processImages(0, SF.size() - 1, !fn_fsc.empty(), true);
+            if (fn_fsc.empty())
+                symmetrizeAccumulatedVolume(true);
             forceWeightSymmetry(FourierWeights);
             FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY3D(VoutFourier)
             {
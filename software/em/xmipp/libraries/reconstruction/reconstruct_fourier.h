@@ -58,12 +58,90 @@
 #define PROCESS_IMAGE 1
 #define PROCESS_WEIGHTS 2
 #define PRELOAD_IMAGE 3
+#define SYMMETRIZE_VOLUME 4
 
 /**@defgroup FourierReconstruction Fourier reconstruction
    @ingroup ReconsLibrary */
 //@{
 class ProgRecFourier;
 
+/** Gridding kernel of the Fourier reconstruction.
+ * Adds a Fourier sample to the coefficients of the half Fourier volume
+ * within the blob radius. The blob table is kept in single precision and
+ * indexed by the squared distance scaled to the table sampling, which is
+ * computed once per axis of the box around the sample. The accumulation
+ * buffers are the volume and weights of the reconstruction. Each thread
+ * keeps its own kernel, because the box tables are overwritten by
+ * every sample. The writes can be restricted to a slab of Z planes of the
+ * volume.
+ */
+class FourierGriddingKernel
+{
+public:
+    /// Blob values indexed by the scaled squared distance
+    MultidimArray<float> blobTable;
+
+    /// Largest scaled squared distance within the blob
+    float maxScaledDistance2;
+
+    /// Factor from squared distances to table indexes
+    double iDeltaSqrt;
+
+    /// Blob radius in voxels
+    double blobRadius;
+
+    /// Size of the full volume, the half volume has xsize/2+1 columns
+    int xsize, ysize, zsize;
+
+    /** Physical indexes of the logical indexes of each axis, and of
+     * their opposite. The x index is larger than the last column of the
+     * half volume when the Hermitian pair has to be used.
+     */
+    MultidimArray<int> xWrapped, yWrapped, zWrapped, xNegWrapped, yNegWrapped, zNegWrapped;
+
+    /// First and last physical Z planes that are modified
+    int slabZ0, slabZ1;
+
+protected:
+    // Box around the current sample
+    int x0, x1, y0, y1, z0, z1;
+    // Scaled squared distances along each axis of the box
+    MultidimArray<float> boxX2, boxY2, boxZ2;
+    // Column and Hermitian flag of each x in the box
+    MultidimArray<int> boxX, boxXConj;
+
+public:
+    /** Initialize from the blob table of the reconstruction.
+     * The table is sampled at squared distances multiple of 1/iDeltaSqrt.
+     */
+    void initialize(const Matrix1D<double> &blobTableSqrt, double iDeltaSqrt, double blobRadius,
+                    int xsize, int ysize, int zsize);
+
+    /** Restrict the writes to the physical Z planes from z0 to z1.
+     * The samples are still given in the coordinates of the whole volume.
+     * By default, the whole volume is modified.
+     */
+    void setSlab(int z0, int z1);
+
+    /** Add a sample at the frequency index (px,py,pz) of the full volume.
+     * The value (re,im) and the weight are multiplied by the blob and added
+     * to V and W.
+     */
+    void addSample(MultidimArray< std::complex<double> > &V, MultidimArray<double> &W,
+                   double px, double py, double pz, double re, double im, double weight);
+
+    /** Add the weights of a sample at the frequency index (px,py,pz).
+     * If Vweights is not NULL, the blob weights are multiplied by the real
+     * part of Vweights at each coefficient.
+     */
+    void addWeight(MultidimArray<double> &W, const MultidimArray< std::complex<double> > *Vweights,
+                   double px, double py, double pz, double weight);
+
+protected:
+    // Fill the box tables around (px,py,pz)
+    void prepareBox(double px, double py, double pz);
+};
+
 // static pthread_mutex_t mutexDocFile= PTHREAD_MUTEX_INITIALIZER;
 
 struct ImageThreadParams
@@ -72,6 +150,8 @@ struct ImageThreadParams
     ProgRecFourier * parent;
     MultidimArray< std::complex<double> > *paddedFourier;
     MultidimArray< std::complex<double> > *localPaddedFourier;
+    MultidimArray<double> *modulator;
+    MultidimArray<double> *localModulator;
     CTFDescription ctf;
     Matrix2D<double> * symmetry;
     int read;
@@ -80,9 +160,31 @@ struct ImageThreadParams
     double weight;
     double localweight;
     bool reprocessFlag;
+    int slabZ0;
+    int slabZ1;
     MetaData * selFile;
 };
 
+/** Image of the Fourier reconstruction read and waiting to be inserted.
+ * The images are inserted in batches, each slab of the volume receives
+ * all the images of the batch before moving to the next one.
+ */
+struct FourierBatchImage
+{
+    /// Fourier transform of the padded image, CTF corrected
+    MultidimArray< std::complex<double> > fourier;
+    /// Weight modulation of the coefficients whose CTF is too small
+    MultidimArray<double> modulator;
+    /// Whether modulator has to be used
+    bool hasModulator;
+    /// Coordinate axes of the image
+    Matrix2D<double> Ainv;
+    /// Weight of the image
+    double weight;
+    /// Index of the image in the metadata
+    int index;
+};
+
 /** Fourier reconstruction parameters. */
 class ProgRecFourier : public ProgReconsBase
 {
@@ -125,6 +227,27 @@ public:
     /// Number of iterations for the weight
     int NiterWeight;
 
+    /** Symmetrize the accumulated volume.
+     * If true, each image is inserted only once and the symmetry is applied
+     * to the accumulated Fourier volume and weights. Otherwise, each image is
+     * inserted once per symmetry matrix.
+     */
+    bool symmetrizeVolume;
+
+    /** Keep the Fourier volume and weights in memory mapped files.
+     * The files are created in the temporary directory of the system.
+     */
+    bool useMmap;
+
+    /** Number of Z slabs of the volume.
+     * The images of a batch are inserted slab by slab, so that the pages of
+     * a single slab of the volume and weights are modified at a time.
+     */
+    int Nslabs;
+
+    /// Number of images in a batch, 0 for one image per thread
+    int batchSize;
+
     /// Number of threads to use in parallel to process a single image
     int numThreads;
 
@@ -195,6 +318,13 @@ public: // Internal members
     // Volume of Fourier weights
     MultidimArray<double> FourierWeights;
 
+    // Copies of the accumulated volume and weights before symmetrizing them
+    MultidimArray< std::complex<double> > VoutFourierAsym;
+    MultidimArray<double> FourierWeightsAsym;
+
+    // Images of the batch being inserted
+    std::vector<FourierBatchImage> batch;
+
     // Padded image
     MultidimArray<double> paddedImg;
 
@@ -224,6 +354,15 @@ public:
 
     /// Method for the correction of the fourier coefficients
     void correctWeight();
+
+    /** Apply the symmetry to the accumulated Fourier volume and weights.
+     * Only the weights are symmetrized when reprocessing, and then they are
+     * multiplied by the current weight estimates kept in VoutFourier.
+     * It must be called once, after all the images have been inserted:
+     * processImages only calls it for the halves of the FSC, and the callers
+     * of processImages do it otherwise.
+     */
+    void symmetrizeAccumulatedVolume(bool reprocessFlag);
 	
 	/// Force the weights to be symmetrized
     void forceWeightSymmetry(MultidimArray<double> &FourierWeights);
@@ -31,6 +31,10 @@ ProgReconstructSignificant::ProgReconstructSignificant()
 {
 	rank=0;
 	Nprocessors=1;
+	Nthreads=1;
+	coarseMargin=-1;
+	fastGalleryIter=0;
+	alignDistributor=NULL;
 	randomize_random_generator();
 }
 
@@ -60,6 +64,11 @@ void ProgReconstructSignificant::defineParams()
     addParamsLine("  [--dontApplyFisher]          : Do not select directions using Fisher");
     addParamsLine("  [--dontReconstruct]          : Do not reconstruct");
     addParamsLine("  [--useForValidation <numOrientationsPerParticle=10>] : Use the program for validation. This number defines the number of possible orientations per particle");
+    addParamsLine("  [--thr <N=1>]                : Number of threads");
+    addParamsLine("  [--coarseSearch <margin=0.1>] : Align first at half resolution and refine only the directions whose");
+    addParamsLine("                               : coarse correlation is within this margin of the significance threshold");
+    addParamsLine("  [--fastGallery <iter=0>]     : The galleries of the first iterations are projected with the fast");
+    addParamsLine("                               : linear Fourier slice instead of the cubic B-spline one");
 }
 
 // Read arguments ==========================================================
@@ -86,6 +95,10 @@ void ProgReconstructSignificant::readParams()
     doReconstruct=!checkParam("--dontReconstruct");
     useForValidation=checkParam("--useForValidation");
     numOrientationsPerParticle = getIntParam("--useForValidation");
+    Nthreads = getIntParam("--thr");
+    if (checkParam("--coarseSearch"))
+        coarseMargin = getDoubleParam("--coarseSearch");
+    fastGalleryIter = getIntParam("--fastGallery");
 
     if (!doReconstruct)
     {
@@ -115,6 +128,11 @@ void ProgReconstructSignificant::show()
         std::cout << "Apply Fisher                : "  << applyFisher << std::endl;
         std::cout << "Reconstruct                 : "  << doReconstruct << std::endl;
         std::cout << "useForValidation            : "  << useForValidation << std::endl;
+        std::cout << "Number of threads           : "  << Nthreads << std::endl;
+        if (coarseMargin>=0)
+            std::cout << "Coarse search margin        : "  << coarseMargin << std::endl;
+        if (fastGalleryIter>0)
+            std::cout << "Fast gallery iterations     : "  << fastGalleryIter << std::endl;
 
         if (fnSym != "")
             std::cout << "Symmetry for projections    : "  << fnSym << std::endl;
@@ -134,18 +152,231 @@ void ProgReconstructSignificant::show()
 }
 
 // Image alignment ========================================================
-//#define DEBUG
-void ProgReconstructSignificant::alignImagesToGallery()
+// Threads share the galleries and ask for images to align
+static void threadAlignImagesToGallery(ThreadArgument &thArg)
 {
-    AlignmentAux aux;
-    CorrelationAux aux2;
-    RotationalCorrelationAux aux3;
+	ProgReconstructSignificant *prm=(ProgReconstructSignificant *)thArg.workClass;
+	SignificantAlignmentAux aux;
+	size_t first, last;
+	while (prm->alignDistributor->getTasks(first, last))
+	{
+		for (size_t i=first; i<=last; ++i)
+			prm->alignImageToGallery(prm->alignFnImgs[i],prm->alignImgIdx[i],prm->alignResults[i],aux);
+		prm->alignMutex.lock();
+		prm->alignDone+=last-first+1;
+		size_t done=prm->alignDone;
+		prm->alignMutex.unlock();
+		if (prm->rank==0 && thArg.thread_id==0)
+			progress_bar(XMIPP_MIN(done*prm->Nprocessors,prm->mdIn.size()));
+	}
+}
 
+//#define DEBUG
+void ProgReconstructSignificant::alignImageToGallery(const FileName &fnImg, size_t nImg,
+		SignificantImageAlignment &result, SignificantAlignmentAux &aux)
+{
+	size_t Nvols=YSIZE(cc);
+	size_t Ndirs=XSIZE(cc);
+	size_t Nall=Nvols*Ndirs;
+	double one_alpha=1-currentAlpha;
 	Matrix2D<double> M;
-	std::vector< Matrix2D<double> > allM;
 
+#ifdef DEBUG
+	std::cout << "Processing: " << fnImg << std::endl;
+#endif
+	// Several threads read images at the same time. The reads of HDF5
+	// files, whose library is not thread safe, are serialized by ImageBase
+	aux.I.read(fnImg);
+	MultidimArray<double> &mCurrentImage=aux.I();
+	mCurrentImage.setXmippOrigin();
+	aux.imgcc.resizeNoCopy(Nall);
+	aux.imgimed.resizeNoCopy(Nall);
+	aux.allM.resize(Nall);
+	aux.refined.assign(Nall,true);
+
+	// Coarse search: correlate at half resolution with all directions and
+	// keep only those that may reach the significance threshold
+	if (coarseMargin>=0)
+	{
+		pyramidReduce(BSPLINE3,aux.mCoarseImage,mCurrentImage);
+		aux.mCoarseImage.setXmippOrigin();
+		aux.imgccCoarse.resizeNoCopy(Nall);
+		for (size_t nVolume=0; nVolume<Nvols; ++nVolume)
+		{
+			AlignmentTransforms *transforms=galleryCoarseTransforms[nVolume];
+			for (size_t nDir=0; nDir<Ndirs; ++nDir)
+			{
+				aux.mCoarseImageAligned=aux.mCoarseImage;
+				aux.mGalleryProjection.aliasImageInStack(galleryCoarse[nVolume](),nDir);
+				aux.mGalleryProjection.setXmippOrigin();
+				DIRECT_A1D_ELEM(aux.imgccCoarse,nVolume*Ndirs+nDir)=
+					alignImagesConsideringMirrors(aux.mGalleryProjection,transforms[nDir],
+						aux.mCoarseImageAligned,M,aux.auxCoarse,aux.aux2Coarse,aux.aux3Coarse,DONT_WRAP);
+			}
+		}
+
+		// Coarse correlation of the least significant direction
+		aux.sortedCoarse.assign(MULTIDIM_ARRAY(aux.imgccCoarse),MULTIDIM_ARRAY(aux.imgccCoarse)+Nall);
+		size_t Nsignificant=(size_t)ceil(currentAlpha*Nall);
+		Nsignificant=XMIPP_MAX(XMIPP_MIN(Nsignificant,Nall),1);
+		std::nth_element(aux.sortedCoarse.begin(),aux.sortedCoarse.begin()+(Nall-Nsignificant),
+						 aux.sortedCoarse.end());
+		double ccThreshold=aux.sortedCoarse[Nall-Nsignificant]-coarseMargin;
+		for (size_t idx=0; idx<Nall; ++idx)
+			aux.refined[idx]=DIRECT_A1D_ELEM(aux.imgccCoarse,idx)>=ccThreshold;
+	}
+
+	double bestCorr=-2, bestRot=0, bestTilt=0, bestImed=1e38, worstImed=-1e38, worstRefinedCorr=2;
+	Matrix2D<double> bestM;
+	int bestVolume=-1;
+
+	// Compute all correlations
+	for (size_t nVolume=0; nVolume<Nvols; ++nVolume)
+	{
+		AlignmentTransforms *transforms=galleryTransforms[nVolume];
+		for (size_t nDir=0; nDir<Ndirs; ++nDir)
+		{
+			size_t idx=nVolume*Ndirs+nDir;
+			if (!aux.refined[idx])
+				continue;
+			aux.mCurrentImageAligned=mCurrentImage;
+			aux.mGalleryProjection.aliasImageInStack(gallery[nVolume](),nDir);
+			aux.mGalleryProjection.setXmippOrigin();
+			double corr=alignImagesConsideringMirrors(aux.mGalleryProjection,transforms[nDir],
+					aux.mCurrentImageAligned,M,aux.aux,aux.aux2,aux.aux3,DONT_WRAP);
+			M=M.inv();
+			double imed=imedDistance(aux.mGalleryProjection, aux.mCurrentImageAligned);
+
+			DIRECT_A3D_ELEM(cc,nImg,nVolume,nDir)=corr;
+			// For the paper plot: std::cout << corr << " " << imed << std::endl;
+			DIRECT_A1D_ELEM(aux.imgcc,idx)=corr;
+			DIRECT_A1D_ELEM(aux.imgimed,idx)=imed;
+			aux.allM[idx]=M;
+
+			if (corr>bestCorr)
+			{
+				bestM=M;
+				bestCorr=corr;
+				bestVolume=(int)nVolume;
+				bestRot=mdGallery[nVolume][nDir].rot;
+				bestTilt=mdGallery[nVolume][nDir].tilt;
+			}
+			if (corr<worstRefinedCorr)
+				worstRefinedCorr=corr;
+
+			if (imed<bestImed)
+				bestImed=imed;
+			else if (imed>worstImed)
+				worstImed=imed;
+		}
+	}
+
+	// The directions discarded by the coarse search rank below all refined
+	// ones, so that the percentiles of the refined directions do not change
+	if (coarseMargin>=0)
+	{
+		if (worstImed<bestImed)
+			worstImed=bestImed;
+		for (size_t nVolume=0; nVolume<Nvols; ++nVolume)
+			for (size_t nDir=0; nDir<Ndirs; ++nDir)
+			{
+				size_t idx=nVolume*Ndirs+nDir;
+				if (aux.refined[idx])
+					continue;
+				double corr=XMIPP_MIN(DIRECT_A1D_ELEM(aux.imgccCoarse,idx),worstRefinedCorr);
+				DIRECT_A3D_ELEM(cc,nImg,nVolume,nDir)=corr;
+				DIRECT_A1D_ELEM(aux.imgcc,idx)=corr;
+				DIRECT_A1D_ELEM(aux.imgimed,idx)=worstImed;
+			}
+	}
+
+	// Keep the best assignment for the projection matching
+	SignificantAssignment &best=result.best;
+	best.nVolume=bestVolume;
+	best.nDir=-1;
+	result.assignments.clear();
+	double scale, shiftX, shiftY, anglePsi;
+	bool flip;
+	transformationMatrix2Parameters2D(bestM,flip,scale,shiftX,shiftY,anglePsi);
+	if (!(maxShift<0 || (maxShift>0 && fabs(shiftX)<maxShift && fabs(shiftY)<maxShift)))
+		best.nVolume=-1;
+	best.cc=bestCorr;
+	best.rot=bestRot;
+	best.tilt=bestTilt;
+	best.psi=anglePsi;
+	best.shiftX=-shiftX;
+	best.shiftY=-shiftY;
+	best.flip=flip;
+
+	// Compute lower limit of correlation
+	double rl=bestCorr*one_alpha;
+	double z=0.5*log((1+rl)/(1-rl));
+	double zl=z-2.96*sqrt(1.0/MULTIDIM_SIZE(mCurrentImage));
+	double ccl=tanh(zl);
+
+	// Compute the cumulative distributions
+	aux.imgcc.cumlativeDensityFunction(aux.cdfcc);
+	aux.imgimed.cumlativeDensityFunction(aux.cdfimed);
+
+	// Get the best images
+	for (size_t nVolume=0; nVolume<Nvols; ++nVolume)
+	{
+		for (size_t nDir=0; nDir<Ndirs; ++nDir)
+		{
+			size_t idx=nVolume*Ndirs+nDir;
+			if (!aux.refined[idx])
+				continue;
+			double cdfccthis=DIRECT_A1D_ELEM(aux.cdfcc,idx);
+			double cdfimedthis=DIRECT_A1D_ELEM(aux.cdfimed,idx);
+			double cc=DIRECT_A1D_ELEM(aux.imgcc,idx);
+			bool condition=true;
+			condition=condition && ((applyFisher && cc>ccl) || !applyFisher);
+			condition=condition && cdfccthis>=one_alpha;
+			if (condition)
+			{
+				double imed=DIRECT_A1D_ELEM(aux.imgimed,idx);
+				transformationMatrix2Parameters2D(aux.allM[idx],flip,scale,shiftX,shiftY,anglePsi);
+				if (maxShift>0)
+					if (fabs(shiftX)>maxShift || fabs(shiftY)>maxShift)
+						continue;
+				if (flip)
+					shiftX*=-1;
+
+				double thisWeight=cdfccthis*(cc/bestCorr);
+				// COSS: To promote sparsity in the volume assignment: sum_i(cc_i^p)/sum_i(cc_i)*cc_i^p/cc_i
+				if (useImed)
+					thisWeight*=(1-cdfimedthis)*(bestImed/imed);
+				DIRECT_A3D_ELEM(weight,nImg,nVolume,nDir)=thisWeight;
+
+				SignificantAssignment assignment;
+				assignment.nVolume=(int)nVolume;
+				assignment.nDir=(int)nDir;
+				assignment.cc=cc;
+				assignment.imed=imed;
+				assignment.weight=thisWeight;
+				assignment.rot=mdGallery[nVolume][nDir].rot;
+				assignment.tilt=mdGallery[nVolume][nDir].tilt;
+				assignment.psi=anglePsi;
+				assignment.shiftX=-shiftX;
+				assignment.shiftY=-shiftY;
+				assignment.flip=flip;
+				result.assignments.push_back(assignment);
+#ifdef DEBUG
+				std::cout << "   Getting Gallery: " << mdGallery[nVolume][nDir].fnImg
+						  << " corr=" << cc << " imed=" << imed << " weight=" << thisWeight << " rot=" << assignment.rot
+						  << " tilt=" << assignment.tilt << std::endl
+						  << "Matrix=" << aux.allM[idx] << std::endl
+						  << "shiftX=" << shiftX << " shiftY=" << shiftY << std::endl;
+#endif
+			}
+		}
+	}
+}
+#undef DEBUG
+
+void ProgReconstructSignificant::alignImagesToGallery()
+{
 	size_t Nvols=YSIZE(cc);
-	size_t Ndirs=XSIZE(cc);
 
 	// Clear the previous assignment
 	for (size_t nvol=0; nvol<Nvols; ++nvol)
@@ -154,206 +385,90 @@ void ProgReconstructSignificant::alignImagesToGallery()
 		mdReconstructionProjectionMatching[nvol].clear();
 	}
 
-	MultidimArray<double> imgcc(Nvols*Ndirs), imgimed(Nvols*Ndirs);
-	MultidimArray<double> cdfcc, cdfimed;
-	double one_alpha=1-currentAlpha;
-
-	FileName fnImg;
+	// Images of this process. Metadatas do not support threads, so that the
+	// filenames are taken here and the rows are written after the alignment
+	std::vector<size_t> objIds;
+	alignFnImgs.clear();
+	alignImgIdx.clear();
 	size_t nImg=0;
-	Image<double> I;
-	MultidimArray<double> mCurrentImageAligned, mGalleryProjection;
+	FileName fnImg;
+	FOR_ALL_OBJECTS_IN_METADATA(mdIn)
+	{
+		if ((nImg+1)%Nprocessors==rank)
+		{
+			mdIn.getValue(MDL_IMAGE,fnImg,__iter.objId);
+			alignFnImgs.push_back(fnImg);
+			alignImgIdx.push_back(nImg);
+			objIds.push_back(__iter.objId);
+		}
+		nImg++;
+	}
+	size_t Nlocal=alignFnImgs.size();
+	alignResults.resize(Nlocal);
+
 	if (rank==0)
 	{
-		std::cout << "Current significance: " << one_alpha << std::endl;
+		std::cout << "Current significance: " << 1-currentAlpha << std::endl;
 		std::cerr << "Aligning images ...\n";
 		init_progress_bar(mdIn.size());
 	}
 
-	MultidimArray<double> ccVol(Nvols);
+	if (Nlocal>0)
+	{
+		alignDone=0;
+		size_t blockSize=XMIPP_MAX(1,XMIPP_MIN(Nlocal/(10*Nthreads),10));
+		alignDistributor=new ThreadTaskDistributor(Nlocal,blockSize);
+		ThreadManager thMgr(Nthreads,this);
+		thMgr.run(threadAlignImagesToGallery);
+		delete alignDistributor;
+		alignDistributor=NULL;
+	}
+
+	// Write the assignments in the order of the images
 	MDRow row;
-	FOR_ALL_OBJECTS_IN_METADATA(mdIn)
+	for (size_t i=0; i<Nlocal; ++i)
 	{
-		if ((nImg+1)%Nprocessors==rank)
+		const SignificantImageAlignment &result=alignResults[i];
+		mdIn.getRow(row,objIds[i]);
+		const SignificantAssignment &best=result.best;
+		if (best.nVolume>=0)
 		{
-			mdIn.getValue(MDL_IMAGE,fnImg,__iter.objId);
-			mdIn.getRow(row,__iter.objId);
-#ifdef DEBUG
-			std::cout << "Processing: " << fnImg << std::endl;
-#endif
-			I.read(fnImg);
-			MultidimArray<double> &mCurrentImage=I();
-			mCurrentImage.setXmippOrigin();
-			allM.clear();
-
-			double bestCorr=-2, bestRot, bestTilt, bestImed=1e38, worstImed=-1e38;
-			Matrix2D<double> bestM;
-			int bestVolume=-1;
-
-			// Compute all correlations
-	    	for (size_t nVolume=0; nVolume<Nvols; ++nVolume)
-	    	{
-	    		AlignmentTransforms *transforms=galleryTransforms[nVolume];
-		    	for (size_t nDir=0; nDir<Ndirs; ++nDir)
-				{
-					mCurrentImageAligned=mCurrentImage;
-					mGalleryProjection.aliasImageInStack(gallery[nVolume](),nDir);
-					mGalleryProjection.setXmippOrigin();
-					double corr=alignImagesConsideringMirrors(mGalleryProjection,transforms[nDir],
-							mCurrentImageAligned,M,aux,aux2,aux3,DONT_WRAP);
-//					double corr=alignImagesConsideringMirrors(mGalleryProjection,
-//							mCurrentImageAligned,M,aux,aux2,aux3,DONT_WRAP);
-					M=M.inv();
-					double imed=imedDistance(mGalleryProjection, mCurrentImageAligned);
-
-//					if (corr>0.99)
-//					{
-//					std::cout << prm.mdGallery[nVolume][nDir].fnImg << " corr= " << corr << " imed= " << imed << std::endl;
-//					std::cout << "Matrix=" << M << std::endl;
-//					Image<double> save;
-//					save()=mGalleryProjection;
-//					save.write("PPPgallery.xmp");
-//					save()=mCurrentImage;
-//					save.write("PPPcurrentImage.xmp");
-//					save()=mCurrentImageAligned;
-//					save.write("PPPcurrentImageAligned.xmp");
-//					char c; std::cin >> c;
-//					}
-
-					DIRECT_A3D_ELEM(cc,nImg,nVolume,nDir)=corr;
-					// For the paper plot: std::cout << corr << " " << imed << std::endl;
-					size_t idx=nVolume*Ndirs+nDir;
-					DIRECT_A1D_ELEM(imgcc,idx)=corr;
-					DIRECT_A1D_ELEM(imgimed,idx)=imed;
-					allM.push_back(M);
-
-					if (corr>bestCorr)
-					{
-						bestM=M;
-						bestCorr=corr;
-						bestVolume=(int)nVolume;
-						bestRot=mdGallery[nVolume][nDir].rot;
-						bestTilt=mdGallery[nVolume][nDir].tilt;
-					}
-
-					if (imed<bestImed)
-						bestImed=imed;
-					else if (imed>worstImed)
-						worstImed=imed;
-				}
-	    	}
-
-	    	// Keep the best assignment for the projection matching
-	    	// Each process keeps a list of the images for each volume
-			MetaData &mdProjectionMatching=mdReconstructionProjectionMatching[bestVolume];
-			double scale, shiftX, shiftY, anglePsi;
-			bool flip;
-			transformationMatrix2Parameters2D(bestM,flip,scale,shiftX,shiftY,anglePsi);
-
-			if (maxShift<0 || (maxShift>0 && fabs(shiftX)<maxShift && fabs(shiftY)<maxShift))
-			{
-				size_t recId=mdProjectionMatching.addRow(row);
-				mdProjectionMatching.setValue(MDL_ENABLED,1,recId);
-				mdProjectionMatching.setValue(MDL_MAXCC,bestCorr,recId);
-				mdProjectionMatching.setValue(MDL_ANGLE_ROT,bestRot,recId);
-				mdProjectionMatching.setValue(MDL_ANGLE_TILT,bestTilt,recId);
-				mdProjectionMatching.setValue(MDL_ANGLE_PSI,anglePsi,recId);
-				mdProjectionMatching.setValue(MDL_SHIFT_X,-shiftX,recId);
-				mdProjectionMatching.setValue(MDL_SHIFT_Y,-shiftY,recId);
-				mdProjectionMatching.setValue(MDL_FLIP,flip,recId);
-			}
-
-			// Compute lower limit of correlation
-			double rl=bestCorr*one_alpha;
-			double z=0.5*log((1+rl)/(1-rl));
-			double zl=z-2.96*sqrt(1.0/MULTIDIM_SIZE(mCurrentImage));
-			double ccl=tanh(zl);
-
-			// Compute the cumulative distributions
-			imgcc.cumlativeDensityFunction(cdfcc);
-			imgimed.cumlativeDensityFunction(cdfimed);
-
-			// Check if force 1 volume
-			size_t firstVolume=0;
-			size_t lastVolume=Nvols-1;
-
-	    	// Get the best images
-			for (size_t nVolume=firstVolume; nVolume<=lastVolume; ++nVolume)
-			{
-				MetaData &mdPartial=mdReconstructionPartial[nVolume];
-				for (size_t nDir=0; nDir<Ndirs; ++nDir)
-				{
-					size_t idx=nVolume*Ndirs+nDir;
-					double cdfccthis=DIRECT_A1D_ELEM(cdfcc,idx);
-					double cdfimedthis=DIRECT_A1D_ELEM(cdfimed,idx);
-					double cc=DIRECT_A1D_ELEM(imgcc,idx);
-					// bool condition=!useImed || (useImed && cdfimedthis<=currentAlpha);
-//					if (cc>ccl)
-//						std::cout << "Image " << nImg << " " << fnImg << " qualifies by Fisher to dir=" << nDir << std::endl;
-//					if (!(cdfccthis>=one_alpha) && cc>ccl)
-//						std::cout << "Image " << nImg << " " << fnImg << " does not qualify by correlation percentile to " << nDir << " -> " << cdfccthis << " " << one_alpha << std::endl;
-//					if (!condition && cc>ccl)
-//						std::cout << "Image " << nImg << " " << fnImg << " does not qualify by imed percentile to " << nDir << " -> " << cdfimedthis << " " << currentAlpha<< std::endl;
-					bool condition=true;
-					condition=condition && ((applyFisher && cc>ccl) || !applyFisher);
-					condition=condition && cdfccthis>=one_alpha;
-					if (condition)
-					{
-//						std::cout << fnImg << " is selected for dir=" << nDir << std::endl;
-						double imed=DIRECT_A1D_ELEM(imgimed,idx);
-						transformationMatrix2Parameters2D(allM[nVolume*Ndirs+nDir],flip,scale,shiftX,shiftY,anglePsi);
-						if (maxShift>0)
-							if (fabs(shiftX)>maxShift || fabs(shiftY)>maxShift)
-								continue;
-						if (flip)
-							shiftX*=-1;
-
-						double thisWeight=cdfccthis*(cc/bestCorr);
-						// COSS: To promote sparsity in the volume assignment: sum_i(cc_i^p)/sum_i(cc_i)*cc_i^p/cc_i
-						if (useImed)
-							thisWeight*=(1-cdfimedthis)*(bestImed/imed);
-						DIRECT_A3D_ELEM(weight,nImg,nVolume,nDir)=thisWeight;
-						double angleRot=mdGallery[nVolume][nDir].rot;
-						double angleTilt=mdGallery[nVolume][nDir].tilt;
-			#ifdef DEBUG
-						std::cout << "   Getting Gallery: " << mdGallery[nVolume][nDir].fnImg
-								  << " corr=" << cc << " imed=" << imed << " weight=" << weight << " rot=" << angleRot
-								  << " tilt=" << angleTilt << std::endl
-						          << "Matrix=" << allM[nVolume*Ndirs+nDir] << std::endl
-						          << "shiftX=" << shiftX << " shiftY=" << shiftY << std::endl;
-			#endif
-
-						size_t recId=mdPartial.addRow(row);
-						mdPartial.setValue(MDL_ENABLED,1,recId);
-						mdPartial.setValue(MDL_MAXCC,cc,recId);
-						mdPartial.setValue(MDL_COST,imed,recId);
-						mdPartial.setValue(MDL_ANGLE_ROT,angleRot,recId);
-						mdPartial.setValue(MDL_ANGLE_TILT,angleTilt,recId);
-						mdPartial.setValue(MDL_ANGLE_PSI,anglePsi,recId);
-						mdPartial.setValue(MDL_SHIFT_X,-shiftX,recId);
-						mdPartial.setValue(MDL_SHIFT_Y,-shiftY,recId);
-						mdPartial.setValue(MDL_FLIP,flip,recId);
-						mdPartial.setValue(MDL_IMAGE_IDX,(size_t)nImg,recId);
-						mdPartial.setValue(MDL_REF,(int)nDir,recId);
-						mdPartial.setValue(MDL_REF3D,(int)nVolume,recId);
-						mdPartial.setValue(MDL_WEIGHT,thisWeight,recId);
-						mdPartial.setValue(MDL_WEIGHT_SIGNIFICANT,thisWeight,recId);
-					}
-				}
-			}
-#ifdef DEBUG
-			std::cout << "Press any key" << std::endl;
-			char c; std::cin >> c;
-#endif
+			MetaData &mdProjectionMatching=mdReconstructionProjectionMatching[best.nVolume];
+			size_t recId=mdProjectionMatching.addRow(row);
+			mdProjectionMatching.setValue(MDL_ENABLED,1,recId);
+			mdProjectionMatching.setValue(MDL_MAXCC,best.cc,recId);
+			mdProjectionMatching.setValue(MDL_ANGLE_ROT,best.rot,recId);
+			mdProjectionMatching.setValue(MDL_ANGLE_TILT,best.tilt,recId);
+			mdProjectionMatching.setValue(MDL_ANGLE_PSI,best.psi,recId);
+			mdProjectionMatching.setValue(MDL_SHIFT_X,best.shiftX,recId);
+			mdProjectionMatching.setValue(MDL_SHIFT_Y,best.shiftY,recId);
+			mdProjectionMatching.setValue(MDL_FLIP,best.flip,recId);
+		}
+		for (size_t n=0; n<result.assignments.size(); ++n)
+		{
+			const SignificantAssignment &assignment=result.assignments[n];
+			MetaData &mdPartial=mdReconstructionPartial[assignment.nVolume];
+			size_t recId=mdPartial.addRow(row);
+			mdPartial.setValue(MDL_ENABLED,1,recId);
+			mdPartial.setValue(MDL_MAXCC,assignment.cc,recId);
+			mdPartial.setValue(MDL_COST,assignment.imed,recId);
+			mdPartial.setValue(MDL_ANGLE_ROT,assignment.rot,recId);
+			mdPartial.setValue(MDL_ANGLE_TILT,assignment.tilt,recId);
+			mdPartial.setValue(MDL_ANGLE_PSI,assignment.psi,recId);
+			mdPartial.setValue(MDL_SHIFT_X,assignment.shiftX,recId);
+			mdPartial.setValue(MDL_SHIFT_Y,assignment.shiftY,recId);
+			mdPartial.setValue(MDL_FLIP,assignment.flip,recId);
+			mdPartial.setValue(MDL_IMAGE_IDX,alignImgIdx[i],recId);
+			mdPartial.setValue(MDL_REF,assignment.nDir,recId);
+			mdPartial.setValue(MDL_REF3D,assignment.nVolume,recId);
+			mdPartial.setValue(MDL_WEIGHT,assignment.weight,recId);
+			mdPartial.setValue(MDL_WEIGHT_SIGNIFICANT,assignment.weight,recId);
 		}
-
-		if (rank==0)
-			progress_bar(nImg+1);
-		nImg++;
 	}
+	alignResults.clear();
 	if (rank==0)
 		progress_bar(mdIn.size());
 }
-#undef DEBUG
 
 // Main routine ------------------------------------------------------------
 void ProgReconstructSignificant::run()
@@ -575,7 +690,7 @@ void ProgReconstructSignificant::reconstructCurrent()
 		MD.read(fnAngles);
 		std::cout << "Volume " << nVolume << ": number of images=" << MD.size() << std::endl;
 		FileName fnVolume=formatString("%s/volume_iter%03d_%02d.vol",fnDir.c_str(),iter,nVolume);
-		String args=formatString("-i %s -o %s --sym %s --weight -v 0",fnAngles.c_str(),fnVolume.c_str(),fnSym.c_str());
+		String args=formatString("-i %s -o %s --sym %s --weight --thr %d -v 0",fnAngles.c_str(),fnVolume.c_str(),fnSym.c_str(),Nthreads);
 		String cmd=(String)"xmipp_reconstruct_fourier "+args;
 		std::cout << cmd << std::endl;
 		if (system(cmd.c_str())==-1)
@@ -613,8 +728,10 @@ void ProgReconstructSignificant::generateProjections()
 			fnGallery=formatString("%s/gallery_iter%03d_%02d.stk",fnDir.c_str(),iter,n);
 			fnAngles=formatString("%s/angles_iter%03d_%02d.xmd",fnDir.c_str(),iter-1,n);
 			fnGalleryMetaData=formatString("%s/gallery_iter%03d_%02d.doc",fnDir.c_str(),iter,n);
-			String args=formatString("-i %s -o %s --sampling_rate %f --sym %s --compute_neighbors --angular_distance -1 --experimental_images %s --min_tilt_angle %f --max_tilt_angle %f -v 0",
-					fnVol.c_str(),fnGallery.c_str(),angularSampling,fnSym.c_str(),fnAngles.c_str(),tilt0,tiltF);
+			String args=formatString("-i %s -o %s --sampling_rate %f --sym %s --compute_neighbors --angular_distance -1 --experimental_images %s --min_tilt_angle %f --max_tilt_angle %f --thr %d -v 0",
+					fnVol.c_str(),fnGallery.c_str(),angularSampling,fnSym.c_str(),fnAngles.c_str(),tilt0,tiltF,Nthreads);
+			if (iter<=fastGalleryIter)
+				args+=" --method fourier 1 0.25 linear";
 
 			String cmd=(String)"xmipp_angular_project_library "+args;
 			if (system(cmd.c_str())==-1)
@@ -671,6 +788,31 @@ void ProgReconstructSignificant::generateProjections()
 		    normalizedPolarFourierTransform(mGalleryProjection, transforms[k].polarFourierI, false,
 		                                    XSIZE(mGalleryProjection) / 5, XSIZE(mGalleryProjection) / 2, aux2.plans, 1);
 		}
+
+		// Gallery at half resolution for the coarse search
+		if (coarseMargin>=0)
+		{
+			if (galleryCoarseTransforms[n]==NULL)
+				galleryCoarseTransforms[n]=new AlignmentTransforms[kmax];
+			AlignmentTransforms *coarseTransforms=galleryCoarseTransforms[n];
+			MultidimArray<double> &mCoarse=galleryCoarse[n]();
+			MultidimArray<double> mReduced, mCoarseProjection;
+			CorrelationAux auxCoarse;
+			AlignmentAux aux2Coarse;
+			for (size_t k=0; k<kmax; ++k)
+			{
+				mGalleryProjection.aliasImageInStack(gallery[n](),k);
+				pyramidReduce(BSPLINE3,mReduced,mGalleryProjection);
+				if (k==0)
+					mCoarse.initZeros(kmax,1,YSIZE(mReduced),XSIZE(mReduced));
+				mCoarseProjection.aliasImageInStack(mCoarse,k);
+				memcpy(MULTIDIM_ARRAY(mCoarseProjection),MULTIDIM_ARRAY(mReduced),MULTIDIM_SIZE(mReduced)*sizeof(double));
+				mCoarseProjection.setXmippOrigin();
+				auxCoarse.transformer1.FourierTransform(mCoarseProjection, coarseTransforms[k].FFTI, true);
+				normalizedPolarFourierTransform(mCoarseProjection, coarseTransforms[k].polarFourierI, false,
+				                                XSIZE(mCoarseProjection) / 5, XSIZE(mCoarseProjection) / 2, aux2Coarse.plans, 1);
+			}
+		}
 	}
 }
 
@@ -833,6 +975,8 @@ void ProgReconstructSignificant::produceSideinfo()
 		}
 		gallery.push_back(galleryDummy);
 		galleryTransforms.push_back(NULL);
+		galleryCoarse.push_back(galleryDummy);
+		galleryCoarseTransforms.push_back(NULL);
 		mdReconstructionPartial.push_back(mdPartial);
 		mdReconstructionProjectionMatching.push_back(mdProjMatch);
 	}
@@ -27,6 +27,8 @@
 #define __RECONSTRUCT_SIGNIFICANT_H
 
 #include <data/xmipp_program.h>
+#include <data/xmipp_threads.h>
+#include <data/filters.h>
 #include "angular_project_library.h"
 #include "volume_initial_simulated_annealing.h"
 
@@ -34,6 +36,43 @@
    @ingroup ReconsLibrary */
 //@{
 
+/** Significant assignment of an image to one gallery direction. */
+class SignificantAssignment
+{
+public:
+    int nVolume, nDir;
+    double cc, imed, weight, rot, tilt, psi, shiftX, shiftY;
+    bool flip;
+};
+
+/** Alignment of one image to all galleries.
+ * It is filled by the alignment threads and written to the metadatas by the
+ * main thread in the order of the images.
+ */
+class SignificantImageAlignment
+{
+public:
+    /// Best assignment, it is valid if bestVolume>=0
+    SignificantAssignment best;
+    /// Significant assignments
+    std::vector<SignificantAssignment> assignments;
+};
+
+/** Working memory of an alignment thread. */
+class SignificantAlignmentAux
+{
+public:
+    AlignmentAux aux, auxCoarse;
+    CorrelationAux aux2, aux2Coarse;
+    RotationalCorrelationAux aux3, aux3Coarse;
+    Image<double> I;
+    MultidimArray<double> mCurrentImageAligned, mGalleryProjection, mCoarseImage, mCoarseImageAligned;
+    MultidimArray<double> imgcc, imgimed, cdfcc, cdfimed, imgccCoarse;
+    std::vector<double> sortedCoarse;
+    std::vector<bool> refined;
+    std::vector< Matrix2D<double> > allM;
+};
+
 /** Significant reconstruction parameters. */
 class ProgReconstructSignificant: public XmippProgram
 {
@@ -88,6 +127,22 @@ public:
 
     size_t numOrientationsPerParticle;
 
+    /** Number of threads */
+    int Nthreads;
+
+    /** Margin of the coarse search.
+     * If it is not negative, the images are first aligned at half resolution
+     * to all directions, and only those directions whose coarse correlation is
+     * within this margin of the significance threshold are aligned at full
+     * resolution.
+     */
+    double coarseMargin;
+
+    /** Iterations whose gallery is projected with the linear Fourier slice.
+     * Accuracy is not needed in the first global searches.
+     */
+    int fastGalleryIter;
+
 
 public: // Internal members
     size_t rank, Nprocessors;
@@ -121,6 +176,20 @@ public: // Internal members
     std::vector< Image<double> > gallery;
     std::vector< AlignmentTransforms* > galleryTransforms;
 
+    // Galleries at half resolution for the coarse search
+    std::vector< Image<double> > galleryCoarse;
+    std::vector< AlignmentTransforms* > galleryCoarseTransforms;
+
+    // Images aligned by this process: filename, index in mdIn and result
+    std::vector<FileName> alignFnImgs;
+    std::vector<size_t> alignImgIdx;
+    std::vector<SignificantImageAlignment> alignResults;
+
+    // Distribution of the images among threads
+    ThreadTaskDistributor *alignDistributor;
+    size_t alignDone;
+    Mutex alignMutex;
+
 	// Current iteration
 	int iter;
 
@@ -157,6 +226,13 @@ public:
     /// Align images to gallery projections
     void alignImagesToGallery();
 
+    /** Align one image to all gallery projections.
+     * This is thread safe, it only reads the galleries and writes the
+     * entries of nImg in cc and weight.
+     */
+    void alignImageToGallery(const FileName &fnImg, size_t nImg, SignificantImageAlignment &result,
+                             SignificantAlignmentAux &aux);
+
     /// Gather alignment
     virtual void gatherAlignment() {}
 
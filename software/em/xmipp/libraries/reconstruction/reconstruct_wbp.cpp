@@ -29,11 +29,17 @@
 ProgRecWbp::ProgRecWbp()
 {
     iter = NULL;
+    thMgr = NULL;
+    Nthreads = 1;
+    filterCacheSize = 0;
+    batchSize = 1;
+    useMmap = false;
 }
 
 ProgRecWbp::~ProgRecWbp()
 {
     delete iter;
+    delete thMgr;
 }
 
 // Read arguments ==========================================================
@@ -48,6 +54,10 @@ void ProgRecWbp::readParams()
     sampling = getDoubleParam("--filsam");
     do_all_matrices = checkParam("--use_each_image");
     do_weights = checkParam("--weight");
+    Nthreads = getIntParam("--thr");
+    filterCacheSize = getIntParam("--filter_cache");
+    batchSize = XMIPP_MAX(getIntParam("--batch"), 1);
+    useMmap = checkParam("--mmap");
 }
 
 // Show ====================================================================
@@ -82,6 +92,11 @@ void ProgRecWbp::show()
         if (do_weights)
             std::cerr << " --> Use weights stored in the image headers"
             << std::endl;
+        std::cerr << " Number of threads         : " << Nthreads << std::endl;
+        if (batchSize > 1)
+            std::cerr << " Images per batch          : " << batchSize << std::endl;
+        if (useMmap)
+            std::cerr << " --> Volume in a memory-mapped file" << std::endl;
         std::cerr
         << " -----------------------------------------------------------------"
         << std::endl;
@@ -158,7 +173,31 @@ void ProgRecWbp::defineParams()
         "                               :+option of using representative projection directions");
     addParamsLine(
         " [ --weight]                   : Use weights stored in image headers or the input metadata");
+    addParamsLine(
+        " [ --thr <N=1>]                : Number of threads");
+    addParamsLine(
+        "                               :+The filter of each image and its backprojection are shared by the threads.");
+    addParamsLine(
+        " [ --filter_cache+ <n=16>]     : Number of weighting filters kept in memory");
+    addParamsLine(
+        "                               :+The weighting filter only depends on the projection direction, so that images ");
+    addParamsLine(
+        "                               :+with the same direction (e.g., several tilt series with the same tilt scheme ");
+    addParamsLine(
+        "                               :+or images assigned to a discrete set of directions) reuse it. 0 disables the cache.");
+    addParamsLine(
+        " [ --batch+ <n=1>]             : Number of images backprojected together");
+    addParamsLine(
+        "                               :+Each slab of the volume receives all the images of the batch before moving to ");
+    addParamsLine(
+        "                               :+the next one, so that the volume is swept once per batch. Useful with --mmap.");
+    addParamsLine(
+        " [ --mmap+]                    : Keep the volume in a memory-mapped temporary file");
+    addParamsLine(
+        "                               :+For volumes that do not fit in memory.");
     addExampleLine("xmipp_reconstruct_wbp -i images.sel -o reconstruction.vol");
+    addExampleLine("For a volume larger than the memory:", false);
+    addExampleLine("xmipp_reconstruct_wbp -i images.sel -o reconstruction.vol --mmap --batch 64 --thr 8");
 }
 
 void ProgRecWbp::run()
@@ -361,89 +400,223 @@ void ProgRecWbp::getAllMatrices(MetaData &SF)
     threshold *= totimgs;
 }
 
-// Simple backprojection of a single image
-void ProgRecWbp::simpleBackprojection(Projection &img,
-                                      MultidimArray<double> &vol, int diameter)
+struct WBPBackprojectArgs
 {
+    std::vector<const MultidimArray<double> *> mImg;
+    MultidimArray<double> *vol;
+    std::vector< Matrix2D<double> > A;
+    double radius2;
+    size_t dim;
+    ThreadTaskDistributor *distributor;
+};
+
+// Backproject the Z slices handed out by the distributor. All the images of
+// the batch are added to a chunk of slices before moving to the next one
+static void threadSimpleBackprojection(ThreadArgument &thArg)
+{
+    WBPBackprojectArgs *args = (WBPBackprojectArgs *) thArg.data;
+    MultidimArray<double> &vol = *(args->vol);
+    double radius2 = args->radius2;
+    size_t dim = args->dim;
+
 	//this should be int not size_t ROB
     int i, j, k, l, m;
-    Matrix2D<double> A(3, 3);
     double dim2, x, y, z, xp, yp;
     double value1, value2, scalex, scaley, value;
-    double radius2, x2, y2, z2, z2_plus_y2;
-
-    // Use minus-tilt, because code copied from OldXmipp
-    Euler_angles2matrix(img.rot(), -img.tilt(), img.psi(), A);
-    A = A.inv();
+    double x2, y2, z2, z2_plus_y2;
 
-    radius2 = diameter / 2.;
-    radius2 = radius2 * radius2;
     dim2 = dim / 2;
-    double a00 = MAT_ELEM(A,0,0);
-    double a01 = MAT_ELEM(A,0,1);
-    double a10 = MAT_ELEM(A,1,0);
-    double a11 = MAT_ELEM(A,1,1);
-    double a20 = MAT_ELEM(A,2,0);
-    double a21 = MAT_ELEM(A,2,1);
-
     double dim1 = dim - 1;
-    const MultidimArray<double> mImg = img();
     int idim;
     idim = dim;//cast to int from size_t
-    for (i = 0; i < idim; i++)
+    size_t first, last;
+    while (args->distributor->getTasks(first, last))
     {
-        z = -i + dim2; /*** Z points upwards ***/
-        z2 = z * z;
-        if (z2 > radius2)
-            continue;
-        double xpz = z * a20 + dim2;
-        double ypz = z * a21 + dim2;
-        for (j = 0; j < idim; j++)
+        for (size_t n = 0; n < args->mImg.size(); n++)
         {
-            y = j - dim2;
-            y2 = y * y;
-            z2_plus_y2 = z2 + y2;
-            if (z2_plus_y2 > radius2)
-                continue;
-            x = 0 - dim2; /***** X for k == 0 *****/
-            xp = x * a00 + y * a10 + xpz;
-            yp = x * a01 + y * a11 + ypz;
-            if (yp >= dim1 || yp < 0.0)
-                continue;
-            l = (int) yp;
-            scaley = yp - l;
-            double scale1y = 1. - scaley;
-            for (k = 0; k < idim; k++, xp += a00, yp += a01, x++)
+            const MultidimArray<double> &mImg = *(args->mImg[n]);
+            const Matrix2D<double> &A = args->A[n];
+            double a00 = MAT_ELEM(A,0,0);
+            double a01 = MAT_ELEM(A,0,1);
+            double a10 = MAT_ELEM(A,1,0);
+            double a11 = MAT_ELEM(A,1,1);
+            double a20 = MAT_ELEM(A,2,0);
+            double a21 = MAT_ELEM(A,2,1);
+            for (i = first; i <= (int)last; i++)
             {
-                x2 = x * x;
-                if (x2 + z2_plus_y2 > radius2)
-                    continue;
-                if (xp >= dim1 || xp < 0.0)
+                z = -i + dim2; /*** Z points upwards ***/
+                z2 = z * z;
+                if (z2 > radius2)
                     continue;
-
-                /**** interpolation ****/
-                m = (int) xp;
-                scalex = xp - m;
-                double scale1x = 1. - scalex;
-                value1 = scalex * dAij(mImg, l, m + 1)
-                         + scale1x * dAij(mImg, l, m);
-                value2 = scalex * dAij(mImg, l + 1, m + 1)
-                         + scale1x * dAij(mImg, l + 1, m);
-                value = scaley * value2 + scale1y * value1;
-                dAkij(vol, i, j, k) += value;
+                double xpz = z * a20 + dim2;
+                double ypz = z * a21 + dim2;
+                for (j = 0; j < idim; j++)
+                {
+                    y = j - dim2;
+                    y2 = y * y;
+                    z2_plus_y2 = z2 + y2;
+                    if (z2_plus_y2 > radius2)
+                        continue;
+                    x = 0 - dim2; /***** X for k == 0 *****/
+                    xp = x * a00 + y * a10 + xpz;
+                    yp = x * a01 + y * a11 + ypz;
+                    if (yp >= dim1 || yp < 0.0)
+                        continue;
+                    l = (int) yp;
+                    scaley = yp - l;
+                    double scale1y = 1. - scaley;
+                    for (k = 0; k < idim; k++, xp += a00, yp += a01, x++)
+                    {
+                        x2 = x * x;
+                        if (x2 + z2_plus_y2 > radius2)
+                            continue;
+                        if (xp >= dim1 || xp < 0.0)
+                            continue;
+
+                        /**** interpolation ****/
+                        m = (int) xp;
+                        scalex = xp - m;
+                        double scale1x = 1. - scalex;
+                        value1 = scalex * dAij(mImg, l, m + 1)
+                                 + scale1x * dAij(mImg, l, m);
+                        value2 = scalex * dAij(mImg, l + 1, m + 1)
+                                 + scale1x * dAij(mImg, l + 1, m);
+                        value = scaley * value2 + scale1y * value1;
+                        dAkij(vol, i, j, k) += value;
+                    }
+                }
             }
         }
     }
 }
 
+// Simple backprojection of a single image
+void ProgRecWbp::simpleBackprojection(Projection &img,
+                                      MultidimArray<double> &vol, int diameter)
+{
+    std::vector<Projection *> imgs(1, &img);
+    simpleBackprojection(imgs, vol, diameter);
+}
+
+// Simple backprojection of a batch of images
+void ProgRecWbp::simpleBackprojection(const std::vector<Projection *> &imgs,
+                                      MultidimArray<double> &vol, int diameter)
+{
+    WBPBackprojectArgs args;
+
+    args.mImg.resize(imgs.size());
+    args.A.resize(imgs.size());
+    for (size_t n = 0; n < imgs.size(); n++)
+    {
+        // Use minus-tilt, because code copied from OldXmipp
+        Euler_angles2matrix(imgs[n]->rot(), -imgs[n]->tilt(), imgs[n]->psi(), args.A[n]);
+        args.A[n] = args.A[n].inv();
+        args.mImg[n] = &((*imgs[n])());
+    }
+
+    args.radius2 = diameter / 2.;
+    args.radius2 = args.radius2 * args.radius2;
+    args.vol = &vol;
+    args.dim = dim;
+    ThreadTaskDistributor distributor(dim, 2);
+    args.distributor = &distributor;
+    runThreads(threadSimpleBackprojection, &args);
+}
+
+void ProgRecWbp::runThreads(ThreadFunction function, void *data)
+{
+    if (thMgr != NULL)
+        thMgr->run(function, data);
+    else
+    {
+        ThreadArgument thArg;
+        thArg.thread_id = 0;
+        thArg.threads = 1;
+        thArg.data = data;
+        thArg.workClass = this;
+        function(thArg);
+    }
+}
+
+struct WBPFilterArgs
+{
+    const WBPInfo *mat_g, *mat_f;
+    int no_mats;
+    const Tabsinc *TSINC;
+    double K, factor, threshold;
+    WBPFilter *filter;
+    ThreadTaskDistributor *distributor;
+    Mutex mutex;
+};
+
+/* Divisor of the filter at the Fourier coordinates (x,y) */
+static inline double wbpFilterValue(const WBPFilterArgs *args, double x, double y, int &below)
+{
+    const WBPInfo *mat_g = args->mat_g;
+    const WBPInfo *mat_f = args->mat_f;
+    const Tabsinc &TSINC = *(args->TSINC);
+    double weight = 0.;
+    for (int k = 0; k < args->no_mats; k++)
+    {
+        double argum = x * mat_f[k].x + y * mat_f[k].y;
+        double daux;
+        TSINCVALUE(TSINC, argum, daux);
+        weight += mat_g[k].count * daux;
+    }
+
+    below = fabs(weight) < args->threshold;
+    if (below)
+        return SGN(weight) * (args->threshold * args->factor);
+    return weight * args->factor;
+}
+
+/* Compute the filter rows handed out by the distributor.
+ * The weight is even in (x,y), so the rows with i<0 also give the rows with
+ * i>0 (those that have their mirror row in the array are skipped). In the
+ * skipped rows only the columns whose mirror is outside the array (j=STARTINGX
+ * for even sizes) are computed. */
+static void threadComputeFilter(ThreadArgument &thArg)
+{
+    WBPFilterArgs *args = (WBPFilterArgs *) thArg.data;
+    MultidimArray<double> &divisor = args->filter->divisor;
+    double K = args->K;
+    int count_thr = 0;
+    // The mirror of every column is in the array (e.g., centered arrays)
+    bool useMirror = FINISHINGX(divisor) <= -STARTINGX(divisor);
+
+    size_t first, last;
+    while (args->distributor->getTasks(first, last))
+        for (int i = STARTINGY(divisor) + (int)first; i <= STARTINGY(divisor) + (int)last; i++)
+        {
+            int jF = FINISHINGX(divisor);
+            if (useMirror && i > 0 && -i >= STARTINGY(divisor))
+                jF = XMIPP_MIN(jF, -FINISHINGX(divisor) - 1);
+            double y = K * i;
+            bool mirror = useMirror && i < 0 && -i <= FINISHINGY(divisor);
+            for (int j = STARTINGX(divisor); j <= jF; j++)
+            {
+                int below;
+                double value = wbpFilterValue(args, K * j, y, below);
+                A2D_ELEM(divisor, i, j) = value;
+                count_thr += below;
+                if (mirror && -j <= FINISHINGX(divisor))
+                {
+                    A2D_ELEM(divisor, -i, -j) = value;
+                    count_thr += below;
+                }
+            }
+        }
+
+    args->mutex.lock();
+    args->filter->count_thr += count_thr;
+    args->mutex.unlock();
+}
+
 // Calculate the filter in 2D and apply ======================================
 void ProgRecWbp::filterOneImage(Projection &proj, Tabsinc &TSINC)
 {
     MultidimArray<std::complex<double> > IMG;
     Matrix2D<double> A(3, 3);
-    double factor, argum, weight, x, y;
-
-    factor = diameter;
 
     //Euler_angles2matrix(proj.rot(), -proj.tilt(), proj.psi(), A);
     //A = A.inv();
@@ -451,44 +624,63 @@ void ProgRecWbp::filterOneImage(Projection &proj, Tabsinc &TSINC)
     FourierTransform(proj(), IMG);
     CenterFFT(IMG, true);
 
-    // loop over all transformation matrices
-    double a00 = MAT_ELEM(A,0,0);
-    double a01 = MAT_ELEM(A,0,1);
-    double a10 = MAT_ELEM(A,1,0);
-    double a11 = MAT_ELEM(A,1,1);
-    double a20 = MAT_ELEM(A,2,0);
-    double a21 = MAT_ELEM(A,2,1);
-    for (int k = 0; k < no_mats; k++)
-    {
-        mat_f[k].x = a00 * mat_g[k].x + a10 * mat_g[k].y + a20 * mat_g[k].z;
-        mat_f[k].y = a01 * mat_g[k].x + a11 * mat_g[k].y + a21 * mat_g[k].z;
-    }
-
-    double K = ((double) diameter) / dim;
-    FOR_ALL_ELEMENTS_IN_ARRAY2D(IMG)
+    WBPDirection direction;
+    direction.rot = proj.rot();
+    direction.tilt = proj.tilt();
+    direction.psi = proj.psi();
+    std::map<WBPDirection, WBPFilter>::iterator it = filterCache.find(direction);
+    WBPFilter newFilter;
+    WBPFilter *filter;
+    if (it != filterCache.end())
+        filter = &(it->second);
+    else
     {
-        y = K * i;
-        x = K * j;
-        weight = 0.;
-        for (int k = 0; k < no_mats; k++)
-        {
-            argum = x * mat_f[k].x + y * mat_f[k].y;
-            double daux;
-            TSINCVALUE(TSINC, argum, daux);
-            weight += mat_g[k].count * daux;
-        }
-
-        if (fabs(weight) < threshold)
+        if (filterCacheSize > 0)
         {
-            count_thr++;
-            A2D_ELEM(IMG, i, j) /= SGN(weight) * (threshold * factor);
+            if (filterCache.size() >= filterCacheSize)
+            {
+                filterCache.erase(filterCacheOrder.front());
+                filterCacheOrder.pop_front();
+            }
+            filter = &(filterCache[direction]);
+            filterCacheOrder.push_back(direction);
         }
         else
+            filter = &newFilter;
+
+        // loop over all transformation matrices
+        double a00 = MAT_ELEM(A,0,0);
+        double a01 = MAT_ELEM(A,0,1);
+        double a10 = MAT_ELEM(A,1,0);
+        double a11 = MAT_ELEM(A,1,1);
+        double a20 = MAT_ELEM(A,2,0);
+        double a21 = MAT_ELEM(A,2,1);
+        for (int k = 0; k < no_mats; k++)
         {
-            A2D_ELEM(IMG, i, j) /= (weight * factor);
+            mat_f[k].x = a00 * mat_g[k].x + a10 * mat_g[k].y + a20 * mat_g[k].z;
+            mat_f[k].y = a01 * mat_g[k].x + a11 * mat_g[k].y + a21 * mat_g[k].z;
         }
+
+        filter->divisor.resizeNoCopy(IMG);
+        filter->count_thr = 0;
+        WBPFilterArgs args;
+        args.mat_g = mat_g;
+        args.mat_f = mat_f;
+        args.no_mats = no_mats;
+        args.TSINC = &TSINC;
+        args.K = ((double) diameter) / dim;
+        args.factor = diameter;
+        args.threshold = threshold;
+        args.filter = filter;
+        ThreadTaskDistributor distributor(YSIZE(IMG), 1);
+        args.distributor = &distributor;
+        runThreads(threadComputeFilter, &args);
     }
 
+    FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(IMG)
+    DIRECT_MULTIDIM_ELEM(IMG, n) /= DIRECT_MULTIDIM_ELEM(filter->divisor, n);
+    count_thr += filter->count_thr;
+
     // Calculate back-projection with the filtered projection
     CenterFFT(IMG, false);
     InverseFourierTransform(IMG, proj());
@@ -517,11 +709,11 @@ void ProgRecWbp::apply2DFilterArbitraryGeometry()
 {
     double rot, tilt, psi, xoff, yoff, weight;
     bool flip;
-    Projection proj;
     Matrix2D<double> L(4, 4), R(4, 4), A;
     FileName fn_img;
 
     MultidimArray<double> &mReconstructedVolume = reconstructedVolume();
+    mReconstructedVolume.setMmap(useMmap);
     mReconstructedVolume.initZeros(dim, dim, dim);
     mReconstructedVolume.setXmippOrigin();
     count_thr = 0;
@@ -535,10 +727,16 @@ void ProgRecWbp::apply2DFilterArbitraryGeometry()
 
     mat_f = (WBPInfo*) malloc(no_mats * sizeof(WBPInfo));
     Tabsinc TSINC(0.0001, dim);
+    if (Nthreads > 1 && thMgr == NULL)
+        thMgr = new ThreadManager(Nthreads, this);
 
+    // The filtered images are kept until the batch is backprojected
+    std::vector<Projection> batch(batchSize);
+    std::vector<Projection *> batchPtrs;
     size_t objId, objIndex;
     while (getImageToProcess(objId, objIndex))
     {
+        Projection &proj = batch[batchPtrs.size()];
         SF.getValue(MDL_IMAGE, fn_img, objId);
         proj.read(fn_img, false);
         getAnglesForImage(objId, rot, tilt, psi, xoff, yoff, flip, weight);
@@ -555,10 +753,17 @@ void ProgRecWbp::apply2DFilterArbitraryGeometry()
             proj() *= proj.weight();
         proj().setXmippOrigin();
         filterOneImage(proj, TSINC);
-        simpleBackprojection(proj, mReconstructedVolume, diameter);
+        batchPtrs.push_back(&proj);
+        if ((int)batchPtrs.size() == batchSize)
+        {
+            simpleBackprojection(batchPtrs, mReconstructedVolume, diameter);
+            batchPtrs.clear();
+        }
 
         showProgress();
     }
+    if (!batchPtrs.empty())
+        simpleBackprojection(batchPtrs, mReconstructedVolume, diameter);
     if (verbose > 0)
         progress_bar(time_bar_size);
 
@@ -566,9 +771,10 @@ void ProgRecWbp::apply2DFilterArbitraryGeometry()
     if (fn_sym != "")
     {
         MultidimArray<double> Vaux;
+        Vaux.setMmap(useMmap);
         Vaux.resize(mReconstructedVolume);
         symmetrizeVolume(SL, mReconstructedVolume, Vaux);
-        mReconstructedVolume = Vaux;
+        mReconstructedVolume.swap(Vaux);
         Mask mask_prm;
         mask_prm.mode = INNER_MASK;
         mask_prm.R1 = diameter / 2.;
@@ -30,6 +30,9 @@
 #include <data/xmipp_image.h>
 #include <data/projection.h>
 #include <data/filters.h>
+#include <data/xmipp_threads.h>
+#include <map>
+#include <deque>
 
 #include <reconstruction/recons.h>
 
@@ -48,6 +51,30 @@ typedef struct
 }
 WBPInfo;
 
+/** Projection direction of a weighting filter */
+struct WBPDirection
+{
+    double rot, tilt, psi;
+    bool operator<(const WBPDirection &d) const
+    {
+        if (rot != d.rot)
+            return rot < d.rot;
+        if (tilt != d.tilt)
+            return tilt < d.tilt;
+        return psi < d.psi;
+    }
+};
+
+/** Weighting filter of a projection direction.
+ * For each pixel of the centered Fourier transform of the projection it holds
+ * the value the coefficient is divided by, together with the number of pixels
+ * for which the threshold was not reached. */
+struct WBPFilter
+{
+    MultidimArray<double> divisor;
+    int count_thr;
+};
+
 /** WBP parameters. */
 class ProgRecWbp: public ProgReconsBase
 {
@@ -85,6 +112,22 @@ public:
     MDIterator * iter;
     /// Reconstructed volume
     Image<double> reconstructedVolume;
+    /// Number of threads
+    int Nthreads;
+    /** Number of weighting filters kept in memory.
+     * Images with the same projection direction reuse the filter. */
+    size_t filterCacheSize;
+    /// Weighting filters of the last projection directions
+    std::map<WBPDirection, WBPFilter> filterCache;
+    /// Order in which the filters entered the cache
+    std::deque<WBPDirection> filterCacheOrder;
+    /// Workers (NULL with one thread)
+    ThreadManager *thMgr;
+    /** Number of images backprojected together.
+     * The volume is swept once per batch instead of once per image. */
+    int batchSize;
+    /// Keep the volume in a memory-mapped temporary file
+    bool useMmap;
 public:
 
     ProgRecWbp();
@@ -128,13 +171,23 @@ public:
     /// evenly sampled projection directions
     void getSampledMatrices(MetaData &SF) ;
 
-    // Simple (i.e. unfiltered) backprojection of a single image
+    // Simple (i.e. unfiltered) backprojection of a single image.
+    // The volume is split in Z slabs among the threads.
     void simpleBackprojection(Projection &img, MultidimArray<double> &vol,
                                int diameter) ;
 
-    // Calculate the filter and apply it to a projection
+    // Simple backprojection of a batch of images. Each Z slab of the volume
+    // receives all the images before moving to the next one.
+    void simpleBackprojection(const std::vector<Projection *> &imgs,
+                              MultidimArray<double> &vol, int diameter) ;
+
+    // Calculate the filter and apply it to a projection.
+    // The filter rows are computed by the threads, and the filter is cached.
     void filterOneImage(Projection &proj, Tabsinc &TSINC);
 
+    // Run a function in all threads, or in the calling one if there is only one
+    void runThreads(ThreadFunction function, void *data);
+
     // Calculate the filter for arbitrary tilt geometry in 2D and apply
     void apply2DFilterArbitraryGeometry() ;
 };
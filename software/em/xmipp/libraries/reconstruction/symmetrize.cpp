@@ -156,8 +156,7 @@ void symmetrizeVolume(const SymList &SL, const MultidimArray<double> &V_in,
         symmetry_Helical(V_out,V_in,zHelical,rotHelical,rotPhaseHelical,NULL,true,heightFraction);
         MultidimArray<double> Vrotated;
         rotate(BSPLINE3,Vrotated,V_out,180.0,'X',WRAP);
-        V_out+=Vrotated;
-        V_out*=0.5;
+        V_out=(lazy(V_out)+Vrotated)*0.5;
     }
     else if (dihedral)
     {
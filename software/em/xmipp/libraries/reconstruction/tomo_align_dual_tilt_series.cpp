@@ -410,9 +410,10 @@ void ProgAlignDualTiltSeries::alignDual()
         SFDual.getValue(MDL_IMAGE,fnImg,__iter.objId);
         Idual.read(fnImg);
         Idual().setXmippOrigin();
+        TransformationBuilder T;
         if (rotatedDual)
-            selfRotate(BSPLINE3,Idual(),180,DONT_WRAP);
-        selfTranslate(BSPLINE3,Idual(),shift2D,DONT_WRAP);
+            T.rotate(180);
+        T.shift(shift2D).selfApply(BSPLINE3,Idual(),DONT_WRAP);
         shiftProjectionInZ(Idual(), n, ZZ(shift3D));
         Euler_angles2matrix(0, tiltDual(n), 0, Edual);
         Edual=Edual*E;